@@ -0,0 +1,51 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// Enable POSIX features
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+
+#include <stddef.h>
+
+// ============================================================================
+// CPU Pinning / NUMA Placement (src/common/affinity.c)
+// CPU lists use the kernel's cpulist syntax ("0-3,8,10-11"). NUMA topology
+// comes from sysfs and memory policy from mbind(2) directly (no libnuma);
+// on single-node hosts the NUMA calls are no-ops.
+// ============================================================================
+#define AFFINITY_MAX_CPUS 1024
+#define AFFINITY_MAX_NODES 64
+
+/**
+ * @brief Parse a cpulist, or "auto" = the CPUs this process may run on,
+ *        grouped node by node (so consecutive workers share a node).
+ * @return Number of CPUs written to `cpus` (at most `max`), -1 on a bad list.
+ */
+int affinity_parse(const char *list, int *cpus, int max);
+
+/**
+ * @brief Restrict the calling process to `cpus` (n = 1: pin to one CPU).
+ * @return 0 on success, -1 on failure (errno set).
+ */
+int affinity_pin(const int *cpus, int n);
+
+/**
+ * @brief NUMA node of `cpu` (0 when the host has no NUMA information).
+ */
+int affinity_cpu_node(int cpu);
+int affinity_node_count(void);
+
+/**
+ * @brief Spread the pages of [addr, addr + len) round-robin over the nodes of
+ *        `cpus` and move the pages already faulted in (memory shared by workers
+ *        on several nodes). Call before forking.
+ * @return Number of nodes used (1 = nothing to do), -1 if mbind failed.
+ */
+int affinity_interleave(void *addr, size_t len, const int *cpus, int n);
+
+/**
+ * @brief Format `cpus` back as a cpulist ("0-3,8") for log lines.
+ */
+void affinity_format(const int *cpus, int n, char *out, size_t out_len);
+
+#endif // AFFINITY_H
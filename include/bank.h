@@ -8,6 +8,7 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #define MAX_ACCOUNTS 100
 #define SHM_NAME "/hsts_bank_core"
@@ -15,6 +16,7 @@
 // [新增] 定義最大並發數 (Semaphore 上限)
 // 方便之後在 shm_manager.c 的 sem_init 使用
 #define MAX_CONCURRENCY 10 
+#define MAX_READ_CONCURRENCY 32   // read lane (OP_BALANCE), separate from the write lane above
 
 // Error Codes (給 Server/Client 用)
 #define BANK_OK              0
@@ -24,26 +26,142 @@
 #define BANK_ERR_INVALID_AMOUNT -4
 #define BANK_ERR_INSUFFICIENT -5
 #define BANK_ERR_BUSY       -6
+#define BANK_ERR_DUPLICATE_ID -7
+#define BANK_ERR_INDEX_FULL -8
+#define BANK_ERR_NONZERO_BALANCE -9
+#define BANK_ERR_NO_SPACE   -10
+#define BANK_ERR_OVERLOADED -11   // 排隊超過期限被提早拒絕：client 退避後重試
+#define BANK_ERR_RATE_LIMITED -12 // 來源帳戶 / client 超過速率上限 (token bucket 空了)
+
+// Online Account Growth (chained extents)
+// 帳戶 id >= MAX_ACCOUNTS 的帳戶放在額外的 SHM extent 裡，Worker 第一次碰到時才 mmap
+#define EXTENT_ACCOUNTS 1024
+#define MAX_EXTENTS 64
+#define SHM_EXTENT_FMT "/hsts_bank_ext_%u"
+#define BANK_CAPACITY (MAX_ACCOUNTS + MAX_EXTENTS * EXTENT_ACCOUNTS)
+
+// Idempotency Dedup Table (retried transfers)
+// 以時間分桶：entry 的 epoch = time / IDEM_BUCKET_SECONDS，超過視窗就可被覆蓋
+// 視窗內活著的 key 最多 = rate x (視窗 + 1 桶)；表的大小至少 3 倍，load <= 1/3 時 probe 鏈很短
+#define IDEM_BUCKET_SECONDS 10
+#define IDEM_WINDOW_BUCKETS 30          // 30 x 10s = 5 minutes
+#define IDEM_TARGET_RATE 1000           // keyed transfers/s sustained over the whole window
+#define IDEM_TABLE_SIZE (1u << 20)      // power of two, >= 3 x 1000/s x 310 s (32 MiB)
+#define IDEM_PROBE_LIMIT 64             // a new key stops at the first never-used slot
+#define IDEM_NEW        0               // first time: run the transfer, then idem_complete()
+#define IDEM_DUPLICATE  1               // retry: *result holds the original result
+
+// Netting Settlement (batch clearing)
+#define SETTLE_MAX_BATCH 256
+
+typedef struct {
+    int src_id;
+    int dst_id;
+    int amount;
+} SettleItem;
+
+// Account state (changed only while holding the account lock)
+#define ACCOUNT_CLOSED 0
+#define ACCOUNT_OPEN   1
+
+// External ID Index (sparse 64-bit account numbers -> account id)
+// 容量必須是 2 的次方；保持 load factor < 0.5 讓 linear probing 鏈很短
+#define ACCOUNT_INDEX_CAPACITY (1u << 16)
+#define INDEX_SLOT_PENDING  -1   // key 已佔位，slot 尚未發布
+#define INDEX_SLOT_DELETED  -2   // 帳戶已關閉 (key 保留，probe 鏈不斷)
 
 // Account Structure (Cache Line Aligned)
 // padding 用來避免 False Sharing，這在高併發寫入時非常重要
+// 餘額不放在這裡，而是放在 BankMap.balances[] (SoA)，讓全行掃描只讀連續的 4 bytes
 typedef struct {
     uint32_t id;
-    int32_t  balance;
+    volatile uint32_t state;  // ACCOUNT_OPEN / ACCOUNT_CLOSED
     pthread_mutex_t lock;
     uint64_t last_updated;
-    char padding[8]; 
+    uint64_t ext_id;          // bound external id (0 = none); keeps sizeof(Account) == 64
 } Account;
 
+// Extent: one extra SHM object holding EXTENT_ACCOUNTS accounts
+typedef struct {
+    uint32_t is_initialized;
+    uint32_t extent_no;
+    Account accounts[EXTENT_ACCOUNTS];
+    int32_t balances[EXTENT_ACCOUNTS] __attribute__((aligned(64)));
+} BankExtent;
+
+// 16 bytes per entry -> 4 entries per cache line
+typedef struct {
+    volatile uint64_t key;    // external id, 0 = empty
+    volatile int32_t  slot;   // account id, or INDEX_SLOT_PENDING
+    uint32_t reserved;
+} AccountIndexEntry;
+
+typedef struct {
+    volatile uint32_t count;
+    AccountIndexEntry entries[ACCOUNT_INDEX_CAPACITY] __attribute__((aligned(64)));
+} AccountIndex;
+
+// tag = epoch(30) | state(2) | fingerprint(32); 0 = never used, state 0 = released. 32 bytes per entry.
+typedef struct {
+    volatile uint64_t tag;
+    uint64_t key_hi;
+    uint64_t key_lo;
+    volatile int32_t result;
+    uint32_t reserved;
+} IdemEntry;
+
+typedef struct {
+    volatile uint64_t replays;   // duplicates answered from the table
+    volatile uint64_t inserts;
+    IdemEntry entries[IDEM_TABLE_SIZE] __attribute__((aligned(64)));
+} IdemTable;
+
 // Bank Map Structure
 typedef struct {
     uint32_t is_initialized;
     volatile uint64_t total_transactions;
-    sem_t limit_sem;
+    sem_t limit_sem;                  // write lane (transfer / settle)
+    sem_t read_sem;                   // read lane (balance queries)
     pthread_rwlock_t bank_lock;
     Account accounts[MAX_ACCOUNTS];
+    // Contiguous balance array (index = account id), protected by accounts[i].lock
+    int32_t balances[MAX_ACCOUNTS] __attribute__((aligned(64)));
+    AccountIndex index;
+    IdemTable idem;
+
+    // Slot allocator: free list of closed account ids (protected by alloc_lock)
+    pthread_mutex_t alloc_lock;
+    volatile uint32_t extent_count;   // extents created so far (published with release)
+    volatile uint32_t open_accounts;
+    int32_t free_head;                // -1 = empty
+    int32_t free_next[BANK_CAPACITY];
 } BankMap;
 
+// Aggregate Scan (bank-wide statistics over the balance array)
+#define BANK_HIST_BUCKETS 16
+
+typedef struct {
+    int32_t threshold;   // count balances strictly below this value
+    int32_t hist_base;   // lower edge of bucket 1 is hist_base + hist_width
+    int32_t hist_width;  // <= 0 disables the histogram
+} BankScanParams;
+
+typedef struct {
+    uint64_t count;
+    int64_t  total;
+    int32_t  min;
+    int32_t  max;
+    uint64_t below;
+    // bucket i = [base + i*width, base + (i+1)*width); first/last buckets are open-ended
+    uint64_t histogram[BANK_HIST_BUCKETS];
+} BankAggregate;
+
+// Kernel selection (AUTO = best one the CPU supports)
+#define BANK_SCAN_AUTO   0
+#define BANK_SCAN_SCALAR 1
+#define BANK_SCAN_SSE41  2
+#define BANK_SCAN_AVX2   3
+
 // Public API
 int bank_init();
 
@@ -54,7 +172,56 @@ int bank_detach();
 int bank_destroy();
 
 BankMap* get_bank_map();
+
+// Resolve account id -> Account + balance cell (maps extents lazily)
+int bank_locate(int account_id, Account **acc, int32_t **balance);
+uint32_t bank_capacity();                 // ids currently addressable
+int bank_create_extent();                 // caller holds alloc_lock
+
+// Online account lifecycle
+int bank_open_account(uint64_t ext_id, int initial_balance);  // returns account id
+int bank_close_account(int account_id);                       // balance must be 0
 int bank_transfer(int src_id, int dst_id, int amount);
+uint64_t bank_last_commit_ns(void);         // CLOCK_MONOTONIC ns taken under the locks of this thread's last transfer/settle (0 = none)
+void bank_set_deadline(uint64_t realtime_ns);  // this thread's request deadline (CLOCK_REALTIME ns, 0 = none)
+int bank_set_lane_limits(int write_limit, int read_limit);   // Master, before forking workers
+void bank_set_interleave(const int *cpus, int n);            // Master, before forking: NUMA-interleave new extents over these CPUs' nodes
+
+// Lock contention profiler: per-lock wait / hold time into the metrics page (top-N
+// hot accounts, see metrics_lock_top). Call before forking workers; -1 without metrics
+int bank_lock_profile_enable(void);
 int bank_get_balance(int account_id, int *balance);
 
+// External ID -> account id (lock-free lookup, concurrent insert)
+int bank_resolve_ext_id(uint64_t ext_id);                 // account id or BANK_ERR_INVALID_ID
+int bank_bind_ext_id(uint64_t ext_id, int account_id);
+
+// Index primitives (src/common/account_index.c), usable on any AccountIndex
+void account_index_init(AccountIndex *idx);
+int account_index_lookup(const AccountIndex *idx, uint64_t key);
+int account_index_insert(AccountIndex *idx, uint64_t key, int slot);
+int account_index_remove(AccountIndex *idx, uint64_t key);
+
+// Netting settlement: apply a batch with one ordered lock pass over the distinct
+// accounts; results[i] is exactly what bank_transfer() would have returned for
+// items[i] applied in order. Returns number of successful transfers.
+int bank_settle(const SettleItem *items, int n, int *results);
+
+// Idempotent transfer: 128-bit key; *replayed = 1 when answered from the dedup table
+int bank_transfer_idem(const uint8_t key[16], int src_id, int dst_id, int amount, int *replayed);
+
+// Dedup table primitives (src/common/idem_table.c), usable on any IdemTable
+void idem_init(IdemTable *t);
+int idem_begin(IdemTable *t, const uint8_t key[16], uint32_t now_sec, IdemEntry **entry, int *result);
+void idem_complete(IdemEntry *entry, int result);
+
+// 全行統計：不加鎖的 fuzzy snapshot (併發轉帳進行中時 total 可能短暫不守恆)
+int bank_aggregate(const BankScanParams *params, BankAggregate *out);
+
+// Scan kernels (src/common/bank_scan.c), usable on any int32 array
+void bank_scan_balances(const int32_t *balances, size_t n,
+                        const BankScanParams *params, BankAggregate *out);
+int bank_scan_force_isa(int isa);   // 0 on success, -1 if the CPU lacks it
+const char* bank_scan_isa_name(void);
+
 #endif
\ No newline at end of file
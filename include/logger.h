@@ -5,10 +5,15 @@
 #define _POSIX_C_SOURCE 200809L
 #define _XOPEN_SOURCE 700
 
+#include <stdint.h>
+#include <stddef.h>
+
 // ============================================================================
 // Auditor API (Implemented by Member 3 in src/common/mq_wrapper.c)
 // ============================================================================
 
+#define LOG_WORKER_NONE 0xFFFF   // sender not bound to a worker ring
+
 // Log Message Structure
 typedef struct {
     long mtype;       // Message Type (e.g., 1)
@@ -17,9 +22,102 @@ typedef struct {
     int src_id;
     int dst_id;
     int amount;
-    // timestamp will be added by the logger process
+    uint16_t worker_id;  // bound worker (LOG_WORKER_NONE otherwise)
+    uint16_t reserved;
+    uint32_t seq;        // per-sender sequence number (starts at 1)
+    uint64_t ts_ns;      // CLOCK_REALTIME, stamped by the sender
+    uint64_t commit_ns;  // CLOCK_MONOTONIC commit time (inside the bank critical section for transfers)
 } LogMessage;
 
+// ============================================================================
+// Logger Configuration (set in the master before forking the logger)
+// ============================================================================
+#define LOG_DEFAULT_PATH "logs/transaction.log"
+#define LOG_DEFAULT_BIN_PATH "logs/transaction.bin"
+
+// On-disk format of the audit log
+#define LOG_FORMAT_TEXT   0   // one human-readable line per record (~90 bytes)
+#define LOG_FORMAT_BINARY 1   // fixed 32-byte AuditRecord, mmap append
+
+// fdatasync policy of the persistent log writer
+#define LOG_SYNC_NONE     0   // leave write-back to the kernel (fastest)
+#define LOG_SYNC_FLUSH    1   // fdatasync after every buffer flush
+#define LOG_SYNC_INTERVAL 2   // fdatasync at most once per sync_interval_ms
+
+#define LOG_KEY_BYTES 16      // AES-128 key of the encrypted audit log (see log_crypt.c)
+
+typedef struct {
+    char path[256];          // log file (parent directories are created)
+    int format;              // LOG_FORMAT_*
+    unsigned buffer_size;    // user-space buffer in bytes
+    unsigned flush_bytes;    // write(2) once this many bytes are buffered
+    int flush_interval_ms;   // ...or once the oldest buffered record is this old (0 = size only)
+    int sync_policy;         // LOG_SYNC_*
+    int sync_interval_ms;    // used by LOG_SYNC_INTERVAL
+    unsigned batch_size;     // max records drained per wake-up (1..LOG_BATCH_MAX)
+    int batch_latency_us;    // how long a started batch may wait to fill up (0 = don't wait)
+    unsigned rotate_mb;      // > 0: roll to a new segment at this size (max LOG_SEGMENT_MAX_MB)
+    int rotate_sec;          // > 0: ...or when the segment is this old (size still capped at LOG_SEGMENT_MAX_MB)
+    int keep_segments;       // > 0: keep only this many sealed segments (oldest deleted)
+    int shards;              // logger processes (1..LOG_SHARDS_MAX), see logger_select_shard()
+    int encrypt;             // binary format only: AES-128-CTR encrypt every batch with `key`
+    uint8_t key[LOG_KEY_BYTES];
+    char sub_path[108];      // "" = off; Unix socket for audit stream subscribers (audit_sub.c)
+} LoggerConfig;
+
+#define LOG_BATCH_MAX  4096
+#define LOG_BATCH_HIST 13     // batch-size histogram buckets: 1, 2-3, 4-7, ... , >= 4096
+#define LOG_SHARDS_MAX 8
+#define LOG_SEGMENT_MAX_MB 4095  // index postings are uint32 offsets: every segment stays under 4 GiB
+#define LOG_LAG_HIST   32     // commit -> written lag buckets: < 1 us, < 2 us, < 4 us, ... (log2)
+
+// Logger counters, published in the log ring SHM segment (single writer: the logger)
+typedef struct {
+    volatile uint64_t batches;          // wake-ups that produced records
+    volatile uint64_t records;
+    volatile uint64_t max_batch;
+    volatile uint64_t batch_fill_us;    // total time spent waiting for batches to fill
+    volatile uint64_t writes;           // writev() calls
+    volatile uint64_t bytes;
+    volatile uint64_t fsyncs;
+    volatile uint64_t batch_hist[LOG_BATCH_HIST];
+    volatile uint64_t lag_hist[LOG_LAG_HIST];
+    volatile uint64_t lag_max_ns;
+    volatile uint64_t seq_gaps;         // records missing from a worker's sequence (dropped)
+    volatile uint64_t seq_reorders;     // records older than one already written
+    uint32_t cfg_batch_size;
+    uint32_t cfg_batch_latency_us;
+} LoggerStats;
+
+/**
+ * @brief Sum of the counters of every logger shard (max fields: maximum).
+ * @return 0 on success, -1 if the shared segment does not exist.
+ */
+int logger_stats_total(LoggerStats *out);
+
+/**
+ * @brief Upper bound (us) of the lag bucket holding the `pct` percentile
+ *        (e.g. 99.0); 0 if no lag samples yet.
+ */
+uint64_t logger_lag_percentile_us(const LoggerStats *s, double pct);
+
+/**
+ * @brief Fill a LoggerConfig with the defaults
+ *        (1 MiB buffer, flush at 256 KiB or 100 ms, no fdatasync,
+ *         batches of up to 256 records without extra wait).
+ */
+void logger_config_default(LoggerConfig *cfg);
+
+/**
+ * @brief Set the configuration used by logger_main_loop().
+ *        With LOG_FORMAT_BINARY and the default text path, the path
+ *        becomes LOG_DEFAULT_BIN_PATH.
+ *        With rotate_mb / rotate_sec set, `path` is the base name of
+ *        segments "<path>.000001", ... each with a "<segment>.idx" sidecar.
+ *        Call before forking the logger process.
+ */
+void logger_configure(const LoggerConfig *cfg);
+
 /**
  * @brief Initialize Message Queue.
  * 
@@ -43,7 +141,8 @@ void logger_mq_cleanup(int mqid);
  * 
  * Behavior:
  * 1. Construct LogMessage.
- * 2. msgsnd() with IPC_NOWAIT to avoid blocking the worker.
+ * 2. If this process is bound to a log ring: push it there (no syscall).
+ * 3. Otherwise msgsnd() with IPC_NOWAIT to avoid blocking the worker.
  * 
  * @param mqid Message Queue ID.
  * @param type Command type (e.g., OP_TRANSFER).
@@ -54,16 +153,481 @@ void logger_mq_cleanup(int mqid);
  */
 void logger_send_async(int mqid, int type, int status, int src, int dst, int amt);
 
+/**
+ * @brief logger_send_async() with the commit time taken by the caller
+ *        (CLOCK_MONOTONIC ns, e.g. bank_last_commit_ns()); 0 = now.
+ *        The logger reports commit -> written lag from it.
+ */
+void logger_send_async_at(int mqid, int type, int status, int src, int dst, int amt, uint64_t commit_ns);
+
+/**
+ * @brief Make this (forked) logger process shard `shard` of cfg.shards:
+ *        it consumes only workers w with w % shards == shard (their rings,
+ *        spill files and SysV mtype 1 + shard) and writes "<name>.s<shard><ext>".
+ *        Call after logger_configure() and logger_ring_set_shards(),
+ *        before logger_main_loop(). Shard 0 also takes unbound senders.
+ */
+void logger_select_shard(int shard);
+
+/**
+ * @brief Path of shard `shard`: "logs/transaction.bin" -> "logs/transaction.s1.bin".
+ */
+void logger_shard_path(const char *base, int shard, char *out, size_t len);
+
 /**
  * @brief Main loop for the Logger Process.
  * 
  * Behavior:
- * 1. Infinite loop.
- * 2. msgrcv() (Blocking) to wait for messages.
- * 3. Write to "transaction.log" with timestamp.
+ * 1. Open the log file once and keep it open.
+ * 2. Drain the SHM rings (futex sleep when idle), or msgrcv() (Blocking)
+ *    when the ring transport is disabled.
+ * 3. Collect up to batch_size records per wake-up (waiting at most
+ *    batch_latency_us for a batch to fill) and format the whole batch at once
+ *    (timestamp cached per second).
+ * 4. Flush pending data + batch with a single writev() on size/time
+ *    thresholds, fdatasync per LoggerConfig.sync_policy.
+ * 5. Batch statistics are published via logger_stats().
+ * 6. On SIGTERM/SIGINT (or queue removal): drain, flush, sync and return.
  * 
  * @param mqid Message Queue ID.
  */
 void logger_main_loop(int mqid);
 
+// ============================================================================
+// Log Encryption (src/common/log_crypt.c)
+// AES-128-CTR; keystream position = byte offset in the file, so any range
+// can be encrypted on append and decrypted on read independently
+// ============================================================================
+typedef struct {
+    uint32_t ek[44];                              // round keys as big-endian words (table version)
+    uint8_t rk[176] __attribute__((aligned(16))); // same round keys in byte order (AES-NI)
+    int aesni;                                    // CPU has AES-NI
+} LogCipher;
+
+/**
+ * @brief Expand an AES-128 key and pick the AES-NI or the portable implementation.
+ */
+void log_cipher_init(LogCipher *c, const uint8_t key[LOG_KEY_BYTES]);
+
+/**
+ * @brief XOR `len` bytes with the keystream starting at byte `offset` (encrypt == decrypt).
+ *        `in` and `out` may be the same buffer.
+ */
+void log_cipher_ctr(const LogCipher *c, const uint8_t nonce[8], uint64_t offset,
+                    const void *in, void *out, size_t len);
+
+/**
+ * @brief Single-block AES encryption (known-answer tests).
+ */
+void log_cipher_block(const LogCipher *c, const uint8_t in[16], uint8_t out[16]);
+
+uint32_t log_cipher_key_check(const LogCipher *c);
+const char *log_cipher_impl(const LogCipher *c);   // "AES-NI" | "portable"
+
+/**
+ * @brief Read a key file (32 hex digits, e.g. `openssl rand -hex 16`).
+ * @return 0 on success, -1 on error (message printed).
+ */
+int log_key_load(const char *path, uint8_t key[LOG_KEY_BYTES]);
+
+// ============================================================================
+// Binary Audit Log (src/common/audit_log.c)
+// File = 64-byte AuditFileHeader + AuditRecord[record_count]
+// ============================================================================
+#define AUDIT_MAGIC "HSTSAUD1"
+#define AUDIT_VERSION 1
+#define AUDIT_GROW_BYTES (16u << 20)  // file/mapping grows in 16 MiB steps
+
+typedef struct {
+    char magic[8];                    // AUDIT_MAGIC
+    uint32_t version;
+    uint32_t record_size;             // sizeof(AuditRecord)
+    uint64_t created_ns;
+    volatile uint64_t record_count;   // committed records (updated after every batch)
+    uint32_t cipher;                  // AUDIT_CIPHER_* applied to everything after the header
+    uint32_t key_check;               // first word of AES_k(0^128): rejects a wrong key
+    uint8_t nonce[8];                 // per-file CTR nonce
+    uint64_t reserved[2];
+} AuditFileHeader;
+
+#define AUDIT_CIPHER_NONE        0
+#define AUDIT_CIPHER_AES128_CTR  1
+
+typedef struct {
+    uint64_t ts_ns;       // CLOCK_REALTIME nanoseconds
+    uint32_t seq;         // per-worker sequence number
+    int32_t src_id;
+    int32_t dst_id;
+    int32_t amount;
+    int16_t status;       // 0 = success, BANK_ERR_* otherwise
+    uint16_t worker_id;   // LOG_WORKER_NONE = unbound sender
+    uint8_t op_code;
+    uint8_t flags;        // AUDIT_FLAG_*
+    uint16_t reserved;
+} AuditRecord;            // 32 bytes
+
+#define AUDIT_FLAG_DROPPED 0x01   // logger note: `amount` records were dropped (ring full)
+
+typedef struct {
+    int fd;
+    AuditFileHeader *hdr;   // whole file is mapped; records follow the header
+    size_t map_size;
+    const LogCipher *cipher; // non-NULL: records are encrypted as they are appended
+} AuditFile;
+
+/**
+ * @brief Open (or create) a binary audit file for appending.
+ *        An existing file is resumed after its last committed record.
+ * @return 0 on success, -1 on failure.
+ */
+int audit_open(AuditFile *af, const char *path);
+
+/**
+ * @brief Same as audit_open(), but records are AES-CTR encrypted with `cipher`
+ *        (a new file gets a random nonce; an existing file must use the same key).
+ *        `cipher` must outlive the AuditFile. NULL = plaintext.
+ */
+int audit_open_encrypted(AuditFile *af, const char *path, const LogCipher *cipher);
+
+/**
+ * @brief Append records (grows the file/mapping as needed) and commit the count.
+ * @return 0 on success, -1 if the file could not grow (records are dropped).
+ */
+int audit_append(AuditFile *af, const AuditRecord *recs, int n);
+
+/**
+ * @brief Trim the file to its committed size, unmap and close.
+ */
+void audit_close(AuditFile *af);
+
+/**
+ * @brief Map an audit file read-only (decoder / query tools).
+ * @return Pointer to the first record and its count, or NULL on error.
+ *         Release with audit_unmap(hdr, map_size).
+ */
+const AuditRecord *audit_map_readonly(const char *path, const AuditFileHeader **hdr,
+                                      uint64_t *count, size_t *map_size);
+
+/**
+ * @brief Key used by audit_map_readonly() for encrypted files (tools: --key <file>).
+ *        Encrypted files are mapped private and decrypted in place.
+ * @return 0 on success, -1 if the key file is unusable.
+ */
+int audit_load_read_key(const char *key_path);
+void audit_unmap(const AuditFileHeader *hdr, size_t map_size);
+
+/**
+ * @brief Opcode name used by the text log ("TRANSFER", "OP_255", ...).
+ */
+const char *audit_op_name(int op_code, char *tmp, size_t tmp_len);
+
+/**
+ * @brief Convert a received LogMessage into its on-disk record.
+ */
+void audit_record_from_msg(AuditRecord *r, const LogMessage *msg);
+
+// strftime result cached per second (formatting is the expensive part)
+typedef struct {
+    int64_t sec;
+    char str[32];
+} AuditTimeCache;
+
+/**
+ * @brief "YYYY-mm-dd HH:MM:SS" (local time) for a ns timestamp.
+ */
+const char *audit_time_str(AuditTimeCache *tc, uint64_t ts_ns);
+
+/**
+ * @brief Render one record in the text log format (with trailing newline).
+ *        Both the text logger and the decoder use this, so output matches.
+ * @return Length written (snprintf semantics).
+ */
+int audit_format_text(char *out, size_t len, const AuditRecord *r, AuditTimeCache *tc);
+
+// ============================================================================
+// Segmented Audit Log Index (src/common/audit_index.c)
+// Sidecar "<segment>.idx", written when a segment is closed:
+//   AuditIndexHeader | AuditIndexAccount[account_count] (sorted by id)
+//                    | uint32_t postings[posting_count] (byte offsets of records)
+// ============================================================================
+#define AUDIT_INDEX_MAGIC "HSTSIDX1"
+#define AUDIT_INDEX_VERSION 1
+#define AUDIT_SEGMENT_FMT "%s.%06u"
+#define AUDIT_INDEX_SUFFIX ".idx"
+
+typedef struct {
+    char magic[8];            // AUDIT_INDEX_MAGIC
+    uint32_t version;
+    uint32_t format;          // LOG_FORMAT_* of the segment
+    uint64_t first_ts_ns;     // time range covered by the segment
+    uint64_t last_ts_ns;
+    uint64_t record_count;
+    uint64_t posting_count;
+    uint32_t account_count;
+    uint32_t reserved[3];
+} AuditIndexHeader;           // 64 bytes
+
+typedef struct {
+    int32_t account_id;
+    uint32_t count;           // postings[first .. first + count), in write order
+    uint64_t first;
+} AuditIndexAccount;
+
+typedef struct AuditIndexBuilder AuditIndexBuilder;
+
+AuditIndexBuilder *audit_index_new(void);
+void audit_index_free(AuditIndexBuilder *b);
+void audit_index_reset(AuditIndexBuilder *b);
+
+/**
+ * @brief Record that `r` is stored at byte `offset` of the current segment.
+ */
+void audit_index_add(AuditIndexBuilder *b, const AuditRecord *r, uint32_t offset);
+
+/**
+ * @brief Write the sidecar (tmp file + rename). Empty builders write nothing.
+ * @return 0 on success, -1 on failure.
+ */
+int audit_index_write(const AuditIndexBuilder *b, const char *path, int format);
+
+typedef struct {
+    const AuditIndexHeader *hdr;
+    const AuditIndexAccount *accounts;
+    const uint32_t *postings;
+    size_t map_size;
+} AuditIndex;
+
+int audit_index_open(AuditIndex *idx, const char *path);
+void audit_index_close(AuditIndex *idx);
+
+/**
+ * @brief Offsets of the records touching `account_id` (NULL if none).
+ */
+const uint32_t *audit_index_lookup(const AuditIndex *idx, int32_t account_id, uint32_t *count);
+
+/**
+ * @brief Accounts a record touches (src, plus dst for transfers).
+ * @return Number of ids written to `ids` (0..2).
+ */
+int audit_record_accounts(const AuditRecord *r, int32_t ids[2]);
+
+/**
+ * @brief The `max` oldest (lowest-numbered) segments of `base`, ascending. The
+ *        whole directory is scanned: `last` gets the highest number and `total`
+ *        the number of segments even when there are more than `max` (both optional).
+ * @return Number of segment numbers written to `out` (at most `max`).
+ */
+int audit_segment_list(const char *base, uint32_t *out, int max, uint32_t *last, int *total);
+
+// ============================================================================
+// Audit Stream Subscribers (src/common/audit_sub.c)
+// The logger publishes every record it writes on a Unix SOCK_SEQPACKET socket.
+//   subscriber -> AuditSubRequest
+//   logger     -> HELLO frame, then frames of AuditSubFrame + AuditRecord[count]
+// Stream seqs are per logger (shard) and restart when `epoch` changes.
+// ============================================================================
+#define AUDIT_SUB_MAGIC       0x42555348u  // "HSUB"
+#define AUDIT_SUB_VERSION     1
+#define AUDIT_SUB_BACKLOG     65536        // records kept for resume (2 MiB)
+#define AUDIT_SUB_BATCH_MAX   256          // records per frame
+#define AUDIT_SUB_MAX_CLIENTS 16
+
+#define AUDIT_SUB_FLAG_HELLO  0x01   // handshake reply: first_seq = oldest resumable seq
+#define AUDIT_SUB_FLAG_GAP    0x02   // records before first_seq were overwritten (slow subscriber)
+#define AUDIT_SUB_FLAG_EPOCH  0x04   // requested epoch is gone (logger restarted): starts at the oldest
+
+typedef struct {
+    uint32_t magic;        // AUDIT_SUB_MAGIC
+    uint32_t version;      // AUDIT_SUB_VERSION
+    uint64_t from_seq;     // 0 = only new records; otherwise the first seq wanted
+    uint64_t epoch;        // epoch from_seq belongs to (0 = current)
+} AuditSubRequest;
+
+typedef struct {
+    uint32_t magic;        // AUDIT_SUB_MAGIC
+    uint16_t flags;        // AUDIT_SUB_FLAG_*
+    uint16_t shard;        // logger shard that produced the stream
+    uint32_t count;        // records following this header
+    uint32_t reserved;
+    uint64_t epoch;        // logger start time (CLOCK_REALTIME ns)
+    uint64_t first_seq;    // stream seq of the first record
+    uint64_t head_seq;     // next seq the logger will publish (lag = head_seq - first_seq - count)
+} AuditSubFrame;
+
+/**
+ * @brief Logger side: listen on `path` (stale socket files are replaced).
+ * @return 0 on success, -1 on failure (the logger keeps running without subscribers).
+ */
+int audit_sub_listen(const char *path, int shard);
+
+/**
+ * @brief Logger side: append a written batch to the backlog and push it to every subscriber.
+ *        Never blocks; a subscriber that cannot keep up falls behind (GAP) instead.
+ */
+void audit_sub_publish(const AuditRecord *recs, int n);
+
+/**
+ * @brief Logger side: accept / handshake new subscribers and retry stalled ones (on the tick).
+ */
+void audit_sub_poll(void);
+
+/**
+ * @brief Logger side: give subscribers up to 1 s to receive the tail, then close everything.
+ */
+void audit_sub_close(void);
+void audit_sub_stats(uint64_t *served, uint64_t *sent, uint64_t *skipped);
+
+/**
+ * @brief Subscriber side: connect and wait for the HELLO frame.
+ * @return Socket fd, or -1 if the logger is not listening.
+ */
+int audit_sub_connect(const char *path, uint64_t from_seq, uint64_t epoch, AuditSubFrame *hello);
+
+/**
+ * @brief Subscriber side: block for the next frame (`recs` holds AUDIT_SUB_BATCH_MAX records).
+ * @return Number of records, or -1 on EOF / error.
+ */
+int audit_sub_read(int fd, AuditSubFrame *frame, AuditRecord *recs);
+
+// ============================================================================
+// Shared-Memory Ring Transport (src/common/log_ring.c)
+// One SPSC ring per worker in POSIX SHM; producers never make a syscall.
+// ============================================================================
+#define LOG_RING_SHM_NAME "/hsts_log_rings"
+#define LOG_RING_MAX_PRODUCERS 16
+#define LOG_RING_SLOTS 16384          // per ring, power of two
+#define LOG_SPILL_SLOTS 131072        // per worker spill file, power of two (~6 MB)
+
+/**
+ * @brief Create the ring segment (Master, before forking logger/workers).
+ *        Once enabled, bound processes log through their ring and the
+ *        logger drains the rings instead of blocking in msgrcv().
+ *        nrings = 0 creates only the LoggerStats page (SysV transport).
+ * @return 0 on success, -1 on failure (SysV queue stays the transport).
+ */
+int logger_ring_init(int nrings);
+
+/**
+ * @brief Logger counters of this process's shard in the shared segment
+ *        (NULL if not initialized). See logger_stats_total() for all shards.
+ */
+LoggerStats *logger_stats(void);
+
+/**
+ * @brief Number of logger processes sharing the workers (Master, after
+ *        logger_ring_init(), before forking). Worker w goes to shard w % n.
+ * @return 0 on success, -1 without a ring segment or if n is out of range.
+ */
+int logger_ring_set_shards(int n);
+
+/**
+ * @brief Consumer side: only drain rings / spill files owned by `shard`.
+ */
+int log_ring_select_shard(int shard);
+
+/**
+ * @brief Configured shard count (1 without a ring segment).
+ */
+int logger_shard_count(void);
+
+/**
+ * @brief Producer side: shard that receives this process's records (0 if unbound).
+ */
+int logger_my_shard(void);
+
+/**
+ * @brief Unmap and unlink the ring segment.
+ */
+void logger_ring_cleanup(void);
+
+/**
+ * @brief Create/map one preallocated spill file per worker,
+ *        "<dir of log_path>/spill.wNN" (Master, before forking).
+ *        A bound worker whose ring (or SysV queue) is full appends to its
+ *        spill file through the mapping: no syscall, never blocks.
+ *        Records left over by a crashed logger are kept and merged first.
+ * @return 0 on success, -1 on failure (full rings / queue then drop).
+ */
+int logger_spill_init(const char *log_path, int nworkers);
+
+/**
+ * @brief Unmap the spill files; fully drained files are deleted.
+ */
+void logger_spill_cleanup(void);
+
+/**
+ * @brief 1 if logger_ring_init(n > 0) succeeded in this process (or its parent).
+ */
+int logger_ring_enabled(void);
+
+/**
+ * @brief Bind the calling process to ring / spill file `worker_id` (0-based).
+ *        logger_send_async() then writes to that ring; unbound processes
+ *        keep using the SysV queue. The id is stamped on every record either
+ *        way so the logger can detect sequence gaps.
+ * @return 0 on success, -1 if neither a ring nor a spill file exists for the id.
+ */
+int logger_bind_worker(int worker_id);
+
+/**
+ * @brief Worker id bound with logger_bind_worker(), or LOG_WORKER_NONE.
+ */
+uint16_t logger_worker_id(void);
+
+/**
+ * @brief Producer side: append one record to the bound ring.
+ *        A full ring spills the record; once spilling, records keep going to
+ *        the spill file until the logger has merged it back (keeps seq order).
+ *        Only a full spill file drops the record (see log_ring_dropped()).
+ * @return 0 if a ring is bound (record queued or counted as dropped), -1 otherwise.
+ */
+int log_ring_push(const LogMessage *msg);
+
+/**
+ * @brief Producer side: append one record to the bound spill file.
+ * @return 0 on success, -1 if no spill file is bound or it is full.
+ */
+int log_spill_push(const LogMessage *msg);
+
+/**
+ * @brief Producer side: 1 if the bound spill file still holds unmerged records.
+ */
+int log_spill_pending(void);
+
+/**
+ * @brief Consumer side (SysV transport): move up to `max` spilled records
+ *        out of all spill files. Call only when the queue is empty.
+ */
+int log_spill_drain(LogMessage *out, int max);
+
+/**
+ * @brief Records spilled by this shard's workers / merged back by its logger.
+ */
+void log_spill_stats(uint64_t *spilled, uint64_t *merged);
+
+/**
+ * @brief Consumer side: records waiting in this shard's rings / spill files right now.
+ */
+void log_ring_backlog(uint64_t *ring, uint64_t *spill);
+
+/**
+ * @brief Consumer side: move up to `max` records out of all rings
+ *        (round-robin, fair share per ring). A worker's spill file is read
+ *        once its ring is empty, so each worker's records stay in seq order.
+ * @return Number of records copied to `out`.
+ */
+int log_ring_drain(LogMessage *out, int max);
+
+/**
+ * @brief Consumer side: sleep on the futex until a producer posts
+ *        or `timeout_ms` passes (0 = no timeout). Returns at once if a ring
+ *        is non-empty.
+ */
+void log_ring_wait(int timeout_ms);
+
+/**
+ * @brief Total records dropped because a ring and its spill file were full.
+ */
+uint64_t log_ring_dropped(void);
+
 #endif // LOGGER_H
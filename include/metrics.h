@@ -0,0 +1,309 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Enable POSIX features
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// Shared-Memory Metrics Page (src/common/metrics.c)
+// Workers, loggers and the bank core publish counters / gauges into one
+// versioned POSIX SHM region with relaxed atomics; readers (hsts-top) map it
+// read-only and sample at any interval: no syscall on the server side.
+// ============================================================================
+#define METRICS_SHM_NAME "/hsts_metrics"
+#define METRICS_MAGIC 0x4D545253u   // "MTRS"
+#define METRICS_VERSION 6           // bump on any layout change
+#define METRICS_MAX_WORKERS 16
+#define METRICS_MAX_LOGGERS 8       // == LOG_SHARDS_MAX
+
+// Per-op counters (index = metrics_op_index(op_code))
+#define METRICS_OP_LOGIN     0
+#define METRICS_OP_BALANCE   1
+#define METRICS_OP_TRANSFER  2
+#define METRICS_OP_AGGREGATE 3
+#define METRICS_OP_BIND      4
+#define METRICS_OP_OPEN      5
+#define METRICS_OP_CLOSE     6
+#define METRICS_OP_STATS     7
+#define METRICS_OP_OTHER     8      // unknown op code
+#define METRICS_OPS          9
+
+// Latency stages of one request (histogram per op x stage, see LatencyHist)
+#define METRICS_STAGE_TOTAL     0   // accepted -> response written
+#define METRICS_STAGE_PARSE     1   // accepted -> request read and checksummed
+#define METRICS_STAGE_ADMISSION 2   // bank semaphore (0 when a slot was free)
+#define METRICS_STAGE_LOCK      3   // account / allocator mutexes (0 when uncontended)
+#define METRICS_STAGE_CRITICAL  4   // both account locks held (transfer / settle)
+#define METRICS_STAGE_LOG       5   // audit record enqueue (ring / spill / SysV)
+#define METRICS_STAGE_RESPONSE  6   // response write
+#define METRICS_STAGES          7
+
+// Log-linear (HDR-style) buckets over ns: values < 8 exact, then 8 linear
+// sub-buckets per power of two (<= 12.5% error) up to 2^35 ns (~34 s, last bucket open-ended)
+#define METRICS_LAT_SUB_BITS 3
+#define METRICS_LAT_SUB      (1 << METRICS_LAT_SUB_BITS)
+#define METRICS_LAT_MAX_EXP  34
+#define METRICS_LAT_BUCKETS  ((METRICS_LAT_MAX_EXP - METRICS_LAT_SUB_BITS + 2) * METRICS_LAT_SUB)
+
+// Lock profiler (--lock-profile): per-worker SpaceSaving top-K of account locks by wait time
+#define METRICS_LOCK_TOPK  64
+#define METRICS_LOCK_ALLOC -1       // LockHotEntry.account of the slot allocator mutex
+
+// Error counters: index = -ret_code (BANK_ERR_*), last slot = anything else
+#define METRICS_ERRORS 16
+
+// 單一寫入者 (每個 Worker / Logger 只寫自己的 slot)：relaxed load + store，不需要 lock 前綴
+#define METRIC_ADD(field, v) \
+    __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+#define METRIC_SET(field, v) __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+// One worker process (single writer). 64-byte aligned: no false sharing between workers
+typedef struct {
+    volatile uint32_t pid;                      // 0 = slot unused
+    uint32_t reserved;
+    volatile uint64_t requests[METRICS_OPS];
+    volatile uint64_t failures[METRICS_OPS];    // ret_code < 0
+    volatile uint64_t errors[METRICS_ERRORS];   // by -ret_code
+    volatile uint64_t connections;              // accepted
+    volatile uint64_t bad_packets;              // bad header / checksum / early disconnect
+    volatile uint64_t admission_waits;          // bank semaphore was full (MAX_CONCURRENCY)
+    volatile uint64_t admission_wait_ns;
+    volatile uint64_t lock_waits;               // account / allocator mutex found held
+    volatile uint64_t lock_wait_ns;
+    volatile uint64_t settle_batches;           // --settle-window-ms flushes
+    volatile uint64_t settle_items;
+    volatile uint64_t settle_pending;           // gauge: transfers buffered right now
+    volatile uint64_t header_timeouts;          // closed: request header not complete by its deadline
+    volatile uint64_t body_timeouts;            // closed: request body not complete by its deadline
+    volatile uint64_t write_timeouts;           // response not written in time (client not reading)
+    volatile uint64_t parked_full;              // incomplete connection dropped: parking table full
+    volatile uint64_t parked;                   // gauge: connections waiting for the rest of a packet
+    volatile uint64_t rate_limited_account;     // transfers refused: source account over --rate-account
+    volatile uint64_t rate_limited_client;      // requests refused: client address over --rate-client
+    volatile uint64_t rate_untracked;           // no free bucket near the key (allowed unlimited)
+} __attribute__((aligned(64))) WorkerMetrics;
+
+// One logger shard (single writer), refreshed on every logger tick (min(flush_interval_ms, 100 ms))
+typedef struct {
+    volatile uint32_t pid;
+    uint32_t reserved;
+    volatile uint64_t tick_ns;                  // CLOCK_MONOTONIC of the last refresh (heartbeat)
+    volatile uint64_t records;
+    volatile uint64_t bytes;
+    volatile uint64_t writes;
+    volatile uint64_t fsyncs;
+    volatile uint64_t seq_gaps;
+    volatile uint64_t dropped;                  // ring + spill full
+    volatile uint64_t spilled;                  // written to this shard's spill files (ring / queue full)
+    volatile uint64_t merged;                   // ...and merged back into the log
+    volatile uint64_t ring_depth;               // gauge: records waiting in this shard's rings
+    volatile uint64_t spill_depth;              // gauge: ... in its spill files
+    volatile uint64_t mq_depth;                 // gauge: SysV queue (SysV transport only)
+    volatile uint64_t lag_p50_us;
+    volatile uint64_t lag_p99_us;
+    volatile uint64_t lag_max_us;
+    volatile uint64_t sub_sent;                 // audit stream subscribers
+    volatile uint64_t sub_skipped;
+} __attribute__((aligned(64))) LoggerMetrics;
+
+// One latency histogram (single writer: the worker owning it; merged across workers on read)
+typedef struct {
+    volatile uint64_t count;
+    volatile uint64_t sum_ns;
+    volatile uint64_t max_ns;
+    volatile uint64_t buckets[METRICS_LAT_BUCKETS];
+} LatencyHist;
+
+// One tracked lock of the SpaceSaving sketch (64 bytes). weight_ns over-counts
+// wait_ns by at most error_ns (inherited from the entry it evicted); the
+// acquisitions / hold figures count only since the lock entered the sketch.
+typedef struct {
+    volatile int32_t account;                   // account id, METRICS_LOCK_ALLOC = allocator
+    uint32_t reserved;
+    volatile uint64_t weight_ns;                // SpaceSaving counter (wait ns + error_ns)
+    volatile uint64_t error_ns;
+    volatile uint64_t acquisitions;
+    volatile uint64_t waits;                    // acquisitions that found the lock held
+    volatile uint64_t wait_ns;
+    volatile uint64_t hold_ns;
+    volatile uint64_t hold_max_ns;
+} LockHotEntry;
+
+// One worker's sketch (single writer). Readers may see one entry mid-replacement
+typedef struct {
+    volatile uint32_t enabled;
+    volatile uint32_t used;                     // entries in use (<= METRICS_LOCK_TOPK)
+    volatile uint64_t events;                   // contended acquisitions fed to the sketch
+    volatile uint64_t evictions;
+    uint64_t reserved[5];
+    LockHotEntry top[METRICS_LOCK_TOPK];
+} __attribute__((aligned(64))) LockProfile;
+
+// Bank-wide gauges (written by whichever worker changed them last)
+typedef struct {
+    volatile uint64_t open_accounts;
+    volatile uint64_t extents;
+} __attribute__((aligned(64))) BankMetrics;
+
+typedef struct {
+    uint32_t magic;              // 0 once the server has removed the region
+    uint32_t version;            // METRICS_VERSION
+    uint32_t size;               // sizeof(MetricsShm)
+    uint32_t nworkers;
+    uint32_t nloggers;
+    uint32_t reserved;
+    uint64_t start_ns;           // CLOCK_REALTIME at creation (identifies a server run)
+    uint64_t start_mono_ns;      // CLOCK_MONOTONIC at creation (uptime)
+    BankMetrics bank;
+    LoggerMetrics loggers[METRICS_MAX_LOGGERS];
+    WorkerMetrics workers[METRICS_MAX_WORKERS];
+    LatencyHist latency[METRICS_MAX_WORKERS][METRICS_OPS][METRICS_STAGES];
+    LockProfile lockprof[METRICS_MAX_WORKERS];
+} MetricsShm;
+
+/**
+ * @brief Create the metrics region (Master, before forking).
+ *        Children inherit the mapping.
+ * @return 0 on success, -1 on failure (the server then runs without metrics).
+ */
+int metrics_init(int nworkers, int nloggers);
+
+/**
+ * @brief Mark the region gone (magic = 0), unmap and unlink it.
+ */
+void metrics_cleanup(void);
+
+/**
+ * @brief Claim slot `worker_id` for this (forked) worker process.
+ *        Bank core waits in this process are then counted in the slot.
+ * @return The slot, or NULL without a metrics region.
+ */
+WorkerMetrics *metrics_bind_worker(int worker_id);
+
+/**
+ * @brief Slot of logger shard `shard` (stamps this process's pid), NULL without a region.
+ */
+LoggerMetrics *metrics_bind_logger(int shard);
+
+/**
+ * @brief Count one answered request: op counter, and failure / error code if ret_code < 0.
+ */
+void metrics_count_request(WorkerMetrics *m, int op_code, int ret_code);
+
+// Bank core hooks (no-ops in processes without a worker slot)
+void metrics_admission_wait(uint64_t ns);
+void metrics_lock_wait(uint64_t ns);
+void metrics_bank_accounts(uint64_t open_accounts, uint64_t extents);
+
+/**
+ * @brief Turn the lock profiler on for every worker (Master, before forking).
+ * @return 0, or -1 without a metrics region.
+ */
+int metrics_lock_profile_enable(void);
+
+/**
+ * @brief Lock profiler hooks (bank core, only while profiling): one acquisition
+ *        of lock `account` that waited `wait_ns` (0 = uncontended), and its release
+ *        after `hold_ns`. `hint` caches the sketch slot between the two (-1 = none).
+ */
+int metrics_lock_acquired(int32_t account, uint64_t wait_ns);
+void metrics_lock_released(int32_t account, int hint, uint64_t hold_ns);
+
+/**
+ * @brief Reader side: merge every worker's sketch by account and sort by wait time.
+ * @return Number of entries written to `out` (at most `max`).
+ */
+int metrics_lock_top(const MetricsShm *snap, LockHotEntry *out, int max);
+
+/**
+ * @brief Per-request stage timing (worker process, single-threaded).
+ *        metrics_req_begin() clears the stages of the current request; the
+ *        worker, bank core and logger add theirs with metrics_stage_*();
+ *        metrics_req_end() counts the request and records every stage that
+ *        ran into this worker's histograms for the op (stages are kept, so a
+ *        settlement batch can end one request per transfer).
+ */
+void metrics_req_begin(void);
+void metrics_req_end(int op_code, int ret_code);
+void metrics_stage_add(int stage, uint64_t ns);
+void metrics_stage_set(int stage, uint64_t ns);
+
+/**
+ * @brief CLOCK_MONOTONIC ns if this process has a worker slot, else 0 (no clock read).
+ *        metrics_stage_since(stage, t0) adds now - t0 (nothing when t0 == 0).
+ */
+uint64_t metrics_stage_clock(void);
+void metrics_stage_since(int stage, uint64_t t0);
+
+void metrics_hist_record(LatencyHist *h, uint64_t ns);
+int metrics_lat_bucket(uint64_t ns);
+uint64_t metrics_lat_bucket_upper(int bucket);   // largest value in the bucket
+
+/**
+ * @brief Upper bound (ns) of the bucket holding the `pct` percentile, capped at max_ns.
+ */
+uint64_t metrics_lat_percentile(const LatencyHist *h, double pct);
+
+/**
+ * @brief Sum of histogram (op, stage) over all worker slots of a snapshot / the live region.
+ */
+void metrics_merge_latency(const MetricsShm *m, int op, int stage, LatencyHist *out);
+
+/**
+ * @brief Live region of this process (inherited from the master), NULL if none.
+ */
+const MetricsShm *metrics_region(void);
+
+int metrics_op_index(int op_code);
+int metrics_op_code(int index);              // OP_* (0 for METRICS_OP_OTHER)
+const char *metrics_op_name(int index);
+const char *metrics_stage_name(int stage);
+const char *metrics_error_name(int index);   // index = -ret_code
+
+/**
+ * @brief Reader side: map the region read-only and check magic / version.
+ * @return The mapping, or NULL (no server / incompatible layout; message in `err` if given).
+ */
+const MetricsShm *metrics_attach(char *err, size_t err_len);
+void metrics_detach(const MetricsShm *m);
+
+/**
+ * @brief Reader side: copy the live region (each counter read once, relaxed).
+ */
+void metrics_snapshot(const MetricsShm *m, MetricsShm *out);
+
+/**
+ * @brief Sum of all worker slots of a snapshot (pid = number of active workers).
+ */
+void metrics_sum_workers(const MetricsShm *snap, WorkerMetrics *out);
+
+// ============================================================================
+// Prometheus Exporter (src/common/metrics_export.c)
+// Admin endpoint serving the metrics page in the text exposition format;
+// runs in its own process and only reads snapshots (no worker involvement).
+// ============================================================================
+#define METRICS_EXPORT_MAX_REQUEST 4096   // longest HTTP request header accepted
+
+/**
+ * @brief Render a snapshot as Prometheus text (format 0.0.4).
+ * @return malloc'd NUL-terminated text (caller frees), length in *len; NULL on OOM.
+ */
+char *metrics_render_prometheus(const MetricsShm *snap, size_t *len);
+
+/**
+ * @brief Open the admin listener: "PORT" / "HOST:PORT" (TCP, host defaults to 127.0.0.1)
+ *        or "unix:PATH" / any path containing '/' (Unix socket, mode 0660).
+ * @return Listening fd, or -1 on failure.
+ */
+int metrics_export_listen(const char *addr);
+
+/**
+ * @brief Serve GET /metrics from the live region until SIGINT / SIGTERM (exporter process).
+ */
+void metrics_export_loop(int listen_fd);
+
+#endif // METRICS_H
@@ -14,8 +14,16 @@
 #define OP_LOGIN    0x10
 #define OP_BALANCE  0x20
 #define OP_TRANSFER 0x30
+#define OP_AGGREGATE 0x40
+#define OP_BIND_ACCOUNT 0x50
+#define OP_OPEN_ACCOUNT 0x51
+#define OP_CLOSE_ACCOUNT 0x52
+#define OP_STATS    0x60   // server-side latency percentiles (StatsBody)
 #define OP_ERROR    0xEE
 
+#define PROTOCOL_MAX_BODY (1024 * 1024)   // larger body_len = bad packet
+#define PROTOCOL_ERR_TIMEOUT -2           // deadline passed (write / deadline-aware reads)
+
 // Packet Header
 typedef struct {
     uint8_t  magic;    // 0x90
@@ -31,6 +39,97 @@ typedef struct {
     int amount;
 } __attribute__((packed)) TransferBody;
 
+// Transfer Body (external account numbers)
+// OP_TRANSFER 以 body_len 區分：sizeof(TransferBody) 或 sizeof(TransferExtBody)
+typedef struct {
+    uint64_t src_ext;
+    uint64_t dst_ext;
+    int amount;
+} __attribute__((packed)) TransferExtBody;
+
+// Transfer Body with idempotency key (retries inside the window return the original result)
+typedef struct {
+    uint8_t idem_key[16];
+    int src_id;
+    int dst_id;
+    int amount;
+} __attribute__((packed)) TransferIdemBody;
+
+// Balance query by external account number (OP_BALANCE, body_len == 8)
+typedef struct {
+    uint64_t ext_id;
+} __attribute__((packed)) BalanceExtBody;
+
+// Bind external account number -> account id
+typedef struct {
+    uint64_t ext_id;
+    int account_id;
+} __attribute__((packed)) BindAccountBody;
+
+// Open account (response ret_code = new account id, or error)
+typedef struct {
+    uint64_t ext_id;        // 0 = no external account number
+    int initial_balance;    // must be 0: new accounts are funded by transfer (else INVALID_AMOUNT)
+} __attribute__((packed)) OpenAccountBody;
+
+// Close account: body is int account_id, or uint64 ext_id (BalanceExtBody)
+
+// Aggregate Request Body (optional; empty body = server defaults)
+typedef struct {
+    int threshold;   // count accounts with balance < threshold
+    int hist_base;
+    int hist_width;  // <= 0 disables the histogram
+} __attribute__((packed)) AggregateRequest;
+
+#define AGG_HIST_BUCKETS 16
+
+// Aggregate Response Body
+typedef struct {
+    uint64_t total;      // int64 sum of balances
+    int32_t  min;
+    int32_t  max;
+    uint32_t count;
+    uint32_t below;
+    uint32_t histogram[AGG_HIST_BUCKETS];
+} __attribute__((packed)) AggregateBody;
+
+// Server Latency Stats (OP_STATS, empty request body)
+// One entry per (op, stage) with samples, merged over all workers; ns, network byte order
+#define STATS_MAX_ENTRIES 64
+
+typedef struct {
+    uint8_t  op_code;    // OP_* (0 = unknown op codes)
+    uint8_t  stage;      // METRICS_STAGE_* (see metrics.h)
+    uint16_t reserved;
+    uint32_t reserved2;
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} __attribute__((packed)) StatsEntry;
+
+typedef struct {
+    uint32_t workers;    // worker slots merged
+    uint32_t count;      // entries that follow
+    StatsEntry entries[STATS_MAX_ENTRIES];
+} __attribute__((packed)) StatsBody;   // sent as offsetof(entries) + count * sizeof(StatsEntry) bytes
+
+// Incremental reader for non-blocking sockets (server side: a slow client
+// never blocks a worker, its partial packet waits in one of these)
+typedef struct {
+    PacketHeader header;   // host byte order once got >= sizeof(PacketHeader)
+    void *body;            // malloc'd body (caller owns it after PROTOCOL_READ_DONE)
+    uint32_t got;          // bytes received so far (header + body)
+    uint64_t arrival_ns;   // kernel receive time of the last bytes read (CLOCK_REALTIME ns,
+                           // needs SO_TIMESTAMPNS on the socket; 0 = unknown)
+} PacketReader;
+
+#define PROTOCOL_READ_MORE 0   // would block: call again when the socket is readable
+#define PROTOCOL_READ_DONE 1   // header + body complete and checksummed
+
 // ============================================================================
 // Protocol Helper API (Implemented in src/common/protocol.c)
 // ============================================================================
@@ -51,13 +150,52 @@ typedef struct {
  */
 int protocol_read_packet(int fd, PacketHeader* header, void** body);
 
+/**
+ * @brief Read whatever the (non-blocking) socket has into `r`.
+ *
+ * protocol_reader_init() before the first call; protocol_reader_free() if the
+ * connection is dropped before the packet completed.
+ *
+ * @return PROTOCOL_READ_DONE (r->header / r->body hold the packet),
+ *         PROTOCOL_READ_MORE (EAGAIN, nothing lost), -1 on error/disconnect.
+ */
+void protocol_reader_init(PacketReader* r);
+int protocol_reader_feed(int fd, PacketReader* r);
+void protocol_reader_free(PacketReader* r);
+int protocol_reader_has_header(const PacketReader* r);
+
 /**
  * @brief Send a response packet.
  * 
  * @param fd Socket file descriptor.
  * @param op_code Operation code.
  * @param ret_code Return code (e.g., 0 for success, -1 for error).
+ * @return 0 on success, -1 on error, PROTOCOL_ERR_TIMEOUT past the write deadline.
+ */
+int protocol_send_response(int fd, uint8_t op_code, int ret_code);
+
+/**
+ * @brief Send a response packet with an arbitrary body.
+ * 
+ * The body must already be in network byte order.
+ * 
+ * @param fd Socket file descriptor.
+ * @param op_code Operation code.
+ * @param body Response body.
+ * @param body_len Length of body in bytes.
+ */
+int protocol_send_body(int fd, uint8_t op_code, const void* body, uint32_t body_len);
+
+/**
+ * @brief Deadline for writing one whole packet on a non-blocking socket
+ *        (per process, 0 = wait as long as it takes). Writes never raise SIGPIPE.
+ */
+void protocol_set_write_timeout(int timeout_ms);
+
+/**
+ * @brief 64-bit host <-> network byte order conversion.
  */
-void protocol_send_response(int fd, uint8_t op_code, int ret_code);
+uint64_t protocol_hton64(uint64_t v);
+uint64_t protocol_ntoh64(uint64_t v);
 
 #endif // PROTOCOL_H
@@ -0,0 +1,92 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+// Enable POSIX features
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bank.h"
+
+// ============================================================================
+// Rate Limiting (src/common/ratelimit.c)
+// One token bucket per source account and per client address, in a SHM table
+// shared by every worker. Buckets refill lazily from timestamps (no background
+// thread); taking a token is one CAS on the bucket.
+// ============================================================================
+#define RATELIMIT_SHM_NAME "/hsts_ratelimit"
+#define RATELIMIT_MAGIC 0x524C4D54u     // "RLMT"
+#define RATELIMIT_VERSION 2
+#define RATELIMIT_ACCOUNT_SLOTS BANK_CAPACITY   // one bucket per possible account id (direct index)
+#define RATELIMIT_CLIENT_SLOTS (1u << 16)       // hashed client buckets, power of two
+#define RATELIMIT_PROBE_LIMIT 16
+
+#define RATELIMIT_ACCOUNT 0             // key = source account id (transfers)
+#define RATELIMIT_CLIENT  1             // key = client IPv4 address (every request)
+#define RATELIMIT_KINDS   2
+
+#define RATELIMIT_OK        0           // token taken
+#define RATELIMIT_LIMITED   1           // bucket empty: reject (BANK_ERR_RATE_LIMITED)
+#define RATELIMIT_UNTRACKED 2           // no free or idle slot near the key / id out of range: allowed, not limited
+
+/*
+ * The bucket level is kept as a "theoretical arrival time" (GCRA): tokens =
+ * (now + burst_ns - tat) / interval. A full bucket is tat <= now, so a zeroed
+ * slot is a full bucket and refilling is just time passing. For the same reason
+ * a client slot whose tat has passed holds no state at all, and is handed to
+ * the next new address that probes it (addresses that come and go never fill
+ * the table for good).
+ */
+typedef struct {
+    volatile uint64_t key;              // key + 1, 0 = empty (client slots are reused once idle)
+    volatile uint64_t tat_ns;           // CLOCK_MONOTONIC
+} RateBucket;
+
+typedef struct {
+    uint32_t rate;                      // tokens per second (0 = kind off)
+    uint32_t burst;                     // bucket size
+    uint64_t interval_ns;               // 1e9 / rate
+    uint64_t burst_ns;                  // (burst - 1) * interval_ns
+    volatile uint64_t used;             // empty slots claimed so far
+    volatile uint64_t reclaimed;        // idle client slots handed to a new address
+    uint64_t reserved[3];
+} RateLimitKind;
+
+typedef struct {
+    uint32_t magic;                     // 0 once the server has removed the region
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t reserved2[7];
+    RateLimitKind kinds[RATELIMIT_KINDS];
+    RateBucket accounts[RATELIMIT_ACCOUNT_SLOTS] __attribute__((aligned(64)));
+    RateBucket clients[RATELIMIT_CLIENT_SLOTS] __attribute__((aligned(64)));
+} RateLimitShm;
+
+/**
+ * @brief Create the bucket table (Master, before forking). rate 0 turns a kind off.
+ * @return 0 on success, -1 on failure (the server then runs without limits).
+ */
+int ratelimit_init(uint32_t account_rate, uint32_t account_burst, uint32_t client_rate, uint32_t client_burst);
+void ratelimit_cleanup(void);
+
+/**
+ * @brief 1 if `kind` is limited in this process (inherited from the master).
+ */
+int ratelimit_enabled(int kind);
+
+/**
+ * @brief Take one token from the bucket of `key` (lock-free, any process).
+ *        ratelimit_take_at() uses the given CLOCK_MONOTONIC time instead of now.
+ * @return RATELIMIT_OK / RATELIMIT_LIMITED / RATELIMIT_UNTRACKED; OK when the kind is off.
+ */
+int ratelimit_take(int kind, uint64_t key);
+int ratelimit_take_at(int kind, uint64_t key, uint64_t now_ns);
+
+/**
+ * @brief Live region of this process, NULL if none.
+ */
+const RateLimitShm *ratelimit_region(void);
+
+#endif // RATELIMIT_H
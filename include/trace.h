@@ -0,0 +1,119 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Enable POSIX features
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// ============================================================================
+// Request Tracing (src/common/trace.c)
+// Sampled requests (1 in N, plus every request slower than a threshold) leave
+// their stage spans in a per-worker SHM ring; hsts-trace / the admin endpoint
+// / SIGUSR1 turn a snapshot of the rings into Chrome trace-event JSON.
+// ============================================================================
+#define TRACE_SHM_NAME "/hsts_trace"
+#define TRACE_MAGIC 0x54524345u     // "TRCE"
+#define TRACE_VERSION 1
+#define TRACE_MAX_WORKERS 16        // == METRICS_MAX_WORKERS
+#define TRACE_RING_SPANS 8192       // per worker, power of two (~1000 traced requests)
+#define TRACE_REQ_SPANS 16          // spans kept for one in-flight request
+
+#define TRACE_SPAN_REQUEST 0xFF     // TraceSpan.stage of the whole-request span
+
+// One span (32 bytes). Timestamps are CLOCK_MONOTONIC ns
+typedef struct {
+    uint64_t start_ns;
+    uint32_t dur_ns;                // saturates at ~4.29 s
+    uint32_t req;                   // per-worker request sequence number (groups spans)
+    uint8_t stage;                  // METRICS_STAGE_* or TRACE_SPAN_REQUEST
+    uint8_t op;                     // METRICS_OP_*
+    int16_t ret;                    // response code (request span)
+    uint8_t flags;                  // TRACE_FLAG_*
+    uint8_t reserved[3];
+    uint64_t reserved2;
+} TraceSpan;
+
+#define TRACE_FLAG_SAMPLED 0x01     // picked by the 1-in-N sampler
+#define TRACE_FLAG_SLOW    0x02     // total latency >= slow threshold
+
+// One worker's ring (single writer). head = spans ever written; slot = head % TRACE_RING_SPANS
+typedef struct {
+    volatile uint64_t head;
+    volatile uint32_t pid;
+    uint32_t reserved;
+    volatile uint64_t traced;       // requests written to the ring
+    uint64_t reserved2[5];
+    TraceSpan spans[TRACE_RING_SPANS];
+} __attribute__((aligned(64))) TraceRing;
+
+typedef struct {
+    uint32_t magic;                 // 0 once the server has removed the region
+    uint32_t version;
+    uint32_t size;
+    uint32_t nworkers;
+    uint32_t sample_every;          // 1 in N requests (0 = only slow ones)
+    uint32_t reserved;
+    uint64_t slow_ns;               // 0 = no slow-request capture
+    uint64_t start_ns;              // CLOCK_REALTIME at creation
+    uint64_t start_mono_ns;         // CLOCK_MONOTONIC at creation (trace time 0)
+    TraceRing rings[TRACE_MAX_WORKERS];
+} TraceShm;
+
+/**
+ * @brief Create the trace region (Master, before forking).
+ * @param sample_every Trace 1 in N requests of every worker (0 = none).
+ * @param slow_ns      Also trace every request at least this slow (0 = off).
+ * @return 0 on success, -1 on failure (the server then runs without tracing).
+ */
+int trace_init(int nworkers, uint32_t sample_every, uint64_t slow_ns);
+void trace_cleanup(void);
+
+/**
+ * @brief Claim ring `worker_id` for this (forked) worker process.
+ */
+void trace_bind_worker(int worker_id);
+
+/**
+ * @brief Worker hot path (called through the metrics stage API).
+ *        trace_req_begin() starts a request; trace_span() keeps one timed
+ *        stage (end_ns 0 = now); trace_req_end() writes the request's spans to
+ *        the ring if it was sampled or slow, otherwise just forgets them.
+ *        All no-ops when tracing is off.
+ */
+void trace_req_begin(void);
+void trace_span(int stage, uint64_t end_ns, uint64_t dur_ns);
+void trace_req_end(int op, int ret_code, const uint64_t *stage_ns, uint32_t stage_mask);
+int trace_enabled(void);
+
+/**
+ * @brief Reader side: map the region read-only and check magic / version.
+ */
+const TraceShm *trace_attach(char *err, size_t err_len);
+void trace_detach(const TraceShm *t);
+
+/**
+ * @brief Live region of this process (inherited from the master), NULL if none.
+ */
+const TraceShm *trace_region(void);
+
+/**
+ * @brief Copy the spans still in ring `worker` (oldest first), dropping any the
+ *        writer overwrote during the copy.
+ * @return Number of spans in `out` (at most TRACE_RING_SPANS).
+ */
+int trace_snapshot_ring(const TraceShm *t, int worker, TraceSpan *out);
+
+/**
+ * @brief Write every ring as Chrome / Perfetto trace-event JSON.
+ *        One process per worker; a traced request is a complete ("X") event with
+ *        its stages nested inside. `min_total_ns` > 0 keeps only requests at least
+ *        that slow.
+ * @return Number of requests written, -1 on error.
+ */
+int trace_write_chrome(const TraceShm *t, FILE *out, uint64_t min_total_ns);
+
+#endif // TRACE_H
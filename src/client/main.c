@@ -11,6 +11,7 @@
 #include <errno.h>
 #include <time.h>
 
+#include "metrics.h"
 #include "protocol.h"
 
 // ============================================================================
@@ -76,11 +77,11 @@ int connect_to_server() {
 }
 
 // ============================================================================
-// Helper: Send Packet and Receive Response
+// Helper: Send Packet and Receive Response Body
 // ============================================================================
-int send_and_receive(int sock, uint8_t op_code, const void* body, uint32_t body_len, int* ret_code) {
+int send_and_receive_body(int sock, uint8_t op_code, const void* body, uint32_t body_len,
+                          void** recv_body, uint32_t* recv_len) {
     PacketHeader send_header, recv_header;
-    void* recv_body = NULL;
 
     // --- Step 1: Prepare and Send Request ---
     send_header.magic = PROTOCOL_MAGIC;
@@ -114,18 +115,33 @@ int send_and_receive(int sock, uint8_t op_code, const void* body, uint32_t body_
     }
 
     // --- Step 2: Receive Response ---
-    if (protocol_read_packet(sock, &recv_header, &recv_body) < 0) {
+    if (protocol_read_packet(sock, &recv_header, recv_body) < 0) {
         fprintf(stderr, "[Client] Failed to read response\n");
         return -1;
     }
 
+    *recv_len = recv_header.body_len;
+    return 0;
+}
+
+// ============================================================================
+// Helper: Send Packet and Receive Response
+// ============================================================================
+int send_and_receive(int sock, uint8_t op_code, const void* body, uint32_t body_len, int* ret_code) {
+    void* recv_body = NULL;
+    uint32_t recv_len = 0;
+
+    if (send_and_receive_body(sock, op_code, body, body_len, &recv_body, &recv_len) < 0) {
+        return -1;
+    }
+
     // --- Step 3: Parse Response ---
-    if (recv_body && recv_header.body_len >= sizeof(int)) {
+    if (recv_body && recv_len >= sizeof(int)) {
         *ret_code = ntohl(*(int*)recv_body);
-        free(recv_body);
     } else {
         *ret_code = -1;
     }
+    free(recv_body);
 
     return 0;
 }
@@ -264,6 +280,95 @@ void interactive_transfer() {
     close(sock);
 }
 
+// ============================================================================
+// Interactive Mode: Bank Summary (Aggregate Scan)
+// ============================================================================
+void interactive_aggregate() {
+    int sock = connect_to_server();
+    if (sock < 0) {
+        fprintf(stderr, "[Client] Cannot connect to server\n");
+        return;
+    }
+
+    printf("\n=== Bank Summary ===\n");
+    printf("Low-balance threshold: ");
+    int threshold;
+    if (scanf("%d", &threshold) != 1) {
+        fprintf(stderr, "Invalid input\n");
+        close(sock);
+        return;
+    }
+
+    AggregateRequest req;
+    req.threshold = htonl(threshold);
+    req.hist_base = htonl(0);
+    req.hist_width = htonl(2000);
+
+    void* resp = NULL;
+    uint32_t resp_len = 0;
+    if (send_and_receive_body(sock, OP_AGGREGATE, &req, sizeof(req), &resp, &resp_len) < 0) {
+        fprintf(stderr, "[Client] Query failed\n");
+    } else if (resp_len != sizeof(AggregateBody)) {
+        int err = (resp && resp_len >= sizeof(int)) ? (int)ntohl(*(int*)resp) : -1;
+        printf("✗ Query failed. Error code: %d\n", err);
+    } else {
+        AggregateBody* agg = (AggregateBody*)resp;
+        printf("✓ Accounts: %u | Total: $%lld | Min: $%d | Max: $%d\n",
+               ntohl(agg->count), (long long)(int64_t)protocol_ntoh64(agg->total),
+               (int)ntohl(agg->min), (int)ntohl(agg->max));
+        printf("  Below $%d: %u account(s)\n", threshold, ntohl(agg->below));
+        for (int i = 0; i < AGG_HIST_BUCKETS; i++) {
+            uint32_t n = ntohl(agg->histogram[i]);
+            if (n > 0) printf("  [%6d, %6d): %u\n", i * 2000, (i + 1) * 2000, n);
+        }
+    }
+    free(resp);
+
+    close(sock);
+}
+
+// ============================================================================
+// Server Latency Stats (OP_STATS)
+// ============================================================================
+int show_server_stats() {
+    int sock = connect_to_server();
+    if (sock < 0) {
+        fprintf(stderr, "[Client] Cannot connect to server\n");
+        return 1;
+    }
+
+    void* resp = NULL;
+    uint32_t resp_len = 0;
+    int rc = 1;
+    if (send_and_receive_body(sock, OP_STATS, NULL, 0, &resp, &resp_len) < 0) {
+        fprintf(stderr, "[Client] Query failed\n");
+    } else if (resp_len < offsetof(StatsBody, entries)) {
+        int err = (resp && resp_len >= sizeof(int)) ? (int)ntohl(*(int*)resp) : -1;
+        printf("✗ Server stats unavailable. Error code: %d\n", err);
+    } else {
+        StatsBody* st = (StatsBody*)resp;
+        uint32_t n = ntohl(st->count);
+        if (resp_len < offsetof(StatsBody, entries) + n * sizeof(StatsEntry)) n = 0;
+        printf("Server latency (%u workers, since start, us):\n", ntohl(st->workers));
+        printf("%-10s %-10s %10s %9s %9s %9s %9s %9s %9s\n",
+               "OP", "STAGE", "count", "avg", "p50", "p90", "p99", "p99.9", "max");
+        for (uint32_t i = 0; i < n; i++) {
+            const StatsEntry* e = &st->entries[i];
+            uint64_t count = protocol_ntoh64(e->count);
+            printf("%-10s %-10s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                   metrics_op_name(metrics_op_index(e->op_code)), metrics_stage_name(e->stage),
+                   (unsigned long long)count, count ? protocol_ntoh64(e->sum_ns) / 1e3 / count : 0.0,
+                   protocol_ntoh64(e->p50_ns) / 1e3, protocol_ntoh64(e->p90_ns) / 1e3,
+                   protocol_ntoh64(e->p99_ns) / 1e3, protocol_ntoh64(e->p999_ns) / 1e3,
+                   protocol_ntoh64(e->max_ns) / 1e3);
+        }
+        rc = 0;
+    }
+    free(resp);
+    close(sock);
+    return rc;
+}
+
 // ============================================================================
 // Stress Test: Worker Thread
 // ============================================================================
@@ -404,7 +509,8 @@ void interactive_mode() {
         printf("1. Login\n");
         printf("2. Check Balance\n");
         printf("3. Transfer Money\n");
-        printf("4. Exit\n");
+        printf("4. Bank Summary\n");
+        printf("5. Exit\n");
         printf("========================================\n");
         printf("Enter your choice: ");
 
@@ -427,6 +533,9 @@ void interactive_mode() {
                 interactive_transfer();
                 break;
             case 4:
+                interactive_aggregate();
+                break;
+            case 5:
                 printf("\nGoodbye!\n");
                 return;
             default:
@@ -455,6 +564,9 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         run_stress_test(num_threads);
+    } else if (argc == 2 && strcmp(argv[1], "--stats") == 0) {
+        // Server-side latency percentiles per op / stage
+        return show_server_stats();
     } else if (argc == 1) {
         // Interactive mode
         interactive_mode();
@@ -464,6 +576,7 @@ int main(int argc, char *argv[]) {
         printf("  %s                    - Interactive mode\n", argv[0]);
         printf("  %s --stress          - Stress test with 100 threads\n", argv[0]);
         printf("  %s --stress <N>      - Stress test with N threads\n", argv[0]);
+        printf("  %s --stats           - Server latency percentiles per op / stage\n", argv[0]);
         return 1;
     }
 
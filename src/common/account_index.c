@@ -0,0 +1,121 @@
+#define _GNU_SOURCE
+
+#include "../../include/bank.h"
+#include <sched.h>
+
+/*
+ * Account Index: open-addressing hash table (linear probing) in shared memory
+ *
+ * - Lookup 完全不拿鎖：只做 acquire load，probe 到 key 相同或空格為止
+ * - Insert 用 CAS 佔住 key (0 -> ext_id)，再以 release store 發布 slot
+ *   讀者看到 key 但 slot 還是 PENDING 時，短暫等待發布完成
+ * - Entry 不會被移除 (關戶只把 slot 標成 DELETED)，所以 probe 鏈永遠不會斷
+ */
+
+#define INDEX_MASK (ACCOUNT_INDEX_CAPACITY - 1)
+#define PUBLISH_SPINS 1000
+
+// ============================================================================
+// Helper: 64-bit mixer (MurmurHash3 fmix64)
+// ============================================================================
+static inline uint32_t index_hash(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (uint32_t)k & INDEX_MASK;
+}
+
+// ============================================================================
+// Helper: Wait for an in-flight insert to publish its slot
+// ============================================================================
+static int wait_published(const AccountIndexEntry *e) {
+    for (int spin = 0; spin < PUBLISH_SPINS; spin++) {
+        int32_t slot = __atomic_load_n(&e->slot, __ATOMIC_ACQUIRE);
+        if (slot == INDEX_SLOT_DELETED) return BANK_ERR_INVALID_ID;
+        if (slot != INDEX_SLOT_PENDING) return slot;
+        sched_yield();
+    }
+    // 插入者在 CAS 之後死掉：視為不存在
+    return BANK_ERR_INVALID_ID;
+}
+
+void account_index_init(AccountIndex *idx) {
+    idx->count = 0;
+    for (uint32_t i = 0; i < ACCOUNT_INDEX_CAPACITY; i++) {
+        idx->entries[i].key = 0;
+        idx->entries[i].slot = INDEX_SLOT_PENDING;
+    }
+}
+
+// ============================================================================
+// Lookup (lock-free)
+// ============================================================================
+int account_index_lookup(const AccountIndex *idx, uint64_t key) {
+    if (key == 0) return BANK_ERR_INVALID_ID;
+
+    uint32_t pos = index_hash(key);
+    for (uint32_t probe = 0; probe < ACCOUNT_INDEX_CAPACITY; probe++) {
+        const AccountIndexEntry *e = &idx->entries[(pos + probe) & INDEX_MASK];
+        uint64_t k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+
+        if (k == key) return wait_published(e);
+        if (k == 0) break; // 空格 = 鏈的尾端
+    }
+    return BANK_ERR_INVALID_ID;
+}
+
+// ============================================================================
+// Insert (concurrent, CAS on key)
+// ============================================================================
+int account_index_insert(AccountIndex *idx, uint64_t key, int slot) {
+    if (key == 0 || slot < 0) return BANK_ERR_INVALID_ID;
+
+    uint32_t pos = index_hash(key);
+    for (uint32_t probe = 0; probe < ACCOUNT_INDEX_CAPACITY; probe++) {
+        AccountIndexEntry *e = &idx->entries[(pos + probe) & INDEX_MASK];
+        uint64_t k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+
+        if (k == 0) {
+            uint64_t expected = 0;
+            if (__atomic_compare_exchange_n(&e->key, &expected, key, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&e->slot, (int32_t)slot, __ATOMIC_RELEASE);
+                __atomic_fetch_add(&idx->count, 1, __ATOMIC_RELAXED);
+                return BANK_OK;
+            }
+            k = expected; // 被別人搶先，看看是不是同一個 key
+        }
+        if (k == key) {
+            // 已關閉的 external id 可以重新綁定
+            int32_t deleted = INDEX_SLOT_DELETED;
+            if (__atomic_compare_exchange_n(&e->slot, &deleted, (int32_t)slot, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return BANK_OK;
+            }
+            return BANK_ERR_DUPLICATE_ID;
+        }
+    }
+    return BANK_ERR_INDEX_FULL;
+}
+
+// ============================================================================
+// Remove (mark DELETED, key stays as a tombstone)
+// ============================================================================
+int account_index_remove(AccountIndex *idx, uint64_t key) {
+    if (key == 0) return BANK_ERR_INVALID_ID;
+
+    uint32_t pos = index_hash(key);
+    for (uint32_t probe = 0; probe < ACCOUNT_INDEX_CAPACITY; probe++) {
+        AccountIndexEntry *e = &idx->entries[(pos + probe) & INDEX_MASK];
+        uint64_t k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+
+        if (k == key) {
+            __atomic_store_n(&e->slot, INDEX_SLOT_DELETED, __ATOMIC_RELEASE);
+            return BANK_OK;
+        }
+        if (k == 0) break;
+    }
+    return BANK_ERR_INVALID_ID;
+}
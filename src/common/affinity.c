@@ -0,0 +1,149 @@
+// 檔案位置: src/common/affinity.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "../../include/affinity.h"
+
+/*
+ * CPU Pinning / NUMA Placement
+ *
+ * - Worker 被 scheduler 搬來搬去時，L1/L2 裡的帳戶表、自己的 log ring 都要重新暖；
+ *   固定在一顆 CPU 上就不會
+ * - NUMA：每個 Worker 自己的 SHM (log ring、trace ring) 要等 Worker 第一次寫才配頁，
+ *   所以只要先 pin 再開始工作，first-touch 就會放在 Worker 所在的 node。
+ *   全部 Worker 共用的帳戶表是 Master 初始化的 (頁面都在 Master 的 node)，
+ *   改成在 Worker 用到的 node 之間 interleave，避免所有 node 都擠去同一個記憶體控制器
+ * - 拓樸從 /sys/devices/system/node 讀；mbind 直接用 syscall，不需要 libnuma
+ */
+
+#define MPOL_INTERLEAVE_MODE 3           // <linux/mempolicy.h> MPOL_INTERLEAVE
+#define MPOL_MF_MOVE_FLAG (1 << 1)       // MPOL_MF_MOVE: 已經配好的頁面也搬
+
+static int g_cpu_node[AFFINITY_MAX_CPUS];
+static int g_nodes = -1;                 // -1 = 還沒讀 sysfs
+
+// "0-3,8,10-11" -> cpus (超過 max 的忽略)；回傳個數，格式錯誤 -1
+static int parse_cpulist(const char *list, int *cpus, int max) {
+    int n = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long a = strtol(p, &end, 10), b;
+        if (end == p || a < 0 || a >= AFFINITY_MAX_CPUS) return -1;
+        b = a;
+        if (*end == '-') {
+            p = end + 1;
+            b = strtol(p, &end, 10);
+            if (end == p || b < a || b >= AFFINITY_MAX_CPUS) return -1;
+        }
+        for (long c = a; c <= b && n < max; c++) cpus[n++] = (int)c;
+        if (*end == ',') end++;
+        else if (*end != '\0' && *end != '\n') return -1;
+        else if (*end == '\n') break;
+        p = end;
+    }
+    return n;
+}
+
+static void load_topology(void) {
+    if (g_nodes >= 0) return;
+    memset(g_cpu_node, 0, sizeof(g_cpu_node));
+    g_nodes = 1;
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+        char path[64], buf[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[len] = '\0';
+        static int cpus[AFFINITY_MAX_CPUS];
+        int n = parse_cpulist(buf, cpus, AFFINITY_MAX_CPUS);
+        for (int i = 0; i < n; i++) g_cpu_node[cpus[i]] = node;
+        if (node + 1 > g_nodes) g_nodes = node + 1;
+    }
+}
+
+int affinity_cpu_node(int cpu) {
+    load_topology();
+    return (cpu >= 0 && cpu < AFFINITY_MAX_CPUS) ? g_cpu_node[cpu] : 0;
+}
+
+int affinity_node_count(void) {
+    load_topology();
+    return g_nodes;
+}
+
+int affinity_parse(const char *list, int *cpus, int max) {
+    if (strcmp(list, "auto") != 0) return parse_cpulist(list, cpus, max);
+
+    // auto：目前允許的 CPU，同一個 node 的排在一起
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    load_topology();
+    int n = 0;
+    for (int node = 0; node < g_nodes; node++) {
+        for (int c = 0; c < AFFINITY_MAX_CPUS && c < CPU_SETSIZE && n < max; c++) {
+            if (CPU_ISSET(c, &set) && g_cpu_node[c] == node) cpus[n++] = c;
+        }
+    }
+    return n;
+}
+
+int affinity_pin(const int *cpus, int n) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < n; i++) {
+        if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) {
+            errno = EINVAL;
+            return -1;
+        }
+        CPU_SET(cpus[i], &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+int affinity_interleave(void *addr, size_t len, const int *cpus, int n) {
+    unsigned long mask[AFFINITY_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        int node = affinity_cpu_node(cpus[i]);
+        unsigned long bit = 1UL << (node % (8 * sizeof(unsigned long)));
+        unsigned long *word = &mask[node / (8 * sizeof(unsigned long))];
+        if (!(*word & bit)) used++;
+        *word |= bit;
+    }
+    if (used <= 1) return used;   // 單一 node：first-touch 已經是對的
+
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(page - 1);
+    size_t span = ((uintptr_t)addr + len - start + (size_t)page - 1) & ~(size_t)(page - 1);
+    if (syscall(SYS_mbind, (void *)start, span, MPOL_INTERLEAVE_MODE, mask, (unsigned long)AFFINITY_MAX_NODES + 1,
+                MPOL_MF_MOVE_FLAG) != 0) {
+        perror("[Affinity] mbind");
+        return -1;
+    }
+    return used;
+}
+
+void affinity_format(const int *cpus, int n, char *out, size_t out_len) {
+    size_t off = 0;
+    out[0] = '\0';
+    for (int i = 0; i < n && off < out_len; i++) {
+        int j = i;
+        while (j + 1 < n && cpus[j + 1] == cpus[j] + 1) j++;
+        int w = (j > i) ? snprintf(out + off, out_len - off, "%s%d-%d", off ? "," : "", cpus[i], cpus[j])
+                        : snprintf(out + off, out_len - off, "%s%d", off ? "," : "", cpus[i]);
+        if (w < 0) break;
+        off += (size_t)w;
+        i = j;
+    }
+}
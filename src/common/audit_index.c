@@ -0,0 +1,363 @@
+// 檔案位置: src/common/audit_index.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../include/logger.h"
+
+/*
+ * Audit Index: 每個 segment 一個 sidecar，account -> 紀錄的 byte offset
+ *
+ * - Logger 寫 segment 的同時在記憶體裡累積 (open addressing: account -> offset 陣列)
+ * - Segment 關閉 (rotation / shutdown) 時一次寫出：帳戶表依 id 排序，查詢用 binary search
+ * - Posting 只存 4 bytes 的 offset；時間過濾靠 header 的 [first_ts, last_ts] 先篩掉整個 segment
+ */
+
+_Static_assert(sizeof(AuditIndexHeader) == 64, "AuditIndexHeader must stay 64 bytes");
+_Static_assert(sizeof(AuditIndexAccount) == 16, "AuditIndexAccount must stay 16 bytes");
+
+typedef struct {
+    int32_t account_id;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *offsets;
+} PostingList;
+
+struct AuditIndexBuilder {
+    PostingList *slots;       // open addressing, account_id -> list
+    uint32_t cap;             // power of two
+    uint32_t used;
+    uint64_t postings;
+    uint64_t records;
+    uint64_t first_ts;
+    uint64_t last_ts;
+};
+
+#define INDEX_INITIAL_CAP 1024
+#define EMPTY_ACCOUNT INT32_MIN
+
+static inline uint32_t account_hash(int32_t id) {
+    return (uint32_t)id * 2654435761u;
+}
+
+// ============================================================================
+// Accounts touched by a record
+// ============================================================================
+int audit_record_accounts(const AuditRecord *r, int32_t ids[2]) {
+    if (r->flags & AUDIT_FLAG_DROPPED) return 0;
+
+    switch (r->op_code) {
+        case 0x30: // TRANSFER
+            ids[0] = r->src_id;
+            if (r->dst_id == r->src_id) return 1;
+            ids[1] = r->dst_id;
+            return 2;
+        case 0x20: // BALANCE
+        case 0x50: // BIND
+        case 0x51: // OPEN
+        case 0x52: // CLOSE
+            ids[0] = r->src_id;
+            return 1;
+        default:   // LOGIN / AGGREGATE / unknown: 沒有帳戶
+            return 0;
+    }
+}
+
+// ============================================================================
+// Builder (Logger side)
+// ============================================================================
+AuditIndexBuilder *audit_index_new(void) {
+    AuditIndexBuilder *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->cap = INDEX_INITIAL_CAP;
+    b->slots = malloc(sizeof(PostingList) * b->cap);
+    if (!b->slots) {
+        free(b);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < b->cap; i++) b->slots[i].account_id = EMPTY_ACCOUNT;
+    return b;
+}
+
+void audit_index_reset(AuditIndexBuilder *b) {
+    for (uint32_t i = 0; i < b->cap; i++) {
+        if (b->slots[i].account_id != EMPTY_ACCOUNT) free(b->slots[i].offsets);
+        b->slots[i].account_id = EMPTY_ACCOUNT;
+    }
+    b->used = 0;
+    b->postings = b->records = b->first_ts = b->last_ts = 0;
+}
+
+void audit_index_free(AuditIndexBuilder *b) {
+    if (!b) return;
+    audit_index_reset(b);
+    free(b->slots);
+    free(b);
+}
+
+static PostingList *find_slot(PostingList *slots, uint32_t cap, int32_t id) {
+    uint32_t pos = account_hash(id) & (cap - 1);
+    while (slots[pos].account_id != EMPTY_ACCOUNT && slots[pos].account_id != id) {
+        pos = (pos + 1) & (cap - 1);
+    }
+    return &slots[pos];
+}
+
+static int grow_table(AuditIndexBuilder *b) {
+    uint32_t new_cap = b->cap * 2;
+    PostingList *ns = malloc(sizeof(PostingList) * new_cap);
+    if (!ns) return -1;
+    for (uint32_t i = 0; i < new_cap; i++) ns[i].account_id = EMPTY_ACCOUNT;
+    for (uint32_t i = 0; i < b->cap; i++) {
+        if (b->slots[i].account_id != EMPTY_ACCOUNT) *find_slot(ns, new_cap, b->slots[i].account_id) = b->slots[i];
+    }
+    free(b->slots);
+    b->slots = ns;
+    b->cap = new_cap;
+    return 0;
+}
+
+static void add_posting(AuditIndexBuilder *b, int32_t id, uint32_t offset) {
+    if (id == EMPTY_ACCOUNT) return;
+    if ((b->used + 1) * 2 > b->cap && grow_table(b) != 0) return;
+
+    PostingList *pl = find_slot(b->slots, b->cap, id);
+    if (pl->account_id == EMPTY_ACCOUNT) {
+        pl->account_id = id;
+        pl->count = pl->cap = 0;
+        pl->offsets = NULL;
+        b->used++;
+    }
+    if (pl->count == pl->cap) {
+        uint32_t nc = pl->cap ? pl->cap * 2 : 8;
+        uint32_t *no = realloc(pl->offsets, sizeof(uint32_t) * nc);
+        if (!no) return;
+        pl->offsets = no;
+        pl->cap = nc;
+    }
+    pl->offsets[pl->count++] = offset;
+    b->postings++;
+}
+
+void audit_index_add(AuditIndexBuilder *b, const AuditRecord *r, uint32_t offset) {
+    if (!b) return;
+    if (b->records == 0 || r->ts_ns < b->first_ts) b->first_ts = r->ts_ns;
+    if (r->ts_ns > b->last_ts) b->last_ts = r->ts_ns;
+    b->records++;
+
+    int32_t ids[2];
+    int n = audit_record_accounts(r, ids);
+    for (int i = 0; i < n; i++) add_posting(b, ids[i], offset);
+}
+
+static int cmp_list(const void *a, const void *b) {
+    int32_t x = ((const PostingList *)a)->account_id, y = ((const PostingList *)b)->account_id;
+    return (x > y) - (x < y);
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int audit_index_write(const AuditIndexBuilder *b, const char *path, int format) {
+    if (!b || b->records == 0) return 0;
+
+    // 取出非空的 list，依 account id 排序
+    PostingList *lists = malloc(sizeof(PostingList) * (b->used ? b->used : 1));
+    AuditIndexAccount *accounts = malloc(sizeof(AuditIndexAccount) * (b->used ? b->used : 1));
+    if (!lists || !accounts) {
+        free(lists);
+        free(accounts);
+        return -1;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < b->cap; i++) {
+        if (b->slots[i].account_id != EMPTY_ACCOUNT) lists[n++] = b->slots[i];
+    }
+    qsort(lists, n, sizeof(PostingList), cmp_list);
+
+    uint64_t first = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        accounts[i].account_id = lists[i].account_id;
+        accounts[i].count = lists[i].count;
+        accounts[i].first = first;
+        first += lists[i].count;
+    }
+
+    AuditIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, AUDIT_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = AUDIT_INDEX_VERSION;
+    hdr.format = (uint32_t)format;
+    hdr.first_ts_ns = b->first_ts;
+    hdr.last_ts_ns = b->last_ts;
+    hdr.record_count = b->records;
+    hdr.posting_count = first;
+    hdr.account_count = n;
+
+    // tmp + rename：讀者永遠不會看到寫一半的 index
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int rc = -1;
+    if (fd != -1) {
+        rc = write_all(fd, &hdr, sizeof(hdr));
+        if (rc == 0) rc = write_all(fd, accounts, sizeof(AuditIndexAccount) * n);
+        for (uint32_t i = 0; i < n && rc == 0; i++) {
+            rc = write_all(fd, lists[i].offsets, sizeof(uint32_t) * lists[i].count);
+        }
+        close(fd);
+        if (rc == 0 && rename(tmp, path) == -1) rc = -1;
+        if (rc != 0) unlink(tmp);
+    }
+    if (rc != 0) perror("[AuditIndex] write failed");
+
+    free(lists);
+    free(accounts);
+    return rc;
+}
+
+// ============================================================================
+// Reader (query tool)
+// ============================================================================
+int audit_index_open(AuditIndex *idx, const char *path) {
+    memset(idx, 0, sizeof(*idx));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(AuditIndexHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    const AuditIndexHeader *h = p;
+    size_t need = sizeof(AuditIndexHeader) + (size_t)h->account_count * sizeof(AuditIndexAccount) +
+                  (size_t)h->posting_count * sizeof(uint32_t);
+    if (memcmp(h->magic, AUDIT_INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != AUDIT_INDEX_VERSION || need > (size_t)st.st_size) {
+        munmap(p, (size_t)st.st_size);
+        return -1;
+    }
+    idx->hdr = h;
+    idx->accounts = (const AuditIndexAccount *)(h + 1);
+    idx->postings = (const uint32_t *)(idx->accounts + h->account_count);
+    idx->map_size = (size_t)st.st_size;
+    return 0;
+}
+
+void audit_index_close(AuditIndex *idx) {
+    if (idx->hdr) munmap((void *)idx->hdr, idx->map_size);
+    memset(idx, 0, sizeof(*idx));
+}
+
+const uint32_t *audit_index_lookup(const AuditIndex *idx, int32_t account_id, uint32_t *count) {
+    uint32_t lo = 0, hi = idx->hdr->account_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int32_t id = idx->accounts[mid].account_id;
+        if (id == account_id) {
+            *count = idx->accounts[mid].count;
+            return idx->postings + idx->accounts[mid].first;
+        }
+        if (id < account_id) lo = mid + 1;
+        else hi = mid;
+    }
+    *count = 0;
+    return NULL;
+}
+
+// ============================================================================
+// Segment discovery: "<base>.NNNNNN"
+// ============================================================================
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// out[0..n) 是 max-heap：目前留下的 n 個最小編號，堆頂是其中最大的
+static void heap_sift_down(uint32_t *h, int n, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && h[l] > h[m]) m = l;
+        if (r < n && h[r] > h[m]) m = r;
+        if (m == i) return;
+        uint32_t t = h[i];
+        h[i] = h[m];
+        h[m] = t;
+        i = m;
+    }
+}
+
+static void heap_push(uint32_t *h, int *n, uint32_t v) {
+    int i = (*n)++;
+    h[i] = v;
+    while (i > 0 && h[(i - 1) / 2] < h[i]) {
+        uint32_t t = h[i];
+        h[i] = h[(i - 1) / 2];
+        h[(i - 1) / 2] = t;
+        i = (i - 1) / 2;
+    }
+}
+
+int audit_segment_list(const char *base, uint32_t *out, int max, uint32_t *last, int *total) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", base);
+    char *slash = strrchr(dir, '/');
+    const char *name;
+    if (slash) {
+        *slash = '\0';
+        name = base + (slash - dir) + 1;
+    } else {
+        snprintf(dir, sizeof(dir), ".");
+        name = base;
+    }
+    size_t name_len = strlen(name);
+    if (last) *last = 0;
+    if (total) *total = 0;
+
+    DIR *d = opendir(dir[0] ? dir : "/");
+    if (!d) return 0;
+    // readdir 的順序是任意的：整個目錄都要看完，最大編號另外記，最小的 max 個用 bounded heap 留下
+    int n = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        const char *s = de->d_name;
+        if (strncmp(s, name, name_len) != 0 || s[name_len] != '.') continue;
+        s += name_len + 1;
+        // 剛好 6 位數字 (排除 .idx / .tmp)
+        if (strlen(s) != 6 || strspn(s, "0123456789") != 6) continue;
+        uint32_t num = (uint32_t)strtoul(s, NULL, 10);
+        if (last && num > *last) *last = num;
+        if (total) (*total)++;
+        if (n < max) {
+            heap_push(out, &n, num);
+        } else if (max > 0 && num < out[0]) {
+            out[0] = num;
+            heap_sift_down(out, n, 0);
+        }
+    }
+    closedir(d);
+    qsort(out, n, sizeof(uint32_t), cmp_u32);
+    return n;
+}
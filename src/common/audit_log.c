@@ -0,0 +1,288 @@
+// 檔案位置: src/common/audit_log.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include "../../include/logger.h"
+
+/*
+ * Binary Audit Log: 固定 32 bytes 的紀錄，直接 append 到 mmap 的檔案
+ *
+ * - 檔案以 AUDIT_GROW_BYTES 為單位 ftruncate 長大，mapping 用 mremap 跟著長
+ * - 每批寫完才更新 header.record_count：當機後只認 count 以內的紀錄
+ * - 正常關閉時把檔案截到實際大小
+ * - 寫入路徑沒有任何格式化，解碼交給離線工具 (logdecode)
+ * - 加密 (--log-key)：append 時整批一次 AES-CTR (複製 + 加密同一趟)，
+ *   keystream 位置就是檔案 offset；header 本身不加密 (count / nonce 要可讀)
+ */
+
+_Static_assert(sizeof(AuditFileHeader) == 64, "AuditFileHeader must stay 64 bytes");
+_Static_assert(sizeof(AuditRecord) == 32, "AuditRecord must stay 32 bytes");
+
+#define RECORDS(hdr) ((AuditRecord *)((char *)(hdr) + sizeof(AuditFileHeader)))
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ============================================================================
+// Writer
+// ============================================================================
+static int audit_grow(AuditFile *af, size_t need) {
+    if (need <= af->map_size) return 0;
+
+    size_t new_size = af->map_size;
+    while (new_size < need) new_size += AUDIT_GROW_BYTES;
+    if (ftruncate(af->fd, (off_t)new_size) == -1) {
+        perror("[AuditLog] ftruncate failed");
+        return -1;
+    }
+    void *p = mremap(af->hdr, af->map_size, new_size, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED) {
+        perror("[AuditLog] mremap failed");
+        return -1;
+    }
+    af->hdr = p;
+    af->map_size = new_size;
+    return 0;
+}
+
+// 新檔案的 nonce：同一把 key 底下每個檔案 (segment) 都要不同
+static void audit_new_nonce(uint8_t nonce[8]) {
+    if (getrandom(nonce, 8, 0) == 8) return;
+    uint64_t v = realtime_ns() ^ ((uint64_t)getpid() << 40);
+    memcpy(nonce, &v, 8);
+}
+
+int audit_open(AuditFile *af, const char *path) {
+    return audit_open_encrypted(af, path, NULL);
+}
+
+int audit_open_encrypted(AuditFile *af, const char *path, const LogCipher *cipher) {
+    memset(af, 0, sizeof(*af));
+    af->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (af->fd == -1) {
+        perror("[AuditLog] Cannot open audit file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(af->fd, &st) == -1) goto fail;
+    int fresh = (st.st_size == 0);
+
+    size_t size = fresh ? AUDIT_GROW_BYTES : (size_t)st.st_size;
+    if (fresh && ftruncate(af->fd, (off_t)size) == -1) goto fail;
+
+    af->hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, af->fd, 0);
+    if (af->hdr == MAP_FAILED) goto fail;
+    af->map_size = size;
+
+    if (fresh) {
+        memcpy(af->hdr->magic, AUDIT_MAGIC, sizeof(af->hdr->magic));
+        af->hdr->version = AUDIT_VERSION;
+        af->hdr->record_size = sizeof(AuditRecord);
+        af->hdr->created_ns = realtime_ns();
+        af->hdr->record_count = 0;
+        if (cipher) {
+            af->hdr->cipher = AUDIT_CIPHER_AES128_CTR;
+            af->hdr->key_check = log_cipher_key_check(cipher);
+            audit_new_nonce(af->hdr->nonce);
+        }
+    } else if (size < sizeof(AuditFileHeader) ||
+               memcmp(af->hdr->magic, AUDIT_MAGIC, sizeof(af->hdr->magic)) != 0 ||
+               af->hdr->record_size != sizeof(AuditRecord)) {
+        fprintf(stderr, "[AuditLog] %s is not a v%d audit file\n", path, AUDIT_VERSION);
+        munmap(af->hdr, size);
+        goto fail;
+    } else if ((af->hdr->cipher != AUDIT_CIPHER_NONE) != (cipher != NULL) ||
+               (cipher && af->hdr->key_check != log_cipher_key_check(cipher))) {
+        // 同一個檔案不能一半明文一半密文，也不能換 key 接著寫
+        fprintf(stderr, "[AuditLog] %s: %s\n", path,
+                af->hdr->cipher == AUDIT_CIPHER_NONE ? "existing file is not encrypted"
+                : cipher ? "encrypted with a different key" : "existing file is encrypted");
+        munmap(af->hdr, size);
+        close(af->fd);
+        af->fd = -1;
+        af->hdr = NULL;
+        return -1;
+    } else {
+        // 接續寫：count 以後的資料 (當機時寫一半的) 一律忽略
+        uint64_t max = (size - sizeof(AuditFileHeader)) / sizeof(AuditRecord);
+        if (af->hdr->record_count > max) af->hdr->record_count = max;
+    }
+    af->cipher = cipher;
+    return 0;
+
+fail:
+    perror("[AuditLog] open failed");
+    close(af->fd);
+    af->fd = -1;
+    af->hdr = NULL;
+    return -1;
+}
+
+void audit_record_from_msg(AuditRecord *r, const LogMessage *msg) {
+    r->ts_ns = msg->ts_ns;
+    r->seq = msg->seq;
+    r->src_id = msg->src_id;
+    r->dst_id = msg->dst_id;
+    r->amount = msg->amount;
+    r->status = (int16_t)msg->status;
+    r->worker_id = msg->worker_id;
+    r->op_code = (uint8_t)msg->cmd_type;
+    r->flags = 0;
+    r->reserved = 0;
+}
+
+int audit_append(AuditFile *af, const AuditRecord *recs, int n) {
+    if (!af->hdr || n <= 0) return af->hdr ? 0 : -1;
+
+    uint64_t count = af->hdr->record_count;
+    size_t need = sizeof(AuditFileHeader) + (size_t)(count + n) * sizeof(AuditRecord);
+    if (audit_grow(af, need) != 0) return -1;
+
+    AuditRecord *dst = RECORDS(af->hdr) + count;
+    size_t len = (size_t)n * sizeof(AuditRecord);
+    if (af->cipher) {
+        log_cipher_ctr(af->cipher, af->hdr->nonce, (uint64_t)((char *)dst - (char *)af->hdr), recs, dst, len);
+    } else {
+        memcpy(dst, recs, len);
+    }
+
+    // 紀錄先寫好，最後才發布 count
+    __atomic_store_n(&af->hdr->record_count, count + (uint64_t)n, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void audit_close(AuditFile *af) {
+    if (!af->hdr) return;
+    size_t used = sizeof(AuditFileHeader) + (size_t)af->hdr->record_count * sizeof(AuditRecord);
+    munmap(af->hdr, af->map_size);
+    if (ftruncate(af->fd, (off_t)used) == -1) perror("[AuditLog] ftruncate failed");
+    close(af->fd);
+    af->hdr = NULL;
+    af->fd = -1;
+}
+
+// ============================================================================
+// Reader
+// ============================================================================
+static LogCipher g_read_cipher;
+static int g_read_key_loaded = 0;
+
+int audit_load_read_key(const char *key_path) {
+    uint8_t key[LOG_KEY_BYTES];
+    if (log_key_load(key_path, key) != 0) return -1;
+    log_cipher_init(&g_read_cipher, key);
+    memset(key, 0, sizeof(key));
+    g_read_key_loaded = 1;
+    return 0;
+}
+
+const AuditRecord *audit_map_readonly(const char *path, const AuditFileHeader **hdr,
+                                      uint64_t *count, size_t *map_size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(AuditFileHeader)) {
+        close(fd);
+        return NULL;
+    }
+    const AuditFileHeader *h = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    if (memcmp(h->magic, AUDIT_MAGIC, sizeof(h->magic)) != 0 || h->record_size != sizeof(AuditRecord)) {
+        munmap((void *)h, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+    uint64_t max = ((size_t)st.st_size - sizeof(AuditFileHeader)) / sizeof(AuditRecord);
+    uint64_t n = __atomic_load_n(&h->record_count, __ATOMIC_ACQUIRE);
+    if (n > max) n = max;
+
+    if (h->cipher != AUDIT_CIPHER_NONE) {
+        // 加密檔：改成 private mapping，直接在 (copy-on-write 的) 頁面上解密，呼叫端照樣拿到連續的紀錄
+        const char *why = h->cipher != AUDIT_CIPHER_AES128_CTR ? "unknown cipher"
+                        : !g_read_key_loaded ? "encrypted (pass --key <file>)"
+                        : h->key_check != log_cipher_key_check(&g_read_cipher) ? "encrypted with a different key"
+                        : NULL;
+        munmap((void *)h, (size_t)st.st_size);
+        if (why) {
+            fprintf(stderr, "[AuditLog] %s: %s\n", path, why);
+            close(fd);
+            return NULL;
+        }
+        AuditFileHeader *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        log_cipher_ctr(&g_read_cipher, p->nonce, sizeof(AuditFileHeader), RECORDS(p), RECORDS(p),
+                       (size_t)n * sizeof(AuditRecord));
+        h = p;
+    }
+    close(fd);
+
+    *hdr = h;
+    *count = n;
+    *map_size = (size_t)st.st_size;
+    return (const AuditRecord *)((const char *)h + sizeof(AuditFileHeader));
+}
+
+void audit_unmap(const AuditFileHeader *hdr, size_t map_size) {
+    if (hdr) munmap((void *)hdr, map_size);
+}
+
+// ============================================================================
+// Text rendering (shared by the text logger and the decoder)
+// ============================================================================
+const char *audit_op_name(int op_code, char *tmp, size_t tmp_len) {
+    switch (op_code) {
+        case 0x10: return "LOGIN";
+        case 0x20: return "BALANCE";
+        case 0x30: return "TRANSFER";
+        case 0x40: return "AGGREGATE";
+        case 0x50: return "BIND";
+        case 0x51: return "OPEN";
+        case 0x52: return "CLOSE";
+        default:
+            snprintf(tmp, tmp_len, "OP_%d", op_code);
+            return tmp;
+    }
+}
+
+const char *audit_time_str(AuditTimeCache *tc, uint64_t ts_ns) {
+    int64_t sec = (int64_t)(ts_ns / 1000000000ULL);
+    if (sec != tc->sec || tc->str[0] == '\0') {
+        time_t t = (time_t)sec;
+        struct tm tm_now;
+        localtime_r(&t, &tm_now);
+        strftime(tc->str, sizeof(tc->str), "%Y-%m-%d %H:%M:%S", &tm_now);
+        tc->sec = sec;
+    }
+    return tc->str;
+}
+
+int audit_format_text(char *out, size_t len, const AuditRecord *r, AuditTimeCache *tc) {
+    if (r->flags & AUDIT_FLAG_DROPPED) {
+        return snprintf(out, len, "[%s] LOGGER: %d records dropped (log ring full)\n",
+                        audit_time_str(tc, r->ts_ns), r->amount);
+    }
+    char op_tmp[20];
+    return snprintf(out, len, "[%s] CMD:%-10s | Status:%-8s | Src:%d -> Dst:%d | Amt:$%d\n",
+                    audit_time_str(tc, r->ts_ns), audit_op_name(r->op_code, op_tmp, sizeof(op_tmp)),
+                    r->status == 0 ? "SUCCESS" : "FAILED", r->src_id, r->dst_id, r->amount);
+}
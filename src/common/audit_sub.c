@@ -0,0 +1,325 @@
+// 檔案位置: src/common/audit_sub.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "../../include/logger.h"
+
+/*
+ * Audit Stream: Logger 把寫進 audit log 的紀錄，用 AuditRecord 原樣推給本機訂閱者
+ *
+ * - Unix domain SOCK_SEQPACKET：一個 frame = 一則訊息 (header + 最多 256 筆紀錄)，
+ *   non-blocking send 要嘛整則送出、要嘛 EAGAIN，不需要處理「送一半」
+ * - 每筆紀錄在這個 Logger (shard) 裡有一個遞增的 stream seq；最近 AUDIT_SUB_BACKLOG 筆
+ *   留在記憶體，訂閱者斷線後可以從 seq 接續 (epoch = 這個 Logger 啟動的時間，換了就代表 seq 重來)
+ * - 每個訂閱者只有一個 cursor：送不出去 (EAGAIN) 就停在那裡，下一批 / 下一個 tick 再補；
+ *   落後超過 backlog 就跳到最舊的一筆並標記 GAP —— 慢的訂閱者永遠不會卡住 Logger
+ */
+
+_Static_assert(sizeof(AuditSubRequest) == 24, "AuditSubRequest must stay 24 bytes");
+_Static_assert(sizeof(AuditSubFrame) == 40, "AuditSubFrame must stay 40 bytes");
+_Static_assert((AUDIT_SUB_BACKLOG & (AUDIT_SUB_BACKLOG - 1)) == 0, "AUDIT_SUB_BACKLOG must be a power of two");
+
+#define SUB_FREE      0
+#define SUB_HANDSHAKE 1   // 已 accept，等訂閱者送 AuditSubRequest
+#define SUB_STREAMING 2
+
+#define SUB_SNDBUF (1 << 20)          // 讓訂閱者短暫停頓時不會馬上 EAGAIN
+#define SUB_CLOSE_DRAIN_MS 1000       // 結束時最多等訂閱者收完這麼久
+
+typedef struct {
+    int fd;
+    int state;
+    uint64_t cursor;                  // 下一筆要送的 stream seq
+} Subscriber;
+
+static struct {
+    int listen_fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    uint16_t shard;
+    uint64_t epoch;
+    AuditRecord *backlog;             // ring：seq s 放在 backlog[s % AUDIT_SUB_BACKLOG]
+    uint64_t next_seq;                // 下一筆發布的 seq (第一筆 = 1)
+    Subscriber subs[AUDIT_SUB_MAX_CLIENTS];
+    // 統計 (結束時印出)
+    uint64_t served;
+    uint64_t sent;
+    uint64_t skipped;
+} g_sub = { .listen_fd = -1 };
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t oldest_seq(void) {
+    return g_sub.next_seq > AUDIT_SUB_BACKLOG ? g_sub.next_seq - AUDIT_SUB_BACKLOG : 1;
+}
+
+static void frame_init(AuditSubFrame *f, uint16_t flags, uint32_t count, uint64_t first_seq) {
+    memset(f, 0, sizeof(*f));
+    f->magic = AUDIT_SUB_MAGIC;
+    f->flags = flags;
+    f->shard = g_sub.shard;
+    f->count = count;
+    f->epoch = g_sub.epoch;
+    f->first_seq = first_seq;
+    f->head_seq = g_sub.next_seq;
+}
+
+static void sub_drop(Subscriber *s) {
+    close(s->fd);
+    s->fd = -1;
+    s->state = SUB_FREE;
+}
+
+// ============================================================================
+// Logger side
+// ============================================================================
+int audit_sub_listen(const char *path, int shard) {
+    if (g_sub.listen_fd != -1) return 0;
+    if (strlen(path) >= sizeof(g_sub.path)) {
+        fprintf(stderr, "[AuditSub] Socket path too long: %s\n", path);
+        return -1;
+    }
+    g_sub.backlog = malloc(sizeof(AuditRecord) * AUDIT_SUB_BACKLOG);
+    if (!g_sub.backlog) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("[AuditSub] socket failed");
+        free(g_sub.backlog);
+        g_sub.backlog = NULL;
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);   // 上次沒清掉的 socket 檔
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, AUDIT_SUB_MAX_CLIENTS) == -1) {
+        perror("[AuditSub] bind/listen failed");
+        close(fd);
+        free(g_sub.backlog);
+        g_sub.backlog = NULL;
+        return -1;
+    }
+    // 紀錄是帳務資料：只給 Server 的使用者 (與同 group 的下游服務)
+    chmod(path, 0660);
+
+    snprintf(g_sub.path, sizeof(g_sub.path), "%s", path);
+    g_sub.listen_fd = fd;
+    g_sub.shard = (uint16_t)shard;
+    g_sub.epoch = realtime_ns();
+    g_sub.next_seq = 1;
+    for (int i = 0; i < AUDIT_SUB_MAX_CLIENTS; i++) g_sub.subs[i].fd = -1;
+    return 0;
+}
+
+// 盡量把 cursor 推到 head；0 = 追上了 / 暫時送不出去, -1 = 訂閱者已經斷線
+static int sub_pump(Subscriber *s) {
+    while (s->cursor < g_sub.next_seq) {
+        uint16_t flags = 0;
+        uint64_t first = s->cursor;
+        if (first < oldest_seq()) {   // 落後太多：中間那段已經被覆蓋
+            first = oldest_seq();
+            flags |= AUDIT_SUB_FLAG_GAP;
+        }
+        uint64_t idx = first % AUDIT_SUB_BACKLOG;
+        uint64_t n = g_sub.next_seq - first;
+        if (n > AUDIT_SUB_BATCH_MAX) n = AUDIT_SUB_BATCH_MAX;
+        if (n > AUDIT_SUB_BACKLOG - idx) n = AUDIT_SUB_BACKLOG - idx;   // 不跨過 ring 的尾端
+
+        AuditSubFrame f;
+        frame_init(&f, flags, (uint32_t)n, first);
+        struct iovec iov[2] = {
+            { &f, sizeof(f) },
+            { &g_sub.backlog[idx], (size_t)n * sizeof(AuditRecord) }
+        };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = 2;
+        if (sendmsg(s->fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+            sub_drop(s);
+            return -1;
+        }
+        g_sub.skipped += first - s->cursor;
+        g_sub.sent += n;
+        s->cursor = first + n;
+    }
+    return 0;
+}
+
+// 握手：讀 AuditSubRequest，決定 cursor，回一個 HELLO frame
+static void sub_handshake(Subscriber *s) {
+    AuditSubRequest req;
+    ssize_t got = recv(s->fd, &req, sizeof(req), MSG_DONTWAIT);
+    if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (got != (ssize_t)sizeof(req) || req.magic != AUDIT_SUB_MAGIC || req.version != AUDIT_SUB_VERSION) {
+        sub_drop(s);
+        return;
+    }
+
+    uint16_t flags = AUDIT_SUB_FLAG_HELLO;
+    if (req.from_seq == 0) {
+        s->cursor = g_sub.next_seq;                 // 只要之後的新紀錄
+    } else if (req.epoch != 0 && req.epoch != g_sub.epoch) {
+        s->cursor = oldest_seq();                   // Logger 重啟過：舊的 seq 沒有意義
+        flags |= AUDIT_SUB_FLAG_EPOCH;
+    } else {
+        s->cursor = req.from_seq < g_sub.next_seq ? req.from_seq : g_sub.next_seq;
+    }
+
+    AuditSubFrame f;
+    frame_init(&f, flags, 0, oldest_seq());
+    if (send(s->fd, &f, sizeof(f), MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(f)) {
+        sub_drop(s);
+        return;
+    }
+    s->state = SUB_STREAMING;
+    g_sub.served++;
+    sub_pump(s);
+}
+
+void audit_sub_poll(void) {
+    if (g_sub.listen_fd == -1) return;
+
+    int fd;
+    while ((fd = accept4(g_sub.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        Subscriber *slot = NULL;
+        for (int i = 0; i < AUDIT_SUB_MAX_CLIENTS && !slot; i++)
+            if (g_sub.subs[i].state == SUB_FREE) slot = &g_sub.subs[i];
+        if (!slot) {
+            close(fd);   // 滿了：訂閱者會看到 EOF，之後再重連
+            continue;
+        }
+        int sndbuf = SUB_SNDBUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        slot->fd = fd;
+        slot->state = SUB_HANDSHAKE;
+    }
+
+    for (int i = 0; i < AUDIT_SUB_MAX_CLIENTS; i++) {
+        Subscriber *s = &g_sub.subs[i];
+        if (s->state == SUB_HANDSHAKE) sub_handshake(s);
+        else if (s->state == SUB_STREAMING) sub_pump(s);
+    }
+}
+
+void audit_sub_publish(const AuditRecord *recs, int n) {
+    if (g_sub.listen_fd == -1 || n <= 0) return;
+
+    for (int i = 0; i < n; i++) {
+        g_sub.backlog[g_sub.next_seq % AUDIT_SUB_BACKLOG] = recs[i];
+        g_sub.next_seq++;
+    }
+    for (int i = 0; i < AUDIT_SUB_MAX_CLIENTS; i++) {
+        if (g_sub.subs[i].state == SUB_STREAMING) sub_pump(&g_sub.subs[i]);
+    }
+}
+
+void audit_sub_close(void) {
+    if (g_sub.listen_fd == -1) return;
+
+    // 最後一批可能還卡在訂閱者的 socket buffer：給它們一點時間收完，EOF 才代表「全部送完了」
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < AUDIT_SUB_MAX_CLIENTS; i++) {
+        Subscriber *s = &g_sub.subs[i];
+        while (s->state == SUB_STREAMING && s->cursor < g_sub.next_seq) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long waited = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+            if (waited >= SUB_CLOSE_DRAIN_MS) break;
+            struct pollfd p = { .fd = s->fd, .events = POLLOUT };
+            poll(&p, 1, (int)(SUB_CLOSE_DRAIN_MS - waited));
+            sub_pump(s);
+        }
+        if (s->state != SUB_FREE) sub_drop(s);
+    }
+    close(g_sub.listen_fd);
+    g_sub.listen_fd = -1;
+    unlink(g_sub.path);
+    free(g_sub.backlog);
+    g_sub.backlog = NULL;
+}
+
+void audit_sub_stats(uint64_t *served, uint64_t *sent, uint64_t *skipped) {
+    *served = g_sub.served;
+    *sent = g_sub.sent;
+    *skipped = g_sub.skipped;
+}
+
+// ============================================================================
+// Subscriber side
+// ============================================================================
+int audit_sub_connect(const char *path, uint64_t from_seq, uint64_t epoch, AuditSubFrame *hello) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    AuditSubRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = AUDIT_SUB_MAGIC;
+    req.version = AUDIT_SUB_VERSION;
+    req.from_seq = from_seq;
+    req.epoch = epoch;
+    if (send(fd, &req, sizeof(req), MSG_NOSIGNAL) != (ssize_t)sizeof(req)) {
+        close(fd);
+        return -1;
+    }
+
+    // Logger 在下一個 tick 才會 accept / 回 HELLO
+    AuditSubFrame f;
+    ssize_t got;
+    while ((got = recv(fd, &f, sizeof(f), 0)) == -1 && errno == EINTR) {}
+    if (got != (ssize_t)sizeof(f) || f.magic != AUDIT_SUB_MAGIC || !(f.flags & AUDIT_SUB_FLAG_HELLO)) {
+        close(fd);
+        return -1;
+    }
+    if (hello) *hello = f;
+    return fd;
+}
+
+int audit_sub_read(int fd, AuditSubFrame *frame, AuditRecord *recs) {
+    struct iovec iov[2] = {
+        { frame, sizeof(*frame) },
+        { recs, sizeof(AuditRecord) * AUDIT_SUB_BATCH_MAX }
+    };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 2;
+
+    ssize_t got;
+    while ((got = recvmsg(fd, &mh, 0)) == -1 && errno == EINTR) {}
+    if (got <= 0) return -1;   // EOF = Logger 結束 (或把我們踢掉)
+    if ((size_t)got < sizeof(*frame) || frame->magic != AUDIT_SUB_MAGIC || frame->count > AUDIT_SUB_BATCH_MAX ||
+        (size_t)got != sizeof(*frame) + (size_t)frame->count * sizeof(AuditRecord)) {
+        errno = EPROTO;
+        return -1;
+    }
+    return (int)frame->count;
+}
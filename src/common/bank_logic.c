@@ -1,17 +1,63 @@
 #define _GNU_SOURCE
 
 #include "../../include/bank.h"
+#include "../../include/metrics.h"
 #include <errno.h>
 #include <stdio.h>
 #include <time.h>
 #include <semaphore.h> 
+#include <stdlib.h>
+#include <string.h>
+
+// 最近一次轉帳 / 清算在臨界區內取得的 CLOCK_MONOTONIC 時間 (本 thread)
+static __thread uint64_t g_commit_ns = 0;
+
+// --lock-profile：每把鎖的等待 / 持有時間進 metrics page 的 SpaceSaving (關閉時只多一個分支)
+static int g_lock_profile = 0;
+// 手上、而且在 sketch 裡的鎖 (取得時間 + slot)：清算一次最多鎖 2 * SETTLE_MAX_BATCH 個帳戶
+// 不在 sketch 裡又沒等到的鎖 (絕大多數) 不讀時鐘，只查一次本行程的小 hash
+static __thread struct { int32_t id; int hint; uint64_t t; } g_held[2 * SETTLE_MAX_BATCH + 1];
+static __thread int g_nheld = 0;
+
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int bank_lock_profile_enable(void) {
+    if (metrics_lock_profile_enable() != 0) return -1;
+    g_lock_profile = 1;
+    return 0;
+}
 
 /*
  * Helper: Robust mutex lock with recovery
  * This ensures the system remains available even if a worker crashes.
+ * 先 trylock：沒人搶的時候不讀時鐘 (lock stage 記 0)；真的要等才計時 (metrics 的 lock waits)
+ * id = 帳戶 id (alloc_lock 是 METRICS_LOCK_ALLOC)，只有 lock profiler 用得到
  */
-static int safe_lock(pthread_mutex_t *lock) {
-    int r = pthread_mutex_lock(lock);
+static int safe_lock(pthread_mutex_t *lock, int32_t id) {
+    uint64_t wait_ns = 0, now = 0;
+    int r = pthread_mutex_trylock(lock);
+    if (r == EBUSY) {
+        uint64_t t0 = mono_ns();
+        r = pthread_mutex_lock(lock);
+        now = mono_ns();
+        wait_ns = now - t0;
+        metrics_lock_wait(wait_ns);
+    } else {
+        metrics_stage_add(METRICS_STAGE_LOCK, 0);
+    }
+    if (g_lock_profile) {
+        int hint = metrics_lock_acquired(id, wait_ns);
+        if (hint >= 0 && g_nheld < (int)(sizeof(g_held) / sizeof(g_held[0]))) {
+            g_held[g_nheld].id = id;
+            g_held[g_nheld].hint = hint;
+            g_held[g_nheld].t = now ? now : mono_ns();
+            g_nheld++;
+        }
+    }
     if (r == EOWNERDEAD) {
         // [專業度] 標記系統已自動修復
         pthread_mutex_consistent(lock);
@@ -21,6 +67,70 @@ static int safe_lock(pthread_mutex_t *lock) {
     return 0;
 }
 
+// 本請求的期限 (CLOCK_REALTIME ns，0 = 沒有)：admission 等不到期限之前就放棄
+static __thread uint64_t g_deadline_ns = 0;
+
+void bank_set_deadline(uint64_t realtime_ns) {
+    g_deadline_ns = realtime_ns;
+}
+
+/*
+ * Helper: Admission control (lane = limit_sem 寫入 / read_sem 讀取)
+ * 先 sem_trywait：有空位就不計時；滿了才阻塞並把等待時間記進 metrics
+ * 有期限時用 sem_timedwait：期限前拿不到名額就回 BANK_ERR_OVERLOADED (client 早就不等了)
+ */
+static int admission_enter(sem_t *lane) {
+    if (sem_trywait(lane) == 0) {
+        metrics_stage_add(METRICS_STAGE_ADMISSION, 0);
+        return BANK_OK;
+    }
+    uint64_t t0 = mono_ns();
+    int r;
+    if (g_deadline_ns) {
+        struct timespec abs = { (time_t)(g_deadline_ns / 1000000000ull), (long)(g_deadline_ns % 1000000000ull) };
+        while ((r = sem_timedwait(lane, &abs)) != 0 && errno == EINTR) {
+        }
+    } else {
+        r = sem_wait(lane);
+    }
+    metrics_admission_wait(mono_ns() - t0);
+    if (r == 0) return BANK_OK;
+    return errno == ETIMEDOUT ? BANK_ERR_OVERLOADED : BANK_ERR_BUSY;
+}
+
+/*
+ * 兩條 lane 各自的併發上限 (Master 在 fork Worker 之前呼叫；之後重設會弄丟名額)
+ */
+int bank_set_lane_limits(int write_limit, int read_limit) {
+    BankMap *bank = get_bank_map();
+    if (!bank || write_limit < 1 || read_limit < 1) return BANK_ERR_INTERNAL;
+    sem_destroy(&bank->limit_sem);
+    sem_destroy(&bank->read_sem);
+    if (sem_init(&bank->limit_sem, 1, (unsigned)write_limit) != 0 ||
+        sem_init(&bank->read_sem, 1, (unsigned)read_limit) != 0) {
+        perror("[BankCore] sem_init (lanes) failed");
+        return BANK_ERR_INTERNAL;
+    }
+    return BANK_OK;
+}
+
+/*
+ * Helper: unlock (被 profile 的鎖記下持有時間；解鎖順序幾乎都是 LIFO，從最上面找)
+ */
+static void safe_unlock(pthread_mutex_t *lock, int32_t id) {
+    for (int i = g_nheld - 1; i >= 0; i--) {
+        if (g_held[i].id != id) continue;
+        metrics_lock_released(id, g_held[i].hint, mono_ns() - g_held[i].t);
+        g_held[i] = g_held[--g_nheld];
+        break;
+    }
+    pthread_mutex_unlock(lock);
+}
+
+uint64_t bank_last_commit_ns(void) {
+    return g_commit_ns;
+}
+
 /*
  * Bank Core: Transfer money from src_id to dst_id
  * Features:
@@ -30,12 +140,15 @@ static int safe_lock(pthread_mutex_t *lock) {
  */
 int bank_transfer(int src_id, int dst_id, int amount) {
     BankMap *bank = get_bank_map();
+    g_commit_ns = 0; // 沒進臨界區就失敗的請求沒有 commit 時間
     if (!bank) return BANK_ERR_INTERNAL;
 
     /* ---------- 0. Input Validation ---------- */
     // 嚴格檢查防止邏輯錯誤
-    if (src_id < 0 || src_id >= MAX_ACCOUNTS) return BANK_ERR_INVALID_ID;
-    if (dst_id < 0 || dst_id >= MAX_ACCOUNTS) return BANK_ERR_INVALID_ID;
+    Account *src, *dst;
+    int32_t *src_bal, *dst_bal;
+    if (bank_locate(src_id, &src, &src_bal) != BANK_OK) return BANK_ERR_INVALID_ID;
+    if (bank_locate(dst_id, &dst, &dst_bal) != BANK_OK) return BANK_ERR_INVALID_ID;
     if (src_id == dst_id) return BANK_ERR_SAME_ACCOUNT;
     if (amount <= 0) return BANK_ERR_INVALID_AMOUNT;
 
@@ -44,30 +157,31 @@ int bank_transfer(int src_id, int dst_id, int amount) {
      * 這能讓高併發請求排隊進入，達到「削峰填谷」的效果，
      * 避免在高負載下大量拒絕服務，提升整體 Throughput。
      */
-    if (sem_wait(&bank->limit_sem) != 0) {
-        return BANK_ERR_BUSY;
+    int adm = admission_enter(&bank->limit_sem);
+    if (adm != BANK_OK) {
+        return adm;
     }
 
-    Account *src = &bank->accounts[src_id];
-    Account *dst = &bank->accounts[dst_id];
-
     /* ---------- 2. Deadlock Prevention (Resource Ordering) ---------- */
     /* 演算法：總是先鎖 ID 小的帳戶 */
     Account *first  = (src_id < dst_id) ? src : dst;
     Account *second = (src_id < dst_id) ? dst : src;
 
-    safe_lock(&first->lock);
-    safe_lock(&second->lock);
+    safe_lock(&first->lock, (int32_t)first->id);
+    safe_lock(&second->lock, (int32_t)second->id);
 
     /* ---------- 3. Atomic Critical Section (ACID) ---------- */
     int result = BANK_OK;
+    g_commit_ns = mono_ns(); // 兩把鎖都在手上：這就是這筆交易的 commit 時間
 
-    if (src->balance < amount) {
+    if (src->state != ACCOUNT_OPEN || dst->state != ACCOUNT_OPEN) {
+        result = BANK_ERR_INVALID_ID; // 已關閉的帳戶
+    } else if (*src_bal < amount) {
         result = BANK_ERR_INSUFFICIENT;
     } else {
         // 執行轉帳
-        src->balance -= amount;
-        dst->balance += amount;
+        *src_bal -= amount;
+        *dst_bal += amount;
 
         // 更新 Metadata
         uint64_t now = (uint64_t)time(NULL);
@@ -79,8 +193,9 @@ int bank_transfer(int src_id, int dst_id, int amount) {
     }
 
     /* ---------- 4. Unlock (Reverse Order) ---------- */
-    pthread_mutex_unlock(&second->lock);
-    pthread_mutex_unlock(&first->lock);
+    safe_unlock(&second->lock, (int32_t)second->id);
+    safe_unlock(&first->lock, (int32_t)first->id);
+    metrics_stage_since(METRICS_STAGE_CRITICAL, g_commit_ns);
 
     /* ---------- 5. Release admission slot ---------- */
     sem_post(&bank->limit_sem);
@@ -88,6 +203,159 @@ int bank_transfer(int src_id, int dst_id, int amount) {
     return result;
 }
 
+/*
+ * Bank Core: Netting settlement
+ * 清算批次中同一對帳戶的來回轉帳大多會互相抵銷，所以：
+ *   1. 收集批次內所有出現的帳戶 (小型 hash 去重)，再依 id 排序
+ *   2. 依序 (由小到大) 一次鎖住全部帳戶 —— 跟 bank_transfer 同一個全域順序，不會死結
+ *   3. 在本地 shadow balance 上依到達順序逐筆套用 (每筆仍有自己的結果碼)
+ *   4. 只把淨額有變動的帳戶寫回 SHM
+ * 鎖的次數從每筆 2 次變成每批「不同帳戶數」次。
+ */
+#define SETTLE_MAX_DISTINCT (SETTLE_MAX_BATCH * 2)
+#define SETTLE_HASH_SIZE (SETTLE_MAX_DISTINCT * 2)   // power of two
+
+typedef struct {
+    int       m;                              // distinct accounts so far
+    int       id[SETTLE_MAX_DISTINCT];
+    Account  *acc[SETTLE_MAX_DISTINCT];
+    int32_t  *bal[SETTLE_MAX_DISTINCT];
+    int32_t   shadow[SETTLE_MAX_DISTINCT];
+    int       order[SETTLE_MAX_DISTINCT];     // distinct index sorted by account id
+    int       hkey[SETTLE_HASH_SIZE];         // account id, -1 = empty
+    int       hval[SETTLE_HASH_SIZE];         // distinct index
+} SettleSet;
+
+static int settle_intern(SettleSet *set, int id, Account *acc, int32_t *bal) {
+    uint32_t h = ((uint32_t)id * 2654435761u) & (SETTLE_HASH_SIZE - 1);
+    while (set->hkey[h] != -1) {
+        if (set->hkey[h] == id) return set->hval[h];
+        h = (h + 1) & (SETTLE_HASH_SIZE - 1);
+    }
+    int slot = set->m++;
+    set->hkey[h] = id;
+    set->hval[h] = slot;
+    set->id[slot] = id;
+    set->acc[slot] = acc;
+    set->bal[slot] = bal;
+    return slot;
+}
+
+static __thread const SettleSet *g_sort_set; // qsort 沒有 context 參數
+
+static int cmp_by_id(const void *a, const void *b) {
+    int x = g_sort_set->id[*(const int *)a], y = g_sort_set->id[*(const int *)b];
+    return (x > y) - (x < y);
+}
+
+int bank_settle(const SettleItem *items, int n, int *results) {
+    BankMap *bank = get_bank_map();
+    g_commit_ns = 0;
+    if (!bank || !items || !results || n < 0 || n > SETTLE_MAX_BATCH) return BANK_ERR_INTERNAL;
+
+    static __thread SettleSet set;
+    int src_slot[SETTLE_MAX_BATCH], dst_slot[SETTLE_MAX_BATCH];
+
+    set.m = 0;
+    memset(set.hkey, 0xFF, sizeof(set.hkey));
+
+    /* ---------- 0. Per-item validation (same rules as bank_transfer) ---------- */
+    for (int i = 0; i < n; i++) {
+        const SettleItem *it = &items[i];
+        Account *sa, *da;
+        int32_t *sb, *db;
+        results[i] = BANK_OK;
+        if (bank_locate(it->src_id, &sa, &sb) != BANK_OK ||
+            bank_locate(it->dst_id, &da, &db) != BANK_OK) results[i] = BANK_ERR_INVALID_ID;
+        else if (it->src_id == it->dst_id) results[i] = BANK_ERR_SAME_ACCOUNT;
+        else if (it->amount <= 0) results[i] = BANK_ERR_INVALID_AMOUNT;
+
+        if (results[i] == BANK_OK) {
+            src_slot[i] = settle_intern(&set, it->src_id, sa, sb);
+            dst_slot[i] = settle_intern(&set, it->dst_id, da, db);
+        }
+    }
+    if (set.m == 0) return 0;
+
+    /* ---------- 1. Distinct accounts in lock order ---------- */
+    for (int j = 0; j < set.m; j++) set.order[j] = j;
+    g_sort_set = &set;
+    qsort(set.order, set.m, sizeof(int), cmp_by_id);
+
+    /* ---------- 2. Admission + ordered lock pass ---------- */
+    int adm = admission_enter(&bank->limit_sem);
+    if (adm != BANK_OK) {
+        for (int i = 0; i < n; i++) if (results[i] == BANK_OK) results[i] = adm;
+        return 0;
+    }
+    for (int j = 0; j < set.m; j++) {
+        int k = set.order[j];
+        safe_lock(&set.acc[k]->lock, (int32_t)set.acc[k]->id);
+        set.shadow[k] = *set.bal[k];
+    }
+    uint64_t locked_at = metrics_stage_clock();
+
+    /* ---------- 3. Apply in arrival order on shadow balances ---------- */
+    int ok = 0;
+    for (int i = 0; i < n; i++) {
+        if (results[i] != BANK_OK) continue;
+        int s = src_slot[i], d = dst_slot[i];
+
+        if (set.acc[s]->state != ACCOUNT_OPEN || set.acc[d]->state != ACCOUNT_OPEN) {
+            results[i] = BANK_ERR_INVALID_ID;
+        } else if (set.shadow[s] < items[i].amount) {
+            results[i] = BANK_ERR_INSUFFICIENT;
+        } else {
+            set.shadow[s] -= items[i].amount;
+            set.shadow[d] += items[i].amount;
+            ok++;
+        }
+    }
+
+    /* ---------- 4. Write back net positions only ---------- */
+    g_commit_ns = mono_ns(); // 整批同一個 commit 時間
+    uint64_t now = (uint64_t)time(NULL);
+    for (int k = 0; k < set.m; k++) {
+        if (set.shadow[k] != *set.bal[k]) {
+            *set.bal[k] = set.shadow[k];
+            set.acc[k]->last_updated = now;
+        }
+    }
+    __sync_fetch_and_add(&bank->total_transactions, ok);
+
+    for (int j = set.m - 1; j >= 0; j--) {
+        Account *acc = set.acc[set.order[j]];
+        safe_unlock(&acc->lock, (int32_t)acc->id);
+    }
+    metrics_stage_since(METRICS_STAGE_CRITICAL, locked_at);
+    sem_post(&bank->limit_sem);
+
+    return ok;
+}
+
+/*
+ * Bank Core: Idempotent transfer (client retries)
+ * 同一把 128-bit key 在視窗內重送時，直接回傳第一次的結果，
+ * 不會再扣款，也不會碰任何帳戶鎖或 admission semaphore。
+ */
+int bank_transfer_idem(const uint8_t key[16], int src_id, int dst_id, int amount, int *replayed) {
+    BankMap *bank = get_bank_map();
+    g_commit_ns = 0;
+    if (!bank || !key) return BANK_ERR_INTERNAL;
+
+    IdemEntry *entry = NULL;
+    int result = BANK_OK;
+    int r = idem_begin(&bank->idem, key, (uint32_t)time(NULL), &entry, &result);
+
+    if (replayed) *replayed = (r == IDEM_DUPLICATE);
+    if (r == IDEM_DUPLICATE) return result;
+    if (r != IDEM_NEW) return r;
+
+    result = bank_transfer(src_id, dst_id, amount);
+    idem_complete(entry, result);
+    return result;
+}
+
 /*
  * Bank Core: Query account balance
  * Consistent Read using locks
@@ -96,15 +364,200 @@ int bank_get_balance(int account_id, int *balance) {
     BankMap *bank = get_bank_map();
     if (!bank || !balance) return BANK_ERR_INTERNAL;
 
-    if (account_id < 0 || account_id >= MAX_ACCOUNTS)
+    Account *acc;
+    int32_t *bal;
+    if (bank_locate(account_id, &acc, &bal) != BANK_OK)
         return BANK_ERR_INVALID_ID;
 
-    Account *acc = &bank->accounts[account_id];
+    // 讀取 lane：跟轉帳的名額 (limit_sem) 分開，轉帳再多也排不到讀取前面
+    int result = BANK_OK;
+    int adm = admission_enter(&bank->read_sem);
+    if (adm != BANK_OK) return adm;
 
     // 讀取也要加鎖，避免讀到 "Dirty Read" (轉帳中間狀態)
-    safe_lock(&acc->lock);
-    *balance = acc->balance;
-    pthread_mutex_unlock(&acc->lock);
+    safe_lock(&acc->lock, (int32_t)acc->id);
+    if (acc->state != ACCOUNT_OPEN) result = BANK_ERR_INVALID_ID;
+    else *balance = *bal;
+    safe_unlock(&acc->lock, (int32_t)acc->id);
+    sem_post(&bank->read_sem);
+
+    return result;
+}
+
+/*
+ * Bank Core: Open a new account (online, no restart)
+ * - 從 SHM free list 取一個 slot；free list 空了就長出新的 extent
+ * - ext_id != 0 時同時綁定 external account number
+ * - initial_balance 只給 Master / 測試這種 operator 路徑用；網路上的 OP_OPEN_ACCOUNT 一律傳 0
+ * Return: 新帳戶 id (>= 0) 或錯誤碼
+ */
+int bank_open_account(uint64_t ext_id, int initial_balance) {
+    BankMap *bank = get_bank_map();
+    if (!bank) return BANK_ERR_INTERNAL;
+    if (initial_balance < 0) return BANK_ERR_INVALID_AMOUNT;
+
+    /* ---------- 1. Allocate slot ---------- */
+    safe_lock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
+    if (bank->free_head < 0) {
+        int r = bank_create_extent();
+        if (r != BANK_OK) {
+            safe_unlock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
+            return r;
+        }
+    }
+    int id = bank->free_head;
+    bank->free_head = bank->free_next[id];
+    safe_unlock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
+
+    Account *acc;
+    int32_t *bal;
+    if (bank_locate(id, &acc, &bal) != BANK_OK) return BANK_ERR_INTERNAL;
+
+    /* ---------- 2. Claim external id (若重複就把 slot 還回去) ---------- */
+    if (ext_id != 0) {
+        int r = account_index_insert(&bank->index, ext_id, id);
+        if (r != BANK_OK) {
+            safe_lock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
+            bank->free_next[id] = bank->free_head;
+            bank->free_head = id;
+            safe_unlock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
+            return r;
+        }
+    }
+
+    /* ---------- 3. Publish account ---------- */
+    safe_lock(&acc->lock, (int32_t)acc->id);
+    *bal = initial_balance;
+    acc->ext_id = ext_id;
+    acc->last_updated = (uint64_t)time(NULL);
+    acc->state = ACCOUNT_OPEN;
+    safe_unlock(&acc->lock, (int32_t)acc->id);
+
+    metrics_bank_accounts(__sync_add_and_fetch(&bank->open_accounts, 1), bank->extent_count);
+    return id;
+}
+
+/*
+ * Bank Core: Close an account
+ * 餘額必須為 0 (錢不能憑空消失)，關閉後 slot 回到 free list 供重複使用
+ */
+int bank_close_account(int account_id) {
+    BankMap *bank = get_bank_map();
+    if (!bank) return BANK_ERR_INTERNAL;
+
+    Account *acc;
+    int32_t *bal;
+    if (bank_locate(account_id, &acc, &bal) != BANK_OK) return BANK_ERR_INVALID_ID;
+
+    safe_lock(&acc->lock, (int32_t)acc->id);
+    if (acc->state != ACCOUNT_OPEN) {
+        safe_unlock(&acc->lock, (int32_t)acc->id);
+        return BANK_ERR_INVALID_ID;
+    }
+    if (*bal != 0) {
+        safe_unlock(&acc->lock, (int32_t)acc->id);
+        return BANK_ERR_NONZERO_BALANCE;
+    }
+    uint64_t ext_id = acc->ext_id;
+    acc->state = ACCOUNT_CLOSED;
+    acc->ext_id = 0;
+    acc->last_updated = (uint64_t)time(NULL);
+    safe_unlock(&acc->lock, (int32_t)acc->id);
+
+    if (ext_id != 0) account_index_remove(&bank->index, ext_id);
+
+    safe_lock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
+    bank->free_next[account_id] = bank->free_head;
+    bank->free_head = account_id;
+    safe_unlock(&bank->alloc_lock, METRICS_LOCK_ALLOC);
 
+    metrics_bank_accounts(__sync_sub_and_fetch(&bank->open_accounts, 1), bank->extent_count);
     return BANK_OK;
-}
\ No newline at end of file
+}
+
+/*
+ * Bank Core: Resolve a sparse 64-bit external account number
+ * Lock-free: 只讀 SHM 中的 hash index，不碰任何帳戶鎖
+ */
+int bank_resolve_ext_id(uint64_t ext_id) {
+    BankMap *bank = get_bank_map();
+    if (!bank) return BANK_ERR_INTERNAL;
+
+    return account_index_lookup(&bank->index, ext_id);
+}
+
+/*
+ * Bank Core: Bind an external account number to an existing account
+ * 一個 external id 只能綁定一次 (BANK_ERR_DUPLICATE_ID)
+ */
+int bank_bind_ext_id(uint64_t ext_id, int account_id) {
+    BankMap *bank = get_bank_map();
+    if (!bank) return BANK_ERR_INTERNAL;
+
+    Account *acc;
+    if (bank_locate(account_id, &acc, NULL) != BANK_OK)
+        return BANK_ERR_INVALID_ID;
+
+    // 每個帳戶最多綁一個 external id (關戶時才能解除)
+    safe_lock(&acc->lock, (int32_t)acc->id);
+    int result = BANK_OK;
+    if (acc->state != ACCOUNT_OPEN) result = BANK_ERR_INVALID_ID;
+    else if (acc->ext_id != 0) result = BANK_ERR_DUPLICATE_ID;
+    else {
+        result = account_index_insert(&bank->index, ext_id, account_id);
+        if (result == BANK_OK) acc->ext_id = ext_id;
+    }
+    safe_unlock(&acc->lock, (int32_t)acc->id);
+
+    return result;
+}
+
+/*
+ * Bank Core: Bank-wide aggregate scan
+ * 直接掃描連續的 balances[] (base segment + 每個 extent)，不拿任何帳戶鎖。
+ * 結果是 fuzzy snapshot：轉帳中途被掃到時 total 可能差一筆的金額。
+ * 只算 OPEN 的帳戶：把每段連續 OPEN 的 slot 交給 SIMD kernel，關閉 / 還沒開的 slot 跳過
+ * (沒有帳戶關閉時，整個 segment 仍然是一次 kernel 呼叫)
+ */
+static void merge_aggregate(BankAggregate *out, const BankAggregate *part) {
+    if (part->count == 0) return;
+    if (out->count == 0 || part->min < out->min) out->min = part->min;
+    if (out->count == 0 || part->max > out->max) out->max = part->max;
+    out->count += part->count;
+    out->total += part->total;
+    out->below += part->below;
+    for (int i = 0; i < BANK_HIST_BUCKETS; i++) out->histogram[i] += part->histogram[i];
+}
+
+static void scan_open_runs(const Account *accs, const int32_t *bal, size_t n, const BankScanParams *params,
+                           BankAggregate *out) {
+    size_t i = 0;
+    while (i < n) {
+        while (i < n && __atomic_load_n(&accs[i].state, __ATOMIC_RELAXED) != ACCOUNT_OPEN) i++;
+        size_t run = i;
+        while (i < n && __atomic_load_n(&accs[i].state, __ATOMIC_RELAXED) == ACCOUNT_OPEN) i++;
+        if (i > run) {
+            BankAggregate part;
+            bank_scan_balances(bal + run, i - run, params, &part);
+            merge_aggregate(out, &part);
+        }
+    }
+}
+
+int bank_aggregate(const BankScanParams *params, BankAggregate *out) {
+    BankMap *bank = get_bank_map();
+    if (!bank || !params || !out) return BANK_ERR_INTERNAL;
+
+    memset(out, 0, sizeof(*out));
+    scan_open_runs(bank->accounts, bank->balances, MAX_ACCOUNTS, params, out);
+
+    uint32_t extents = __atomic_load_n(&bank->extent_count, __ATOMIC_ACQUIRE);
+    for (uint32_t n = 0; n < extents; n++) {
+        Account *acc;
+        int32_t *bal;
+        if (bank_locate(MAX_ACCOUNTS + (int)(n * EXTENT_ACCOUNTS), &acc, &bal) != BANK_OK)
+            return BANK_ERR_INTERNAL;
+        scan_open_runs(acc, bal, EXTENT_ACCOUNTS, params, out);
+    }
+    return BANK_OK;
+}
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+
+#include "../../include/bank.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/*
+ * Bank Scan: total / min / max / below-threshold / histogram over int32 balances
+ *
+ * 所有「計數」都化成同一個問題：count(v < bound)。
+ *   - below        = count(v < threshold)
+ *   - histogram[k] = count(v < bound[k+1]) - count(v < bound[k])
+ * 這樣 SIMD 版本只需要 compare + subtract，不需要向量除法或 scatter。
+ */
+
+#define SCAN_MAX_BOUNDS (BANK_HIST_BUCKETS) // threshold + (BUCKETS - 1) edges
+
+typedef struct {
+    int     nb;                        // number of in-range bounds
+    int32_t bound[SCAN_MAX_BOUNDS];
+    int     slot[SCAN_MAX_BOUNDS];     // -1 = threshold, k = histogram edge k
+    int32_t hist_base;                 // scalar kernel buckets by division instead
+    int32_t hist_width;
+} ScanBounds;
+
+typedef void (*scan_kernel_fn)(const int32_t *b, size_t n, const ScanBounds *sb,
+                               int64_t *total, int32_t *mn, int32_t *mx, uint64_t *lt);
+
+// ============================================================================
+// Helper: Build the list of compare bounds
+// ============================================================================
+/* Edge k (1..BUCKETS-1) = base + k*width, computed in 64-bit.
+ * Edges above INT32_MAX count everything, edges at/below INT32_MIN count nothing,
+ * so only in-range edges need a vector compare. */
+static void build_bounds(const BankScanParams *p, ScanBounds *sb,
+                         int64_t edge_lt_all[BANK_HIST_BUCKETS]) {
+    sb->nb = 0;
+    sb->hist_base = p->hist_base;
+    sb->hist_width = p->hist_width;
+    sb->bound[sb->nb] = p->threshold;
+    sb->slot[sb->nb++] = -1;
+
+    for (int k = 0; k < BANK_HIST_BUCKETS; k++) edge_lt_all[k] = 0;
+    if (p->hist_width <= 0) return;
+
+    for (int k = 1; k < BANK_HIST_BUCKETS; k++) {
+        int64_t edge = (int64_t)p->hist_base + (int64_t)k * p->hist_width;
+        if (edge > INT32_MAX) {
+            edge_lt_all[k] = 1;     // every value is below this edge
+        } else if (edge <= INT32_MIN) {
+            edge_lt_all[k] = -1;    // no value is below this edge
+        } else {
+            sb->bound[sb->nb] = (int32_t)edge;
+            sb->slot[sb->nb++] = k;
+        }
+    }
+}
+
+// ============================================================================
+// Kernel: Scalar Fallback
+// ============================================================================
+static void scan_scalar(const int32_t *b, size_t n, const ScanBounds *sb,
+                        int64_t *total, int32_t *mn, int32_t *mx, uint64_t *lt) {
+    int64_t sum = 0;
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+    int32_t threshold = sb->bound[0];
+    uint64_t below = 0;
+    uint64_t bucket[BANK_HIST_BUCKETS] = {0};
+
+    /* 純量版用除法直接算 bucket，比逐一比較 16 個邊界快；
+     * 最後再把 bucket 計數轉回 count(v < edge) 的形式 */
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = b[i];
+        sum += v;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+        below += (v < threshold);
+        if (sb->hist_width > 0) {
+            int64_t k = 0;
+            if (v >= sb->hist_base) k = ((int64_t)v - sb->hist_base) / sb->hist_width;
+            if (k >= BANK_HIST_BUCKETS) k = BANK_HIST_BUCKETS - 1;
+            bucket[k]++;
+        }
+    }
+
+    *total += sum;
+    if (lo < *mn) *mn = lo;
+    if (hi > *mx) *mx = hi;
+    lt[0] += below;
+
+    // count(v < edge k) = bucket[0] + ... + bucket[k-1]
+    for (int j = 1; j < sb->nb; j++) {
+        uint64_t c = 0;
+        for (int k = 0; k < sb->slot[j]; k++) c += bucket[k];
+        lt[j] += c;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+/* Lane counters are 32-bit; flush them into the 64-bit totals every
+ * SCAN_CHUNK vectors so a lane can never wrap. */
+#define SCAN_CHUNK (1u << 24)
+
+// ============================================================================
+// Kernel: SSE4.1 (4 x int32 per iteration)
+// ============================================================================
+__attribute__((target("sse4.1")))
+static void scan_sse41(const int32_t *b, size_t n, const ScanBounds *sb,
+                       int64_t *total, int32_t *mn, int32_t *mx, uint64_t *lt) {
+    __m128i vmin = _mm_set1_epi32(INT32_MAX);
+    __m128i vmax = _mm_set1_epi32(INT32_MIN);
+    __m128i vsum = _mm_setzero_si128();     // 2 x int64
+    __m128i vbound[SCAN_MAX_BOUNDS];
+    __m128i vcnt[SCAN_MAX_BOUNDS];
+    size_t i = 0;
+
+    for (int j = 0; j < sb->nb; j++) vbound[j] = _mm_set1_epi32(sb->bound[j]);
+
+    while (i + 4 <= n) {
+        size_t end = n - ((n - i) % 4);
+        if ((end - i) / 4 > SCAN_CHUNK) end = i + (size_t)SCAN_CHUNK * 4;
+
+        for (int j = 0; j < sb->nb; j++) vcnt[j] = _mm_setzero_si128();
+
+        for (; i < end; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(b + i));
+            vmin = _mm_min_epi32(vmin, v);
+            vmax = _mm_max_epi32(vmax, v);
+            vsum = _mm_add_epi64(vsum, _mm_cvtepi32_epi64(v));
+            vsum = _mm_add_epi64(vsum, _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+            // cmpgt 結果是 -1，減掉等於 +1
+            for (int j = 0; j < sb->nb; j++) {
+                vcnt[j] = _mm_sub_epi32(vcnt[j], _mm_cmpgt_epi32(vbound[j], v));
+            }
+        }
+
+        for (int j = 0; j < sb->nb; j++) {
+            uint32_t c[4];
+            _mm_storeu_si128((__m128i *)c, vcnt[j]);
+            lt[j] += (uint64_t)c[0] + c[1] + c[2] + c[3];
+        }
+    }
+
+    int32_t m[4];
+    int64_t s[2];
+    _mm_storeu_si128((__m128i *)m, vmin);
+    for (int k = 0; k < 4; k++) if (m[k] < *mn) *mn = m[k];
+    _mm_storeu_si128((__m128i *)m, vmax);
+    for (int k = 0; k < 4; k++) if (m[k] > *mx) *mx = m[k];
+    _mm_storeu_si128((__m128i *)s, vsum);
+    *total += s[0] + s[1];
+
+    // Tail (< 4 elements)
+    scan_scalar(b + i, n - i, sb, total, mn, mx, lt);
+}
+
+// ============================================================================
+// Kernel: AVX2 (8 x int32 per iteration)
+// ============================================================================
+__attribute__((target("avx2")))
+static void scan_avx2(const int32_t *b, size_t n, const ScanBounds *sb,
+                      int64_t *total, int32_t *mn, int32_t *mx, uint64_t *lt) {
+    __m256i vmin = _mm256_set1_epi32(INT32_MAX);
+    __m256i vmax = _mm256_set1_epi32(INT32_MIN);
+    __m256i vsum = _mm256_setzero_si256();  // 4 x int64
+    __m256i vbound[SCAN_MAX_BOUNDS];
+    __m256i vcnt[SCAN_MAX_BOUNDS];
+    size_t i = 0;
+
+    for (int j = 0; j < sb->nb; j++) vbound[j] = _mm256_set1_epi32(sb->bound[j]);
+
+    while (i + 8 <= n) {
+        size_t end = n - ((n - i) % 8);
+        if ((end - i) / 8 > SCAN_CHUNK) end = i + (size_t)SCAN_CHUNK * 8;
+
+        for (int j = 0; j < sb->nb; j++) vcnt[j] = _mm256_setzero_si256();
+
+        for (; i < end; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(b + i));
+            vmin = _mm256_min_epi32(vmin, v);
+            vmax = _mm256_max_epi32(vmax, v);
+            vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+            vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+            for (int j = 0; j < sb->nb; j++) {
+                vcnt[j] = _mm256_sub_epi32(vcnt[j], _mm256_cmpgt_epi32(vbound[j], v));
+            }
+        }
+
+        for (int j = 0; j < sb->nb; j++) {
+            uint32_t c[8];
+            _mm256_storeu_si256((__m256i *)c, vcnt[j]);
+            for (int k = 0; k < 8; k++) lt[j] += c[k];
+        }
+    }
+
+    int32_t m[8];
+    int64_t s[4];
+    _mm256_storeu_si256((__m256i *)m, vmin);
+    for (int k = 0; k < 8; k++) if (m[k] < *mn) *mn = m[k];
+    _mm256_storeu_si256((__m256i *)m, vmax);
+    for (int k = 0; k < 8; k++) if (m[k] > *mx) *mx = m[k];
+    _mm256_storeu_si256((__m256i *)s, vsum);
+    *total += s[0] + s[1] + s[2] + s[3];
+
+    // Tail (< 8 elements)
+    scan_scalar(b + i, n - i, sb, total, mn, mx, lt);
+}
+#endif // HAVE_X86_SIMD
+
+// ============================================================================
+// Runtime Dispatch
+// ============================================================================
+static scan_kernel_fn g_kernel = NULL;
+static const char *g_kernel_name = "scalar";
+
+static int isa_supported(int isa) {
+    switch (isa) {
+        case BANK_SCAN_SCALAR: return 1;
+#ifdef HAVE_X86_SIMD
+        case BANK_SCAN_SSE41:  return __builtin_cpu_supports("sse4.1");
+        case BANK_SCAN_AVX2:   return __builtin_cpu_supports("avx2");
+#endif
+        default: return 0;
+    }
+}
+
+int bank_scan_force_isa(int isa) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+#endif
+    if (isa == BANK_SCAN_AUTO) {
+        if (isa_supported(BANK_SCAN_AVX2)) isa = BANK_SCAN_AVX2;
+        else if (isa_supported(BANK_SCAN_SSE41)) isa = BANK_SCAN_SSE41;
+        else isa = BANK_SCAN_SCALAR;
+    }
+    if (!isa_supported(isa)) return -1;
+
+    switch (isa) {
+#ifdef HAVE_X86_SIMD
+        case BANK_SCAN_AVX2:  g_kernel = scan_avx2;  g_kernel_name = "avx2";   break;
+        case BANK_SCAN_SSE41: g_kernel = scan_sse41; g_kernel_name = "sse4.1"; break;
+#endif
+        default:              g_kernel = scan_scalar; g_kernel_name = "scalar"; break;
+    }
+    return 0;
+}
+
+const char* bank_scan_isa_name(void) {
+    if (!g_kernel) bank_scan_force_isa(BANK_SCAN_AUTO);
+    return g_kernel_name;
+}
+
+// ============================================================================
+// Public API: Scan
+// ============================================================================
+void bank_scan_balances(const int32_t *balances, size_t n,
+                        const BankScanParams *params, BankAggregate *out) {
+    ScanBounds sb;
+    int64_t edge_state[BANK_HIST_BUCKETS];
+    uint64_t lt[SCAN_MAX_BOUNDS];
+    uint64_t edge_lt[BANK_HIST_BUCKETS + 1];
+
+    if (!g_kernel) bank_scan_force_isa(BANK_SCAN_AUTO);
+
+    memset(out, 0, sizeof(*out));
+    if (n == 0 || !balances || !params) return;
+
+    build_bounds(params, &sb, edge_state);
+    memset(lt, 0, sizeof(lt));
+
+    out->count = n;
+    out->min = INT32_MAX;
+    out->max = INT32_MIN;
+    g_kernel(balances, n, &sb, &out->total, &out->min, &out->max, lt);
+
+    /* ---------- Convert count(v < bound) into results ---------- */
+    for (int k = 1; k < BANK_HIST_BUCKETS; k++) {
+        edge_lt[k] = (edge_state[k] > 0) ? n : 0;
+    }
+    for (int j = 0; j < sb.nb; j++) {
+        if (sb.slot[j] < 0) out->below = lt[j];
+        else edge_lt[sb.slot[j]] = lt[j];
+    }
+
+    if (params->hist_width > 0) {
+        edge_lt[0] = 0;
+        edge_lt[BANK_HIST_BUCKETS] = n;
+        for (int k = 0; k < BANK_HIST_BUCKETS; k++) {
+            out->histogram[k] = edge_lt[k + 1] - edge_lt[k];
+        }
+    }
+}
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+
+#include "../../include/bank.h"
+#include <string.h>
+#include <sched.h>
+
+/*
+ * Idempotency Table: fixed-size, lock-free, time-bucketed dedup table in SHM
+ *
+ * 每個 entry 的狀態全部塞在一個 64-bit tag 裡，所以換手只需要一次 CAS：
+ *   tag = epoch(30 bits) | state(2 bits) | fingerprint(32 bits)
+ *
+ *   EMPTY/EXPIRED --CAS--> CLAIMED --store--> KEYED --store--> DONE
+ *                                   (key 寫好)        (result 寫好)
+ *
+ * - epoch 落在視窗外的 entry 視同空格，可以直接 CAS 覆蓋 (不需要背景清理)
+ * - 釋放的 entry 寫成 IDEM_FREED (state 0) 而不是 0：tag == 0 只代表「從來沒用過」，
+ *   key 一定放在 probe 路上第一個空格，所以掃到從沒用過的格子就可以停 (新 key 不用掃滿整個視窗)
+ * - 同一把 key 被同時佔到兩個格子 (前面的格子在掃描中途被釋放)：佔好後再掃一次，前面那格贏
+ * - 重送請求只讀 tag/key/result，完全不碰帳戶鎖
+ */
+
+#define IDEM_MASK (IDEM_TABLE_SIZE - 1)
+#define IDEM_LIVE_MAX ((uint64_t)IDEM_TARGET_RATE * (IDEM_WINDOW_BUCKETS + 1) * IDEM_BUCKET_SECONDS)
+
+_Static_assert((IDEM_TABLE_SIZE & IDEM_MASK) == 0, "IDEM_TABLE_SIZE must be a power of two");
+_Static_assert(IDEM_TABLE_SIZE >= 3 * IDEM_LIVE_MAX, "IDEM_TABLE_SIZE too small for IDEM_TARGET_RATE over the window");
+#define IDEM_WAIT_SPINS 2000
+#define IDEM_CLAIM_RETRIES 4
+
+#define IDEM_STATE_CLAIMED 1ULL
+#define IDEM_STATE_KEYED   2ULL
+#define IDEM_STATE_DONE    3ULL
+
+#define IDEM_FREED 1ULL              // state 0, nonzero: released / reusable, probe continues
+
+#define TAG(epoch, state, fp) (((uint64_t)(epoch) << 34) | ((state) << 32) | (uint64_t)(fp))
+#define TAG_EPOCH(t) ((uint32_t)((t) >> 34))
+#define TAG_STATE(t) (((t) >> 32) & 3ULL)
+#define TAG_FP(t)    ((uint32_t)(t))
+
+// ============================================================================
+// Helper: Key hashing
+// ============================================================================
+static inline uint64_t mix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// 比 epoch 新的 entry 也算活著：呼叫端 time() 拿得早、別的行程已經寫進下一個桶，不能當成過期覆蓋掉
+static inline int tag_live(uint64_t tag, uint32_t epoch) {
+    return TAG_STATE(tag) != 0 && (int32_t)(epoch - TAG_EPOCH(tag)) <= IDEM_WINDOW_BUCKETS;
+}
+
+void idem_init(IdemTable *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+// ============================================================================
+// Helper: Compare an in-window entry against our key
+// Return: 1 = same key (tag_out = last observed tag), 0 = different, -1 = gone
+// ============================================================================
+static int entry_matches(IdemEntry *e, uint64_t tag, uint64_t hi, uint64_t lo, uint64_t *tag_out) {
+    // CLAIMED: 對方正在寫 key，稍等
+    for (int spin = 0; TAG_STATE(tag) == IDEM_STATE_CLAIMED; spin++) {
+        if (spin >= IDEM_WAIT_SPINS) return 0; // 佔位者死掉了，當作不同 key
+        sched_yield();
+        uint64_t t2 = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+        if ((t2 & ~(3ULL << 32)) != (tag & ~(3ULL << 32))) return -1;
+        tag = t2;
+    }
+
+    int same = (e->key_hi == hi && e->key_lo == lo);
+
+    // Seqlock-style recheck：讀 key 的期間 entry 沒有被換手
+    uint64_t t2 = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+    if ((t2 & ~(3ULL << 32)) != (tag & ~(3ULL << 32))) return -1;
+    *tag_out = t2;
+    return same;
+}
+
+// ============================================================================
+// Public API: Begin (lookup or claim)
+// ============================================================================
+int idem_begin(IdemTable *t, const uint8_t key[16], uint32_t now_sec, IdemEntry **entry, int *result) {
+    uint64_t hi, lo;
+    memcpy(&hi, key, 8);
+    memcpy(&lo, key + 8, 8);
+
+    uint64_t h = mix64(hi ^ mix64(lo));
+    uint32_t home = (uint32_t)(h >> 32) & IDEM_MASK;
+    uint32_t fp = (uint32_t)h;
+    uint32_t epoch = now_sec / IDEM_BUCKET_SECONDS;
+
+    for (int attempt = 0; attempt < IDEM_CLAIM_RETRIES; attempt++) {
+        IdemEntry *free_e = NULL;
+        uint64_t free_tag = 0;
+        uint32_t free_p = 0;
+        int restart = 0;
+
+        /* ---------- 1. Look for the key in the probe window ---------- */
+        for (uint32_t p = 0; p < IDEM_PROBE_LIMIT && !restart; p++) {
+            IdemEntry *e = &t->entries[(home + p) & IDEM_MASK];
+            uint64_t tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+
+            if (!tag_live(tag, epoch)) {
+                if (!free_e) { free_e = e; free_tag = tag; free_p = p; }
+                if (tag == 0) break;   // 從沒用過：後面不會有這把 key
+                continue;
+            }
+            if (TAG_FP(tag) != fp) continue;
+
+            int m = entry_matches(e, tag, hi, lo, &tag);
+            if (m < 0) { restart = 1; break; }
+            if (m == 0) continue;
+
+            // 同一把 key：等原本的請求完成，回傳當初的結果
+            for (int spin = 0; TAG_STATE(tag) != IDEM_STATE_DONE; spin++) {
+                if (spin >= IDEM_WAIT_SPINS || TAG_FP(tag) != fp) return BANK_ERR_BUSY;
+                sched_yield();
+                tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+            }
+            *result = e->result;
+            __atomic_fetch_add(&t->replays, 1, __ATOMIC_RELAXED);
+            return IDEM_DUPLICATE;
+        }
+        if (restart) continue;
+
+        /* ---------- 2. Claim the first empty/expired entry ---------- */
+        if (!free_e) return BANK_ERR_BUSY; // 視窗內全滿：寧可請 client 重試也不重複扣款
+
+        uint64_t claimed = TAG(epoch, IDEM_STATE_CLAIMED, fp);
+        if (!__atomic_compare_exchange_n(&free_e->tag, &free_tag, claimed, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue; // 被搶走了 (可能正是同一把 key)，重新掃描
+        }
+        free_e->key_hi = hi;
+        free_e->key_lo = lo;
+        __atomic_store_n(&free_e->tag, TAG(epoch, IDEM_STATE_KEYED, fp), __ATOMIC_RELEASE);
+
+        /* ---------- 3. Same key claimed twice? ---------- */
+        // 同一把 key 的兩個第一次請求同時掃描時，若前面有格子剛好被釋放，兩邊會佔到不同格子。
+        // 佔好之後 (fence：兩邊至少有一邊看得到對方) 再掃一次：位置在前面的贏，後面的退讓
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        for (uint32_t p = 0; p < IDEM_PROBE_LIMIT && !restart; p++) {
+            if (p == free_p) continue;
+            IdemEntry *e = &t->entries[(home + p) & IDEM_MASK];
+            uint64_t tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+            if (tag == 0) break;        // 對方的格子不會在從沒用過的格子後面
+            if (!tag_live(tag, epoch) || TAG_FP(tag) != fp) continue;
+            if (entry_matches(e, tag, hi, lo, &tag) != 1) continue;
+
+            if (p < free_p) {           // 對方在前面：放掉自己的，重新掃描就會重播它的結果
+                restart = 1;
+                break;
+            }
+            // 對方在後面：它要嘛看到我們而退讓 (格子換手)，要嘛沒看到、已經在執行 -> 等它完成
+            uint64_t orig = tag & ~(3ULL << 32);
+            for (int spin = 0; (tag & ~(3ULL << 32)) == orig; spin++) {
+                if (TAG_STATE(tag) == IDEM_STATE_DONE) {
+                    __atomic_store_n(&free_e->tag, IDEM_FREED, __ATOMIC_RELEASE);
+                    *result = e->result;
+                    __atomic_fetch_add(&t->replays, 1, __ATOMIC_RELAXED);
+                    return IDEM_DUPLICATE;
+                }
+                if (spin >= IDEM_WAIT_SPINS) {
+                    __atomic_store_n(&free_e->tag, IDEM_FREED, __ATOMIC_RELEASE);
+                    return BANK_ERR_BUSY;
+                }
+                sched_yield();
+                tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+            }
+        }
+        if (restart) {
+            __atomic_store_n(&free_e->tag, IDEM_FREED, __ATOMIC_RELEASE);
+            continue;
+        }
+        __atomic_fetch_add(&t->inserts, 1, __ATOMIC_RELAXED);
+
+        *entry = free_e;
+        return IDEM_NEW;
+    }
+    return BANK_ERR_BUSY;
+}
+
+// ============================================================================
+// Public API: Complete (publish result)
+// ============================================================================
+void idem_complete(IdemEntry *e, int result) {
+    uint64_t tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+
+    // BUSY / OVERLOADED / RATE_LIMITED 都是「退避後再試」(轉帳根本沒執行)，不值得記住：
+    // 釋放 entry 讓重試真的再執行一次，否則整個視窗內都只會重播這個拒絕
+    if (result == BANK_ERR_BUSY || result == BANK_ERR_OVERLOADED || result == BANK_ERR_RATE_LIMITED) {
+        __atomic_store_n(&e->tag, IDEM_FREED, __ATOMIC_RELEASE);
+        return;
+    }
+    e->result = result;
+    __atomic_store_n(&e->tag, TAG(TAG_EPOCH(tag), IDEM_STATE_DONE, TAG_FP(tag)), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,273 @@
+// 檔案位置: src/common/log_crypt.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../../include/logger.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_AESNI 1
+#endif
+
+/*
+ * Log Encryption: AES-128-CTR，Logger 每寫一批就整批加密一次
+ *
+ * - Keystream 由「檔案 nonce + 這段資料在檔案中的 byte offset」決定：
+ *   counter block = nonce (8 bytes) || big-endian(offset / 16)
+ *   所以 append 不需要狀態，讀者也能從任意 offset 解密 (index 的 offset 照樣可用)
+ * - CPU 有 AES-NI 就一次跑 8 個 block (pipeline 填滿)；否則用 T-table 的 portable 版本
+ * - 兩個版本共用同一組 round keys (FIPS-197 的 byte 順序，AESENC 可以直接 load)
+ */
+
+#define AES_ROUNDS 10
+
+static uint8_t g_sbox[256];
+static uint32_t g_te[4][256];
+static pthread_once_t g_tables_once = PTHREAD_ONCE_INIT;
+
+#define ROTL8(x, s) ((uint8_t)(((x) << (s)) | ((x) >> (8 - (s)))))
+#define ROR32(x, s) (((x) >> (s)) | ((x) << (32 - (s))))
+
+static inline uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+// S-box 由 GF(2^8) 的乘法反元素 + affine 轉換算出來，再展開成 4 張 T-table
+static void build_tables(void) {
+    uint8_t p = 1, q = 1;
+    do {
+        p = (uint8_t)(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));   // p *= 3
+        q ^= (uint8_t)(q << 1);                                   // q /= 3
+        q ^= (uint8_t)(q << 2);
+        q ^= (uint8_t)(q << 4);
+        if (q & 0x80) q ^= 0x09;
+        g_sbox[p] = (uint8_t)(q ^ ROTL8(q, 1) ^ ROTL8(q, 2) ^ ROTL8(q, 3) ^ ROTL8(q, 4) ^ 0x63);
+    } while (p != 1);
+    g_sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        uint32_t s = g_sbox[i];
+        uint32_t s2 = ((s << 1) ^ ((s & 0x80) ? 0x1B : 0)) & 0xFF;
+        uint32_t t = (s2 << 24) | (s << 16) | (s << 8) | (s2 ^ s);
+        g_te[0][i] = t;
+        g_te[1][i] = ROR32(t, 8);
+        g_te[2][i] = ROR32(t, 16);
+        g_te[3][i] = ROR32(t, 24);
+    }
+}
+
+// ============================================================================
+// Portable AES-128 (T-table)
+// ============================================================================
+static void aes_encrypt_block(const uint32_t *rk, const uint8_t in[16], uint8_t out[16]) {
+    uint32_t s0 = load_be32(in) ^ rk[0];
+    uint32_t s1 = load_be32(in + 4) ^ rk[1];
+    uint32_t s2 = load_be32(in + 8) ^ rk[2];
+    uint32_t s3 = load_be32(in + 12) ^ rk[3];
+
+    for (int r = 1; r < AES_ROUNDS; r++) {
+        rk += 4;
+        uint32_t t0 = g_te[0][s0 >> 24] ^ g_te[1][(s1 >> 16) & 0xFF] ^ g_te[2][(s2 >> 8) & 0xFF] ^ g_te[3][s3 & 0xFF] ^ rk[0];
+        uint32_t t1 = g_te[0][s1 >> 24] ^ g_te[1][(s2 >> 16) & 0xFF] ^ g_te[2][(s3 >> 8) & 0xFF] ^ g_te[3][s0 & 0xFF] ^ rk[1];
+        uint32_t t2 = g_te[0][s2 >> 24] ^ g_te[1][(s3 >> 16) & 0xFF] ^ g_te[2][(s0 >> 8) & 0xFF] ^ g_te[3][s1 & 0xFF] ^ rk[2];
+        uint32_t t3 = g_te[0][s3 >> 24] ^ g_te[1][(s0 >> 16) & 0xFF] ^ g_te[2][(s1 >> 8) & 0xFF] ^ g_te[3][s2 & 0xFF] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // 最後一輪沒有 MixColumns：只查 S-box
+    rk += 4;
+#define FINAL(a, b, c, d) (((uint32_t)g_sbox[(a) >> 24] << 24) | ((uint32_t)g_sbox[((b) >> 16) & 0xFF] << 16) | \
+                           ((uint32_t)g_sbox[((c) >> 8) & 0xFF] << 8) | g_sbox[(d) & 0xFF])
+    store_be32(out,      FINAL(s0, s1, s2, s3) ^ rk[0]);
+    store_be32(out + 4,  FINAL(s1, s2, s3, s0) ^ rk[1]);
+    store_be32(out + 8,  FINAL(s2, s3, s0, s1) ^ rk[2]);
+    store_be32(out + 12, FINAL(s3, s0, s1, s2) ^ rk[3]);
+#undef FINAL
+}
+
+static inline void counter_block(uint8_t ctr[16], const uint8_t nonce[8], uint64_t block) {
+    memcpy(ctr, nonce, 8);
+    store_be32(ctr + 8, (uint32_t)(block >> 32));
+    store_be32(ctr + 12, (uint32_t)block);
+}
+
+static void ctr_blocks_portable(const LogCipher *c, const uint8_t nonce[8], uint64_t block,
+                                const uint8_t *in, uint8_t *out, size_t nblocks) {
+    uint8_t ctr[16], ks[16];
+    for (size_t b = 0; b < nblocks; b++) {
+        counter_block(ctr, nonce, block + b);
+        aes_encrypt_block(c->ek, ctr, ks);
+        for (int i = 0; i < 16; i++) out[i] = in[i] ^ ks[i];
+        in += 16;
+        out += 16;
+    }
+}
+
+// ============================================================================
+// AES-NI: 8 個 counter block 交錯執行，蓋過 AESENC 的 latency
+// ============================================================================
+#ifdef HAVE_X86_AESNI
+#define AESNI_LANES 8
+
+__attribute__((target("aes,sse2")))
+static void ctr_blocks_aesni(const LogCipher *c, const uint8_t nonce[8], uint64_t block,
+                             const uint8_t *in, uint8_t *out, size_t nblocks) {
+    __m128i k[AES_ROUNDS + 1];
+    for (int r = 0; r <= AES_ROUNDS; r++) k[r] = _mm_load_si128((const __m128i *)(c->rk + 16 * r));
+    long long lo;
+    memcpy(&lo, nonce, 8);   // 低 8 bytes 在記憶體裡就是 nonce 原本的順序
+
+    // 8 條 lane 寫成獨立變數：留在 register 裡，每一輪的 8 個 AESENC 才能真的並行
+#define LANES(op) op(0) op(1) op(2) op(3) op(4) op(5) op(6) op(7)
+#define CTR(j)   __m128i b##j = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(block + j), lo), k[0]);
+#define ROUND(j) b##j = _mm_aesenc_si128(b##j, k[r]);
+#define LAST(j)  b##j = _mm_aesenclast_si128(b##j, k[AES_ROUNDS]); \
+                 _mm_storeu_si128((__m128i *)(out + 16 * j), \
+                                  _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16 * j)), b##j));
+    while (nblocks >= AESNI_LANES) {
+        LANES(CTR)
+        for (int r = 1; r < AES_ROUNDS; r++) { LANES(ROUND) }
+        LANES(LAST)
+        block += AESNI_LANES;
+        in += 16 * AESNI_LANES;
+        out += 16 * AESNI_LANES;
+        nblocks -= AESNI_LANES;
+    }
+#undef LANES
+#undef CTR
+#undef ROUND
+#undef LAST
+    for (; nblocks > 0; nblocks--) {
+        __m128i b = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(block), lo), k[0]);
+        for (int r = 1; r < AES_ROUNDS; r++) b = _mm_aesenc_si128(b, k[r]);
+        b = _mm_aesenclast_si128(b, k[AES_ROUNDS]);
+        _mm_storeu_si128((__m128i *)out, _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), b));
+        block++;
+        in += 16;
+        out += 16;
+    }
+}
+#endif
+
+// ============================================================================
+// Public API
+// ============================================================================
+void log_cipher_init(LogCipher *c, const uint8_t key[LOG_KEY_BYTES]) {
+    static const uint8_t rcon[AES_ROUNDS] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+    pthread_once(&g_tables_once, build_tables);
+    memset(c, 0, sizeof(*c));
+
+    uint32_t *w = c->ek;
+    for (int i = 0; i < 4; i++) w[i] = load_be32(key + 4 * i);
+    for (int i = 4; i < 4 * (AES_ROUNDS + 1); i++) {
+        uint32_t t = w[i - 1];
+        if (i % 4 == 0) {
+            t = (t << 8) | (t >> 24);   // RotWord
+            t = ((uint32_t)g_sbox[t >> 24] << 24) | ((uint32_t)g_sbox[(t >> 16) & 0xFF] << 16) |
+                ((uint32_t)g_sbox[(t >> 8) & 0xFF] << 8) | g_sbox[t & 0xFF];
+            t ^= (uint32_t)rcon[i / 4 - 1] << 24;
+        }
+        w[i] = w[i - 4] ^ t;
+    }
+    for (int i = 0; i < 4 * (AES_ROUNDS + 1); i++) store_be32(c->rk + 4 * i, w[i]);
+
+#ifdef HAVE_X86_AESNI
+    c->aesni = __builtin_cpu_supports("aes");
+#endif
+}
+
+void log_cipher_ctr(const LogCipher *c, const uint8_t nonce[8], uint64_t offset,
+                    const void *in, void *out, size_t len) {
+    const uint8_t *src = in;
+    uint8_t *dst = out;
+    uint64_t block = offset / 16;
+    size_t skip = (size_t)(offset % 16);
+
+    // 1. 開頭不對齊 16 bytes 的部分
+    if (skip) {
+        uint8_t ctr[16], ks[16];
+        counter_block(ctr, nonce, block++);
+        aes_encrypt_block(c->ek, ctr, ks);
+        size_t n = 16 - skip < len ? 16 - skip : len;
+        for (size_t i = 0; i < n; i++) dst[i] = src[i] ^ ks[skip + i];
+        src += n; dst += n; len -= n;
+    }
+
+    // 2. 整數個 block
+    size_t nblocks = len / 16;
+    if (nblocks) {
+#ifdef HAVE_X86_AESNI
+        if (c->aesni) ctr_blocks_aesni(c, nonce, block, src, dst, nblocks);
+        else
+#endif
+        ctr_blocks_portable(c, nonce, block, src, dst, nblocks);
+        block += nblocks;
+        src += nblocks * 16;
+        dst += nblocks * 16;
+        len -= nblocks * 16;
+    }
+
+    // 3. 結尾剩下的 bytes
+    if (len) {
+        uint8_t ctr[16], ks[16];
+        counter_block(ctr, nonce, block);
+        aes_encrypt_block(c->ek, ctr, ks);
+        for (size_t i = 0; i < len; i++) dst[i] = src[i] ^ ks[i];
+    }
+}
+
+void log_cipher_block(const LogCipher *c, const uint8_t in[16], uint8_t out[16]) {
+    aes_encrypt_block(c->ek, in, out);
+}
+
+uint32_t log_cipher_key_check(const LogCipher *c) {
+    uint8_t zero[16] = { 0 }, out[16];
+    aes_encrypt_block(c->ek, zero, out);
+    return load_be32(out);
+}
+
+const char *log_cipher_impl(const LogCipher *c) {
+    return c->aesni ? "AES-NI" : "portable";
+}
+
+// 金鑰檔：32 個 hex 字元 (前後空白 / 換行可以有)，例如 `openssl rand -hex 16 > log.key`
+int log_key_load(const char *path, uint8_t key[LOG_KEY_BYTES]) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror("[LogCrypt] Cannot open key file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0 && (st.st_mode & 0077))
+        fprintf(stderr, "[LogCrypt] WARNING: %s is readable by group/others (chmod 600)\n", path);
+
+    char hex[2 * LOG_KEY_BYTES];
+    int n = 0, ch;
+    while ((ch = fgetc(fp)) != EOF) {
+        if (isspace(ch)) continue;
+        if (!isxdigit(ch) || n == (int)sizeof(hex)) { n = -1; break; }
+        hex[n++] = (char)ch;
+    }
+    fclose(fp);
+    if (n != (int)sizeof(hex)) {
+        fprintf(stderr, "[LogCrypt] %s: expected %d hex digits (AES-128 key)\n", path, 2 * LOG_KEY_BYTES);
+        return -1;
+    }
+    for (int i = 0; i < LOG_KEY_BYTES; i++) {
+        char byte[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+        key[i] = (uint8_t)strtoul(byte, NULL, 16);
+    }
+    return 0;
+}
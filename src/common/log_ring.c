@@ -0,0 +1,501 @@
+// 檔案位置: src/common/log_ring.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "../../include/logger.h"
+
+/*
+ * Log Ring Transport: 每個 Worker 一條 SPSC ring，放在 POSIX SHM
+ *
+ * - Producer (Worker) 只寫自己的 head，Consumer (Logger) 只寫每條 ring 的 tail
+ *   head / tail 各自獨佔一條 cache line，互不 false sharing
+ * - 送出一筆紀錄 = 寫 slot + release store head，沒有任何 system call
+ * - Logger 沒事做時把 sleeping 設成 1 再 futex_wait；Producer 只有在看到
+ *   sleeping == 1 時才 CAS 回 0 並 futex_wake (忙碌時完全不會進 kernel)
+ * - 多個 Logger 行程 (shard)：ring w 由 shard (w % nshards) 收，
+ *   每個 shard 有自己的 futex word 與統計，互不干擾
+ * - Ring 滿了改寫進該 Worker 的 spill 檔 (預先配置好的 file-backed mmap，同樣沒有 system call)
+ *   spill 也滿了才丟掉並累計 dropped，Logger 會把丟失數量寫進 audit log
+ *
+ * Spill 的順序保證：
+ * - Worker 一旦開始 spill，就一直寫 spill，直到 Logger 把 spill 全部收完 (sticky)
+ *   => 同一個 Worker 的 ring 紀錄一定比 spill 紀錄舊，spill 之後的 ring 紀錄一定比較新
+ * - Logger 對每個 Worker 先收 ring，ring 空了才收 spill => 合併結果就是 seq 順序
+ */
+
+#define LOG_RING_MASK (LOG_RING_SLOTS - 1)
+#define LOG_RING_MAGIC 0x4C4F4752u  // "LOGR"
+
+typedef struct {
+    volatile uint64_t head __attribute__((aligned(64)));   // producer
+    volatile uint64_t dropped;                             // producer
+    volatile uint64_t tail __attribute__((aligned(64)));   // consumer
+    LogMessage slots[LOG_RING_SLOTS] __attribute__((aligned(64)));
+} LogRing;
+
+// 每個 Logger (shard) 自己的 futex word 與統計：Producer 只叫醒負責自己的那一個
+typedef struct {
+    volatile int32_t sleeping __attribute__((aligned(64)));  // futex word
+    LoggerStats stats __attribute__((aligned(64)));
+} LogShard;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t nrings;
+    uint32_t nshards;                   // Logger 行程數：ring w 由 shard (w % nshards) 負責
+    LogShard shards[LOG_SHARDS_MAX];
+    LogRing rings[LOG_RING_MAX_PRODUCERS];
+} LogRingShm;
+
+static LogRingShm *g_ring_shm = NULL;  // fork 之後所有子行程都繼承這個 mapping
+static size_t g_ring_shm_size = 0;
+static LogRing *g_my_ring = NULL;      // 本行程綁定的 ring (Producer)
+static uint64_t g_cached_tail = 0;     // Producer 看到的 tail (只有看起來滿了才重讀)
+static uint16_t g_my_worker = LOG_WORKER_NONE;
+static uint32_t g_drain_next = 0;      // Consumer round-robin 起點
+static uint32_t g_my_shard = 0;        // Producer: 負責本行程的 Logger
+static uint32_t g_consumer_shard = 0;  // Consumer: 本 Logger 的 shard 編號
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slots;
+    volatile uint64_t head __attribute__((aligned(64)));   // producer
+    volatile uint64_t spilled;                             // producer: 寫進 spill 的總筆數
+    volatile uint64_t lost;                                // producer: spill 也滿了
+    volatile uint64_t tail __attribute__((aligned(64)));   // consumer
+    volatile uint64_t merged;                              // consumer: 已經收回的總筆數
+    LogMessage data[] __attribute__((aligned(64)));
+} LogSpill;
+
+#define LOG_SPILL_MAGIC 0x4C4F4753u  // "LOGS"
+#define LOG_SPILL_MASK (LOG_SPILL_SLOTS - 1)
+#define LOG_SPILL_SIZE (sizeof(LogSpill) + sizeof(LogMessage) * LOG_SPILL_SLOTS)
+
+static LogSpill *g_spills[LOG_RING_MAX_PRODUCERS]; // fork 之後繼承
+static char g_spill_paths[LOG_RING_MAX_PRODUCERS][300];
+static int g_nspills = 0;
+static LogSpill *g_my_spill = NULL;
+static uint64_t g_spill_cached_tail = 0;
+
+static long futex(volatile int32_t *uaddr, int op, int val, const struct timespec *timeout) {
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+// ============================================================================
+// Setup (Master, before fork)
+// ============================================================================
+int logger_ring_init(int nrings) {
+    if (nrings < 0 || nrings > LOG_RING_MAX_PRODUCERS) return -1;
+
+    shm_unlink(LOG_RING_SHM_NAME); // 上次異常結束留下的殘骸
+    int fd = shm_open(LOG_RING_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        perror("[LogRing] shm_open failed");
+        return -1;
+    }
+    // 只配置實際用到的 ring
+    g_ring_shm_size = offsetof(LogRingShm, rings) + (size_t)nrings * sizeof(LogRing);
+    if (ftruncate(fd, g_ring_shm_size) == -1) {
+        perror("[LogRing] ftruncate failed");
+        close(fd);
+        shm_unlink(LOG_RING_SHM_NAME);
+        return -1;
+    }
+    g_ring_shm = mmap(NULL, g_ring_shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (g_ring_shm == MAP_FAILED) {
+        perror("[LogRing] mmap failed");
+        g_ring_shm = NULL;
+        shm_unlink(LOG_RING_SHM_NAME);
+        return -1;
+    }
+
+    // ftruncate 出來的頁面全是 0：head = tail = dropped = sleeping = 0
+    g_ring_shm->nrings = (uint32_t)nrings;
+    g_ring_shm->nshards = 1;
+    __atomic_store_n(&g_ring_shm->magic, LOG_RING_MAGIC, __ATOMIC_RELEASE);
+    printf("[LogRing] %d rings x %d slots initialized (%zu KB)\n",
+           nrings, LOG_RING_SLOTS, g_ring_shm_size / 1024);
+    return 0;
+}
+
+void logger_ring_cleanup(void) {
+    if (g_ring_shm) {
+        munmap(g_ring_shm, g_ring_shm_size);
+        g_ring_shm = NULL;
+        g_my_ring = NULL;
+        g_my_worker = LOG_WORKER_NONE;
+    }
+    shm_unlink(LOG_RING_SHM_NAME);
+}
+
+// 每個 Worker 一個 spill 檔："<log 目錄>/spill.wNN"
+// 上次異常結束留下、還沒收回的紀錄會保留下來，由這次的 Logger 先收回
+int logger_spill_init(const char *log_path, int nworkers) {
+    if (nworkers < 0 || nworkers > LOG_RING_MAX_PRODUCERS) return -1;
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", log_path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+
+    for (int i = 0; i < nworkers; i++) {
+        snprintf(g_spill_paths[i], sizeof(g_spill_paths[i]), "%s/spill.w%02d", dir, i);
+        int fd = open(g_spill_paths[i], O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1) {
+            perror("[LogRing] spill open failed");
+            logger_spill_cleanup();
+            return -1;
+        }
+        struct stat st;
+        int reuse = fstat(fd, &st) == 0 && (size_t)st.st_size == LOG_SPILL_SIZE;
+        // 先把磁碟空間要到手：之後經由 mapping 寫入不會因為空間不足收到 SIGBUS
+        int err = posix_fallocate(fd, 0, LOG_SPILL_SIZE);
+        if (err != 0) {
+            fprintf(stderr, "[LogRing] spill preallocation failed: %s\n", strerror(err));
+            close(fd);
+            logger_spill_cleanup();
+            return -1;
+        }
+        // MAP_POPULATE：先把頁面全部對應好，Worker 寫入時不會再 page fault 進 kernel
+        LogSpill *sp = mmap(NULL, LOG_SPILL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (sp == MAP_FAILED) {
+            perror("[LogRing] spill mmap failed");
+            logger_spill_cleanup();
+            return -1;
+        }
+        uint64_t leftover = 0;
+        if (reuse && sp->magic == LOG_SPILL_MAGIC && sp->slots == LOG_SPILL_SLOTS &&
+            sp->head >= sp->tail && sp->head - sp->tail <= LOG_SPILL_SLOTS) {
+            leftover = sp->head - sp->tail;
+        } else {
+            sp->head = sp->tail = 0;
+            sp->slots = LOG_SPILL_SLOTS;
+            sp->magic = LOG_SPILL_MAGIC;
+        }
+        sp->spilled = sp->lost = sp->merged = 0;
+        if (leftover) printf("[LogRing] %s: recovering %lu spilled records\n",
+                             g_spill_paths[i], (unsigned long)leftover);
+        g_spills[i] = sp;
+        g_nspills = i + 1;
+    }
+    printf("[LogRing] %d spill files x %d slots in %s (%zu KB each)\n",
+           nworkers, LOG_SPILL_SLOTS, dir, LOG_SPILL_SIZE / 1024);
+    return 0;
+}
+
+// 收乾淨的 spill 檔才刪除 (Logger 異常結束時留給下次收回)
+void logger_spill_cleanup(void) {
+    for (int i = 0; i < g_nspills; i++) {
+        LogSpill *sp = g_spills[i];
+        if (!sp) continue;
+        int empty = __atomic_load_n(&sp->head, __ATOMIC_ACQUIRE) == sp->tail;
+        munmap(sp, LOG_SPILL_SIZE);
+        g_spills[i] = NULL;
+        if (empty) unlink(g_spill_paths[i]);
+    }
+    g_nspills = 0;
+    g_my_spill = NULL;
+}
+
+int logger_ring_enabled(void) {
+    return g_ring_shm != NULL && g_ring_shm->nrings > 0;
+}
+
+static uint32_t nshards(void) {
+    return (g_ring_shm && g_ring_shm->nshards > 0) ? g_ring_shm->nshards : 1;
+}
+
+// Worker w 的紀錄 (ring / spill / SysV mtype) 由這個 shard 收
+static int owned(uint32_t w) {
+    return w % nshards() == g_consumer_shard;
+}
+
+int logger_ring_set_shards(int n) {
+    if (!g_ring_shm || n < 1 || n > LOG_SHARDS_MAX) return -1;
+    g_ring_shm->nshards = (uint32_t)n;
+    return 0;
+}
+
+int log_ring_select_shard(int shard) {
+    if (shard < 0 || (uint32_t)shard >= nshards()) return -1;
+    g_consumer_shard = (uint32_t)shard;
+    return 0;
+}
+
+int logger_shard_count(void) {
+    return (int)nshards();
+}
+
+int logger_my_shard(void) {
+    return (int)g_my_shard;
+}
+
+LoggerStats *logger_stats(void) {
+    return g_ring_shm ? &g_ring_shm->shards[g_consumer_shard].stats : NULL;
+}
+
+// 所有 shard 加總 (Monitor / 工具用)
+int logger_stats_total(LoggerStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (!g_ring_shm) return -1;
+    for (uint32_t k = 0; k < nshards(); k++) {
+        const LoggerStats *s = &g_ring_shm->shards[k].stats;
+        out->batches += s->batches;
+        out->records += s->records;
+        out->batch_fill_us += s->batch_fill_us;
+        out->writes += s->writes;
+        out->bytes += s->bytes;
+        out->fsyncs += s->fsyncs;
+        out->seq_gaps += s->seq_gaps;
+        out->seq_reorders += s->seq_reorders;
+        for (int i = 0; i < LOG_BATCH_HIST; i++) out->batch_hist[i] += s->batch_hist[i];
+        for (int i = 0; i < LOG_LAG_HIST; i++) out->lag_hist[i] += s->lag_hist[i];
+        if (s->max_batch > out->max_batch) out->max_batch = s->max_batch;
+        if (s->lag_max_ns > out->lag_max_ns) out->lag_max_ns = s->lag_max_ns;
+    }
+    out->cfg_batch_size = g_ring_shm->shards[0].stats.cfg_batch_size;
+    out->cfg_batch_latency_us = g_ring_shm->shards[0].stats.cfg_batch_latency_us;
+    return 0;
+}
+
+int logger_bind_worker(int worker_id) {
+    if (worker_id < 0 || worker_id >= LOG_RING_MAX_PRODUCERS) return -1;
+    g_my_shard = (uint32_t)worker_id % nshards();
+    if (worker_id < g_nspills && g_spills[worker_id]) {
+        g_my_spill = g_spills[worker_id];
+        g_spill_cached_tail = __atomic_load_n(&g_my_spill->tail, __ATOMIC_ACQUIRE);
+    }
+    g_my_worker = (uint16_t)worker_id; // 沒有 ring 也蓋上 worker id (Logger 用來檢查缺號)
+    if (!g_ring_shm || (uint32_t)worker_id >= g_ring_shm->nrings) return g_my_spill ? 0 : -1;
+    g_my_ring = &g_ring_shm->rings[worker_id];
+    g_cached_tail = __atomic_load_n(&g_my_ring->tail, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+uint64_t logger_lag_percentile_us(const LoggerStats *s, double pct) {
+    uint64_t total = 0;
+    for (int i = 0; i < LOG_LAG_HIST; i++) total += s->lag_hist[i];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(total * pct / 100.0);
+    if (rank >= total) rank = total - 1;
+    // bucket 上界不會超過實際看過的最大值
+    uint64_t max_us = s->lag_max_ns / 1000 + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LOG_LAG_HIST; i++) {
+        seen += s->lag_hist[i];
+        if (seen > rank) return (1ULL << i) < max_us ? (1ULL << i) : max_us;
+    }
+    return max_us;
+}
+
+uint16_t logger_worker_id(void) {
+    return g_my_worker;
+}
+
+// ============================================================================
+// Producer (Worker): no syscall unless the logger is asleep
+// ============================================================================
+static void wake_consumer(void) {
+    if (!g_ring_shm) return;
+    volatile int32_t *sleeping = &g_ring_shm->shards[g_my_shard].sleeping;
+    // 跟 Consumer 的 sleeping=1 -> 重新檢查 配對 (兩邊都是 seq_cst)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleeping, __ATOMIC_RELAXED)) {
+        int32_t expected = 1;
+        if (__atomic_compare_exchange_n(sleeping, &expected, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            futex(sleeping, FUTEX_WAKE, 1, NULL);
+        }
+    }
+}
+
+int log_spill_pending(void) {
+    LogSpill *sp = g_my_spill;
+    if (!sp || sp->head == g_spill_cached_tail) return 0;
+    g_spill_cached_tail = __atomic_load_n(&sp->tail, __ATOMIC_ACQUIRE);
+    return sp->head != g_spill_cached_tail;
+}
+
+int log_spill_push(const LogMessage *msg) {
+    LogSpill *sp = g_my_spill;
+    if (!sp) return -1;
+
+    uint64_t head = sp->head;
+    if (head - g_spill_cached_tail >= LOG_SPILL_SLOTS) {
+        g_spill_cached_tail = __atomic_load_n(&sp->tail, __ATOMIC_ACQUIRE);
+    }
+    if (head - g_spill_cached_tail >= LOG_SPILL_SLOTS) {
+        __atomic_store_n(&sp->lost, sp->lost + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    sp->data[head & LOG_SPILL_MASK] = *msg;
+    __atomic_store_n(&sp->head, head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&sp->spilled, sp->spilled + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int log_ring_push(const LogMessage *msg) {
+    LogRing *r = g_my_ring;
+    if (!r) return -1;
+
+    // spill 還沒被收完：繼續寫 spill，維持這個 Worker 的紀錄順序
+    if (log_spill_pending()) {
+        if (log_spill_push(msg) != 0) __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        wake_consumer();
+        return 0;
+    }
+
+    uint64_t head = r->head; // 只有自己會寫
+    if (head - g_cached_tail >= LOG_RING_SLOTS) {
+        // 避免每筆都去讀 Consumer 那條 cache line
+        g_cached_tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    }
+    if (head - g_cached_tail >= LOG_RING_SLOTS) {
+        if (log_spill_push(msg) != 0) __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+    } else {
+        r->slots[head & LOG_RING_MASK] = *msg;
+        __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    }
+    wake_consumer();
+    return 0;
+}
+
+// ============================================================================
+// Consumer (Logger)
+// ============================================================================
+// 從 spill 收回最多 max 筆
+static int spill_take(LogSpill *sp, LogMessage *out, int max) {
+    if (!sp || max <= 0) return 0;
+    uint64_t tail = sp->tail;
+    uint64_t head = __atomic_load_n(&sp->head, __ATOMIC_ACQUIRE);
+    int take = 0;
+    while (tail + take < head && take < max) {
+        out[take] = sp->data[(tail + take) & LOG_SPILL_MASK];
+        take++;
+    }
+    if (take) {
+        __atomic_store_n(&sp->tail, tail + take, __ATOMIC_RELEASE);
+        __atomic_store_n(&sp->merged, sp->merged + take, __ATOMIC_RELAXED);
+    }
+    return take;
+}
+
+int log_ring_drain(LogMessage *out, int max) {
+    if (!g_ring_shm) return 0;
+
+    int n = 0;
+    uint32_t nrings = g_ring_shm->nrings;
+    if (nrings == 0) return 0;
+    // 每條 ring 最多拿 max / (本 shard 的 ring 數) 筆，避免單一忙碌的 Worker 餓死其他人
+    uint32_t mine = 0;
+    for (uint32_t w = 0; w < nrings; w++) mine += owned(w);
+    if (mine == 0) return 0;
+    int share = max / (int)mine;
+    if (share < 1) share = 1;
+
+    for (uint32_t k = 0; k < nrings && n < max; k++) {
+        uint32_t w = (g_drain_next + k) % nrings;
+        if (!owned(w)) continue;
+        LogRing *r = &g_ring_shm->rings[w];
+        uint64_t tail = r->tail;
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        int take = 0;
+        while (tail + take < head && take < share && n < max) {
+            out[n++] = r->slots[(tail + take) & LOG_RING_MASK];
+            take++;
+        }
+        if (take) __atomic_store_n(&r->tail, tail + take, __ATOMIC_RELEASE);
+
+        // Ring 收空了才輪到 spill (spill 的紀錄都比 ring 裡的新)
+        if (tail + take == head && (int)w < g_nspills) {
+            int room = (share - take < max - n) ? share - take : max - n;
+            n += spill_take(g_spills[w], out + n, room);
+        }
+    }
+    g_drain_next = (g_drain_next + 1) % nrings;
+    return n;
+}
+
+int log_spill_drain(LogMessage *out, int max) {
+    int n = 0;
+    for (int k = 0; k < g_nspills && n < max; k++) {
+        if (owned((uint32_t)k)) n += spill_take(g_spills[k], out + n, max - n);
+    }
+    return n;
+}
+
+void log_spill_stats(uint64_t *spilled, uint64_t *merged) {
+    *spilled = *merged = 0;
+    for (int k = 0; k < g_nspills; k++) {
+        if (!g_spills[k] || !owned((uint32_t)k)) continue;   // 每個 shard 只算自己的 worker
+        *spilled += __atomic_load_n(&g_spills[k]->spilled, __ATOMIC_RELAXED);
+        *merged += __atomic_load_n(&g_spills[k]->merged, __ATOMIC_RELAXED);
+    }
+}
+
+void log_ring_backlog(uint64_t *ring, uint64_t *spill) {
+    *ring = *spill = 0;
+    for (uint32_t k = 0; g_ring_shm && k < g_ring_shm->nrings; k++) {
+        LogRing *r = &g_ring_shm->rings[k];
+        if (owned(k)) *ring += __atomic_load_n(&r->head, __ATOMIC_RELAXED) - __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    }
+    for (int k = 0; k < g_nspills; k++) {
+        LogSpill *sp = g_spills[k];
+        if (sp && owned((uint32_t)k))
+            *spill += __atomic_load_n(&sp->head, __ATOMIC_RELAXED) - __atomic_load_n(&sp->tail, __ATOMIC_RELAXED);
+    }
+}
+
+static int rings_empty(void) {
+    for (uint32_t k = 0; k < g_ring_shm->nrings; k++) {
+        LogRing *r = &g_ring_shm->rings[k];
+        if (owned(k) && __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != r->tail) return 0;
+    }
+    for (int k = 0; k < g_nspills; k++) {
+        if (g_spills[k] && owned((uint32_t)k) && __atomic_load_n(&g_spills[k]->head, __ATOMIC_ACQUIRE) != g_spills[k]->tail) return 0;
+    }
+    return 1;
+}
+
+void log_ring_wait(int timeout_ms) {
+    if (!g_ring_shm) return;
+    volatile int32_t *sleeping = &g_ring_shm->shards[g_consumer_shard].sleeping;
+
+    __atomic_store_n(sleeping, 1, __ATOMIC_SEQ_CST);
+    if (!rings_empty()) {
+        // 設旗標之前剛好有人寫入：不要睡
+        __atomic_store_n(sleeping, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    futex(sleeping, FUTEX_WAIT, 1, timeout_ms > 0 ? &ts : NULL);
+    __atomic_store_n(sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+uint64_t log_ring_dropped(void) {
+    uint64_t total = 0;
+    for (uint32_t k = 0; g_ring_shm && k < g_ring_shm->nrings; k++) {
+        if (owned(k)) total += __atomic_load_n(&g_ring_shm->rings[k].dropped, __ATOMIC_RELAXED);
+    }
+    // SysV 模式下 spill 滿了的筆數 (ring 模式已經算進 ring 的 dropped)
+    if (!g_ring_shm || g_ring_shm->nrings == 0) {
+        for (int k = 0; k < g_nspills; k++) {
+            if (g_spills[k] && owned((uint32_t)k)) total += __atomic_load_n(&g_spills[k]->lost, __ATOMIC_RELAXED);
+        }
+    }
+    return total;
+}
@@ -24,7 +24,7 @@ int main() {
     // 現在都已經封裝在 mq_wrapper.c 的 logger_main_loop() 裡面了。
     // 我們只要呼叫它，它就會開始：
     //   a. 無限迴圈收信
-    //   b. 解密 (XOR)
+    //   b. 整批解析 (落地加密見 log_crypt.c)
     //   c. 寫入 logs/transaction.log
     //   d. 自動加上時間戳記
     // ================
@@ -0,0 +1,497 @@
+// 檔案位置: src/common/metrics.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../include/metrics.h"
+#include "../../include/protocol.h"
+#include "../../include/trace.h"
+
+/*
+ * Metrics Page: 取代 Monitor 行程每 1 ms 一次的 msgctl(IPC_STAT)
+ *
+ * - Master 在 fork 之前建立一個固定大小的 SHM 區塊，所有子行程繼承 mapping
+ * - 每個 Worker / Logger shard 只寫自己的 slot (各自對齊 cache line)：
+ *   relaxed load + store 就夠了，熱路徑上沒有 lock 前綴、沒有 system call
+ * - 讀者 (hsts-top) 以唯讀方式 mmap，要多久取樣一次都可以，Server 端完全感覺不到
+ * - 版面有 magic + version + size：不相容的讀者直接拒絕，而不是讀到錯位的數字
+ * - 延遲：每個 Worker 每個 (op, stage) 一個 log-linear 直方圖，一樣是單一寫入者；
+ *   讀的一方 (OP_STATS / hsts-top) 再把所有 Worker 的同一格加總
+ */
+
+static MetricsShm *g_metrics = NULL;        // fork 之後所有子行程都繼承這個 mapping
+static WorkerMetrics *g_self = NULL;        // 本行程的 Worker slot (Bank Core 的等待時間記在這裡)
+static int g_self_index = -1;
+
+// 目前這個請求各 stage 累積的時間 (Worker 是單執行緒：一個行程同時只處理一個請求)
+static struct {
+    uint32_t mask;                          // 這次請求有跑到的 stage
+    uint64_t ns[METRICS_STAGES];
+} g_req;
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ============================================================================
+// Setup (Master, before fork)
+// ============================================================================
+int metrics_init(int nworkers, int nloggers) {
+    if (nworkers < 0 || nworkers > METRICS_MAX_WORKERS || nloggers < 0 || nloggers > METRICS_MAX_LOGGERS)
+        return -1;
+
+    shm_unlink(METRICS_SHM_NAME); // 上次異常結束留下的殘骸
+    int fd = shm_open(METRICS_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror("[Metrics] shm_open failed");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(MetricsShm)) == -1) {
+        perror("[Metrics] ftruncate failed");
+        close(fd);
+        shm_unlink(METRICS_SHM_NAME);
+        return -1;
+    }
+    g_metrics = mmap(NULL, sizeof(MetricsShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (g_metrics == MAP_FAILED) {
+        perror("[Metrics] mmap failed");
+        g_metrics = NULL;
+        shm_unlink(METRICS_SHM_NAME);
+        return -1;
+    }
+
+    // ftruncate 出來的頁面全是 0：所有 counter 從 0 開始
+    g_metrics->version = METRICS_VERSION;
+    g_metrics->size = sizeof(MetricsShm);
+    g_metrics->nworkers = (uint32_t)nworkers;
+    g_metrics->nloggers = (uint32_t)nloggers;
+    g_metrics->start_ns = clock_ns(CLOCK_REALTIME);
+    g_metrics->start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+    __atomic_store_n(&g_metrics->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void metrics_cleanup(void) {
+    if (g_metrics) {
+        // 還開著的讀者看到 magic = 0 就知道要重新 attach
+        __atomic_store_n(&g_metrics->magic, 0, __ATOMIC_RELEASE);
+        munmap(g_metrics, sizeof(MetricsShm));
+        g_metrics = NULL;
+        g_self = NULL;
+        g_self_index = -1;
+    }
+    shm_unlink(METRICS_SHM_NAME);
+}
+
+static void lock_index_rebuild(const LockProfile *p);
+
+WorkerMetrics *metrics_bind_worker(int worker_id) {
+    if (!g_metrics || worker_id < 0 || worker_id >= METRICS_MAX_WORKERS) return NULL;
+    g_self = &g_metrics->workers[worker_id];
+    g_self_index = worker_id;
+    lock_index_rebuild(&g_metrics->lockprof[worker_id]);
+    METRIC_SET(g_self->pid, (uint32_t)getpid());
+    return g_self;
+}
+
+LoggerMetrics *metrics_bind_logger(int shard) {
+    if (!g_metrics || shard < 0 || shard >= METRICS_MAX_LOGGERS) return NULL;
+    LoggerMetrics *lm = &g_metrics->loggers[shard];
+    METRIC_SET(lm->pid, (uint32_t)getpid());
+    return lm;
+}
+
+// ============================================================================
+// Publishers
+// ============================================================================
+int metrics_op_index(int op_code) {
+    switch (op_code) {
+        case OP_LOGIN:         return METRICS_OP_LOGIN;
+        case OP_BALANCE:       return METRICS_OP_BALANCE;
+        case OP_TRANSFER:      return METRICS_OP_TRANSFER;
+        case OP_AGGREGATE:     return METRICS_OP_AGGREGATE;
+        case OP_BIND_ACCOUNT:  return METRICS_OP_BIND;
+        case OP_OPEN_ACCOUNT:  return METRICS_OP_OPEN;
+        case OP_CLOSE_ACCOUNT: return METRICS_OP_CLOSE;
+        case OP_STATS:         return METRICS_OP_STATS;
+        default:               return METRICS_OP_OTHER;
+    }
+}
+
+int metrics_op_code(int index) {
+    static const int codes[METRICS_OPS] = {
+        OP_LOGIN, OP_BALANCE, OP_TRANSFER, OP_AGGREGATE, OP_BIND_ACCOUNT, OP_OPEN_ACCOUNT, OP_CLOSE_ACCOUNT,
+        OP_STATS, 0
+    };
+    return (index >= 0 && index < METRICS_OPS) ? codes[index] : 0;
+}
+
+void metrics_count_request(WorkerMetrics *m, int op_code, int ret_code) {
+    if (!m) return;
+    int i = metrics_op_index(op_code);
+    METRIC_ADD(m->requests[i], 1);
+    // 正的 ret_code 是結果 (餘額 / 新帳戶 id)，不是錯誤
+    if (ret_code < 0) {
+        int e = -ret_code < METRICS_ERRORS ? -ret_code : METRICS_ERRORS - 1;
+        METRIC_ADD(m->failures[i], 1);
+        METRIC_ADD(m->errors[e], 1);
+    }
+}
+
+void metrics_admission_wait(uint64_t ns) {
+    if (!g_self) return;
+    METRIC_ADD(g_self->admission_waits, 1);
+    METRIC_ADD(g_self->admission_wait_ns, ns);
+    metrics_stage_add(METRICS_STAGE_ADMISSION, ns);
+    trace_span(METRICS_STAGE_ADMISSION, 0, ns);
+}
+
+void metrics_lock_wait(uint64_t ns) {
+    if (!g_self) return;
+    METRIC_ADD(g_self->lock_waits, 1);
+    METRIC_ADD(g_self->lock_wait_ns, ns);
+    metrics_stage_add(METRICS_STAGE_LOCK, ns);
+    trace_span(METRICS_STAGE_LOCK, 0, ns);
+}
+
+void metrics_bank_accounts(uint64_t open_accounts, uint64_t extents) {
+    if (!g_metrics) return;
+    METRIC_SET(g_metrics->bank.open_accounts, open_accounts);
+    METRIC_SET(g_metrics->bank.extents, extents);
+}
+
+// ============================================================================
+// Lock Profiler (--lock-profile): weighted SpaceSaving per worker
+// ============================================================================
+/*
+ * 每個 Worker 一個固定 K 格的 SpaceSaving：key = 帳戶 id，weight = 等鎖的 ns
+ * - 已在表裡：直接累加；表沒滿：佔一格
+ * - 表滿了：踢掉 weight 最小的一格，新帳戶繼承它的 weight 當誤差上界 (error_ns)
+ *   所以總等待超過 (全部等待 / K) 的鎖一定留在表裡
+ * - 沒等到鎖 (wait 0) 的取得只更新已經在表裡的帳戶：冷帳戶不會把表洗掉
+ * - 找格子用本行程私有的小 hash (account -> slot)，不用每次掃 K 格；
+ *   只有踢人時才掃一次找最小值並重建 hash。只有開 --lock-profile 才會被呼叫
+ * - Sketch 在 SHM、hash 在行程裡：bind 時從 SHM 的表重建 hash，
+ *   接手同一個 slot 的新行程 (重啟的 Worker) 才不會把已經在表裡的帳戶再佔一格
+ */
+#define LOCK_INDEX_SIZE (METRICS_LOCK_TOPK * 4)     // power of two, load <= 1/4
+static int32_t g_lock_key[LOCK_INDEX_SIZE];
+static uint8_t g_lock_slot[LOCK_INDEX_SIZE];        // slot + 1, 0 = empty
+
+static unsigned lock_hash(int32_t account) {
+    return ((uint32_t)account * 2654435761u) >> 16 & (LOCK_INDEX_SIZE - 1);
+}
+
+static void lock_index_put(int32_t account, int slot) {
+    unsigned h = lock_hash(account);
+    while (g_lock_slot[h]) h = (h + 1) & (LOCK_INDEX_SIZE - 1);
+    g_lock_key[h] = account;
+    g_lock_slot[h] = (uint8_t)(slot + 1);
+}
+
+static void lock_index_rebuild(const LockProfile *p) {
+    uint32_t used = p->used < METRICS_LOCK_TOPK ? p->used : METRICS_LOCK_TOPK;
+    memset(g_lock_slot, 0, sizeof(g_lock_slot));
+    for (uint32_t i = 0; i < used; i++) lock_index_put(p->top[i].account, (int)i);
+}
+
+static int lock_index_get(int32_t account) {
+    for (unsigned h = lock_hash(account); g_lock_slot[h]; h = (h + 1) & (LOCK_INDEX_SIZE - 1))
+        if (g_lock_key[h] == account) return g_lock_slot[h] - 1;
+    return -1;
+}
+
+int metrics_lock_profile_enable(void) {
+    if (!g_metrics) return -1;
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) METRIC_SET(g_metrics->lockprof[w].enabled, 1);
+    return 0;
+}
+
+int metrics_lock_acquired(int32_t account, uint64_t wait_ns) {
+    if (!g_self) return -1;
+    LockProfile *p = &g_metrics->lockprof[g_self_index];
+    int slot = lock_index_get(account);
+    if (slot >= 0) {
+        LockHotEntry *e = &p->top[slot];
+        METRIC_ADD(e->acquisitions, 1);
+        if (wait_ns) {
+            METRIC_ADD(e->weight_ns, wait_ns);
+            METRIC_ADD(e->waits, 1);
+            METRIC_ADD(e->wait_ns, wait_ns);
+            METRIC_ADD(p->events, 1);
+        }
+        return slot;
+    }
+    if (!wait_ns) return -1;
+
+    METRIC_ADD(p->events, 1);
+    uint32_t used = p->used;
+    uint64_t inherited = 0;
+    if (used < METRICS_LOCK_TOPK) {
+        slot = (int)used;
+        METRIC_SET(p->used, used + 1);
+        lock_index_put(account, slot);
+    } else {
+        slot = 0;
+        for (int i = 1; i < METRICS_LOCK_TOPK; i++)
+            if (p->top[i].weight_ns < p->top[slot].weight_ns) slot = i;
+        inherited = p->top[slot].weight_ns;
+        METRIC_ADD(p->evictions, 1);
+        METRIC_SET(p->top[slot].account, account);
+        lock_index_rebuild(p);
+    }
+    LockHotEntry *e = &p->top[slot];
+    METRIC_SET(e->account, account);
+    METRIC_SET(e->weight_ns, inherited + wait_ns);
+    METRIC_SET(e->error_ns, inherited);
+    METRIC_SET(e->acquisitions, 1);
+    METRIC_SET(e->waits, 1);
+    METRIC_SET(e->wait_ns, wait_ns);
+    METRIC_SET(e->hold_ns, 0);
+    METRIC_SET(e->hold_max_ns, 0);
+    return slot;
+}
+
+void metrics_lock_released(int32_t account, int hint, uint64_t hold_ns) {
+    if (!g_self || hint < 0 || hint >= METRICS_LOCK_TOPK) return;
+    LockHotEntry *e = &g_metrics->lockprof[g_self_index].top[hint];
+    if (e->account != account) return;   // 持有期間被別的帳戶擠掉了
+    METRIC_ADD(e->hold_ns, hold_ns);
+    if (hold_ns > e->hold_max_ns) METRIC_SET(e->hold_max_ns, hold_ns);
+}
+
+static int cmp_lock_wait(const void *a, const void *b) {
+    const LockHotEntry *x = a, *y = b;
+    return x->weight_ns < y->weight_ns ? 1 : x->weight_ns > y->weight_ns ? -1 : 0;
+}
+
+int metrics_lock_top(const MetricsShm *snap, LockHotEntry *out, int max) {
+    static LockHotEntry all[METRICS_MAX_WORKERS * METRICS_LOCK_TOPK];
+    int n = 0;
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        const LockProfile *p = &snap->lockprof[w];
+        uint32_t used = p->used < METRICS_LOCK_TOPK ? p->used : METRICS_LOCK_TOPK;
+        for (uint32_t i = 0; i < used; i++) {
+            const LockHotEntry *e = &p->top[i];
+            int j = 0;
+            while (j < n && all[j].account != e->account) j++;
+            if (j == n) {
+                memset(&all[n], 0, sizeof(all[n]));
+                all[n++].account = e->account;
+            }
+            // 不同 Worker 的同一把鎖：加總 (誤差上界也相加)
+            all[j].weight_ns += e->weight_ns;
+            all[j].error_ns += e->error_ns;
+            all[j].acquisitions += e->acquisitions;
+            all[j].waits += e->waits;
+            all[j].wait_ns += e->wait_ns;
+            all[j].hold_ns += e->hold_ns;
+            if (e->hold_max_ns > all[j].hold_max_ns) all[j].hold_max_ns = e->hold_max_ns;
+        }
+    }
+    qsort(all, (size_t)n, sizeof(all[0]), cmp_lock_wait);
+    if (n > max) n = max;
+    memcpy(out, all, sizeof(all[0]) * (size_t)n);
+    return n;
+}
+
+// ============================================================================
+// Latency Histograms (per worker, per op x stage)
+// ============================================================================
+int metrics_lat_bucket(uint64_t ns) {
+    if (ns < METRICS_LAT_SUB) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);                   // 2^e <= ns < 2^(e+1)
+    if (e > METRICS_LAT_MAX_EXP) return METRICS_LAT_BUCKETS - 1;
+    int sub = (int)(ns >> (e - METRICS_LAT_SUB_BITS)) & (METRICS_LAT_SUB - 1);
+    return (e - METRICS_LAT_SUB_BITS + 1) * METRICS_LAT_SUB + sub;
+}
+
+uint64_t metrics_lat_bucket_upper(int bucket) {
+    if (bucket < METRICS_LAT_SUB) return (uint64_t)bucket;
+    int e = bucket / METRICS_LAT_SUB + METRICS_LAT_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(bucket % METRICS_LAT_SUB);
+    return ((METRICS_LAT_SUB + sub + 1) << (e - METRICS_LAT_SUB_BITS)) - 1;
+}
+
+void metrics_hist_record(LatencyHist *h, uint64_t ns) {
+    METRIC_ADD(h->buckets[metrics_lat_bucket(ns)], 1);
+    METRIC_ADD(h->count, 1);
+    METRIC_ADD(h->sum_ns, ns);
+    if (ns > h->max_ns) METRIC_SET(h->max_ns, ns);
+}
+
+uint64_t metrics_lat_percentile(const LatencyHist *h, double pct) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(h->count * pct / 100.0);
+    if (rank >= h->count) rank = h->count - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            uint64_t upper = metrics_lat_bucket_upper(b);
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+void metrics_merge_latency(const MetricsShm *m, int op, int stage, LatencyHist *out) {
+    memset(out, 0, sizeof(*out));
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        const LatencyHist *h = &m->latency[w][op][stage];
+        uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        if (!count) continue;
+        out->count += count;
+        out->sum_ns += __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+        if (max > out->max_ns) out->max_ns = max;
+        for (int b = 0; b < METRICS_LAT_BUCKETS; b++) out->buckets[b] += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_req_begin(void) {
+    if (!g_self) return;
+    memset(&g_req, 0, sizeof(g_req));
+    trace_req_begin();
+}
+
+void metrics_stage_add(int stage, uint64_t ns) {
+    if (!g_self) return;
+    g_req.mask |= 1u << stage;
+    g_req.ns[stage] += ns;
+}
+
+void metrics_stage_set(int stage, uint64_t ns) {
+    if (!g_self) return;
+    g_req.mask |= 1u << stage;
+    g_req.ns[stage] = ns;
+}
+
+uint64_t metrics_stage_clock(void) {
+    return g_self ? clock_ns(CLOCK_MONOTONIC) : 0;
+}
+
+void metrics_stage_since(int stage, uint64_t t0) {
+    if (!g_self || !t0) return;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    metrics_stage_add(stage, now > t0 ? now - t0 : 0);
+    trace_span(stage, now, now > t0 ? now - t0 : 0);
+}
+
+void metrics_req_end(int op_code, int ret_code) {
+    if (!g_self) return;
+    int op = metrics_op_index(op_code);
+    metrics_count_request(g_self, op_code, ret_code);
+    LatencyHist *row = g_metrics->latency[g_self_index][op];
+    for (int s = 0; s < METRICS_STAGES; s++) {
+        if (g_req.mask & (1u << s)) metrics_hist_record(&row[s], g_req.ns[s]);
+    }
+    trace_req_end(op, ret_code, g_req.ns, g_req.mask); // 有開 trace 才會留下這個請求的 span
+}
+
+const MetricsShm *metrics_region(void) {
+    return g_metrics;
+}
+
+const char *metrics_op_name(int index) {
+    static const char *names[METRICS_OPS] = {
+        "LOGIN", "BALANCE", "TRANSFER", "AGGREGATE", "BIND", "OPEN", "CLOSE", "STATS", "OTHER"
+    };
+    return (index >= 0 && index < METRICS_OPS) ? names[index] : "?";
+}
+
+const char *metrics_stage_name(int stage) {
+    static const char *names[METRICS_STAGES] = {
+        "total", "parse", "admission", "lock", "critical", "log", "response"
+    };
+    return (stage >= 0 && stage < METRICS_STAGES) ? names[stage] : "?";
+}
+
+const char *metrics_error_name(int index) {
+    static const char *names[METRICS_ERRORS] = {
+        "OK", "INTERNAL", "INVALID_ID", "SAME_ACCOUNT", "INVALID_AMOUNT", "INSUFFICIENT",
+        "BUSY", "DUPLICATE_ID", "INDEX_FULL", "NONZERO_BALANCE", "NO_SPACE",
+        "OVERLOADED", "RATE_LIMITED", "ERR_13", "ERR_14", "OTHER"
+    };
+    return (index >= 0 && index < METRICS_ERRORS) ? names[index] : "?";
+}
+
+// ============================================================================
+// Readers (hsts-top, tools)
+// ============================================================================
+const MetricsShm *metrics_attach(char *err, size_t err_len) {
+    int fd = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        if (err) snprintf(err, err_len, "%s not found (server not running?)", METRICS_SHM_NAME);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(MetricsShm)) {
+        if (err) snprintf(err, err_len, "%s: unexpected size (layout version mismatch?)", METRICS_SHM_NAME);
+        close(fd);
+        return NULL;
+    }
+    const MetricsShm *m = mmap(NULL, sizeof(MetricsShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        if (err) snprintf(err, err_len, "%s: mmap failed", METRICS_SHM_NAME);
+        return NULL;
+    }
+    if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC ||
+        m->version != METRICS_VERSION || m->size != sizeof(MetricsShm)) {
+        if (err) snprintf(err, err_len, "%s: version %u, this reader understands %u",
+                          METRICS_SHM_NAME, m->version, METRICS_VERSION);
+        munmap((void *)m, sizeof(MetricsShm));
+        return NULL;
+    }
+    return m;
+}
+
+void metrics_detach(const MetricsShm *m) {
+    if (m) munmap((void *)m, sizeof(MetricsShm));
+}
+
+void metrics_snapshot(const MetricsShm *m, MetricsShm *out) {
+    // 每個 counter 都是對齊的 8 bytes：x86-64 上一般的複製不會讀到撕裂的值
+    memcpy(out, (const void *)m, sizeof(*out));
+}
+
+void metrics_sum_workers(const MetricsShm *snap, WorkerMetrics *out) {
+    memset(out, 0, sizeof(*out));
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        const WorkerMetrics *s = &snap->workers[w];
+        if (!s->pid) continue;
+        out->pid++;
+        for (int i = 0; i < METRICS_OPS; i++) {
+            out->requests[i] += s->requests[i];
+            out->failures[i] += s->failures[i];
+        }
+        for (int i = 0; i < METRICS_ERRORS; i++) out->errors[i] += s->errors[i];
+        out->connections += s->connections;
+        out->bad_packets += s->bad_packets;
+        out->admission_waits += s->admission_waits;
+        out->admission_wait_ns += s->admission_wait_ns;
+        out->lock_waits += s->lock_waits;
+        out->lock_wait_ns += s->lock_wait_ns;
+        out->settle_batches += s->settle_batches;
+        out->settle_items += s->settle_items;
+        out->settle_pending += s->settle_pending;
+        out->header_timeouts += s->header_timeouts;
+        out->body_timeouts += s->body_timeouts;
+        out->write_timeouts += s->write_timeouts;
+        out->parked_full += s->parked_full;
+        out->parked += s->parked;
+        out->rate_limited_account += s->rate_limited_account;
+        out->rate_limited_client += s->rate_limited_client;
+        out->rate_untracked += s->rate_untracked;
+    }
+}
@@ -0,0 +1,512 @@
+// 檔案位置: src/common/metrics_export.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "../../include/metrics.h"
+#include "../../include/trace.h"
+
+/*
+ * Prometheus Exporter: 把 metrics page 轉成 text exposition format (0.0.4)
+ *
+ * - 獨立的 exporter 行程 (或 hsts-top --prometheus) 只讀 metrics page 的快照：
+ *   scrape 不會送任何東西給 Worker，也不會碰 Bank SHM 或任何鎖
+ * - 直方圖的 le 用 2 的次方 (ns)：剛好落在 log-linear bucket 的邊界上，累積值是精確的
+ * - 一次只服務一個連線，讀寫都有 timeout：卡住的 scraper 最多拖住 exporter 自己
+ */
+
+#define EXPORT_IO_TIMEOUT_MS 2000
+#define EXPORT_LE_MIN_EXP 10          // 1.024 us
+#define EXPORT_LE_MAX_EXP 34          // ~17 s
+#define EXPORT_HOT_LOCKS 10           // --lock-profile：只匯出前 10 名 (label 數量有上限)
+
+static char g_unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];  // Unix socket 模式：結束時 unlink
+static volatile sig_atomic_t g_export_stop = 0;
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ============================================================================
+// Text Buffer
+// ============================================================================
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int oom;
+} TextBuf;
+
+static void tb_printf(TextBuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void tb_printf(TextBuf *b, const char *fmt, ...) {
+    if (b->oom) return;
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->buf + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            b->oom = 1;
+            return;
+        }
+        if ((size_t)n < b->cap - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+        size_t cap = b->cap * 2 + (size_t)n;
+        char *p = realloc(b->buf, cap);
+        if (!p) {
+            b->oom = 1;
+            return;
+        }
+        b->buf = p;
+        b->cap = cap;
+    }
+}
+
+static void tb_family(TextBuf *b, const char *name, const char *type, const char *help) {
+    tb_printf(b, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// ============================================================================
+// Rendering
+// ============================================================================
+static int pid_alive(uint32_t pid) {
+    return pid && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
+static void render_histograms(TextBuf *b, const MetricsShm *snap) {
+    static LatencyHist h;
+    tb_family(b, "hsts_request_duration_seconds", "histogram",
+              "Server-side request latency by op and stage (total = accepted to response written)");
+    for (int op = 0; op < METRICS_OPS; op++) {
+        for (int s = 0; s < METRICS_STAGES; s++) {
+            metrics_merge_latency(snap, op, s, &h);
+            // _count = +Inf = bucket 總和 (快照時 count 可能和 bucket 差一筆，以 bucket 為準)
+            uint64_t total = 0;
+            for (int i = 0; i < METRICS_LAT_BUCKETS; i++) total += h.buckets[i];
+            if (!total) continue;
+
+            const char *opn = metrics_op_name(op), *stn = metrics_stage_name(s);
+            uint64_t cum = 0;
+            int i = 0;
+            for (int e = EXPORT_LE_MIN_EXP; e <= EXPORT_LE_MAX_EXP; e++) {
+                uint64_t le_ns = 1ULL << e;
+                while (i < METRICS_LAT_BUCKETS && metrics_lat_bucket_upper(i) < le_ns) cum += h.buckets[i++];
+                tb_printf(b, "hsts_request_duration_seconds_bucket{op=\"%s\",stage=\"%s\",le=\"%.12g\"} %lu\n",
+                          opn, stn, le_ns / 1e9, (unsigned long)cum);
+            }
+            tb_printf(b, "hsts_request_duration_seconds_bucket{op=\"%s\",stage=\"%s\",le=\"+Inf\"} %lu\n",
+                      opn, stn, (unsigned long)total);
+            tb_printf(b, "hsts_request_duration_seconds_sum{op=\"%s\",stage=\"%s\"} %.9f\n", opn, stn,
+                      h.sum_ns / 1e9);
+            tb_printf(b, "hsts_request_duration_seconds_count{op=\"%s\",stage=\"%s\"} %lu\n", opn, stn,
+                      (unsigned long)total);
+        }
+    }
+}
+
+static void render_workers(TextBuf *b, const MetricsShm *snap) {
+    tb_family(b, "hsts_worker_up", "gauge", "1 if the worker process is alive");
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        uint32_t pid = snap->workers[w].pid;
+        if (!pid) continue;
+        tb_printf(b, "hsts_worker_up{worker=\"%d\",pid=\"%u\"} %d\n", w, pid, pid_alive(pid));
+    }
+    tb_family(b, "hsts_worker_requests_total", "counter", "Requests answered by each worker");
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        const WorkerMetrics *wm = &snap->workers[w];
+        if (!wm->pid) continue;
+        uint64_t t = 0;
+        for (int i = 0; i < METRICS_OPS; i++) t += wm->requests[i];
+        tb_printf(b, "hsts_worker_requests_total{worker=\"%d\"} %lu\n", w, (unsigned long)t);
+    }
+    tb_family(b, "hsts_settle_pending", "gauge", "Transfers buffered for the next settlement batch");
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        const WorkerMetrics *wm = &snap->workers[w];
+        if (!wm->pid) continue;
+        tb_printf(b, "hsts_settle_pending{worker=\"%d\"} %lu\n", w, (unsigned long)wm->settle_pending);
+    }
+}
+
+// 每個 logger shard 一行的 counter / gauge
+#define LOGGER_SERIES(field, name, type, help)                                                   \
+    do {                                                                                         \
+        tb_family(b, name, type, help);                                                          \
+        for (int k = 0; k < (int)snap->nloggers && k < METRICS_MAX_LOGGERS; k++)                 \
+            tb_printf(b, name "{shard=\"%d\"} %lu\n", k, (unsigned long)snap->loggers[k].field); \
+    } while (0)
+
+static void render_loggers(TextBuf *b, const MetricsShm *snap) {
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    int n = (int)snap->nloggers < METRICS_MAX_LOGGERS ? (int)snap->nloggers : METRICS_MAX_LOGGERS;
+
+    tb_family(b, "hsts_logger_up", "gauge", "1 if the logger shard process is alive");
+    for (int k = 0; k < n; k++) tb_printf(b, "hsts_logger_up{shard=\"%d\"} %d\n", k, pid_alive(snap->loggers[k].pid));
+    tb_family(b, "hsts_logger_heartbeat_age_seconds", "gauge", "Time since the logger shard last refreshed its slot");
+    for (int k = 0; k < n; k++) {
+        uint64_t tick = snap->loggers[k].tick_ns;
+        if (tick) tb_printf(b, "hsts_logger_heartbeat_age_seconds{shard=\"%d\"} %.3f\n", k,
+                            now > tick ? (now - tick) / 1e9 : 0.0);
+    }
+
+    LOGGER_SERIES(records, "hsts_log_records_total", "counter", "Audit records written");
+    LOGGER_SERIES(bytes, "hsts_log_bytes_total", "counter", "Audit log bytes written");
+    LOGGER_SERIES(writes, "hsts_log_writes_total", "counter", "write() calls on the audit log");
+    LOGGER_SERIES(fsyncs, "hsts_log_fsyncs_total", "counter", "fdatasync() calls on the audit log");
+    LOGGER_SERIES(seq_gaps, "hsts_log_seq_gaps_total", "counter", "Missing per-worker sequence numbers");
+    LOGGER_SERIES(dropped, "hsts_log_dropped_total", "counter", "Records dropped (ring and spill full)");
+    LOGGER_SERIES(spilled, "hsts_log_spilled_total", "counter", "Records spilled to files (ring or queue full)");
+    LOGGER_SERIES(merged, "hsts_log_merged_total", "counter", "Spilled records merged back into the audit log");
+    LOGGER_SERIES(sub_sent, "hsts_audit_stream_sent_total", "counter", "Records sent to audit stream subscribers");
+    LOGGER_SERIES(sub_skipped, "hsts_audit_stream_skipped_total", "counter",
+                  "Records skipped for subscribers that fell behind");
+
+    tb_family(b, "hsts_log_queue_depth", "gauge", "Audit records waiting for the logger shard");
+    for (int k = 0; k < n; k++) {
+        const LoggerMetrics *lm = &snap->loggers[k];
+        tb_printf(b, "hsts_log_queue_depth{shard=\"%d\",queue=\"ring\"} %lu\n", k, (unsigned long)lm->ring_depth);
+        tb_printf(b, "hsts_log_queue_depth{shard=\"%d\",queue=\"spill\"} %lu\n", k, (unsigned long)lm->spill_depth);
+        tb_printf(b, "hsts_log_queue_depth{shard=\"%d\",queue=\"sysv\"} %lu\n", k, (unsigned long)lm->mq_depth);
+    }
+    // logger 每個 tick 更新的百分位數 (從啟動累積的直方圖算出來，匯出成 gauge)
+    static const struct { const char *name, *help; size_t off; } lag[] = {
+        { "hsts_log_lag_p50_seconds", "Commit-to-write lag p50 since the shard started",
+          offsetof(LoggerMetrics, lag_p50_us) },
+        { "hsts_log_lag_p99_seconds", "Commit-to-write lag p99 since the shard started",
+          offsetof(LoggerMetrics, lag_p99_us) },
+        { "hsts_log_lag_max_seconds", "Commit-to-write lag max since the shard started",
+          offsetof(LoggerMetrics, lag_max_us) },
+    };
+    for (size_t j = 0; j < sizeof(lag) / sizeof(lag[0]); j++) {
+        tb_family(b, lag[j].name, "gauge", lag[j].help);
+        for (int k = 0; k < n; k++) {
+            uint64_t us = *(const volatile uint64_t *)((const char *)&snap->loggers[k] + lag[j].off);
+            tb_printf(b, "%s{shard=\"%d\"} %.6f\n", lag[j].name, k, us / 1e6);
+        }
+    }
+}
+
+static void render_hot_locks(TextBuf *b, const MetricsShm *snap) {
+    static LockHotEntry hot[EXPORT_HOT_LOCKS];
+    int n = metrics_lock_top(snap, hot, EXPORT_HOT_LOCKS);
+    // SpaceSaving 的格子會被換掉 (數字歸零)：匯出成 gauge，不是 counter
+    static const struct { const char *name, *type, *help; } fam[] = {
+        { "hsts_hot_lock_wait_seconds", "gauge", "Wait time on the most contended locks since tracked (top-N)" },
+        { "hsts_hot_lock_waits", "gauge", "Contended acquisitions of the most contended locks since tracked" },
+        { "hsts_hot_lock_hold_seconds", "gauge", "Hold time of the most contended locks since tracked" },
+    };
+    for (int f = 0; f < 3; f++) {
+        tb_family(b, fam[f].name, fam[f].type, fam[f].help);
+        for (int i = 0; i < n; i++) {
+            char lock[16];
+            if (hot[i].account == METRICS_LOCK_ALLOC) snprintf(lock, sizeof(lock), "alloc");
+            else snprintf(lock, sizeof(lock), "%d", hot[i].account);
+            if (f == 0) tb_printf(b, "%s{lock=\"%s\"} %.9f\n", fam[f].name, lock, hot[i].wait_ns / 1e9);
+            else if (f == 1) tb_printf(b, "%s{lock=\"%s\"} %lu\n", fam[f].name, lock, (unsigned long)hot[i].waits);
+            else tb_printf(b, "%s{lock=\"%s\"} %.9f\n", fam[f].name, lock, hot[i].hold_ns / 1e9);
+        }
+    }
+}
+
+char *metrics_render_prometheus(const MetricsShm *snap, size_t *len) {
+    TextBuf b = { .cap = 64 * 1024 };
+    b.buf = malloc(b.cap);
+    if (!b.buf) return NULL;
+    b.buf[0] = '\0';
+
+    WorkerMetrics sum;
+    metrics_sum_workers(snap, &sum);
+    double uptime = (clock_ns(CLOCK_MONOTONIC) - snap->start_mono_ns) / 1e9;
+
+    tb_family(&b, "hsts_up", "gauge", "1 while the server's metrics page is live");
+    tb_printf(&b, "hsts_up %d\n", snap->magic == METRICS_MAGIC);
+    tb_family(&b, "hsts_start_time_seconds", "gauge", "Server start time (Unix epoch)");
+    tb_printf(&b, "hsts_start_time_seconds %.3f\n", snap->start_ns / 1e9);
+    tb_family(&b, "hsts_uptime_seconds", "gauge", "Seconds since the server started");
+    tb_printf(&b, "hsts_uptime_seconds %.3f\n", uptime);
+
+    tb_family(&b, "hsts_requests_total", "counter", "Requests answered, by op");
+    for (int i = 0; i < METRICS_OPS; i++)
+        tb_printf(&b, "hsts_requests_total{op=\"%s\"} %lu\n", metrics_op_name(i), (unsigned long)sum.requests[i]);
+    tb_family(&b, "hsts_request_failures_total", "counter", "Requests answered with an error code, by op");
+    for (int i = 0; i < METRICS_OPS; i++)
+        tb_printf(&b, "hsts_request_failures_total{op=\"%s\"} %lu\n", metrics_op_name(i),
+                  (unsigned long)sum.failures[i]);
+    tb_family(&b, "hsts_errors_total", "counter", "Error responses, by BANK_ERR_* code");
+    for (int i = 1; i < METRICS_ERRORS; i++) {
+        if (!sum.errors[i] && i >= 13 && i < METRICS_ERRORS - 1) continue;   // 沒用到的號碼
+        tb_printf(&b, "hsts_errors_total{code=\"%s\"} %lu\n", metrics_error_name(i), (unsigned long)sum.errors[i]);
+    }
+
+    tb_family(&b, "hsts_connections_total", "counter", "Connections accepted");
+    tb_printf(&b, "hsts_connections_total %lu\n", (unsigned long)sum.connections);
+    tb_family(&b, "hsts_bad_packets_total", "counter", "Bad header / checksum / early disconnect");
+    tb_printf(&b, "hsts_bad_packets_total %lu\n", (unsigned long)sum.bad_packets);
+    tb_family(&b, "hsts_connection_timeouts_total", "counter",
+              "Connections closed at a read / write deadline, by phase (slow or stalled clients)");
+    tb_printf(&b, "hsts_connection_timeouts_total{phase=\"header\"} %lu\n", (unsigned long)sum.header_timeouts);
+    tb_printf(&b, "hsts_connection_timeouts_total{phase=\"body\"} %lu\n", (unsigned long)sum.body_timeouts);
+    tb_printf(&b, "hsts_connection_timeouts_total{phase=\"write\"} %lu\n", (unsigned long)sum.write_timeouts);
+    tb_family(&b, "hsts_connections_dropped_total", "counter",
+              "Incomplete connections closed because every parking slot was taken");
+    tb_printf(&b, "hsts_connections_dropped_total %lu\n", (unsigned long)sum.parked_full);
+    tb_family(&b, "hsts_connections_waiting", "gauge", "Connections waiting for the rest of a request packet");
+    tb_printf(&b, "hsts_connections_waiting %lu\n", (unsigned long)sum.parked);
+    tb_family(&b, "hsts_rate_limited_total", "counter", "Requests refused by a token bucket, by bucket key");
+    tb_printf(&b, "hsts_rate_limited_total{key=\"account\"} %lu\n", (unsigned long)sum.rate_limited_account);
+    tb_printf(&b, "hsts_rate_limited_total{key=\"client\"} %lu\n", (unsigned long)sum.rate_limited_client);
+    tb_family(&b, "hsts_rate_limit_untracked_total", "counter",
+              "Requests let through without a bucket (bucket table crowded around the key)");
+    tb_printf(&b, "hsts_rate_limit_untracked_total %lu\n", (unsigned long)sum.rate_untracked);
+    tb_family(&b, "hsts_admission_waits_total", "counter", "Requests that waited for a bank admission slot");
+    tb_printf(&b, "hsts_admission_waits_total %lu\n", (unsigned long)sum.admission_waits);
+    tb_family(&b, "hsts_admission_wait_seconds_total", "counter", "Time spent waiting for admission");
+    tb_printf(&b, "hsts_admission_wait_seconds_total %.9f\n", sum.admission_wait_ns / 1e9);
+    tb_family(&b, "hsts_lock_waits_total", "counter", "Account / allocator mutex acquisitions that found it held");
+    tb_printf(&b, "hsts_lock_waits_total %lu\n", (unsigned long)sum.lock_waits);
+    tb_family(&b, "hsts_lock_wait_seconds_total", "counter", "Time spent waiting for held mutexes");
+    tb_printf(&b, "hsts_lock_wait_seconds_total %.9f\n", sum.lock_wait_ns / 1e9);
+    tb_family(&b, "hsts_settle_batches_total", "counter", "Settlement batches flushed");
+    tb_printf(&b, "hsts_settle_batches_total %lu\n", (unsigned long)sum.settle_batches);
+    tb_family(&b, "hsts_settle_items_total", "counter", "Transfers settled in batches");
+    tb_printf(&b, "hsts_settle_items_total %lu\n", (unsigned long)sum.settle_items);
+
+    tb_family(&b, "hsts_open_accounts", "gauge", "Open accounts");
+    tb_printf(&b, "hsts_open_accounts %lu\n", (unsigned long)snap->bank.open_accounts);
+    tb_family(&b, "hsts_account_extents", "gauge", "Account table extents allocated");
+    tb_printf(&b, "hsts_account_extents %lu\n", (unsigned long)snap->bank.extents);
+
+    render_workers(&b, snap);
+    render_loggers(&b, snap);
+    render_histograms(&b, snap);
+    if (snap->lockprof[0].enabled) render_hot_locks(&b, snap);
+
+    if (b.oom) {
+        free(b.buf);
+        return NULL;
+    }
+    if (len) *len = b.len;
+    return b.buf;
+}
+
+// ============================================================================
+// Admin Listener
+// ============================================================================
+int metrics_export_listen(const char *addr) {
+    int fd;
+    const char *path = NULL;
+    if (strncmp(addr, "unix:", 5) == 0) path = addr + 5;
+    else if (strchr(addr, '/')) path = addr;
+
+    if (path) {
+        struct sockaddr_un un;
+        if (!*path || strlen(path) >= sizeof(un.sun_path)) {
+            fprintf(stderr, "[Exporter] Bad socket path: %s\n", addr);
+            return -1;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            perror("[Exporter] socket failed");
+            return -1;
+        }
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        snprintf(un.sun_path, sizeof(un.sun_path), "%s", path);
+        unlink(path);   // 上次沒清掉的 socket 檔
+        if (bind(fd, (struct sockaddr *)&un, sizeof(un)) == -1 || listen(fd, 16) == -1) {
+            perror("[Exporter] bind/listen failed");
+            close(fd);
+            return -1;
+        }
+        chmod(path, 0660);
+        snprintf(g_unix_path, sizeof(g_unix_path), "%s", path);
+        return fd;
+    }
+
+    // "PORT" 或 "HOST:PORT"；沒給 host 只聽 127.0.0.1 (admin 介面不對外)
+    char host[64] = "127.0.0.1";
+    const char *colon = strrchr(addr, ':');
+    const char *port_str = addr;
+    if (colon) {
+        size_t hl = (size_t)(colon - addr);
+        if (hl == 0 || hl >= sizeof(host)) {
+            fprintf(stderr, "[Exporter] Bad address: %s\n", addr);
+            return -1;
+        }
+        memcpy(host, addr, hl);
+        host[hl] = '\0';
+        port_str = colon + 1;
+    }
+    int port = atoi(port_str);
+    struct sockaddr_in in;
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons((uint16_t)port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, host, &in.sin_addr) != 1) {
+        fprintf(stderr, "[Exporter] Bad address: %s (use PORT, HOST:PORT or unix:PATH)\n", addr);
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("[Exporter] socket failed");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(fd, (struct sockaddr *)&in, sizeof(in)) == -1 || listen(fd, 16) == -1) {
+        perror("[Exporter] bind/listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void send_response(int fd, const char *status, const char *type, const char *body, size_t len, int head) {
+    char hdr[256];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, len);
+    if (write_all(fd, hdr, (size_t)n) == 0 && !head && len) write_all(fd, body, len);
+}
+
+// GET /trace：trace ring 的快照 (Server 沒開 tracing 時 404)
+static void serve_trace(int fd, const char *query, int head) {
+    const TraceShm *t = trace_region();
+    if (!t) {
+        static const char msg[] = "tracing off (start the server with --trace-sample / --trace-slow-us)\n";
+        send_response(fd, "404 Not Found", "text/plain", msg, sizeof(msg) - 1, head);
+        return;
+    }
+    uint64_t min_ns = 0;
+    const char *m = query ? strstr(query, "min_us=") : NULL;
+    if (m) min_ns = strtoull(m + 7, NULL, 10) * 1000ULL;
+
+    char *json = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&json, &len);
+    int n = out ? trace_write_chrome(t, out, min_ns) : -1;
+    if (out) fclose(out);
+    if (n < 0) {
+        send_response(fd, "500 Internal Server Error", "text/plain", "out of memory\n", 14, head);
+    } else {
+        send_response(fd, "200 OK", "application/json", json, len, head);
+    }
+    free(json);
+}
+
+// 讀完 request header (到空行)，只看第一行的 method 和 path
+static void serve_one(int fd, const MetricsShm *live) {
+    static MetricsShm snap;
+    char req[METRICS_EXPORT_MAX_REQUEST];
+    size_t got = 0;
+    struct timeval tv = { EXPORT_IO_TIMEOUT_MS / 1000, (EXPORT_IO_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    while (got < sizeof(req) - 1) {
+        ssize_t r = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR && !g_export_stop) continue;
+            return;   // 斷線 / timeout
+        }
+        got += (size_t)r;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[got] = '\0';
+
+    char method[8] = "", path[256] = "";
+    if (sscanf(req, "%7s %255s", method, path) != 2) {
+        send_response(fd, "400 Bad Request", "text/plain", "bad request\n", 12, 0);
+        return;
+    }
+    int head = strcmp(method, "HEAD") == 0;
+    if (!head && strcmp(method, "GET") != 0) {
+        send_response(fd, "405 Method Not Allowed", "text/plain", "GET only\n", 9, 0);
+        return;
+    }
+    char *q = strchr(path, '?');
+    if (q) *q++ = '\0';
+    if (strcmp(path, "/") == 0) {
+        static const char index[] = "HSTS metrics exporter: GET /metrics, GET /trace[?min_us=N] (Chrome trace JSON)\n";
+        send_response(fd, "200 OK", "text/plain", index, sizeof(index) - 1, head);
+        return;
+    }
+    if (strcmp(path, "/trace") == 0) {
+        serve_trace(fd, q, head);
+        return;
+    }
+    if (strcmp(path, "/metrics") != 0) {
+        send_response(fd, "404 Not Found", "text/plain", "not found\n", 10, head);
+        return;
+    }
+
+    metrics_snapshot(live, &snap);
+    size_t len = 0;
+    char *text = metrics_render_prometheus(&snap, &len);
+    if (!text) {
+        send_response(fd, "500 Internal Server Error", "text/plain", "out of memory\n", 14, head);
+        return;
+    }
+    send_response(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", text, len, head);
+    free(text);
+}
+
+static void on_export_signal(int sig) {
+    (void)sig;
+    g_export_stop = 1;
+}
+
+void metrics_export_loop(int listen_fd) {
+    const MetricsShm *live = metrics_region();
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_export_signal;   // 不設 SA_RESTART：poll / recv 被中斷後馬上結束
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t served = 0;
+    while (!g_export_stop && live) {
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        int r = poll(&pfd, 1, 1000);
+        if (r <= 0) continue;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) continue;
+        serve_one(fd, live);
+        close(fd);
+        served++;
+    }
+    close(listen_fd);
+    if (g_unix_path[0]) unlink(g_unix_path);
+    printf("[Exporter] Stopped after %lu scrapes.\n", (unsigned long)served);
+}
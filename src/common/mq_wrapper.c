@@ -7,23 +7,14 @@
 #include <errno.h>
 #include <time.h>       // 用於 logger_main_loop 寫時間
 #include <unistd.h>     // usleep
+#include <fcntl.h>      // open
+#include <signal.h>     // sigaction
+#include <sys/stat.h>   // mkdir
+#include <sys/time.h>   // setitimer
+#include <sys/uio.h>    // writev
+#include <sched.h>      // sched_yield
 #include "../../include/logger.h" // 引用學長的合約
-
-// ==========================================
-// [安全性設定] XOR 加密模組
-// ==========================================
-#define ENCRYPTION_KEY 0xAB 
-
-// [修改] 為了適應 struct，我們改成對 "記憶體位元組" 進行加密
-// void* data: 可以接受任何型態的指標
-// size_t len: 要加密的長度 (bytes)
-void apply_xor_cipher(void *data, size_t len) {
-    char *ptr = (char *)data; // 強制轉型成 byte 指標
-    for (size_t i = 0; i < len; i++) {
-        ptr[i] ^= ENCRYPTION_KEY;
-    }
-}
-// ==========================================
+#include "../../include/metrics.h"
 
 // 這些定義如果 logger.h 沒寫，我們這裡補上，確保能運作
 #ifndef MQ_KEY_FILE
@@ -43,8 +34,9 @@ int logger_mq_init() {
         key = 5678; 
     }
 
-    // 0666 | IPC_CREAT: 允許讀寫，不存在則建立
-    int mqid = msgget(key, 0666 | IPC_CREAT);
+    // 0600 | IPC_CREAT: 只有 Server 本身的使用者能讀寫，不存在則建立
+    // (Queue 裡是明文紀錄；落地的 audit log 由 Logger 整批加密，見 log_crypt.c)
+    int mqid = msgget(key, 0600 | IPC_CREAT);
     if (mqid == -1) {
         perror("[MQ Wrapper] msgget failed");
         return -1;
@@ -71,97 +63,766 @@ void logger_mq_cleanup(int mqid) {
 // 3. 非阻塞發送 (對應 logger.h 的 logger_send_async)
 // ----------------------------------------------------------------------------
 void logger_send_async(int mqid, int type, int status, int src, int dst, int amt) {
+    logger_send_async_at(mqid, type, status, src, dst, amt, 0);
+}
+
+static void send_record(int mqid, int type, int status, int src, int dst, int amt, uint64_t commit_ns) {
     LogMessage msg;
     
     // 1. 填寫資料
-    msg.mtype = 1;         // 必須 > 0
+    msg.mtype = 1 + logger_my_shard(); // 必須 > 0；多個 Logger 時用 mtype 分流
     msg.cmd_type = type;
     msg.status = status;
     msg.src_id = src;
     msg.dst_id = dst;
     msg.amount = amt;
 
-    // 2. 計算 payload 大小 (只要加密資料部分，不要加密 mtype)
-    // msgsnd 的大小定義是不包含 mtype 的
-    size_t payload_size = sizeof(LogMessage) - sizeof(long);
+    // 來源 / 順序 / 時間由送出端蓋章 (Logger 寫檔時間可能晚很多)
+    static uint32_t seq = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    msg.worker_id = logger_worker_id();
+    msg.reserved = 0;
+    msg.seq = ++seq;
+    msg.ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    if (commit_ns == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        commit_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+    msg.commit_ns = commit_ns;
 
-    // 3. [加密] 取得資料部分的指標
-    // 這裡我們跳過前面的 mtype，直接把後面的 int 欄位當成一坨 byte 來加密
-    void *payload_ptr = (void *)((char *)&msg + sizeof(long));
-    apply_xor_cipher(payload_ptr, payload_size);
+    // 已綁定 SHM ring 的 Worker：寫進自己的 ring 就結束 (不需要 system call，滿了會自動 spill)
+    if (log_ring_push(&msg) == 0) return;
+    // SysV 模式：spill 還沒被收完就繼續寫 spill，維持順序
+    if (log_spill_pending() && log_spill_push(&msg) == 0) return;
+
+    // 2. 計算 payload 大小：msgsnd 的大小定義是不包含 mtype 的
+    size_t payload_size = sizeof(LogMessage) - sizeof(long);
 
-    // 4. 發送 (使用 IPC_NOWAIT 避免卡住 Server)
+    // 3. 發送 (使用 IPC_NOWAIT 避免卡住 Server)
     if (msgsnd(mqid, &msg, payload_size, IPC_NOWAIT) == -1) {
-        // 如果 Queue 滿了 (EAGAIN)，為了不卡住 Server，我們選擇丟棄或印個 error
-        // 這裡只印 error，不做處理
         if (errno != EAGAIN) {
             perror("[MQ Wrapper] Async send failed");
+            return;
+        }
+        // Queue 滿了 (EAGAIN)：Worker 改寫進自己的 spill 檔，Logger 之後會收回
+        // spill 也滿了就只累計丟失數量 (Logger 會寫進 audit log)，不在最忙的時候印 stderr
+        if (log_spill_push(&msg) == 0 || logger_worker_id() != LOG_WORKER_NONE) return;
+        fprintf(stderr, "[MQ Wrapper] Queue full, log dropped!\n");
+    }
+}
+
+// 請求延遲的 "log" stage：從填紀錄到交給 ring / spill / SysV 為止 (沒有 metrics 的行程不讀時鐘)
+void logger_send_async_at(int mqid, int type, int status, int src, int dst, int amt, uint64_t commit_ns) {
+    uint64_t t0 = metrics_stage_clock();
+    send_record(mqid, type, status, src, dst, amt, commit_ns);
+    metrics_stage_since(METRICS_STAGE_LOG, t0);
+}
+
+// ----------------------------------------------------------------------------
+// 4. Logger 設定 (由 Master 在 fork 之前設定)
+// ----------------------------------------------------------------------------
+static LoggerConfig g_log_cfg = {
+    .path = LOG_DEFAULT_PATH,
+    .buffer_size = 1 << 20,
+    .flush_bytes = 256 << 10,
+    .flush_interval_ms = 100,
+    .sync_policy = LOG_SYNC_NONE,
+    .sync_interval_ms = 1000,
+    .batch_size = 256,
+    .batch_latency_us = 0,
+    .shards = 1
+};
+static int g_log_shard = 0;      // 本 Logger 行程負責的 shard
+
+void logger_config_default(LoggerConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    snprintf(cfg->path, sizeof(cfg->path), "%s", LOG_DEFAULT_PATH);
+    cfg->buffer_size = 1 << 20;
+    cfg->flush_bytes = 256 << 10;
+    cfg->flush_interval_ms = 100;
+    cfg->sync_policy = LOG_SYNC_NONE;
+    cfg->sync_interval_ms = 1000;
+    cfg->batch_size = 256;
+    cfg->batch_latency_us = 0;
+    cfg->shards = 1;
+}
+
+void logger_configure(const LoggerConfig *cfg) {
+    g_log_cfg = *cfg;
+    if (g_log_cfg.format == LOG_FORMAT_BINARY && strcmp(g_log_cfg.path, LOG_DEFAULT_PATH) == 0)
+        snprintf(g_log_cfg.path, sizeof(g_log_cfg.path), "%s", LOG_DEFAULT_BIN_PATH);
+    if (g_log_cfg.buffer_size < 4096) g_log_cfg.buffer_size = 4096;
+    if (g_log_cfg.flush_bytes == 0 || g_log_cfg.flush_bytes > g_log_cfg.buffer_size)
+        g_log_cfg.flush_bytes = g_log_cfg.buffer_size;
+    if (g_log_cfg.batch_size < 1) g_log_cfg.batch_size = 1;
+    if (g_log_cfg.batch_size > LOG_BATCH_MAX) g_log_cfg.batch_size = LOG_BATCH_MAX;
+    if (g_log_cfg.batch_latency_us < 0) g_log_cfg.batch_latency_us = 0;
+    // Index 的 offset 是 uint32：單一 segment 必須小於 4 GiB (只設 rotate_sec 時也照這個上限換，見 writer_maybe_rotate)
+    if (g_log_cfg.rotate_mb > LOG_SEGMENT_MAX_MB) g_log_cfg.rotate_mb = LOG_SEGMENT_MAX_MB;
+    if (g_log_cfg.rotate_sec < 0) g_log_cfg.rotate_sec = 0;
+    if (g_log_cfg.keep_segments < 0) g_log_cfg.keep_segments = 0;
+    if (g_log_cfg.shards < 1) g_log_cfg.shards = 1;
+    if (g_log_cfg.shards > LOG_SHARDS_MAX) g_log_cfg.shards = LOG_SHARDS_MAX;
+    // 加密只支援 binary (header 放 nonce)；文字格式不能默默變成明文，由呼叫端先擋掉
+    if (g_log_cfg.format != LOG_FORMAT_BINARY) g_log_cfg.encrypt = 0;
+}
+
+void logger_shard_path(const char *base, int shard, char *out, size_t len) {
+    const char *slash = strrchr(base, '/');
+    const char *dot = strrchr(base, '.');
+    if (!dot || (slash && dot < slash) || dot == (slash ? slash + 1 : base)) {
+        snprintf(out, len, "%s.s%d", base, shard);
+    } else {
+        snprintf(out, len, "%.*s.s%d%s", (int)(dot - base), base, shard, dot);
+    }
+}
+
+void logger_select_shard(int shard) {
+    if (logger_shard_count() <= 1 || log_ring_select_shard(shard) != 0) return;
+    g_log_shard = shard;
+    char path[sizeof(g_log_cfg.path)];
+    logger_shard_path(g_log_cfg.path, shard, path, sizeof(path));
+    memcpy(g_log_cfg.path, path, sizeof(path));
+    if (g_log_cfg.sub_path[0]) {
+        char sub[sizeof(g_log_cfg.sub_path)];
+        logger_shard_path(g_log_cfg.sub_path, shard, sub, sizeof(sub));
+        memcpy(g_log_cfg.sub_path, sub, sizeof(sub));
+    }
+}
+
+// ----------------------------------------------------------------------------
+// 5. Persistent buffered writer
+//    檔案只開一次；一整批紀錄格式化進 batch buffer，
+//    pending + batch 超過門檻時用「一次 writev」寫出 (batch 不必再複製)
+//    Binary 格式則直接 append 到 mmap 的檔案 (audit_log.c)，不做任何格式化
+//    開啟 rotation 時寫的是 "<path>.NNNNNN" segment，同時在記憶體累積
+//    account -> offset 的 index，segment 封存時寫出 "<segment>.idx" (audit_index.c)
+//    設了 encrypt：binary append 時整批做一次 AES-CTR (log_crypt.c)，Worker 端完全不碰加密
+//    寫完的每一批同時推給 audit stream 訂閱者 (audit_sub.c)
+// ----------------------------------------------------------------------------
+#define LOG_RECORD_MAX 160   // 單筆文字紀錄的上限
+#define LOG_SEGMENT_PATH_MAX (sizeof(g_log_cfg.path) + 16)
+
+typedef struct {
+    int fd;
+    char *buf;               // pending: 還沒寫出的資料
+    size_t len;
+    size_t cap;
+    char *batch;             // 本批格式化結果
+    size_t batch_cap;
+    int binary;              // LOG_FORMAT_BINARY
+    AuditFile af;
+    LogCipher *cipher;       // encrypt: 展開好的 key (每個 segment 共用，nonce 各自不同)
+    AuditTimeCache tc;       // 快取的時間戳 (同一秒只做一次 localtime/strftime)
+    long long oldest_ms;     // pending 中最舊一筆的時間 (0 = pending 是空的)
+    long long last_sync_ms;
+    int unsynced;            // 有 write 但還沒 fdatasync
+    uint64_t dropped_seen;   // 已經寫進 log 的 ring 丟失數量
+    uint32_t next_seq[LOG_RING_MAX_PRODUCERS]; // 每個 Worker 下一個預期的 seq (0 = 還沒看過)
+    LoggerStats *stats;      // SHM 中的統計 (可能是 NULL)
+    LoggerMetrics *metrics;  // metrics page 上本 shard 的 slot (可能是 NULL)，每個 tick 更新一次
+    // Segment rotation (rotate_mb / rotate_sec)
+    int rotating;
+    uint32_t seg_no;
+    char seg_path[LOG_SEGMENT_PATH_MAX];
+    uint64_t seg_bytes;      // 目前 segment 的邏輯大小 (包含還在 pending 的資料)
+    long long seg_start_ms;
+    AuditIndexBuilder *index;
+} LogWriter;
+
+static volatile sig_atomic_t g_logger_stop = 0;
+static volatile sig_atomic_t g_logger_tick = 0;
+
+static void logger_on_signal(int sig) {
+    if (sig == SIGTERM || sig == SIGINT) g_logger_stop = 1;
+    else if (sig == SIGALRM) g_logger_tick = 1; // 週期性檢查 flush/sync 期限
+}
+
+static long long mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static long long mono_ms(void) {
+    return mono_us() / 1000;
+}
+
+// Logger 是唯一的寫入者：relaxed store 就夠了，讀者只需要看到大概的數字
+#define STAT_ADD(w, field, v) \
+    do { if ((w)->stats) __atomic_store_n(&(w)->stats->field, (w)->stats->field + (v), __ATOMIC_RELAXED); } while (0)
+
+// mkdir -p 的 system call 版本 (取代原本每筆都 fork 一次的 system("mkdir -p logs"))
+static void make_parent_dirs(const char *path) {
+    char tmp[sizeof(g_log_cfg.path)];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) == -1 && errno != EEXIST) perror("[Logger Process] mkdir failed");
+        *p = '/';
+    }
+}
+
+static int writer_open_file(LogWriter *w, const char *path) {
+    if (w->binary) {
+        if (audit_open_encrypted(&w->af, path, w->cipher) != 0) return -1;
+        w->fd = w->af.fd;
+        w->seg_bytes = sizeof(AuditFileHeader) + w->af.hdr->record_count * sizeof(AuditRecord);
+    } else {
+        w->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (w->fd != -1) {
+            off_t end = lseek(w->fd, 0, SEEK_END);
+            w->seg_bytes = end > 0 ? (uint64_t)end : 0;
+        }
+    }
+    if (w->fd == -1) {
+        perror("[Logger Process] Cannot open log file");
+        return -1;
+    }
+    w->seg_start_ms = mono_ms();
+    return 0;
+}
+
+// 目前開著的 segment 檔 (rotation 時新舊兩個要同時開著)
+typedef struct {
+    int fd;
+    AuditFile af;
+    uint32_t seg_no;
+    char seg_path[LOG_SEGMENT_PATH_MAX];
+    uint64_t seg_bytes;
+    long long seg_start_ms;
+} SegmentFile;
+
+static void segment_save(const LogWriter *w, SegmentFile *s) {
+    s->fd = w->fd;
+    s->af = w->af;
+    s->seg_no = w->seg_no;
+    memcpy(s->seg_path, w->seg_path, sizeof(s->seg_path));
+    s->seg_bytes = w->seg_bytes;
+    s->seg_start_ms = w->seg_start_ms;
+}
+
+static void segment_load(LogWriter *w, const SegmentFile *s) {
+    w->fd = s->fd;
+    w->af = s->af;
+    w->seg_no = s->seg_no;
+    memcpy(w->seg_path, s->seg_path, sizeof(w->seg_path));
+    w->seg_bytes = s->seg_bytes;
+    w->seg_start_ms = s->seg_start_ms;
+}
+
+static void writer_close_file(LogWriter *w) {
+    if (w->binary) audit_close(&w->af);
+    else close(w->fd);
+    w->fd = -1;
+}
+
+// 新的 segment 永遠接在現有最大編號之後 (上次當機留下的 segment 不會被覆寫)
+static void writer_next_segment(LogWriter *w, const LoggerConfig *cfg) {
+    if (w->seg_no == 0) audit_segment_list(cfg->path, NULL, 0, &w->seg_no, NULL);
+    w->seg_no++;
+    snprintf(w->seg_path, sizeof(w->seg_path), AUDIT_SEGMENT_FMT, cfg->path, w->seg_no);
+}
+
+static int writer_open(LogWriter *w, const LoggerConfig *cfg) {
+    memset(w, 0, sizeof(*w));
+    make_parent_dirs(cfg->path);
+
+    w->binary = (cfg->format == LOG_FORMAT_BINARY);
+    if (w->binary && cfg->encrypt) {
+        w->cipher = malloc(sizeof(LogCipher));
+        if (!w->cipher) return -1;
+        log_cipher_init(w->cipher, cfg->key);
+    }
+    w->rotating = (cfg->rotate_mb > 0 || cfg->rotate_sec > 0);
+    if (w->rotating) {
+        w->index = audit_index_new();
+        if (!w->index) {
+            free(w->cipher);
+            return -1;
+        }
+        writer_next_segment(w, cfg);
+    } else {
+        snprintf(w->seg_path, sizeof(w->seg_path), "%s", cfg->path);
+    }
+    if (writer_open_file(w, w->seg_path) != 0) {
+        audit_index_free(w->index);
+        free(w->cipher);
+        return -1;
+    }
+
+    w->cap = cfg->buffer_size;
+    w->buf = malloc(w->cap);
+    w->batch_cap = (size_t)cfg->batch_size * LOG_RECORD_MAX;
+    w->batch = malloc(w->batch_cap);
+    if (!w->buf || !w->batch) {
+        free(w->buf);
+        free(w->batch);
+        writer_close_file(w);
+        audit_index_free(w->index);
+        free(w->cipher);
+        return -1;
+    }
+    w->last_sync_ms = mono_ms();
+
+    w->stats = logger_stats();
+    w->metrics = metrics_bind_logger(g_log_shard);
+    if (w->stats) {
+        w->stats->cfg_batch_size = cfg->batch_size;
+        w->stats->cfg_batch_latency_us = (uint32_t)cfg->batch_latency_us;
+    }
+    return 0;
+}
+
+static void writer_sync(LogWriter *w, long long now_ms) {
+    if (!w->unsynced) return;
+    if (fdatasync(w->fd) == -1) perror("[Logger Process] fdatasync failed");
+    w->unsynced = 0;
+    w->last_sync_ms = now_ms;
+    STAT_ADD(w, fsyncs, 1);
+}
+
+// pending (+ 本批) 一次 writev 寫出
+static void writer_flush_with(LogWriter *w, const LoggerConfig *cfg, const char *extra, size_t extra_len) {
+    struct iovec iov[2] = {
+        { w->buf, w->len },
+        { (void *)extra, extra_len }
+    };
+    struct iovec *v = iov;
+    int cnt = 2;
+    size_t total = w->len + extra_len;
+    if (total == 0) return;
+
+    while (cnt > 0) {
+        // 跳過已經寫完 (或本來就是空) 的 iovec
+        while (cnt > 0 && v->iov_len == 0) { v++; cnt--; }
+        if (cnt == 0) break;
+
+        ssize_t n = writev(w->fd, v, cnt);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("[Logger Process] writev failed");
+            break; // 磁碟出問題：丟掉這批，不要卡死 Logger
+        }
+        STAT_ADD(w, writes, 1);
+        // 部分寫入：往前推進 iovec
+        while (n > 0) {
+            size_t step = (size_t)n < v->iov_len ? (size_t)n : v->iov_len;
+            v->iov_base = (char *)v->iov_base + step;
+            v->iov_len -= step;
+            n -= (ssize_t)step;
+            if (v->iov_len == 0 && n > 0) { v++; cnt--; }
+        }
+    }
+    STAT_ADD(w, bytes, total);
+    w->unsynced = 1;
+    w->len = 0;
+    w->oldest_ms = 0;
+
+    long long now = mono_ms();
+    if (cfg->sync_policy == LOG_SYNC_FLUSH ||
+        (cfg->sync_policy == LOG_SYNC_INTERVAL && now - w->last_sync_ms >= cfg->sync_interval_ms)) {
+        writer_sync(w, now);
+    }
+}
+
+static void writer_flush(LogWriter *w, const LoggerConfig *cfg) {
+    writer_flush_with(w, cfg, NULL, 0);
+}
+
+// 整批格式化到 batch buffer，然後「搬進 pending」或「跟 pending 一起 writev」
+static void writer_write_text(LogWriter *w, const LoggerConfig *cfg, const AuditRecord *recs, int count) {
+    size_t blen = 0;
+    for (int i = 0; i < count; i++) {
+        int n = audit_format_text(w->batch + blen, w->batch_cap - blen, &recs[i], &w->tc);
+        if (n <= 0 || (size_t)n >= w->batch_cap - blen) continue;
+        if (w->index) audit_index_add(w->index, &recs[i], (uint32_t)(w->seg_bytes + blen));
+        blen += (size_t)n;
+    }
+    w->seg_bytes += blen;
+
+    if (w->len + blen >= cfg->flush_bytes || blen > w->cap - w->len) {
+        writer_flush_with(w, cfg, w->batch, blen);
+    } else {
+        memcpy(w->buf + w->len, w->batch, blen);
+        w->len += blen;
+        if (w->oldest_ms == 0) w->oldest_ms = mono_ms();
+    }
+}
+
+static void writer_write_records(LogWriter *w, const LoggerConfig *cfg, const AuditRecord *recs, int count) {
+    if (!w->binary) {
+        writer_write_text(w, cfg, recs, count);
+        audit_sub_publish(recs, count);
+        return;
+    }
+    // 固定長度紀錄直接 append 到 mapping：沒有格式化、沒有 write(2)
+    if (audit_append(&w->af, recs, count) != 0) return;
+    if (w->index) {
+        for (int i = 0; i < count; i++)
+            audit_index_add(w->index, &recs[i], (uint32_t)(w->seg_bytes + (uint64_t)i * sizeof(AuditRecord)));
+    }
+    w->seg_bytes += (uint64_t)count * sizeof(AuditRecord);
+    STAT_ADD(w, bytes, (uint64_t)count * sizeof(AuditRecord));
+    w->unsynced = 1;
+    if (cfg->sync_policy == LOG_SYNC_FLUSH) writer_sync(w, mono_ms());
+    // 訂閱者拿到的是明文 AuditRecord (加密只針對落地的檔案)
+    audit_sub_publish(recs, count);
+}
+
+static void writer_write_batch(LogWriter *w, const LoggerConfig *cfg, const LogMessage *msgs, int count) {
+    static AuditRecord recs[LOG_BATCH_MAX];
+    for (int i = 0; i < count; i++) audit_record_from_msg(&recs[i], &msgs[i]);
+    writer_write_records(w, cfg, recs, count);
+}
+
+// Ring 滿了被丟掉的紀錄不能無聲無息：在 audit log 裡留下一行說明
+static void writer_note_drops(LogWriter *w, const LoggerConfig *cfg) {
+    uint64_t dropped = log_ring_dropped();
+    if (dropped == w->dropped_seen) return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    AuditRecord note;
+    memset(&note, 0, sizeof(note));
+    note.ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    note.worker_id = LOG_WORKER_NONE;
+    note.flags = AUDIT_FLAG_DROPPED;
+    note.amount = (int32_t)(dropped - w->dropped_seen);
+    w->dropped_seen = dropped;
+    writer_write_records(w, cfg, &note, 1);
+}
+
+// 封存目前的 segment：寫出、關檔、寫 index，再刪掉超過 keep_segments 的舊 segment
+// (newer = 已經開好、還沒封存的下一個 segment 數，不算在 keep_segments 裡)
+static void writer_seal_segment(LogWriter *w, const LoggerConfig *cfg, int newer) {
+    writer_flush(w, cfg);
+    if (cfg->sync_policy != LOG_SYNC_NONE) writer_sync(w, mono_ms());
+    writer_close_file(w);
+    if (!w->index) return;
+    if (w->seg_bytes <= (w->binary ? sizeof(AuditFileHeader) : 0)) {
+        unlink(w->seg_path); // 沒寫過任何紀錄的 segment 不留下來
+        return;
+    }
+
+    char idx_path[LOG_SEGMENT_PATH_MAX + sizeof(AUDIT_INDEX_SUFFIX)];
+    snprintf(idx_path, sizeof(idx_path), "%s%s", w->seg_path, AUDIT_INDEX_SUFFIX);
+    audit_index_write(w->index, idx_path, cfg->format);
+    audit_index_reset(w->index);
+
+    if (cfg->keep_segments <= 0) return;
+    // 只刪最舊的 (total - keep) 個；一次最多拿 1024 個最舊的編號，不夠就再掃一次
+    for (;;) {
+        uint32_t nums[1024];
+        int total = 0;
+        int n = audit_segment_list(cfg->path, nums, 1024, NULL, &total);
+        int excess = total - newer - cfg->keep_segments;
+        if (excess <= 0 || n == 0) return;
+        for (int i = 0; i < n && i < excess; i++) {
+            char old[LOG_SEGMENT_PATH_MAX + sizeof(AUDIT_INDEX_SUFFIX)];
+            snprintf(old, sizeof(old), AUDIT_SEGMENT_FMT, cfg->path, nums[i]);
+            unlink(old);
+            strcat(old, AUDIT_INDEX_SUFFIX);
+            unlink(old);
+        }
+        if (excess <= n) return;
+    }
+}
+
+// 大小或時間到了就換下一個 segment (空的 segment 不換)
+// rotate_mb == 0 (只有 rotate_sec) 也要在 LOG_SEGMENT_MAX_MB 換：index 的 offset 是 uint32，
+// 檢查在每批寫入之前，所以 segment 最多超過上限一批 (LOG_BATCH_MAX 筆，遠小於剩下的 1 MB)
+static void writer_maybe_rotate(LogWriter *w, const LoggerConfig *cfg) {
+    if (!w->rotating) return;
+    uint64_t empty = w->binary ? sizeof(AuditFileHeader) : 0;
+    if (w->seg_bytes <= empty) return;
+
+    unsigned cap_mb = cfg->rotate_mb > 0 ? cfg->rotate_mb : LOG_SEGMENT_MAX_MB;
+    int full = w->seg_bytes >= ((uint64_t)cap_mb << 20);
+    int old = cfg->rotate_sec > 0 && mono_ms() - w->seg_start_ms >= (long long)cfg->rotate_sec * 1000;
+    if (!full && !old) return;
+
+    // 先開好下一個 segment 才封存目前的：開不了就繼續寫目前的 segment 下次再試。
+    // 目前的 segment 沒有封存過，index 也還在累積，不會出現「.idx 只有後半段」的情況
+    writer_flush(w, cfg);
+    SegmentFile cur, next;
+    segment_save(w, &cur);
+    writer_next_segment(w, cfg);
+    int r = writer_open_file(w, w->seg_path);
+    segment_save(w, &next);
+    segment_load(w, &cur);
+    if (r != 0) return;
+    writer_seal_segment(w, cfg, 1);
+    segment_load(w, &next);
+}
+
+// SIGALRM 的間隔：flush 門檻跟 LOG_TICK_MAX_MS 取小的。flush_interval_ms == 0 只關掉時間門檻的 flush，
+// 其他週期性工作 (訂閱者、fdatasync、rotation、metrics、丟失回報) 一樣要跑
+#define LOG_TICK_MAX_MS 100
+static int logger_tick_ms(const LoggerConfig *cfg) {
+    return cfg->flush_interval_ms > 0 && cfg->flush_interval_ms < LOG_TICK_MAX_MS ? cfg->flush_interval_ms
+                                                                                  : LOG_TICK_MAX_MS;
+}
+
+// 週期性工作 (SIGALRM)：時間門檻 flush、interval fdatasync、回報丟失、時間 rotation
+static int writer_tick(LogWriter *w, const LoggerConfig *cfg) {
+    if (!g_logger_tick) return 0;
+    g_logger_tick = 0;
+
+    writer_note_drops(w, cfg);
+    long long now = mono_ms();
+    if (cfg->flush_interval_ms > 0 && w->oldest_ms && now - w->oldest_ms >= cfg->flush_interval_ms)
+        writer_flush(w, cfg);
+    if (cfg->sync_policy == LOG_SYNC_INTERVAL && now - w->last_sync_ms >= cfg->sync_interval_ms)
+        writer_sync(w, now);
+    writer_maybe_rotate(w, cfg);
+    audit_sub_poll();   // 新的訂閱者 / 之前送不出去的訂閱者
+    return 1;
+}
+
+// 把本 shard 的狀態抄到 metrics page (每個 tick 一次，hsts-top 讀的就是這裡)
+static void writer_publish_metrics(LogWriter *w, int mqid, int use_ring) {
+    LoggerMetrics *m = w->metrics;
+    if (!m) return;
+    uint64_t ring, spill;
+    log_ring_backlog(&ring, &spill);
+    METRIC_SET(m->ring_depth, ring);
+    METRIC_SET(m->spill_depth, spill);
+    // SysV queue 是所有 shard 共用的：由 shard 0 回報 (每個 tick 一次 msgctl，不是每 1 ms)
+    struct msqid_ds qs;
+    if (!use_ring && g_log_shard == 0 && msgctl(mqid, IPC_STAT, &qs) == 0) METRIC_SET(m->mq_depth, (uint64_t)qs.msg_qnum);
+    METRIC_SET(m->dropped, log_ring_dropped());
+    uint64_t spilled, merged;
+    log_spill_stats(&spilled, &merged);
+    METRIC_SET(m->spilled, spilled);
+    METRIC_SET(m->merged, merged);
+    if (w->stats) {
+        METRIC_SET(m->records, w->stats->records);
+        METRIC_SET(m->bytes, w->stats->bytes);
+        METRIC_SET(m->writes, w->stats->writes);
+        METRIC_SET(m->fsyncs, w->stats->fsyncs);
+        METRIC_SET(m->seq_gaps, w->stats->seq_gaps);
+        METRIC_SET(m->lag_p50_us, logger_lag_percentile_us(w->stats, 50.0));
+        METRIC_SET(m->lag_p99_us, logger_lag_percentile_us(w->stats, 99.0));
+        METRIC_SET(m->lag_max_us, w->stats->lag_max_ns / 1000);
+    }
+    uint64_t served, sent, skipped;
+    audit_sub_stats(&served, &sent, &skipped);
+    METRIC_SET(m->sub_sent, sent);
+    METRIC_SET(m->sub_skipped, skipped);
+    METRIC_SET(m->tick_ns, (uint64_t)mono_us() * 1000);
+}
+
+static void writer_close(LogWriter *w, const LoggerConfig *cfg) {
+    writer_note_drops(w, cfg);
+    writer_seal_segment(w, cfg, 0);
+    audit_index_free(w->index);
+    free(w->cipher);
+    free(w->buf);
+    free(w->batch);
+}
+
+static void stats_record_batch(LogWriter *w, int n, long long fill_us) {
+    if (!w->stats) return;
+    int bucket = 0;
+    while (bucket < LOG_BATCH_HIST - 1 && (1 << (bucket + 1)) <= n) bucket++;
+
+    STAT_ADD(w, batches, 1);
+    STAT_ADD(w, records, (uint64_t)n);
+    STAT_ADD(w, batch_fill_us, (uint64_t)fill_us);
+    STAT_ADD(w, batch_hist[bucket], 1);
+    if ((uint64_t)n > w->stats->max_batch) __atomic_store_n(&w->stats->max_batch, (uint64_t)n, __ATOMIC_RELAXED);
+}
+
+// 端到端延遲 (commit -> 交給 writer) 與每個 Worker 的 seq 缺號
+static void stats_record_lag(LogWriter *w, const LogMessage *msgs, int n) {
+    if (!w->stats) return;
+    uint64_t now = (uint64_t)mono_us() * 1000;
+    uint64_t max = w->stats->lag_max_ns, gaps = 0, reorders = 0;
+
+    for (int i = 0; i < n; i++) {
+        const LogMessage *m = &msgs[i];
+        if (m->commit_ns && m->commit_ns <= now) {
+            uint64_t lag = now - m->commit_ns;
+            uint64_t us = lag / 1000;
+            int bucket = 0;
+            while (bucket < LOG_LAG_HIST - 1 && (1ULL << bucket) <= us) bucket++;
+            STAT_ADD(w, lag_hist[bucket], 1);
+            if (lag > max) max = lag;
+        }
+
+        if (m->worker_id >= LOG_RING_MAX_PRODUCERS) continue;
+        uint32_t *next = &w->next_seq[m->worker_id];
+        int32_t d = (int32_t)(m->seq - *next);
+        if (*next == 0 || m->seq == 1) {
+            *next = m->seq + 1;         // 第一次看到 / Worker 重新啟動
+        } else if (d >= 0) {
+            gaps += (uint64_t)d;
+            *next = m->seq + 1;
         } else {
-            fprintf(stderr, "[MQ Wrapper] Queue full, log dropped!\n");
+            reorders++;
         }
     }
+    if (max > w->stats->lag_max_ns) __atomic_store_n(&w->stats->lag_max_ns, max, __ATOMIC_RELAXED);
+    if (gaps) STAT_ADD(w, seq_gaps, gaps);
+    if (reorders) STAT_ADD(w, seq_reorders, reorders);
 }
 
 // ----------------------------------------------------------------------------
-// 4. Logger 主迴圈 (對應 logger.h 的 logger_main_loop)
+// 6. 收一批：SysV Message Queue
+//    第一筆阻塞 msgrcv，之後 IPC_NOWAIT 補到 batch_size，
+//    Queue 暫時空了就在 batch_latency_us 內再等一下
+// Return: >0 筆數, 0 = 被訊號打斷, -1 = 結束 (Queue 清空且正在關閉 / 被移除)
 // ----------------------------------------------------------------------------
-void logger_main_loop(int mqid) {
-    LogMessage msg;
+static int sysv_recv(int mqid, LogMessage *msg, int flags) {
     size_t payload_size = sizeof(LogMessage) - sizeof(long);
+    if (msgrcv(mqid, msg, payload_size, 1 + g_log_shard, flags) == -1) return -1;
+    return 0;
+}
+
+static int collect_sysv(int mqid, LogMessage *batch, const LoggerConfig *cfg, long long *fill_us) {
+    // 1. 接收：Queue 空了才收 spill (Worker 是在 Queue 滿的時候才 spill，spill 的紀錄都比較新)
+    //    兩邊都空才阻塞 (結束時不阻塞，把剩下的收完)
+    if (sysv_recv(mqid, &batch[0], IPC_NOWAIT) == -1) {
+        if (errno == EINTR) return 0;
+        if (errno != ENOMSG) {
+            if (errno != EIDRM) perror("[Logger Process] msgrcv failed");
+            return -1;
+        }
+        int n = log_spill_drain(batch, (int)cfg->batch_size);
+        if (n > 0) return n;
+        if (g_logger_stop) return -1;
+        // 阻塞期間剛好 spill 的紀錄，最晚在下一次 SIGALRM tick 時收回
+        if (sysv_recv(mqid, &batch[0], 0) == -1) {
+            if (errno == EINTR) return 0;
+            if (errno != EIDRM) perror("[Logger Process] msgrcv failed");
+            return -1;
+        }
+    }
+
+    // 2. 補滿這一批
+    long long start = mono_us();
+    int n = 1;
+    while (n < (int)cfg->batch_size) {
+        if (sysv_recv(mqid, &batch[n], IPC_NOWAIT) == 0) { n++; continue; }
+        if (errno != ENOMSG || g_logger_stop) break;
+        if (mono_us() - start >= cfg->batch_latency_us) break;
+        usleep(20);
+    }
+    *fill_us = mono_us() - start;
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+// 7. 收一批：SHM rings (閒置時才睡在 futex 上)
+//    沒有綁定 ring 的行程 (例如 Master、測試工具) 仍然走 SysV Queue
+// ----------------------------------------------------------------------------
+static int collect_ring(int mqid, LogMessage *batch, const LoggerConfig *cfg, long long *fill_us) {
+    int max = (int)cfg->batch_size;
+    int n = log_ring_drain(batch, max);
+    while (n < max && sysv_recv(mqid, &batch[n], IPC_NOWAIT) == 0) n++;
+
+    if (n == 0) {
+        if (g_logger_stop) return -1;          // 所有來源都清空了才結束
+        log_ring_wait(logger_tick_ms(cfg));
+        return 0;
+    }
+
+    long long start = mono_us();
+    while (n < max && cfg->batch_latency_us > 0 && !g_logger_stop &&
+           mono_us() - start < cfg->batch_latency_us) {
+        int got = log_ring_drain(batch + n, max - n);
+        if (got == 0) sched_yield();
+        n += got;
+    }
+    *fill_us = mono_us() - start;
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+// 8. Logger 主迴圈 (對應 logger.h 的 logger_main_loop)
+// ----------------------------------------------------------------------------
+void logger_main_loop(int mqid) {
+    const LoggerConfig *cfg = &g_log_cfg;
+    LogWriter w;
 
     printf("[Logger Process] Started monitoring queue ID: %d...\n", mqid);
-    printf("[Logger Process] Writing logs to logs/transaction.log\n");
+    if (writer_open(&w, cfg) != 0) return;
+    printf("[Logger Process] Writing logs to %s%s\n", w.seg_path,
+           w.rotating ? " (segmented, indexed on rotation)" : "");
+    if (w.cipher) printf("[Logger Process] Encrypting each batch with AES-128-CTR (%s)\n", log_cipher_impl(w.cipher));
+    if (cfg->sub_path[0] && audit_sub_listen(cfg->sub_path, g_log_shard) == 0)
+        printf("[Logger Process] Publishing the audit stream on %s\n", cfg->sub_path);
 
-    while (1) {
-        // 1. 接收 (使用 0 = 阻塞模式，沒信就睡覺，節省 CPU)
-        ssize_t result = msgrcv(mqid, &msg, payload_size, 1, 0);
+    // 不用 SA_RESTART：讓 msgrcv 被訊號打斷，才能檢查 flush 期限 / 結束旗標
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = logger_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGALRM, &sa, NULL);
 
-        if (result == -1) {
-            if (errno == EINTR) continue; // 被訊號中斷，繼續
-            perror("[Logger Process] msgrcv failed");
-            break; // 嚴重錯誤，退出
-        }
+    // 一定要有 tick：訂閱者的 audit_sub_poll、時間 rotation、metrics 都靠它
+    struct itimerval it;
+    int tick_ms = logger_tick_ms(cfg);
+    it.it_interval.tv_sec = tick_ms / 1000;
+    it.it_interval.tv_usec = (tick_ms % 1000) * 1000;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_REAL, &it, NULL);
+
+    LogMessage *batch = malloc(sizeof(LogMessage) * cfg->batch_size);
+    if (!batch) {
+        writer_close(&w, cfg);
+        return;
+    }
+    int use_ring = logger_ring_enabled();
+    printf("[Logger Process] Source: %s | batch up to %u records, wait up to %d us\n",
+           use_ring ? "SHM log rings" : "SysV queue", cfg->batch_size, cfg->batch_latency_us);
 
-        // 2. [解密] 收到的資料是亂碼，必須解密才能讀
-        void *payload_ptr = (void *)((char *)&msg + sizeof(long));
-        apply_xor_cipher(payload_ptr, payload_size);
-
-        // 3. 準備寫檔
-        // 先建立 logs 資料夾，確保不會寫檔失敗
-        system("mkdir -p logs"); 
-        
-        FILE *fp = fopen("logs/transaction.log", "a");
-        if (fp == NULL) {
-            perror("[Logger Process] Cannot open log file");
-            continue;
+    while (1) {
+        long long fill_us = 0;
+        int n = use_ring ? collect_ring(mqid, batch, cfg, &fill_us)
+                         : collect_sysv(mqid, batch, cfg, &fill_us);
+        if (n < 0) break;
+        if (n > 0) {
+            writer_maybe_rotate(&w, cfg);
+            writer_write_batch(&w, cfg, batch, n);
+            stats_record_batch(&w, n, fill_us);
+            stats_record_lag(&w, batch, n);
         }
+        // 時間門檻：最舊的一筆已經等太久 / 該 fdatasync 了
+        if (writer_tick(&w, cfg)) writer_publish_metrics(&w, mqid, use_ring);
+    }
+    free(batch);
 
-        // 4. 取得時間
-        time_t now = time(NULL);
-        struct tm *t = localtime(&now);
-        char time_str[30];
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", t);
-
-        // 5. 格式化輸出
-        // 將 int status 轉成易讀的文字
-        char status_str[10];
-        if (msg.status == 0) strcpy(status_str, "SUCCESS");
-        else strcpy(status_str, "FAILED");
-
-        // 這裡將數字代號轉為文字 (假設 OP code 定義)
-        char op_str[20];
-        if (msg.cmd_type == 0x10) strcpy(op_str, "LOGIN");
-        else if (msg.cmd_type == 0x20) strcpy(op_str, "BALANCE");
-        else if (msg.cmd_type == 0x30) strcpy(op_str, "TRANSFER");
-        else sprintf(op_str, "OP_%d", msg.cmd_type);
-
-        // 寫入檔案
-        fprintf(fp, "[%s] CMD:%-10s | Status:%-8s | Src:%d -> Dst:%d | Amt:$%d\n",
-                time_str, op_str, status_str, msg.src_id, msg.dst_id, msg.amount);
-
-        fclose(fp);
-        
-        // 簡單顯示在螢幕上方便除錯
-        // printf("[Logger] Recorded: %s\n", op_str);
-    }
-}
\ No newline at end of file
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_REAL, &off, NULL);
+
+    writer_close(&w, cfg);
+    writer_publish_metrics(&w, mqid, use_ring);
+    if (cfg->sub_path[0]) {
+        uint64_t served, sent, skipped;
+        audit_sub_stats(&served, &sent, &skipped);
+        audit_sub_close();
+        printf("[Logger Process] Audit stream: %lu subscribers served, %lu records sent, %lu skipped (slow)\n",
+               (unsigned long)served, (unsigned long)sent, (unsigned long)skipped);
+    }
+    uint64_t spilled, merged;
+    log_spill_stats(&spilled, &merged);
+    if (spilled > 0) printf("[Logger Process] Spill: %lu records spilled, %lu merged back\n",
+                            (unsigned long)spilled, (unsigned long)merged);
+    if (w.stats) {
+        printf("[Logger Process] Lag p50 <= %lu us, p99 <= %lu us, p99.9 <= %lu us, max %lu us | "
+               "seq gaps: %lu, out of order: %lu\n",
+               (unsigned long)logger_lag_percentile_us(w.stats, 50.0),
+               (unsigned long)logger_lag_percentile_us(w.stats, 99.0),
+               (unsigned long)logger_lag_percentile_us(w.stats, 99.9),
+               (unsigned long)(w.stats->lag_max_ns / 1000),
+               (unsigned long)w.stats->seq_gaps, (unsigned long)w.stats->seq_reorders);
+    }
+    printf("[Logger Process] Log flushed, exiting.\n");
+}
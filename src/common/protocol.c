@@ -1,10 +1,16 @@
+#define _GNU_SOURCE
 #include "protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+
+static int g_write_timeout_ms = 0;   // protocol_set_write_timeout()，0 = 不限
 
 // ============================================================================
 // Helper: Calculate Simple Checksum (XOR-based)
@@ -45,19 +51,40 @@ static int safe_read(int fd, void* buf, size_t count) {
     return 0;
 }
 
+static long long mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 // ============================================================================
 // Helper: Safe Write with EINTR Handling
 // ============================================================================
-static int safe_write(int fd, const void* buf, size_t count) {
+// send + MSG_NOSIGNAL：對方先斷線只會得到 EPIPE，不會用 SIGPIPE 殺掉 Worker
+// Non-blocking socket 寫不進去時 poll 等，整個封包最多等 g_write_timeout_ms (不讀回應的 client)；
+// *deadline_ms 第一次要等的時候才讀時鐘 (一般回應一次 send 就寫完)
+static int safe_write(int fd, const void* buf, size_t count, long long* deadline_ms) {
     size_t total_written = 0;
     const uint8_t* ptr = (const uint8_t*)buf;
     
     while (total_written < count) {
-        ssize_t n = write(fd, ptr + total_written, count - total_written);
+        ssize_t n = send(fd, ptr + total_written, count - total_written, MSG_NOSIGNAL);
         
         if (n < 0) {
             if (errno == EINTR) continue;
-            perror("[Protocol] write failed");
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                int timeout = -1;
+                if (g_write_timeout_ms) {
+                    if (!*deadline_ms) *deadline_ms = mono_ms() + g_write_timeout_ms;
+                    long long left = *deadline_ms - mono_ms();
+                    if (left <= 0) return PROTOCOL_ERR_TIMEOUT;
+                    timeout = (int)left;
+                }
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+                if (poll(&pfd, 1, timeout) == 0) return PROTOCOL_ERR_TIMEOUT;
+                continue;
+            }
+            if (errno != EPIPE && errno != ECONNRESET) perror("[Protocol] write failed");
             return -1;
         }
         
@@ -67,6 +94,25 @@ static int safe_write(int fd, const void* buf, size_t count) {
     return 0;
 }
 
+// ============================================================================
+// Helper: Header Validation (magic, byte order, body size)
+// ============================================================================
+static int header_decode(PacketHeader* header) {
+    if (header->magic != PROTOCOL_MAGIC) {
+        fprintf(stderr, "[Protocol] Invalid magic byte: 0x%02X (expected 0x%02X)\n", 
+                header->magic, PROTOCOL_MAGIC);
+        return -1;
+    }
+    header->checksum = ntohs(header->checksum);
+    header->body_len = ntohl(header->body_len);
+    // Sanity check: Prevent memory exhaustion attacks
+    if (header->body_len > PROTOCOL_MAX_BODY) {
+        fprintf(stderr, "[Protocol] Body too large: %u bytes\n", header->body_len);
+        return -1;
+    }
+    return 0;
+}
+
 // ============================================================================
 // Public API: Read Packet
 // ============================================================================
@@ -83,25 +129,13 @@ int protocol_read_packet(int fd, PacketHeader* header, void** body) {
         return -1;
     }
     
-    // Step 2: Validate Magic Byte
-    if (header->magic != PROTOCOL_MAGIC) {
-        fprintf(stderr, "[Protocol] Invalid magic byte: 0x%02X (expected 0x%02X)\n", 
-                header->magic, PROTOCOL_MAGIC);
+    // Step 2-3: Validate Magic Byte / Size, Network Byte Order -> Host Byte Order
+    if (header_decode(header) < 0) {
         return -1;
     }
     
-    // Step 3: Convert Network Byte Order to Host Byte Order
-    header->checksum = ntohs(header->checksum);
-    header->body_len = ntohl(header->body_len);
-    
     // Step 4: Read Body (if exists)
     if (header->body_len > 0) {
-        // Sanity check: Prevent memory exhaustion attacks
-        if (header->body_len > 1024 * 1024) { // Max 1MB
-            fprintf(stderr, "[Protocol] Body too large: %u bytes\n", header->body_len);
-            return -1;
-        }
-        
         *body = malloc(header->body_len);
         if (!*body) {
             perror("[Protocol] malloc failed");
@@ -128,30 +162,135 @@ int protocol_read_packet(int fd, PacketHeader* header, void** body) {
     return 0;
 }
 
+// ============================================================================
+// Public API: Incremental Read (non-blocking sockets)
+// ============================================================================
+void protocol_reader_init(PacketReader* r) {
+    memset(r, 0, sizeof(*r));
+}
+
+void protocol_reader_free(PacketReader* r) {
+    free(r->body);
+    r->body = NULL;
+}
+
+int protocol_reader_has_header(const PacketReader* r) {
+    return r->got >= sizeof(PacketHeader);
+}
+
+int protocol_reader_feed(int fd, PacketReader* r) {
+    const uint32_t hlen = sizeof(PacketHeader);
+    for (;;) {
+        uint8_t* dst;
+        size_t want;
+        if (r->got < hlen) {
+            dst = (uint8_t*)&r->header + r->got;
+            want = hlen - r->got;
+        } else if (r->got - hlen < r->header.body_len) {
+            dst = (uint8_t*)r->body + (r->got - hlen);
+            want = r->header.body_len - (r->got - hlen);
+        } else {
+            break;
+        }
+
+        // recvmsg：socket 開了 SO_TIMESTAMPNS 時順便拿到 kernel 收到這些 bytes 的時間
+        // (server 用來算請求在 accept queue / socket buffer 裡排了多久)
+        union {
+            char buf[CMSG_SPACE(sizeof(struct timespec))];
+            struct cmsghdr align;
+        } ctl;
+        struct iovec iov = { dst, want };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+        ssize_t n = recvmsg(fd, &msg, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return PROTOCOL_READ_MORE;
+            return -1;
+        }
+        if (n == 0) return -1; // Connection closed by peer
+        r->got += (uint32_t)n;
+        for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                r->arrival_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+            }
+        }
+
+        // 標頭剛收齊：檢查、配置 body
+        if (r->got == hlen) {
+            if (header_decode(&r->header) < 0) return -1;
+            if (r->header.body_len > 0 && !(r->body = malloc(r->header.body_len))) {
+                perror("[Protocol] malloc failed");
+                return -1;
+            }
+        }
+    }
+
+    if (r->header.body_len > 0) {
+        uint16_t calculated = calculate_checksum(r->body, r->header.body_len);
+        if (calculated != r->header.checksum) {
+            fprintf(stderr, "[Protocol] Checksum mismatch: got 0x%04X, expected 0x%04X\n",
+                    calculated, r->header.checksum);
+            return -1;
+        }
+    }
+    return PROTOCOL_READ_DONE;
+}
+
 // ============================================================================
 // Public API: Send Response
 // ============================================================================
-void protocol_send_response(int fd, uint8_t op_code, int ret_code) {
+int protocol_send_response(int fd, uint8_t op_code, int ret_code) {
+    int body = htonl(ret_code); // Body is just the return code (network byte order)
+    return protocol_send_body(fd, op_code, &body, sizeof(int));
+}
+
+void protocol_set_write_timeout(int timeout_ms) {
+    g_write_timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+}
+
+// ============================================================================
+// Public API: Send Response with Body
+// ============================================================================
+int protocol_send_body(int fd, uint8_t op_code, const void* body, uint32_t body_len) {
     PacketHeader header;
+    long long deadline_ms = 0;
     
     // Prepare Header
     header.magic = PROTOCOL_MAGIC;
     header.op_code = op_code;
-    header.body_len = htonl(sizeof(int)); // Body is just the return code
-    
-    // Prepare Body
-    int body = htonl(ret_code); // Convert to network byte order
+    header.body_len = htonl(body_len);
     
     // Calculate Checksum
-    header.checksum = htons(calculate_checksum(&body, sizeof(int)));
+    header.checksum = htons(calculate_checksum(body, body_len));
     
     // Send Header
-    if (safe_write(fd, &header, sizeof(PacketHeader)) < 0) {
-        return;
+    int r = safe_write(fd, &header, sizeof(PacketHeader), &deadline_ms);
+    if (r < 0) {
+        return r;
     }
     
     // Send Body
-    if (safe_write(fd, &body, sizeof(int)) < 0) {
-        return;
+    if (body_len > 0) {
+        r = safe_write(fd, body, body_len, &deadline_ms);
     }
-}
\ No newline at end of file
+    return r;
+}
+
+// ============================================================================
+// Public API: 64-bit Byte Order
+// ============================================================================
+uint64_t protocol_hton64(uint64_t v) {
+    if (htonl(1) == 1) return v; // Big-endian host
+    return ((uint64_t)htonl((uint32_t)(v & 0xFFFFFFFFu)) << 32) | htonl((uint32_t)(v >> 32));
+}
+
+uint64_t protocol_ntoh64(uint64_t v) {
+    return protocol_hton64(v);
+}
@@ -0,0 +1,164 @@
+// 檔案位置: src/common/ratelimit.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../include/ratelimit.h"
+
+/*
+ * Rate Limiting: 每個來源帳戶 / 每個 client 位址一個 token bucket
+ *
+ * - 表在 SHM 裡，所有 Worker 共用 (同一個 client 打到不同 Worker 也算同一桶)
+ * - Bucket 只存一個時間 (GCRA)：tat = 桶子「空了」之後下一個 token 出現的時間。
+ *   拿 token = tat 往後推一個 interval；tat 超前現在超過 burst 就是桶子空了。
+ *   補充 token 不用背景執行緒：時間過去，tat 就自然落在 now 後面
+ * - 拿 token 是一次 CAS (失敗就用新的 tat 重算)，沒有鎖
+ * - 帳戶：帳戶 id 直接當 index，表的大小 = BANK_CAPACITY，每個帳戶都有自己的桶子
+ * - Client：位址 hash 之後 linear probing，第一次看到的位址用 CAS 佔一個空位 (0 -> key + 1)。
+ *   tat 已經過去的桶子 = 滿的桶子，跟全新的一樣：probe 範圍內沒有空位時就把這種閒置的
+ *   slot 直接換給新位址 (CAS key)，一直換位址的 client 不會把表永久佔滿
+ * - Probe 範圍內全是忙碌中的桶子時放行並回報 RATELIMIT_UNTRACKED：寧可少限一個 client，也不誤擋
+ */
+
+static RateLimitShm *g_rl = NULL;           // fork 之後所有子行程都繼承這個 mapping
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ============================================================================
+// Setup (Master, before fork)
+// ============================================================================
+static void kind_setup(RateLimitKind *k, uint32_t rate, uint32_t burst) {
+    k->rate = rate;
+    k->burst = burst ? burst : rate;
+    k->interval_ns = rate ? 1000000000ULL / rate : 0;
+    k->burst_ns = rate && k->burst ? (uint64_t)(k->burst - 1) * k->interval_ns : 0;
+    k->used = 0;
+}
+
+int ratelimit_init(uint32_t account_rate, uint32_t account_burst, uint32_t client_rate, uint32_t client_burst) {
+    if (account_rate > 1000000000u || client_rate > 1000000000u) return -1;
+
+    shm_unlink(RATELIMIT_SHM_NAME); // 上次異常結束留下的殘骸
+    int fd = shm_open(RATELIMIT_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror("[RateLimit] shm_open failed");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(RateLimitShm)) == -1) {
+        perror("[RateLimit] ftruncate failed");
+        close(fd);
+        shm_unlink(RATELIMIT_SHM_NAME);
+        return -1;
+    }
+    g_rl = mmap(NULL, sizeof(RateLimitShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (g_rl == MAP_FAILED) {
+        perror("[RateLimit] mmap failed");
+        g_rl = NULL;
+        shm_unlink(RATELIMIT_SHM_NAME);
+        return -1;
+    }
+
+    g_rl->version = RATELIMIT_VERSION;
+    g_rl->size = sizeof(RateLimitShm);
+    kind_setup(&g_rl->kinds[RATELIMIT_ACCOUNT], account_rate, account_burst);
+    kind_setup(&g_rl->kinds[RATELIMIT_CLIENT], client_rate, client_burst);
+    __atomic_store_n(&g_rl->magic, RATELIMIT_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void ratelimit_cleanup(void) {
+    if (g_rl) {
+        __atomic_store_n(&g_rl->magic, 0, __ATOMIC_RELEASE);
+        munmap(g_rl, sizeof(RateLimitShm));
+        g_rl = NULL;
+    }
+    shm_unlink(RATELIMIT_SHM_NAME);
+}
+
+int ratelimit_enabled(int kind) {
+    return g_rl && kind >= 0 && kind < RATELIMIT_KINDS && g_rl->kinds[kind].rate != 0;
+}
+
+const RateLimitShm *ratelimit_region(void) {
+    return g_rl;
+}
+
+// ============================================================================
+// Hot path
+// ============================================================================
+// 帳戶：id 直接對到 bucket；第一次用到時標上 key (只為了統計 used)
+static RateBucket *account_bucket(uint64_t key) {
+    if (key >= RATELIMIT_ACCOUNT_SLOTS) return NULL;
+    RateBucket *b = &g_rl->accounts[key];
+    uint64_t cur = 0;
+    if (__atomic_load_n(&b->key, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&b->key, &cur, key + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        __atomic_fetch_add(&g_rl->kinds[RATELIMIT_ACCOUNT].used, 1, __ATOMIC_RELAXED);
+    return b;
+}
+
+// Client：先找整個 probe 範圍有沒有這個 key；沒有就佔第一個空的或閒置 (tat <= now) 的 slot。
+// NULL = probe 範圍內都是別的 key、而且桶子都還在用
+static RateBucket *client_bucket(uint64_t key, uint64_t now_ns) {
+    RateBucket *table = g_rl->clients;
+    RateLimitKind *k = &g_rl->kinds[RATELIMIT_CLIENT];
+    uint64_t tag = key + 1;
+    uint64_t h = tag * 0x9E3779B97F4A7C15ULL;
+    uint32_t slot = (uint32_t)(h >> 32) & (RATELIMIT_CLIENT_SLOTS - 1);
+    for (int attempt = 0; attempt < RATELIMIT_PROBE_LIMIT; attempt++) {
+        RateBucket *spare = NULL;
+        uint64_t spare_key = 0;
+        for (int i = 0; i < RATELIMIT_PROBE_LIMIT; i++) {
+            RateBucket *b = &table[(slot + (uint32_t)i) & (RATELIMIT_CLIENT_SLOTS - 1)];
+            uint64_t cur = __atomic_load_n(&b->key, __ATOMIC_ACQUIRE);
+            if (cur == tag) return b;
+            if (!spare && (cur == 0 || __atomic_load_n(&b->tat_ns, __ATOMIC_RELAXED) <= now_ns)) {
+                spare = b;
+                spare_key = cur;
+            }
+        }
+        if (!spare) return NULL;
+        // 換手時 tat 不用動：閒置的桶子本來就是滿的。舊 key 剛好在同一瞬間拿 token 的話，
+        // 新 key 會少一個 token，只會偏嚴、不會偏鬆
+        uint64_t cur = spare_key;
+        if (__atomic_compare_exchange_n(&spare->key, &cur, tag, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(spare_key ? &k->reclaimed : &k->used, 1, __ATOMIC_RELAXED);
+            return spare;
+        }
+        if (cur == tag) return spare;   // 別的 Worker 剛好幫同一個 key 佔了這格
+        // 被別的 key 搶走了：重新掃一次
+    }
+    return NULL;
+}
+
+int ratelimit_take_at(int kind, uint64_t key, uint64_t now_ns) {
+    if (!ratelimit_enabled(kind)) return RATELIMIT_OK;
+    const RateLimitKind *k = &g_rl->kinds[kind];
+    RateBucket *b = kind == RATELIMIT_ACCOUNT ? account_bucket(key) : client_bucket(key, now_ns);
+    if (!b) return RATELIMIT_UNTRACKED;
+
+    uint64_t tat = __atomic_load_n(&b->tat_ns, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t base = tat > now_ns ? tat : now_ns;   // 桶子滿了之後不再累積
+        if (base - now_ns > k->burst_ns) return RATELIMIT_LIMITED;
+        if (__atomic_compare_exchange_n(&b->tat_ns, &tat, base + k->interval_ns, 1, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+            return RATELIMIT_OK;
+        // 別人先拿走了一個 token：tat 已更新，重算一次
+    }
+}
+
+int ratelimit_take(int kind, uint64_t key) {
+    if (!ratelimit_enabled(kind)) return RATELIMIT_OK;
+    return ratelimit_take_at(kind, key, mono_ns());
+}
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 
 #include "../../include/bank.h"
+#include "../../include/affinity.h"
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -13,6 +14,9 @@
 
 static BankMap *shm_ptr = NULL;
 
+// Process-local extent mappings (mmap 一次後快取，不需要全域暫停)
+static BankExtent *extent_ptr[MAX_EXTENTS];
+
 /*
  * bank_init
  * - Creator (Master): Creates and initializes SHM (O_CREAT | O_EXCL)
@@ -109,17 +113,36 @@ int bank_init() {
     /* Initialize Accounts */
     for (int i = 0; i < MAX_ACCOUNTS; i++) {
         shm_ptr->accounts[i].id = i;
-        shm_ptr->accounts[i].balance = 10000;
+        shm_ptr->accounts[i].state = ACCOUNT_OPEN;
+        shm_ptr->balances[i] = 10000;
         shm_ptr->accounts[i].last_updated = 0;
         pthread_mutex_init(&shm_ptr->accounts[i].lock, &mtx_attr);
     }
 
+    /* Initialize Slot Allocator (free list starts empty; first open grows an extent) */
+    if (pthread_mutex_init(&shm_ptr->alloc_lock, &mtx_attr) != 0) {
+        perror("[BankCore] alloc_lock init failed");
+        return -1;
+    }
+    shm_ptr->free_head = -1;
+    shm_ptr->extent_count = 0;
+    shm_ptr->open_accounts = MAX_ACCOUNTS;
+
+    /* Initialize External ID Index */
+    account_index_init(&shm_ptr->index);
+    idem_init(&shm_ptr->idem);
+
     /* Initialize Semaphore */
     // 使用 bank.h 定義的常數，方便未來調整並發量
     if (sem_init(&shm_ptr->limit_sem, 1, MAX_CONCURRENCY) != 0) { 
         perror("[BankCore] sem_init failed");
         return -1;
     }
+    // 讀取 (OP_BALANCE) 走自己的 lane：轉帳再多也不會把讀取的名額用光
+    if (sem_init(&shm_ptr->read_sem, 1, MAX_READ_CONCURRENCY) != 0) {
+        perror("[BankCore] sem_init (read lane) failed");
+        return -1;
+    }
 
     shm_ptr->total_transactions = 0;
 
@@ -137,8 +160,149 @@ BankMap* get_bank_map() {
     return shm_ptr;
 }
 
+/* ==========================================================
+ * Chained Extents
+ * ========================================================== */
+
+/* Worker 的 CPU (Master 在 fork 前設定)：之後才長出來的 extent 跟帳戶表一樣 interleave */
+static int extent_cpus[AFFINITY_MAX_CPUS];
+static int extent_ncpus = 0;
+
+void bank_set_interleave(const int *cpus, int n) {
+    if (n < 0) n = 0;
+    if (n > AFFINITY_MAX_CPUS) n = AFFINITY_MAX_CPUS;
+    memcpy(extent_cpus, cpus, sizeof(int) * (size_t)n);
+    extent_ncpus = n;
+}
+
+/* map_extent: 把第 n 個 extent mmap 進本 process (只做一次) */
+static BankExtent* map_extent(uint32_t n) {
+    BankExtent *ext = __atomic_load_n(&extent_ptr[n], __ATOMIC_ACQUIRE);
+    if (ext) return ext;
+
+    char name[64];
+    snprintf(name, sizeof(name), SHM_EXTENT_FMT, n);
+    int fd = shm_open(name, O_RDWR, 0666);
+    if (fd < 0) {
+        perror("[BankCore] shm_open extent failed");
+        return NULL;
+    }
+    ext = mmap(NULL, sizeof(BankExtent), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ext == MAP_FAILED) {
+        perror("[BankCore] mmap extent failed");
+        return NULL;
+    }
+
+    // 同一 process 內多個 thread 同時 map：只留一份
+    BankExtent *expected = NULL;
+    if (!__atomic_compare_exchange_n(&extent_ptr[n], &expected, ext, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        munmap(ext, sizeof(BankExtent));
+        ext = expected;
+    }
+    return ext;
+}
+
+/*
+ * bank_create_extent
+ * 建立下一個 extent 並把它的帳戶全部推進 free list。
+ * 呼叫者必須持有 alloc_lock。extent_count 最後才以 release 發布，
+ * 其他 Worker 看到新 id 時才會去 lazy map。
+ */
+int bank_create_extent() {
+    BankMap *bank = get_bank_map();
+    if (!bank) return BANK_ERR_INTERNAL;
+
+    uint32_t n = bank->extent_count;
+    if (n >= MAX_EXTENTS) return BANK_ERR_NO_SPACE;
+
+    char name[64];
+    snprintf(name, sizeof(name), SHM_EXTENT_FMT, n);
+    shm_unlink(name); // 清掉上次 crash 留下的同名物件
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) {
+        perror("[BankCore] shm_open new extent failed");
+        return BANK_ERR_INTERNAL;
+    }
+    if (ftruncate(fd, sizeof(BankExtent)) == -1) {
+        perror("[BankCore] ftruncate extent failed");
+        close(fd);
+        shm_unlink(name);
+        return BANK_ERR_INTERNAL;
+    }
+    BankExtent *ext = mmap(NULL, sizeof(BankExtent), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ext == MAP_FAILED) {
+        perror("[BankCore] mmap new extent failed");
+        shm_unlink(name);
+        return BANK_ERR_INTERNAL;
+    }
+    // 頁面還沒碰過：先設 policy (tmpfs 物件共用一份)，下面初始化時就照 interleave 配頁，
+    // 不會全部落在剛好開戶的這個 Worker 的 node 上
+    if (extent_ncpus > 0) affinity_interleave(ext, sizeof(BankExtent), extent_cpus, extent_ncpus);
+
+    pthread_mutexattr_t mtx_attr;
+    pthread_mutexattr_init(&mtx_attr);
+    pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mtx_attr, PTHREAD_MUTEX_ROBUST);
+
+    ext->extent_no = n;
+    int base = MAX_ACCOUNTS + (int)n * EXTENT_ACCOUNTS;
+    // 反向推入，讓小的 id 先被配出去
+    for (int i = EXTENT_ACCOUNTS - 1; i >= 0; i--) {
+        ext->accounts[i].id = base + i;
+        ext->accounts[i].state = ACCOUNT_CLOSED;
+        ext->balances[i] = 0;
+        pthread_mutex_init(&ext->accounts[i].lock, &mtx_attr);
+        bank->free_next[base + i] = bank->free_head;
+        bank->free_head = base + i;
+    }
+    ext->is_initialized = 0xBEEF;
+    __atomic_store_n(&extent_ptr[n], ext, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&bank->extent_count, n + 1, __ATOMIC_RELEASE);
+    printf("[BankCore] Extent %u created (accounts %d..%d)\n", n, base, base + EXTENT_ACCOUNTS - 1);
+    return BANK_OK;
+}
+
+uint32_t bank_capacity() {
+    BankMap *bank = get_bank_map();
+    if (!bank) return 0;
+    return MAX_ACCOUNTS + __atomic_load_n(&bank->extent_count, __ATOMIC_ACQUIRE) * EXTENT_ACCOUNTS;
+}
+
+/* bank_locate: account id -> Account / balance (base segment 或 extent) */
+int bank_locate(int account_id, Account **acc, int32_t **balance) {
+    BankMap *bank = get_bank_map();
+    if (!bank) return BANK_ERR_INTERNAL;
+
+    if (account_id < 0) return BANK_ERR_INVALID_ID;
+    if (account_id < MAX_ACCOUNTS) {
+        if (acc) *acc = &bank->accounts[account_id];
+        if (balance) *balance = &bank->balances[account_id];
+        return BANK_OK;
+    }
+
+    uint32_t rel = (uint32_t)(account_id - MAX_ACCOUNTS);
+    uint32_t n = rel / EXTENT_ACCOUNTS;
+    if (n >= __atomic_load_n(&bank->extent_count, __ATOMIC_ACQUIRE)) return BANK_ERR_INVALID_ID;
+
+    BankExtent *ext = map_extent(n);
+    if (!ext) return BANK_ERR_INTERNAL;
+    if (acc) *acc = &ext->accounts[rel % EXTENT_ACCOUNTS];
+    if (balance) *balance = &ext->balances[rel % EXTENT_ACCOUNTS];
+    return BANK_OK;
+}
+
 /* [新增] bank_detach: Client 離開時呼叫，不刪除檔案 */
 int bank_detach() {
+    for (int i = 0; i < MAX_EXTENTS; i++) {
+        if (extent_ptr[i]) {
+            munmap(extent_ptr[i], sizeof(BankExtent));
+            extent_ptr[i] = NULL;
+        }
+    }
     if (shm_ptr) {
         munmap(shm_ptr, sizeof(BankMap));
         shm_ptr = NULL;
@@ -148,8 +312,14 @@ int bank_detach() {
 
 /* [修正] bank_destroy: 只有 Server 關機時呼叫，會刪除檔案 */
 int bank_destroy() {
+    uint32_t extents = shm_ptr ? shm_ptr->extent_count : 0;
     bank_detach(); // 先斷開
     shm_unlink(SHM_NAME); // 再刪除
+    for (uint32_t i = 0; i < extents; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), SHM_EXTENT_FMT, i);
+        shm_unlink(name);
+    }
     printf("[BankCore] SHM Unlinked (Destroyed).\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,283 @@
+// 檔案位置: src/common/trace.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../include/trace.h"
+#include "../../include/metrics.h"
+
+/*
+ * Request Tracing: 看單一個慢請求的時間花在哪裡
+ *
+ * - 直方圖 (metrics page) 只告訴我們 p99 很慢；trace 保留個別請求每個 stage 的起訖時間
+ * - 每個 Worker 一條 SHM ring，單一寫入者：先寫 span，最後才 release-store head，
+ *   讀者 (hsts-trace / exporter / Master 的 SIGUSR1) 複製完再讀一次 head，丟掉可能被蓋掉的部分
+ * - Span 的來源就是 metrics 的 stage API：真的有計時的 stage (admission / lock / critical / log)
+ *   直接帶起訖時間；parse / response / total 只有長度，在請求結束時依 accept 與完成時間擺放
+ * - 每個請求都先收在行程內的小陣列 (幾個 store)，結束時才決定要不要寫進 ring：
+ *   1 / N 取樣，或總時間超過門檻 (慢請求一定留下來)
+ */
+
+static TraceShm *g_trace = NULL;            // fork 之後所有子行程都繼承這個 mapping
+static TraceRing *g_ring = NULL;            // 本 Worker 的 ring (NULL = 不 trace)
+static uint32_t g_tick = 0;                 // 1 / N 取樣的計數
+static uint32_t g_seq = 0;                  // 寫進 ring 的請求編號
+
+// 目前這個請求已經完成的 span (Worker 是單執行緒)
+static struct {
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int stage;
+} g_spans[TRACE_REQ_SPANS];
+static int g_nspans = 0;
+static int g_nshared = -1;                  // 第一次 req_end 前收到的 span (清算批次共用)
+static int g_shared_done = 0;               // 共用的 span 已經跟某一筆請求寫出去了
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ============================================================================
+// Setup (Master, before fork)
+// ============================================================================
+int trace_init(int nworkers, uint32_t sample_every, uint64_t slow_ns) {
+    if (nworkers < 0 || nworkers > TRACE_MAX_WORKERS) return -1;
+
+    shm_unlink(TRACE_SHM_NAME); // 上次異常結束留下的殘骸
+    int fd = shm_open(TRACE_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror("[Trace] shm_open failed");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(TraceShm)) == -1) {
+        perror("[Trace] ftruncate failed");
+        close(fd);
+        shm_unlink(TRACE_SHM_NAME);
+        return -1;
+    }
+    g_trace = mmap(NULL, sizeof(TraceShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (g_trace == MAP_FAILED) {
+        perror("[Trace] mmap failed");
+        g_trace = NULL;
+        shm_unlink(TRACE_SHM_NAME);
+        return -1;
+    }
+
+    g_trace->version = TRACE_VERSION;
+    g_trace->size = sizeof(TraceShm);
+    g_trace->nworkers = (uint32_t)nworkers;
+    g_trace->sample_every = sample_every;
+    g_trace->slow_ns = slow_ns;
+    g_trace->start_ns = clock_ns(CLOCK_REALTIME);
+    g_trace->start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+    __atomic_store_n(&g_trace->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_cleanup(void) {
+    if (g_trace) {
+        __atomic_store_n(&g_trace->magic, 0, __ATOMIC_RELEASE);
+        munmap(g_trace, sizeof(TraceShm));
+        g_trace = NULL;
+        g_ring = NULL;
+    }
+    shm_unlink(TRACE_SHM_NAME);
+}
+
+void trace_bind_worker(int worker_id) {
+    if (!g_trace || worker_id < 0 || worker_id >= TRACE_MAX_WORKERS) return;
+    g_ring = &g_trace->rings[worker_id];
+    __atomic_store_n(&g_ring->pid, (uint32_t)getpid(), __ATOMIC_RELAXED);
+    g_tick = 0;
+    g_nspans = 0;
+}
+
+int trace_enabled(void) {
+    return g_ring != NULL;
+}
+
+const TraceShm *trace_region(void) {
+    return g_trace;
+}
+
+// ============================================================================
+// Worker hot path
+// ============================================================================
+void trace_req_begin(void) {
+    if (!g_ring) return;
+    g_nspans = 0;
+    g_nshared = -1;
+    g_shared_done = 0;
+}
+
+void trace_span(int stage, uint64_t end_ns, uint64_t dur_ns) {
+    if (!g_ring || g_nspans == TRACE_REQ_SPANS) return;
+    if (!end_ns) end_ns = clock_ns(CLOCK_MONOTONIC);
+    g_spans[g_nspans].start_ns = end_ns - dur_ns;
+    g_spans[g_nspans].dur_ns = dur_ns;
+    g_spans[g_nspans].stage = stage;
+    g_nspans++;
+}
+
+static void ring_put(TraceRing *r, uint64_t *head, uint64_t start_ns, uint64_t dur_ns, int stage, int op,
+                     int ret, int flags) {
+    TraceSpan *s = &r->spans[*head & (TRACE_RING_SPANS - 1)];
+    s->start_ns = start_ns;
+    s->dur_ns = dur_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)dur_ns;
+    s->req = g_seq;
+    s->stage = (uint8_t)stage;
+    s->op = (uint8_t)op;
+    s->ret = (int16_t)(ret < INT16_MIN ? INT16_MIN : ret > INT16_MAX ? INT16_MAX : ret);
+    s->flags = (uint8_t)flags;
+    (*head)++;
+}
+
+void trace_req_end(int op, int ret_code, const uint64_t *stage_ns, uint32_t stage_mask) {
+    if (!g_ring) return;
+    // 清算批次：begin 之後第一次 end 以前的 span (admission / lock / critical) 是整批共用的，
+    // 只跟第一筆寫出去的請求一起寫；之後每筆自己的 span (log) 寫完就丟
+    if (g_nshared < 0) g_nshared = g_nspans;
+
+    uint64_t total = (stage_mask & (1u << METRICS_STAGE_TOTAL)) ? stage_ns[METRICS_STAGE_TOTAL] : 0;
+    int flags = 0;
+    if (g_trace->sample_every && ++g_tick >= g_trace->sample_every) {
+        g_tick = 0;
+        flags |= TRACE_FLAG_SAMPLED;
+    }
+    if (g_trace->slow_ns && total >= g_trace->slow_ns) flags |= TRACE_FLAG_SLOW;
+
+    if (flags) {
+        uint64_t end = clock_ns(CLOCK_MONOTONIC);
+        uint64_t start = end > total ? end - total : 0;
+        uint64_t head = g_ring->head;
+        g_seq++;
+        if (stage_mask & (1u << METRICS_STAGE_PARSE))
+            ring_put(g_ring, &head, start, stage_ns[METRICS_STAGE_PARSE], METRICS_STAGE_PARSE, op, ret_code, flags);
+        for (int i = g_shared_done ? g_nshared : 0; i < g_nspans; i++)
+            ring_put(g_ring, &head, g_spans[i].start_ns, g_spans[i].dur_ns, g_spans[i].stage, op, ret_code, flags);
+        if (stage_mask & (1u << METRICS_STAGE_RESPONSE)) {
+            uint64_t resp = stage_ns[METRICS_STAGE_RESPONSE];
+            ring_put(g_ring, &head, end - resp, resp, METRICS_STAGE_RESPONSE, op, ret_code, flags);
+        }
+        // 整個請求的 span 最後寫：讀者看到它，就表示前面屬於它的 span 都已經寫好了
+        ring_put(g_ring, &head, start, end - start, TRACE_SPAN_REQUEST, op, ret_code, flags);
+        __atomic_store_n(&g_ring->head, head, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_ring->traced, g_ring->traced + 1, __ATOMIC_RELAXED);
+        g_shared_done = 1;
+    }
+    g_nspans = g_nshared;
+}
+
+// ============================================================================
+// Readers (hsts-trace, exporter, Master SIGUSR1)
+// ============================================================================
+const TraceShm *trace_attach(char *err, size_t err_len) {
+    int fd = shm_open(TRACE_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        if (err) snprintf(err, err_len, "%s not found (server not started with --trace-sample / --trace-slow-us?)",
+                          TRACE_SHM_NAME);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(TraceShm)) {
+        if (err) snprintf(err, err_len, "%s: unexpected size (layout version mismatch?)", TRACE_SHM_NAME);
+        close(fd);
+        return NULL;
+    }
+    const TraceShm *t = mmap(NULL, sizeof(TraceShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) {
+        if (err) snprintf(err, err_len, "%s: mmap failed", TRACE_SHM_NAME);
+        return NULL;
+    }
+    if (__atomic_load_n(&t->magic, __ATOMIC_ACQUIRE) != TRACE_MAGIC || t->version != TRACE_VERSION ||
+        t->size != sizeof(TraceShm)) {
+        if (err) snprintf(err, err_len, "%s: version %u, this reader understands %u", TRACE_SHM_NAME, t->version,
+                          TRACE_VERSION);
+        munmap((void *)t, sizeof(TraceShm));
+        return NULL;
+    }
+    return t;
+}
+
+void trace_detach(const TraceShm *t) {
+    if (t) munmap((void *)t, sizeof(TraceShm));
+}
+
+int trace_snapshot_ring(const TraceShm *t, int worker, TraceSpan *out) {
+    if (!t || worker < 0 || worker >= TRACE_MAX_WORKERS) return 0;
+    const TraceRing *r = &t->rings[worker];
+    uint64_t h1 = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t from = h1 > TRACE_RING_SPANS ? h1 - TRACE_RING_SPANS : 0;
+    for (uint64_t i = from; i < h1; i++) out[i - from] = r->spans[i & (TRACE_RING_SPANS - 1)];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t h2 = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    // 寫入者在 head 之後最多先寫一個請求的 span (還沒發布)，會蓋掉最舊的幾格：
+    // 複製期間 head 前進多少，加上一個請求的量，這麼多格最舊的都不能信
+    uint64_t unsafe = h2 + TRACE_REQ_SPANS + 3;
+    uint64_t keep_from = unsafe > TRACE_RING_SPANS ? unsafe - TRACE_RING_SPANS : 0;
+    if (keep_from <= from) return (int)(h1 - from);
+    if (keep_from >= h1) return 0;
+    int n = (int)(h1 - keep_from);
+    memmove(out, out + (keep_from - from), (size_t)n * sizeof(TraceSpan));
+    return n;
+}
+
+// ts / dur：相對於 region 建立時間的微秒 (Chrome trace-event 的單位)
+static double trace_us(const TraceShm *t, uint64_t mono_ns) {
+    return mono_ns >= t->start_mono_ns ? (double)(mono_ns - t->start_mono_ns) / 1e3
+                                       : -(double)(t->start_mono_ns - mono_ns) / 1e3;
+}
+
+int trace_write_chrome(const TraceShm *t, FILE *out, uint64_t min_total_ns) {
+    if (!t || !out) return -1;
+    TraceSpan *spans = malloc(sizeof(TraceSpan) * TRACE_RING_SPANS);
+    if (!spans) return -1;
+
+    int written = 0, first = 1;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"source\":\"hsts\",\"start_unix_ns\":%lu,"
+                 "\"sample_every\":%u,\"slow_ns\":%lu},\"traceEvents\":[",
+            (unsigned long)t->start_ns, t->sample_every, (unsigned long)t->slow_ns);
+    for (int w = 0; w < (int)t->nworkers && w < TRACE_MAX_WORKERS; w++) {
+        uint32_t pid = __atomic_load_n(&t->rings[w].pid, __ATOMIC_RELAXED);
+        fprintf(out, "%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                     "\"args\":{\"name\":\"worker %d (pid %u)\"}}",
+                first ? "" : ",", w, w, pid);
+        fprintf(out, ",\n{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                     "\"args\":{\"sort_index\":%d}}", w, w);
+        first = 0;
+
+        int n = trace_snapshot_ring(t, w, spans);
+        for (int i = 0; i < n; i++) {
+            const TraceSpan *req = &spans[i];
+            if (req->stage != TRACE_SPAN_REQUEST || req->dur_ns < min_total_ns) continue;
+            // 同一個請求的 span 就在它前面；最舊的那個請求可能只剩一半，它的 request span 也還在才寫
+            int j = i;
+            while (j > 0 && spans[j - 1].req == req->req && spans[j - 1].stage != TRACE_SPAN_REQUEST) j--;
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"pid\":%d,\"tid\":1,"
+                         "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"req\":%u,\"ret\":%d,\"sampled\":%d,\"slow\":%d}}",
+                    metrics_op_name(req->op), w, trace_us(t, req->start_ns), req->dur_ns / 1e3, req->req, req->ret,
+                    !!(req->flags & TRACE_FLAG_SAMPLED), !!(req->flags & TRACE_FLAG_SLOW));
+            for (; j < i; j++) {
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":%d,\"tid\":1,"
+                             "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"req\":%u}}",
+                        metrics_stage_name(spans[j].stage), w, trace_us(t, spans[j].start_ns), spans[j].dur_ns / 1e3,
+                        spans[j].req);
+            }
+            written++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    free(spans);
+    return ferror(out) ? -1 : written;
+}
@@ -14,26 +14,93 @@
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <time.h>
+#include <getopt.h>
+#include <poll.h>
+#include <fcntl.h>
 
+#include "affinity.h"
 #include "bank.h"
 #include "logger.h"
+#include "metrics.h"
 #include "protocol.h"
+#include "ratelimit.h"
+#include "trace.h"
 
 #define PORT 8080
 #define WORKER_COUNT 4
 
-// --- 顏色定義 (儀表板用) ---
-#define ANSI_COLOR_CYAN    "\x1b[36m"
-#define ANSI_COLOR_YELLOW  "\x1b[33m"
-#define ANSI_COLOR_RED     "\x1b[31m"
-#define ANSI_COLOR_RESET   "\x1b[0m"
+// ============================================================================
+// Server Configuration (command-line options)
+// ============================================================================
+typedef struct {
+    int settle_window_ms;   // > 0: netting settlement mode for OP_TRANSFER
+    int settle_batch;       // flush early once this many transfers are buffered
+    int log_ring;           // 1: SHM ring log transport, 0: SysV message queue only
+    const char *metrics_listen;  // Prometheus admin endpoint (PORT / HOST:PORT / unix:PATH), NULL = off
+    int lock_profile;       // 1: per-lock wait / hold time, top-N hot accounts in the metrics page
+    int trace_sample;       // > 0: trace 1 in N requests into the per-worker span rings
+    int trace_slow_us;      // > 0: also trace every request slower than this
+    int header_timeout_ms;  // close a connection whose request header is not complete by then (0 = never)
+    int body_timeout_ms;    // ... whose body is not complete this long after its header
+    int write_timeout_ms;   // give up on a response the client does not read
+    int queue_budget_ms;    // > 0: shed requests that queued longer than this (BANK_ERR_OVERLOADED)
+    int listen_backlog;     // accept queue length
+    int write_lane;         // concurrent transfers / settlements in the bank (limit_sem)
+    int read_lane;          // concurrent balance reads (read_sem), independent of the write lane
+    int read_workers;       // > 0: extra workers that only serve reads, on read_port
+    int read_port;
+    uint32_t rate_account;  // > 0: transfers per second per source account (token bucket)
+    uint32_t burst_account; // bucket size (0 = one second's worth)
+    uint32_t rate_client;   // > 0: requests per second per client address
+    uint32_t burst_client;
+    const char *cpu_workers;     // cpulist / "auto": pin worker i to the i-th CPU (NULL = let the scheduler place them)
+    const char *cpu_loggers;     // cpulist: pin logger shard k to the k-th CPU
+    const char *cpu_monitor;     // cpulist: CPUs of the metrics exporter
+} ServerConfig;
+
+static ServerConfig g_config = {
+    .settle_window_ms = 0,
+    .settle_batch = SETTLE_MAX_BATCH,
+    .log_ring = 1,
+    .metrics_listen = NULL,
+    .lock_profile = 0,
+    .trace_sample = 0,
+    .trace_slow_us = 0,
+    .header_timeout_ms = 2000,
+    .body_timeout_ms = 2000,
+    .write_timeout_ms = 2000,
+    .queue_budget_ms = 0,
+    .listen_backlog = 10,
+    .write_lane = MAX_CONCURRENCY,
+    .read_lane = MAX_READ_CONCURRENCY,
+    .read_workers = 0,
+    .read_port = PORT + 1,
+    .rate_account = 0,
+    .burst_account = 0,
+    .rate_client = 0,
+    .burst_client = 0,
+    .cpu_workers = NULL,
+    .cpu_loggers = NULL,
+    .cpu_monitor = NULL
+};
+// 解析後的 CPU 清單 (n = 0: 不 pin)
+static int g_worker_cpus[AFFINITY_MAX_CPUS], g_worker_ncpu = 0;
+static int g_logger_cpus[AFFINITY_MAX_CPUS], g_logger_ncpu = 0;
+static int g_monitor_cpus[AFFINITY_MAX_CPUS], g_monitor_ncpu = 0;
+static LoggerConfig g_log_config;
 
 // ============================================================================
 // Global Resources (for Signal Handler Cleanup)
 // ============================================================================
 static int mq_id = -1;
 static int server_fd = -1;
+static int read_fd = -1;           // --read-workers: listen socket of the read lane
+static pid_t logger_pids[LOG_SHARDS_MAX];
+static int logger_count = 0;
 static volatile sig_atomic_t keep_running = 1;
+static volatile sig_atomic_t trace_dump_requested = 0;
+static WorkerMetrics *g_metrics = NULL;  // 本 Worker 在 metrics page 的 slot (NULL = 沒有 metrics)
+static int g_read_only = 0;              // 本 Worker 是讀取專用的 (--read-workers)
 
 // ============================================================================
 // Signal Handler: Graceful Shutdown
@@ -43,17 +110,31 @@ void handle_signal(int sig) {
         keep_running = 0;
         printf("\n[Server] Caught signal %d. Initiating shutdown...\n", sig);
         
+        // Stop Loggers first so they can drain the queue and flush their buffers
+        for (int i = 0; i < logger_count; i++) {
+            if (logger_pids[i] > 0) kill(logger_pids[i], SIGTERM);
+        }
+        for (int i = 0; i < logger_count; i++) {
+            if (logger_pids[i] > 0) waitpid(logger_pids[i], NULL, 0);
+        }
+
         // Cleanup Logger Resources (Message Queue)
         if (mq_id != -1) {
             logger_mq_cleanup(mq_id);
             printf("[Server] Logger MQ cleaned up.\n");
         }
+        logger_ring_cleanup();
+        logger_spill_cleanup();
+        metrics_cleanup();
+        trace_cleanup();
+        ratelimit_cleanup();
         
         // Cleanup Bank Resources (Shared Memory)
         bank_destroy(); // Master process destroys SHM
         printf("[Server] Bank SHM destroyed.\n");
         
         // Close Server Socket
+        if (read_fd != -1) close(read_fd);
         if (server_fd != -1) {
             close(server_fd);
             printf("[Server] Server socket closed.\n");
@@ -66,44 +147,10 @@ void handle_signal(int sig) {
     }
 }
 
-// ============================================================================
-// MQ Monitor Function (儀表板核心)
-// ============================================================================
-void monitor_queue(int msqid) {
-    struct msqid_ds buf;
-
-    // 查詢 Queue 狀態
-    if (msgctl(msqid, IPC_STAT, &buf) == -1) {
-        return;
-    }
-
-    unsigned long count = buf.msg_qnum;            
-    unsigned long current_bytes = buf.__msg_cbytes; // GNU模式下通常用 __msg_cbytes
-    unsigned long max_bytes = buf.msg_qbytes;      
-    double load = (double)current_bytes / max_bytes * 100.0;
-
-    // 取得時間
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char time_str[20];
-    strftime(time_str, sizeof(time_str), "%H:%M:%S", t);
-
-    printf("\r"); // 同一行更新
-
-    if (load < 20.0) {
-        printf("[%s] " ANSI_COLOR_CYAN "[監控] 狀態: 空閒 | 堆積: %lu | 負載: %.1f%%    " ANSI_COLOR_RESET, time_str, count, load);
-    } else if (load < 70.0) {
-        printf("[%s] " ANSI_COLOR_YELLOW "[監控] 狀態: 忙碌 | 堆積: %lu | 負載: %.1f%%    " ANSI_COLOR_RESET, time_str, count, load);
-    } else {
-        printf("[%s] " ANSI_COLOR_RED "[監控] 狀態: 擁塞 | 堆積: %lu | 負載: %.1f%%    " ANSI_COLOR_RESET, time_str, count, load);
-    }
-    fflush(stdout); 
-}
-
 // ============================================================================
 // Network: Create Listening Socket
 // ============================================================================
-int network_create_listener(int port) {
+int network_create_listener(int port, int backlog) {
     int fd;
     struct sockaddr_in addr;
     int opt = 1;
@@ -130,7 +177,7 @@ int network_create_listener(int port) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(fd, 10) < 0) {
+    if (listen(fd, backlog) < 0) {
         perror("[Network] listen");
         close(fd);
         exit(EXIT_FAILURE);
@@ -139,13 +186,497 @@ int network_create_listener(int port) {
     return fd;
 }
 
+// ============================================================================
+// Worker: Latency Stats (OP_STATS)
+// ============================================================================
+/* 所有 Worker 的 (op, stage) 直方圖加總後回傳百分位數；只讀 metrics page，不碰其他 Worker */
+static uint32_t stats_fill(StatsBody* resp) {
+    const MetricsShm* m = metrics_region();
+    if (!m) return 0;
+
+    uint32_t n = 0;
+    LatencyHist h;
+    for (int op = 0; op < METRICS_OPS; op++) {
+        for (int stage = 0; stage < METRICS_STAGES && n < STATS_MAX_ENTRIES; stage++) {
+            metrics_merge_latency(m, op, stage, &h);
+            if (h.count == 0) continue;
+            StatsEntry* e = &resp->entries[n++];
+            memset(e, 0, sizeof(*e));
+            e->op_code = (uint8_t)metrics_op_code(op);
+            e->stage = (uint8_t)stage;
+            e->count = protocol_hton64(h.count);
+            e->sum_ns = protocol_hton64(h.sum_ns);
+            e->max_ns = protocol_hton64(h.max_ns);
+            e->p50_ns = protocol_hton64(metrics_lat_percentile(&h, 50.0));
+            e->p90_ns = protocol_hton64(metrics_lat_percentile(&h, 90.0));
+            e->p99_ns = protocol_hton64(metrics_lat_percentile(&h, 99.0));
+            e->p999_ns = protocol_hton64(metrics_lat_percentile(&h, 99.9));
+        }
+    }
+    resp->workers = htonl(m->nworkers);
+    resp->count = htonl(n);
+    return (uint32_t)(offsetof(StatsBody, entries) + n * sizeof(StatsEntry));
+}
+
+// ============================================================================
+// Worker: Rate Limits (--rate-account / --rate-client)
+// ============================================================================
+// 來源帳戶的 token bucket：BANK_OK 或 BANK_ERR_RATE_LIMITED (拒絕的轉帳不進 bank、不寫 audit log)
+static int account_admit(int src_id) {
+    if (src_id < 0 || !ratelimit_enabled(RATELIMIT_ACCOUNT)) return BANK_OK;
+    int r = ratelimit_take(RATELIMIT_ACCOUNT, (uint64_t)src_id);
+    if (r == RATELIMIT_OK) return BANK_OK;
+    if (r == RATELIMIT_UNTRACKED) {
+        if (g_metrics) METRIC_ADD(g_metrics->rate_untracked, 1);
+        return BANK_OK;
+    }
+    if (g_metrics) METRIC_ADD(g_metrics->rate_limited_account, 1);
+    return BANK_ERR_RATE_LIMITED;
+}
+
+// ============================================================================
+// Worker: Handle One Request (dispatch by op_code, send response)
+// ============================================================================
+// accepted_ns: metrics_stage_clock() at accept (0 = no metrics)
+static void worker_handle_request(int client_fd, const PacketHeader* header, void* body, int mqid,
+                                  uint64_t accepted_ns) {
+    int ret_code = 0;
+    int responded = 0; // 已經用 protocol_send_body 回覆過
+    int sent = 0;      // PROTOCOL_ERR_TIMEOUT: client 不讀回應 (寫入期限)
+    switch (header->op_code) {
+        case OP_LOGIN: {
+            ret_code = 0; 
+            logger_send_async(mqid, OP_LOGIN, ret_code, 0, 0, 0);
+            break;
+        }
+        case OP_BALANCE: {
+            int account_id;
+            if (header->body_len == sizeof(int)) {
+                account_id = ntohl(*(int*)body);
+            } else if (header->body_len == sizeof(BalanceExtBody)) {
+                BalanceExtBody* q = (BalanceExtBody*)body;
+                account_id = bank_resolve_ext_id(protocol_ntoh64(q->ext_id));
+            } else {
+                ret_code = BANK_ERR_INTERNAL;
+                break;
+            }
+            int balance = 0;
+            ret_code = (account_id < 0) ? account_id : bank_get_balance(account_id, &balance);
+            if (ret_code == BANK_OK) ret_code = balance;
+            logger_send_async(mqid, OP_BALANCE, ret_code, account_id, 0, 0);
+            break;
+        }
+        case OP_TRANSFER: {
+            int src_id, dst_id, amount;
+            if (header->body_len == sizeof(TransferBody)) {
+                TransferBody* tf = (TransferBody*)body;
+                src_id = ntohl(tf->src_id);
+                dst_id = ntohl(tf->dst_id);
+                amount = ntohl(tf->amount);
+            } else if (header->body_len == sizeof(TransferExtBody)) {
+                // External account numbers -> account id (lock-free index)
+                TransferExtBody* tf = (TransferExtBody*)body;
+                src_id = bank_resolve_ext_id(protocol_ntoh64(tf->src_ext));
+                dst_id = bank_resolve_ext_id(protocol_ntoh64(tf->dst_ext));
+                amount = ntohl(tf->amount);
+            } else if (header->body_len == sizeof(TransferIdemBody)) {
+                // Retry-safe transfer：重送只回原本結果，不重複記帳
+                TransferIdemBody* tf = (TransferIdemBody*)body;
+                src_id = ntohl(tf->src_id);
+                dst_id = ntohl(tf->dst_id);
+                amount = ntohl(tf->amount);
+                int replayed = 0;
+                ret_code = account_admit(src_id);
+                if (ret_code != BANK_OK) break;
+                ret_code = bank_transfer_idem(tf->idem_key, src_id, dst_id, amount, &replayed);
+                if (!replayed) logger_send_async_at(mqid, OP_TRANSFER, ret_code, src_id, dst_id, amount,
+                                                    bank_last_commit_ns());
+                break;
+            } else {
+                ret_code = BANK_ERR_INTERNAL;
+                break;
+            }
+            
+            ret_code = account_admit(src_id);
+            if (ret_code != BANK_OK) break;
+            ret_code = bank_transfer(src_id, dst_id, amount);
+            logger_send_async_at(mqid, OP_TRANSFER, ret_code, src_id, dst_id, amount, bank_last_commit_ns());
+            break;
+        }
+        case OP_BIND_ACCOUNT: {
+            if (header->body_len != sizeof(BindAccountBody)) {
+                ret_code = BANK_ERR_INTERNAL;
+                break;
+            }
+            BindAccountBody* bind = (BindAccountBody*)body;
+            int account_id = ntohl(bind->account_id);
+            ret_code = bank_bind_ext_id(protocol_ntoh64(bind->ext_id), account_id);
+            logger_send_async(mqid, OP_BIND_ACCOUNT, ret_code, account_id, 0, 0);
+            break;
+        }
+        case OP_OPEN_ACCOUNT: {
+            if (header->body_len != sizeof(OpenAccountBody)) {
+                ret_code = BANK_ERR_INTERNAL;
+                break;
+            }
+            OpenAccountBody* req = (OpenAccountBody*)body;
+            int initial = ntohl(req->initial_balance);
+            // Client 不能自己決定開戶餘額 (等於憑空造錢)：新帳戶一律從 0 開始，靠轉帳入金
+            ret_code = initial != 0 ? BANK_ERR_INVALID_AMOUNT : bank_open_account(protocol_ntoh64(req->ext_id), 0);
+            logger_send_async(mqid, OP_OPEN_ACCOUNT, ret_code < 0 ? ret_code : BANK_OK,
+                              ret_code < 0 ? -1 : ret_code, 0, initial);
+            break;
+        }
+        case OP_CLOSE_ACCOUNT: {
+            int account_id;
+            if (header->body_len == sizeof(int)) {
+                account_id = ntohl(*(int*)body);
+            } else if (header->body_len == sizeof(BalanceExtBody)) {
+                account_id = bank_resolve_ext_id(protocol_ntoh64(((BalanceExtBody*)body)->ext_id));
+            } else {
+                ret_code = BANK_ERR_INTERNAL;
+                break;
+            }
+            ret_code = (account_id < 0) ? account_id : bank_close_account(account_id);
+            logger_send_async(mqid, OP_CLOSE_ACCOUNT, ret_code, account_id, 0, 0);
+            break;
+        }
+        case OP_AGGREGATE: {
+            // Defaults: 低於 1000 的帳戶數，直方圖 0..16000 每格 1000
+            BankScanParams params = { 1000, 0, 1000 };
+            if (header->body_len == sizeof(AggregateRequest)) {
+                AggregateRequest* req = (AggregateRequest*)body;
+                params.threshold = ntohl(req->threshold);
+                params.hist_base = ntohl(req->hist_base);
+                params.hist_width = ntohl(req->hist_width);
+            } else if (header->body_len != 0) {
+                ret_code = BANK_ERR_INTERNAL;
+                break;
+            }
+
+            BankAggregate agg;
+            ret_code = bank_aggregate(&params, &agg);
+            logger_send_async(mqid, OP_AGGREGATE, ret_code, 0, 0, 0);
+            if (ret_code != BANK_OK) break;
+
+            AggregateBody resp;
+            resp.total = protocol_hton64((uint64_t)agg.total);
+            resp.min = htonl(agg.min);
+            resp.max = htonl(agg.max);
+            resp.count = htonl((uint32_t)agg.count);
+            resp.below = htonl((uint32_t)agg.below);
+            for (int i = 0; i < AGG_HIST_BUCKETS; i++) {
+                resp.histogram[i] = htonl((uint32_t)agg.histogram[i]);
+            }
+            sent = protocol_send_body(client_fd, header->op_code, &resp, sizeof(resp));
+            responded = 1;
+            break;
+        }
+        case OP_STATS: {
+            static StatsBody resp;
+            uint32_t len = stats_fill(&resp);
+            if (len == 0) {
+                ret_code = BANK_ERR_INTERNAL; // Server 沒有 metrics page
+                break;
+            }
+            sent = protocol_send_body(client_fd, header->op_code, &resp, len);
+            responded = 1;
+            break;
+        }
+        default:
+            ret_code = BANK_ERR_INTERNAL;
+            break;
+    }
+
+    uint64_t t_resp = metrics_stage_clock();
+    if (!responded) sent = protocol_send_response(client_fd, header->op_code, ret_code);
+    if (sent == PROTOCOL_ERR_TIMEOUT && g_metrics) METRIC_ADD(g_metrics->write_timeouts, 1);
+    if (accepted_ns) {
+        uint64_t done = metrics_stage_clock();
+        if (responded) t_resp = done; // protocol_send_body 已經在 switch 裡寫完了
+        metrics_stage_set(METRICS_STAGE_RESPONSE, done - t_resp);
+        metrics_stage_set(METRICS_STAGE_TOTAL, done - accepted_ns);
+    }
+    metrics_req_end(header->op_code, ret_code);
+}
+
+// ============================================================================
+// Worker: Netting Settlement Buffer
+// ============================================================================
+/* 清算模式：OP_TRANSFER 先放進本 Worker 的批次 (client 連線保持開啟)，
+ * 時間窗到期或批次滿了再用 bank_settle() 一次結算，每筆各自回覆與記錄 */
+typedef struct {
+    int fd;
+    SettleItem item;
+    uint64_t accepted_ns;    // metrics: 從 accept 開始算 (包含在時間窗裡等待的時間)
+    uint64_t parse_ns;
+} PendingTransfer;
+
+static PendingTransfer settle_queue[SETTLE_MAX_BATCH];
+static int settle_count = 0;
+static struct timespec settle_deadline;
+
+static long ms_until(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+static void settle_enqueue(int client_fd, const TransferBody* tf, uint64_t accepted_ns, uint64_t parse_ns) {
+    if (settle_count == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &settle_deadline);
+        settle_deadline.tv_sec += g_config.settle_window_ms / 1000;
+        settle_deadline.tv_nsec += (long)(g_config.settle_window_ms % 1000) * 1000000;
+        if (settle_deadline.tv_nsec >= 1000000000L) {
+            settle_deadline.tv_sec++;
+            settle_deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    PendingTransfer* p = &settle_queue[settle_count++];
+    p->fd = client_fd;
+    p->item.src_id = ntohl(tf->src_id);
+    p->item.dst_id = ntohl(tf->dst_id);
+    p->item.amount = ntohl(tf->amount);
+    p->accepted_ns = accepted_ns;
+    p->parse_ns = parse_ns;
+    if (g_metrics) METRIC_SET(g_metrics->settle_pending, (uint64_t)settle_count);
+}
+
+static void settle_flush(int mqid) {
+    SettleItem items[SETTLE_MAX_BATCH];
+    int results[SETTLE_MAX_BATCH];
+
+    for (int i = 0; i < settle_count; i++) items[i] = settle_queue[i].item;
+    metrics_req_begin(); // admission / lock / critical 是整批共用的，每筆都算進去
+    if (bank_settle(items, settle_count, results) < 0) {
+        for (int i = 0; i < settle_count; i++) results[i] = BANK_ERR_INTERNAL;
+    }
+
+    uint64_t commit_ns = bank_last_commit_ns();
+    for (int i = 0; i < settle_count; i++) {
+        PendingTransfer* p = &settle_queue[i];
+        metrics_stage_set(METRICS_STAGE_LOG, 0);
+        logger_send_async_at(mqid, OP_TRANSFER, results[i], items[i].src_id, items[i].dst_id, items[i].amount,
+                             commit_ns);
+        uint64_t t_resp = metrics_stage_clock();
+        if (protocol_send_response(p->fd, OP_TRANSFER, results[i]) == PROTOCOL_ERR_TIMEOUT && g_metrics)
+            METRIC_ADD(g_metrics->write_timeouts, 1);
+        close(p->fd);
+        if (p->accepted_ns) {
+            uint64_t done = metrics_stage_clock();
+            metrics_stage_set(METRICS_STAGE_PARSE, p->parse_ns);
+            metrics_stage_set(METRICS_STAGE_RESPONSE, done - t_resp);
+            metrics_stage_set(METRICS_STAGE_TOTAL, done - p->accepted_ns);
+        }
+        metrics_req_end(OP_TRANSFER, results[i]);
+    }
+    if (g_metrics) {
+        METRIC_ADD(g_metrics->settle_batches, 1);
+        METRIC_ADD(g_metrics->settle_items, (uint64_t)settle_count);
+        METRIC_SET(g_metrics->settle_pending, 0);
+    }
+    settle_count = 0;
+}
+
+// ============================================================================
+// Worker: Slow-Client Protection (partial packets wait here, not in read())
+// ============================================================================
+/* 連線 socket 是 non-blocking：封包一次收齊 (一般情況) 就直接處理；只收到一部分的
+ * 連線停在這裡，Worker 繼續 accept / 處理別人的請求，資料到了再接著讀。
+ * 標頭、body 各有期限，到期就關掉：送半個標頭的 client 不會再卡住 4 個 Worker 之一 */
+#define PARKED_MAX 64
+#define PARKED_POLL_EVERY 8      // 一直有新連線時，每 accept 幾個才 poll 一次等資料的連線
+
+typedef struct {
+    int fd;
+    PacketReader rd;
+    uint64_t accepted_ns;    // CLOCK_MONOTONIC at accept
+    uint64_t deadline_ns;    // header deadline, then body deadline (0 = none)
+    uint32_t peer;           // client IPv4 address (host order), key of the client token bucket
+} ParkedConn;
+
+static ParkedConn parked[PARKED_MAX];
+static int parked_count = 0;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 還沒收齊標頭：從 accept 起算 header 期限；標頭收齊之後：從那時起算 body 期限
+static uint64_t conn_deadline(const PacketReader* rd, uint64_t now) {
+    int ms = protocol_reader_has_header(rd) ? g_config.body_timeout_ms : g_config.header_timeout_ms;
+    return ms > 0 ? now + (uint64_t)ms * 1000000ULL : 0;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 不處理的請求：不碰帳戶、不寫 audit log，直接回錯誤碼
+//   BANK_ERR_OVERLOADED：排隊預算用完 (client 退避後重試)；BANK_ERR_INTERNAL：讀取專用 Worker 收到寫入
+static void conn_reject(int client_fd, PacketReader* rd, uint64_t accepted_ns, int ret_code) {
+    uint64_t t_resp = metrics_stage_clock();
+    if (protocol_send_response(client_fd, rd->header.op_code, ret_code) == PROTOCOL_ERR_TIMEOUT && g_metrics)
+        METRIC_ADD(g_metrics->write_timeouts, 1);
+    if (accepted_ns) {
+        uint64_t done = metrics_stage_clock();
+        metrics_stage_set(METRICS_STAGE_RESPONSE, done - t_resp);
+        metrics_stage_set(METRICS_STAGE_TOTAL, done - accepted_ns);
+    }
+    metrics_req_end(rd->header.op_code, ret_code);
+    protocol_reader_free(rd);
+    close(client_fd);
+}
+
+static int op_is_read(uint8_t op_code) {
+    return op_code == OP_LOGIN || op_code == OP_BALANCE || op_code == OP_AGGREGATE || op_code == OP_STATS;
+}
+
+// 完整的封包：清算模式的 OP_TRANSFER 進批次 (連線保持開啟)，其他的馬上處理、回覆、關閉
+static void conn_dispatch(int client_fd, PacketReader* rd, uint64_t accepted_ns, uint32_t peer, int mqid) {
+    if (!g_metrics) accepted_ns = 0; // 0 = no metrics (worker_handle_request / settle_enqueue)
+    metrics_req_begin();
+    uint64_t parse_ns = accepted_ns ? metrics_stage_clock() - accepted_ns : 0;
+    metrics_stage_set(METRICS_STAGE_PARSE, parse_ns);
+
+    // 排隊預算：從 kernel 收到請求 (SO_TIMESTAMPNS) 算起，accept queue 裡等的時間也算在內。
+    // 已經超過的請求 client 多半已經逾時放棄 —— 做了也是白做，不如把 Worker 留給還來得及的請求
+    uint64_t deadline = 0;
+    if (g_config.queue_budget_ms > 0 && rd->arrival_ns) {
+        deadline = rd->arrival_ns + (uint64_t)g_config.queue_budget_ms * 1000000ULL;
+        if (realtime_ns() >= deadline) {
+            conn_reject(client_fd, rd, accepted_ns, BANK_ERR_OVERLOADED);
+            return;
+        }
+    }
+
+    // 每個 client 位址一個 token bucket：同一個 client 打到哪個 Worker 都扣同一桶
+    if (ratelimit_enabled(RATELIMIT_CLIENT)) {
+        int r = ratelimit_take(RATELIMIT_CLIENT, peer);
+        if (r == RATELIMIT_LIMITED) {
+            if (g_metrics) METRIC_ADD(g_metrics->rate_limited_client, 1);
+            conn_reject(client_fd, rd, accepted_ns, BANK_ERR_RATE_LIMITED);
+            return;
+        }
+        if (r == RATELIMIT_UNTRACKED && g_metrics) METRIC_ADD(g_metrics->rate_untracked, 1);
+    }
+
+    // 讀取 lane 的 Worker 只做不改狀態的 op：寫入不會排到讀取前面，也不會佔住讀取的 Worker
+    if (g_read_only && !op_is_read(rd->header.op_code)) {
+        conn_reject(client_fd, rd, accepted_ns, BANK_ERR_INTERNAL);
+        return;
+    }
+
+    if (g_config.settle_window_ms > 0 && rd->header.op_code == OP_TRANSFER &&
+        rd->header.body_len == sizeof(TransferBody)) {
+        if (account_admit((int)ntohl(((TransferBody*)rd->body)->src_id)) != BANK_OK) {
+            conn_reject(client_fd, rd, accepted_ns, BANK_ERR_RATE_LIMITED);
+            return;
+        }
+        settle_enqueue(client_fd, (TransferBody*)rd->body, accepted_ns, parse_ns);
+        protocol_reader_free(rd);
+        return;
+    }
+
+    bank_set_deadline(deadline); // admission 也最多等到期限
+    worker_handle_request(client_fd, &rd->header, rd->body, mqid, accepted_ns);
+    bank_set_deadline(0);
+    protocol_reader_free(rd);
+    close(client_fd);
+}
+
+static void conn_drop(int i) {
+    protocol_reader_free(&parked[i].rd);
+    close(parked[i].fd);
+    parked[i] = parked[--parked_count];
+}
+
+static void conn_start(int client_fd, uint32_t peer, int mqid) {
+    uint64_t now = mono_ns();
+    if (g_metrics) METRIC_ADD(g_metrics->connections, 1);
+
+    PacketReader rd;
+    protocol_reader_init(&rd);
+    int r = protocol_reader_feed(client_fd, &rd);
+    if (r == PROTOCOL_READ_DONE) {
+        conn_dispatch(client_fd, &rd, now, peer, mqid);
+        return;
+    }
+    if (r < 0 || parked_count == PARKED_MAX) {
+        if (g_metrics) {
+            if (r < 0) METRIC_ADD(g_metrics->bad_packets, 1);
+            else METRIC_ADD(g_metrics->parked_full, 1);
+        }
+        protocol_reader_free(&rd);
+        close(client_fd);
+        return;
+    }
+    ParkedConn* c = &parked[parked_count++];
+    c->fd = client_fd;
+    c->rd = rd;
+    c->accepted_ns = now;
+    c->peer = peer;
+    c->deadline_ns = conn_deadline(&rd, now);
+    if (g_metrics) METRIC_SET(g_metrics->parked, (uint64_t)parked_count);
+}
+
+// pfds[i] 對應 parked[i] (poll 當時)；從後面往前處理，移除 (和最後一個交換) 不影響還沒看的
+static void conn_service(const struct pollfd* pfds, int n, int mqid) {
+    uint64_t now = mono_ns();
+    for (int i = n - 1; i >= 0; i--) {
+        ParkedConn* c = &parked[i];
+        if (pfds[i].revents) {
+            int had_header = protocol_reader_has_header(&c->rd);
+            int r = protocol_reader_feed(c->fd, &c->rd);
+            if (r == PROTOCOL_READ_DONE) {
+                ParkedConn done = *c;
+                parked[i] = parked[--parked_count];
+                conn_dispatch(done.fd, &done.rd, done.accepted_ns, done.peer, mqid);
+                continue;
+            }
+            if (r < 0) {
+                if (g_metrics) METRIC_ADD(g_metrics->bad_packets, 1);
+                conn_drop(i);
+                continue;
+            }
+            if (!had_header && protocol_reader_has_header(&c->rd)) c->deadline_ns = conn_deadline(&c->rd, now);
+        }
+        if (c->deadline_ns && now >= c->deadline_ns) {
+            if (g_metrics) {
+                if (protocol_reader_has_header(&c->rd)) METRIC_ADD(g_metrics->body_timeouts, 1);
+                else METRIC_ADD(g_metrics->header_timeouts, 1);
+            }
+            conn_drop(i);
+        }
+    }
+    if (g_metrics) METRIC_SET(g_metrics->parked, (uint64_t)parked_count);
+}
+
+// poll 最多等到：清算時間窗結束、最早的連線期限 (都沒有 = -1)
+static int wait_timeout_ms(void) {
+    long t = -1;
+    if (settle_count > 0) {
+        t = ms_until(&settle_deadline);
+        if (t < 0) t = 0;
+    }
+    uint64_t now = 0;
+    for (int i = 0; i < parked_count; i++) {
+        if (!parked[i].deadline_ns) continue;
+        if (!now) now = mono_ns();
+        long ms = parked[i].deadline_ns > now ? (long)((parked[i].deadline_ns - now + 999999) / 1000000) : 0;
+        if (t < 0 || ms < t) t = ms;
+    }
+    return (int)t;
+}
+
 // ============================================================================
 // Worker: Process Client Requests
 // ============================================================================
 void worker_process_loop(int server_socket, int mqid) {
-    struct sockaddr_in address;
-    socklen_t addrlen = sizeof(address);
-    
     // Worker must attach to existing SHM (not create)
     if (bank_init() != 0) {
         fprintf(stderr, "[Worker %d] Failed to attach to Bank SHM\n", getpid());
@@ -160,76 +691,307 @@ void worker_process_loop(int server_socket, int mqid) {
 
     printf("[Worker %d] Ready to accept connections.\n", getpid());
 
+    int settle_mode = (g_config.settle_window_ms > 0);
+    protocol_set_write_timeout(g_config.write_timeout_ms);
+    static struct pollfd pfds[1 + PARKED_MAX];
+    int accepts = 0;
+
     while (keep_running) {
-        int client_fd = accept(server_socket, (struct sockaddr *)&address, &addrlen);
-        if (client_fd < 0) {
-            if (errno == EINTR) continue; 
-            perror("[Worker] accept");
+        // 有待結算的批次時，時間窗到了 / 批次滿了就結算
+        if (settle_mode && settle_count > 0 &&
+            (settle_count >= g_config.settle_batch || ms_until(&settle_deadline) <= 0)) {
+            settle_flush(mqid);
             continue;
         }
 
-        // 為了讓畫面乾淨，這裡我把 Worker 的 Log 註解掉，讓您專心看儀表板
-        // printf("[Worker %d] Client connected...\n", getpid());
+        // 先直接 accept (忙的時候不多一次 poll)；listen socket 是 non-blocking，沒有新連線才 poll
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int client_fd = accept4(server_socket, (struct sockaddr*)&peer, &peer_len, SOCK_NONBLOCK);
+        if (client_fd >= 0) {
+            // 為了讓畫面乾淨，這裡我把 Worker 的 Log 註解掉 (即時狀態請用 hsts-top 看)
+            // printf("[Worker %d] Client connected...\n", getpid());
+            conn_start(client_fd, ntohl(peer.sin_addr.s_addr), mqid);
+            if (parked_count == 0 || ++accepts < PARKED_POLL_EVERY) continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("[Worker] accept");
+        }
 
-        PacketHeader header;
-        void* body = NULL;
-        if (protocol_read_packet(client_fd, &header, &body) < 0) {
-            close(client_fd);
-            continue;
+        // listen socket + 等資料的連線；剛 accept 到一個的話只看一眼 (timeout 0) 就回去 accept
+        int n = parked_count;
+        pfds[0].fd = server_socket;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < n; i++) {
+            pfds[1 + i].fd = parked[i].fd;
+            pfds[1 + i].events = POLLIN;
+            pfds[1 + i].revents = 0;
         }
+        accepts = 0;
+        if (poll(pfds, (nfds_t)(1 + n), client_fd >= 0 ? 0 : wait_timeout_ms()) < 0) continue; // EINTR
+        if (n > 0) conn_service(pfds + 1, n, mqid);
+    }
+    if (settle_count > 0) settle_flush(mqid);
+    while (parked_count > 0) conn_drop(parked_count - 1);
+    bank_detach();
+}
 
-        int ret_code = 0;
-        switch (header.op_code) {
-            case OP_LOGIN: {
-                ret_code = 0; 
-                logger_send_async(mqid, OP_LOGIN, ret_code, 0, 0, 0);
+// ============================================================================
+// Master: Trace Snapshot (SIGUSR1)
+// ============================================================================
+static void handle_trace_dump(int sig) {
+    (void)sig;
+    trace_dump_requested = 1;
+}
+
+// 寫到 audit log 的目錄：<dir>/trace-<unix time>.json (用 chrome://tracing 或 ui.perfetto.dev 開)
+static void trace_dump(void) {
+    const TraceShm *t = trace_region();
+    if (!t) {
+        fprintf(stderr, "[Server] SIGUSR1: tracing is off (--trace-sample / --trace-slow-us)\n");
+        return;
+    }
+    char path[512];
+    const char *slash = strrchr(g_log_config.path, '/');
+    int dir_len = slash ? (int)(slash - g_log_config.path) : 1;
+    snprintf(path, sizeof(path), "%.*s/trace-%ld.json", dir_len, slash ? g_log_config.path : ".", (long)time(NULL));
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("[Server] trace snapshot");
+        return;
+    }
+    int n = trace_write_chrome(t, out, 0);
+    if (fclose(out) != 0) n = -1;
+    if (n < 0) fprintf(stderr, "[Server] Trace snapshot to %s failed\n", path);
+    else printf("[Server] Trace snapshot: %d requests -> %s\n", n, path);
+}
+
+// ============================================================================
+// Command-Line Options
+// ============================================================================
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --settle-window-ms <N>  Netting settlement mode: buffer transfers for N ms\n");
+    printf("  --settle-batch <N>      Settle early once N transfers are buffered (max %d)\n", SETTLE_MAX_BATCH);
+    printf("  --log-transport <t>     Audit log transport: ring (SHM, default) | sysv\n");
+    printf("  --log-format <fmt>      Audit log format: text (default) | binary (decode with logdecode)\n");
+    printf("  --log-sync <policy>     Audit log fdatasync policy: none | flush | interval\n");
+    printf("  --log-flush-ms <N>      Flush buffered log records at least every N ms (0 = when the buffer fills)\n");
+    printf("  --log-batch <N>         Logger drains up to N records per wake-up (max %d)\n", LOG_BATCH_MAX);
+    printf("  --log-batch-wait-us <N> Let a started batch wait up to N us to fill up\n");
+    printf("  --log-rotate-mb <N>     Roll the audit log into indexed segments of N MB (max %d)\n", LOG_SEGMENT_MAX_MB);
+    printf("  --log-rotate-sec <N>    ...or every N seconds (segments still roll at %d MB; query with logquery)\n",
+           LOG_SEGMENT_MAX_MB);
+    printf("  --log-keep <N>          Keep only the newest N sealed segments\n");
+    printf("  --log-key <file>        AES-128-CTR encrypt the binary audit log (32 hex digits; read with --key)\n");
+    printf("  --log-subscribe <sock>  Stream written records to local subscribers on a Unix socket (see logtail)\n");
+    printf("  --loggers <N>           Logger processes, each writing its own shard (max %d; merge with logmerge)\n",
+           LOG_SHARDS_MAX);
+    printf("  --metrics-listen <addr> Serve Prometheus metrics on PORT, HOST:PORT (default host 127.0.0.1)\n");
+    printf("                          or unix:PATH (GET /metrics)\n");
+    printf("  --lock-profile          Profile account lock wait / hold time (hot accounts in hsts-top)\n");
+    printf("  --trace-sample <N>      Trace 1 in N requests per worker (dump with hsts-trace, GET /trace\n");
+    printf("                          on the metrics endpoint, or kill -USR1 <master pid>)\n");
+    printf("  --trace-slow-us <N>     Also trace every request slower than N us\n");
+    printf("  --header-timeout-ms <N> Close connections whose request header is not in after N ms (default 2000,\n");
+    printf("                          0 = never); slow clients wait aside and never block a worker\n");
+    printf("  --body-timeout-ms <N>   ...whose body is not in N ms after the header (default 2000)\n");
+    printf("  --write-timeout-ms <N>  Give up on a response the client does not read after N ms (default 2000)\n");
+    printf("  --queue-budget-ms <N>   Answer requests that waited N ms since they reached the host (accept\n");
+    printf("                          queue included) with OVERLOADED instead of serving them late (0 = off)\n");
+    printf("  --listen-backlog <N>    Accept queue length (default 10; a longer queue needs --queue-budget-ms)\n");
+    printf("  --write-lane <N>        Transfers / settlements inside the bank at once (default %d)\n", MAX_CONCURRENCY);
+    printf("  --read-lane <N>         Balance reads inside the bank at once, independent of writes (default %d)\n",
+           MAX_READ_CONCURRENCY);
+    printf("  --read-workers <N>      Extra workers that only serve reads (balance, aggregate, stats) on\n");
+    printf("                          --read-port (default %d), with their own accept queue\n", PORT + 1);
+    printf("  --rate-account <R[:B]>  Token bucket per source account: R transfers/s, bursts of B (default R);\n");
+    printf("                          more are refused with RATE_LIMITED\n");
+    printf("  --rate-client <R[:B]>   Token bucket per client IPv4 address, for every request\n");
+    printf("  --cpu-workers <list>    Pin worker i to the i-th CPU of a cpulist (\"0-3,8\"), round-robin; \"auto\"\n");
+    printf("                          = the allowed CPUs node by node. The shared account table and its\n");
+    printf("                          extents are interleaved over the workers' NUMA nodes\n");
+    printf("  --cpu-loggers <list>    Pin logger shard k to the k-th CPU of the list\n");
+    printf("  --cpu-monitor <list>    Run the metrics exporter on these CPUs\n");
+    printf("  --help                  Show this message\n");
+}
+
+// "R" 或 "R:B" (每秒 R 個、桶子 B 個；沒給 B = R)
+static int parse_rate(const char* arg, uint32_t* rate, uint32_t* burst) {
+    char* end;
+    long r = strtol(arg, &end, 10), b = 0;
+    if (*end == ':') b = strtol(end + 1, &end, 10);
+    if (*end != '\0' || r < 0 || r > 1000000000L || b < 0 || b > 1000000000L) return -1;
+    *rate = (uint32_t)r;
+    *burst = (uint32_t)b;
+    return 0;
+}
+
+static int parse_options(int argc, char *argv[]) {
+    logger_config_default(&g_log_config);
+    static const struct option long_opts[] = {
+        { "settle-window-ms", required_argument, NULL, 'w' },
+        { "settle-batch",     required_argument, NULL, 'b' },
+        { "log-transport",    required_argument, NULL, 't' },
+        { "log-format",       required_argument, NULL, 'F' },
+        { "log-sync",         required_argument, NULL, 's' },
+        { "log-flush-ms",     required_argument, NULL, 'f' },
+        { "log-batch",        required_argument, NULL, 'B' },
+        { "log-batch-wait-us", required_argument, NULL, 'W' },
+        { "log-rotate-mb",    required_argument, NULL, 'R' },
+        { "log-rotate-sec",   required_argument, NULL, 'T' },
+        { "log-keep",         required_argument, NULL, 'K' },
+        { "log-key",          required_argument, NULL, 'k' },
+        { "log-subscribe",    required_argument, NULL, 'S' },
+        { "loggers",          required_argument, NULL, 'L' },
+        { "metrics-listen",   required_argument, NULL, 'M' },
+        { "lock-profile",     no_argument,       NULL, 'P' },
+        { "trace-sample",     required_argument, NULL, 'r' },
+        { "trace-slow-us",    required_argument, NULL, 'u' },
+        { "header-timeout-ms", required_argument, NULL, 'H' },
+        { "body-timeout-ms",  required_argument, NULL, 'Y' },
+        { "write-timeout-ms", required_argument, NULL, 'X' },
+        { "queue-budget-ms",  required_argument, NULL, 'Q' },
+        { "listen-backlog",   required_argument, NULL, 'G' },
+        { "write-lane",       required_argument, NULL, 'A' },
+        { "read-lane",        required_argument, NULL, 'a' },
+        { "read-workers",     required_argument, NULL, 'N' },
+        { "read-port",        required_argument, NULL, 'p' },
+        { "rate-account",     required_argument, NULL, 'c' },
+        { "rate-client",      required_argument, NULL, 'C' },
+        { "cpu-workers",      required_argument, NULL, 'U' },
+        { "cpu-loggers",      required_argument, NULL, 'V' },
+        { "cpu-monitor",      required_argument, NULL, 'O' },
+        { "help",             no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'w': g_config.settle_window_ms = atoi(optarg); break;
+            case 'b': g_config.settle_batch = atoi(optarg); break;
+            case 't':
+                if (strcmp(optarg, "ring") == 0) g_config.log_ring = 1;
+                else if (strcmp(optarg, "sysv") == 0) g_config.log_ring = 0;
+                else { fprintf(stderr, "[Server] Unknown --log-transport: %s\n", optarg); return -1; }
                 break;
-            }
-            case OP_BALANCE: {
-                if (header.body_len != sizeof(int)) {
-                    ret_code = BANK_ERR_INTERNAL;
-                    break;
+            case 'F':
+                if (strcmp(optarg, "text") == 0) g_log_config.format = LOG_FORMAT_TEXT;
+                else if (strcmp(optarg, "binary") == 0) g_log_config.format = LOG_FORMAT_BINARY;
+                else { fprintf(stderr, "[Server] Unknown --log-format: %s\n", optarg); return -1; }
+                break;
+            case 's':
+                if (strcmp(optarg, "none") == 0) g_log_config.sync_policy = LOG_SYNC_NONE;
+                else if (strcmp(optarg, "flush") == 0) g_log_config.sync_policy = LOG_SYNC_FLUSH;
+                else if (strcmp(optarg, "interval") == 0) g_log_config.sync_policy = LOG_SYNC_INTERVAL;
+                else { fprintf(stderr, "[Server] Unknown --log-sync policy: %s\n", optarg); return -1; }
+                break;
+            case 'f': g_log_config.flush_interval_ms = atoi(optarg); break;
+            case 'B': g_log_config.batch_size = (unsigned)atoi(optarg); break;
+            case 'W': g_log_config.batch_latency_us = atoi(optarg); break;
+            case 'R': g_log_config.rotate_mb = (unsigned)atoi(optarg); break;
+            case 'T': g_log_config.rotate_sec = atoi(optarg); break;
+            case 'K': g_log_config.keep_segments = atoi(optarg); break;
+            case 'k':
+                if (log_key_load(optarg, g_log_config.key) != 0) return -1;
+                g_log_config.encrypt = 1;
+                break;
+            case 'L': g_log_config.shards = atoi(optarg); break;
+            case 'S':
+                if (strlen(optarg) >= sizeof(g_log_config.sub_path)) {
+                    fprintf(stderr, "[Server] --log-subscribe path too long\n");
+                    return -1;
                 }
-                int account_id = ntohl(*(int*)body);
-                int balance = 0;
-                ret_code = bank_get_balance(account_id, &balance);
-                if (ret_code == BANK_OK) ret_code = balance;
-                logger_send_async(mqid, OP_BALANCE, ret_code, account_id, 0, 0);
+                snprintf(g_log_config.sub_path, sizeof(g_log_config.sub_path), "%s", optarg);
                 break;
-            }
-            case OP_TRANSFER: {
-                if (header.body_len != sizeof(TransferBody)) {
-                    ret_code = BANK_ERR_INTERNAL;
-                    break;
+            case 'M': g_config.metrics_listen = optarg; break;
+            case 'P': g_config.lock_profile = 1; break;
+            case 'r': g_config.trace_sample = atoi(optarg); break;
+            case 'u': g_config.trace_slow_us = atoi(optarg); break;
+            case 'H': g_config.header_timeout_ms = atoi(optarg); break;
+            case 'Y': g_config.body_timeout_ms = atoi(optarg); break;
+            case 'X': g_config.write_timeout_ms = atoi(optarg); break;
+            case 'Q': g_config.queue_budget_ms = atoi(optarg); break;
+            case 'G': g_config.listen_backlog = atoi(optarg); break;
+            case 'A': g_config.write_lane = atoi(optarg); break;
+            case 'a': g_config.read_lane = atoi(optarg); break;
+            case 'N': g_config.read_workers = atoi(optarg); break;
+            case 'p': g_config.read_port = atoi(optarg); break;
+            case 'c':
+                if (parse_rate(optarg, &g_config.rate_account, &g_config.burst_account) != 0) {
+                    fprintf(stderr, "[Server] Invalid --rate-account: %s\n", optarg);
+                    return -1;
                 }
-                TransferBody* tf = (TransferBody*)body;
-                int src_id = ntohl(tf->src_id);
-                int dst_id = ntohl(tf->dst_id);
-                int amount = ntohl(tf->amount);
-                
-                ret_code = bank_transfer(src_id, dst_id, amount);
-                logger_send_async(mqid, OP_TRANSFER, ret_code, src_id, dst_id, amount);
                 break;
-            }
-            default:
-                ret_code = BANK_ERR_INTERNAL;
+            case 'C':
+                if (parse_rate(optarg, &g_config.rate_client, &g_config.burst_client) != 0) {
+                    fprintf(stderr, "[Server] Invalid --rate-client: %s\n", optarg);
+                    return -1;
+                }
                 break;
+            case 'U': g_config.cpu_workers = optarg; break;
+            case 'V': g_config.cpu_loggers = optarg; break;
+            case 'O': g_config.cpu_monitor = optarg; break;
+            case 'h': print_usage(argv[0]); exit(0);
+            default:  print_usage(argv[0]); return -1;
         }
+    }
 
-        protocol_send_response(client_fd, header.op_code, ret_code);
-        if (body) free(body);
-        close(client_fd);
+    if (g_config.settle_window_ms < 0 ||
+        g_config.settle_batch < 1 || g_config.settle_batch > SETTLE_MAX_BATCH) {
+        fprintf(stderr, "[Server] Invalid settlement options\n");
+        return -1;
     }
-    bank_detach();
+    if (g_config.trace_sample < 0 || g_config.trace_slow_us < 0) {
+        fprintf(stderr, "[Server] Invalid trace options\n");
+        return -1;
+    }
+    if (g_config.write_lane < 1 || g_config.read_lane < 1 || g_config.read_workers < 0 ||
+        g_config.read_workers > METRICS_MAX_WORKERS - WORKER_COUNT || g_config.read_port < 1 ||
+        g_config.read_port > 65535 || g_config.read_port == PORT) {
+        fprintf(stderr, "[Server] Invalid lane options (at most %d read workers)\n",
+                METRICS_MAX_WORKERS - WORKER_COUNT);
+        return -1;
+    }
+    if (g_config.header_timeout_ms < 0 || g_config.body_timeout_ms < 0 || g_config.write_timeout_ms < 0 ||
+        g_config.queue_budget_ms < 0 || g_config.listen_backlog < 1) {
+        fprintf(stderr, "[Server] Invalid connection timeouts\n");
+        return -1;
+    }
+    if (g_log_config.flush_interval_ms < 0 || g_log_config.batch_latency_us < 0 ||
+        g_log_config.batch_size < 1 || g_log_config.batch_size > LOG_BATCH_MAX ||
+        g_log_config.rotate_mb > LOG_SEGMENT_MAX_MB || g_log_config.rotate_sec < 0 || g_log_config.keep_segments < 0 ||
+        g_log_config.shards < 1 || g_log_config.shards > LOG_SHARDS_MAX) {
+        fprintf(stderr, "[Server] Invalid logger options\n");
+        return -1;
+    }
+    if ((g_config.cpu_workers && (g_worker_ncpu = affinity_parse(g_config.cpu_workers, g_worker_cpus,
+                                                                   AFFINITY_MAX_CPUS)) < 1) ||
+        (g_config.cpu_loggers && (g_logger_ncpu = affinity_parse(g_config.cpu_loggers, g_logger_cpus,
+                                                                   AFFINITY_MAX_CPUS)) < 1) ||
+        (g_config.cpu_monitor && (g_monitor_ncpu = affinity_parse(g_config.cpu_monitor, g_monitor_cpus,
+                                                                    AFFINITY_MAX_CPUS)) < 1)) {
+        fprintf(stderr, "[Server] Invalid CPU list (expected e.g. 0-3,8 or auto)\n");
+        return -1;
+    }
+    if (g_log_config.encrypt && g_log_config.format != LOG_FORMAT_BINARY) {
+        fprintf(stderr, "[Server] --log-key needs --log-format binary\n");
+        return -1;
+    }
+    logger_configure(&g_log_config);
+    return 0;
 }
 
 // ============================================================================
 // Main: Master Process
 // ============================================================================
-int main() {
+int main(int argc, char *argv[]) {
+    if (parse_options(argc, argv) != 0) exit(EXIT_FAILURE);
+
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
     signal(SIGCHLD, SIG_IGN);
+    signal(SIGUSR1, SIG_IGN); // 子行程繼承 ignore；Master 在 fork 完之後才接 SIGUSR1
 
     printf("=== High-Concurrency Safe Transfer System (HSTS) ===\n");
     printf("[Server] Master process starting (PID: %d)...\n", getpid());
@@ -240,6 +1002,27 @@ int main() {
         exit(EXIT_FAILURE);
     }
     printf("[Server] ✓ Bank SHM initialized\n");
+    int nworkers = WORKER_COUNT + g_config.read_workers;   // 讀取專用的 Worker 排在後面 (id 4, 5, ...)
+    if ((g_config.write_lane != MAX_CONCURRENCY || g_config.read_lane != MAX_READ_CONCURRENCY) &&
+        bank_set_lane_limits(g_config.write_lane, g_config.read_lane) != BANK_OK) {
+        fprintf(stderr, "[Server] FATAL: Failed to set admission lanes\n");
+        bank_destroy();
+        exit(EXIT_FAILURE);
+    }
+    printf("[Server] ✓ Admission lanes: %d writes, %d reads at once\n", g_config.write_lane, g_config.read_lane);
+
+    // 帳戶表是 Master 寫的 (頁面都在 Master 的 node)；Worker 跨 node 時改成平均分到那幾個 node。
+    // 開戶時才長出來的 extent 也一樣 (由建立它的 Worker 設定)。
+    // 每個 Worker 自己的 ring 要等 Worker pin 好、第一次寫入才配頁，自然在它的 node 上
+    if (g_worker_ncpu > 0) {
+        char list[256];
+        int used = nworkers < g_worker_ncpu ? nworkers : g_worker_ncpu;
+        int nodes = affinity_interleave(get_bank_map(), sizeof(BankMap), g_worker_cpus, used);
+        bank_set_interleave(g_worker_cpus, used);
+        affinity_format(g_worker_cpus, used, list, sizeof(list));
+        printf("[Server] ✓ Workers pinned to CPUs %s (%d NUMA node%s%s)\n", list, nodes < 1 ? 1 : nodes,
+               nodes > 1 ? "s" : "", nodes > 1 ? ", account table and extents interleaved" : "");
+    }
 
     // 2. Initialize Logger
     mq_id = logger_mq_init();
@@ -250,54 +1033,167 @@ int main() {
     }
     printf("[Server] ✓ Logger MQ initialized (ID: %d)\n", mq_id);
 
+    // Ring 模式：每個 Worker 一條；SysV 模式也建立 segment，只放 Logger 統計
+    if (logger_ring_init(g_config.log_ring ? nworkers : 0) == 0) {
+        if (g_config.log_ring) printf("[Server] ✓ Log rings initialized (one per worker)\n");
+    } else if (g_config.log_ring) {
+        fprintf(stderr, "[Server] WARNING: Log rings unavailable, falling back to SysV queue\n");
+    }
+    // Ring / Queue 滿了時 Worker 改寫 spill 檔 (Logger 之後依序收回)，不再丟紀錄
+    if (logger_spill_init(g_log_config.path, nworkers) == 0) {
+        printf("[Server] ✓ Log spill files ready (lossless backpressure)\n");
+    } else {
+        fprintf(stderr, "[Server] WARNING: Log spill unavailable, full queues will drop records\n");
+    }
+
+    // 即時狀態 (每個 op 的速率、錯誤碼、等待時間、Log 堆積) 放在 SHM metrics page，
+    // 由 hsts-top 自己去讀：Server 端不再有每 1 ms 跑一次 msgctl 的 Monitor 行程
+    if (metrics_init(nworkers, g_log_config.shards) == 0) {
+        BankMap *bank = get_bank_map();
+        if (bank) metrics_bank_accounts(bank->open_accounts, bank->extent_count);
+        printf("[Server] ✓ Metrics page %s ready (watch with ./bin/hsts-top)\n", METRICS_SHM_NAME);
+        if (g_config.lock_profile && bank_lock_profile_enable() == 0)
+            printf("[Server] ✓ Lock profiler on (top %d locks per worker)\n", METRICS_LOCK_TOPK);
+    } else {
+        fprintf(stderr, "[Server] WARNING: Metrics page unavailable, running without metrics\n");
+    }
+
+    // Request tracing：span 從 metrics 的 stage API 來，沒有 metrics page 就沒有 trace
+    if ((g_config.trace_sample > 0 || g_config.trace_slow_us > 0) && metrics_region()) {
+        if (trace_init(nworkers, (uint32_t)g_config.trace_sample, (uint64_t)g_config.trace_slow_us * 1000) == 0) {
+            printf("[Server] ✓ Request tracing on (sample 1/%d, slow >= %d us, 0 = off); dump with ./bin/hsts-trace"
+                   " or kill -USR1 %d\n", g_config.trace_sample, g_config.trace_slow_us, getpid());
+        } else {
+            fprintf(stderr, "[Server] WARNING: Trace rings unavailable, running without tracing\n");
+        }
+    }
+
+    // Token buckets (來源帳戶 / client 位址)：SHM 表，所有 Worker 共用
+    if (g_config.rate_account > 0 || g_config.rate_client > 0) {
+        if (ratelimit_init(g_config.rate_account, g_config.burst_account, g_config.rate_client,
+                           g_config.burst_client) == 0) {
+            const RateLimitShm *rl = ratelimit_region();
+            printf("[Server] ✓ Rate limits: account %u/s (burst %u), client %u/s (burst %u), 0 = off\n",
+                   rl->kinds[RATELIMIT_ACCOUNT].rate, rl->kinds[RATELIMIT_ACCOUNT].burst,
+                   rl->kinds[RATELIMIT_CLIENT].rate, rl->kinds[RATELIMIT_CLIENT].burst);
+        } else {
+            fprintf(stderr, "[Server] WARNING: Rate limit table unavailable, running without limits\n");
+        }
+    }
+
     // 3. Create Server Socket
-    server_fd = network_create_listener(PORT);
+    server_fd = network_create_listener(PORT, g_config.listen_backlog);
     printf("[Server] ✓ Listening on 0.0.0.0:%d\n", PORT);
 
-    // 4. Fork Logger Process
-    pid_t logger_pid = fork();
-    if (logger_pid == 0) {
-        close(server_fd);
-        logger_main_loop(mq_id);
-        exit(0);
+    // Worker 用 accept + poll (等資料的慢連線、清算時間窗)，listen socket 必須是 non-blocking
+    // (poll 醒來但連線被別的 Worker 拿走時，accept 不能卡住)
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+
+    // 讀取 lane：自己的 port / accept queue，轉帳再多也不會排在讀取前面
+    if (g_config.read_workers > 0) {
+        read_fd = network_create_listener(g_config.read_port, g_config.listen_backlog);
+        fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) | O_NONBLOCK);
+        printf("[Server] ✓ Read lane on 0.0.0.0:%d (%d read-only workers)\n", g_config.read_port,
+               g_config.read_workers);
+    }
+    printf("[Server] ✓ Connection deadlines: header %d ms, body %d ms, response write %d ms\n",
+           g_config.header_timeout_ms, g_config.body_timeout_ms, g_config.write_timeout_ms);
+
+    // 排隊預算：accepted socket 繼承 SO_TIMESTAMPNS，每次 recvmsg 都帶 kernel 收到資料的時間
+    if (g_config.queue_budget_ms > 0) {
+        int on = 1;
+        if (setsockopt(server_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0 &&
+            (read_fd < 0 || setsockopt(read_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0)) {
+            printf("[Server] ✓ Queue budget %d ms: later requests get OVERLOADED (retry after backoff)\n",
+                   g_config.queue_budget_ms);
+        } else {
+            perror("[Server] WARNING: SO_TIMESTAMPNS, running without a queue budget");
+            g_config.queue_budget_ms = 0;
+        }
+    }
+
+    if (g_config.settle_window_ms > 0) {
+        printf("[Server] ✓ Settlement mode: window %d ms, batch %d\n",
+               g_config.settle_window_ms, g_config.settle_batch);
     }
-    printf("[Server] ✓ Logger process started (PID: %d)\n", logger_pid);
 
-    // 5. Fork Worker Pool
-    for (int i = 0; i < WORKER_COUNT; i++) {
+    // 4. Fork Logger Processes (shard k 負責 worker k, k + N, ...，各寫各的檔)
+    int shards = g_log_config.shards;
+    if (shards > 1 && logger_ring_set_shards(shards) != 0) {
+        fprintf(stderr, "[Server] WARNING: Log sharding unavailable, using one logger\n");
+        shards = 1;
+    }
+    for (int k = 0; k < shards; k++) {
         pid_t pid = fork();
         if (pid == 0) {
-            worker_process_loop(server_fd, mq_id);
+            close(server_fd);
+            if (read_fd != -1) close(read_fd);
+            if (g_logger_ncpu > 0 && affinity_pin(&g_logger_cpus[k % g_logger_ncpu], 1) != 0)
+                perror("[Logger] sched_setaffinity");
+            logger_select_shard(k);
+            logger_main_loop(mq_id);
             exit(0);
         }
-        printf("[Server] ✓ Worker %d started (PID: %d)\n", i + 1, pid);
+        logger_pids[logger_count++] = pid;
+        printf("[Server] ✓ Logger process %d/%d started (PID: %d)\n", k + 1, shards, pid);
     }
 
-    // ========================================================================
-    // 6. [新增] Fork Monitor Process (高速監控版)
-    // ========================================================================
-    pid_t monitor_pid = fork();
-    if (monitor_pid == 0) {
-        close(server_fd);
-        printf("\n[Monitor] 高速儀表板啟動 (取樣間隔 1ms)\n");
-        sleep(1); 
-        
-        while (keep_running) {
-            monitor_queue(mq_id); 
-            // 修改 2: 將這裡的等待時間改短
-            usleep(1000); // 1000 us = 0.001 秒 (極速監控)
+    // Prometheus exporter：獨立行程，只讀 metrics page 的快照，scrape 不經過 Worker
+    if (g_config.metrics_listen) {
+        int admin_fd = metrics_region() ? metrics_export_listen(g_config.metrics_listen) : -1;
+        if (admin_fd >= 0) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(server_fd);
+                if (read_fd != -1) close(read_fd);
+                if (g_monitor_ncpu > 0 && affinity_pin(g_monitor_cpus, g_monitor_ncpu) != 0)
+                    perror("[Exporter] sched_setaffinity");
+                metrics_export_loop(admin_fd);
+                exit(0);
+            }
+            close(admin_fd);
+            printf("[Server] ✓ Metrics exporter on %s (PID: %d)\n", g_config.metrics_listen, pid);
+        } else {
+            fprintf(stderr, "[Server] WARNING: Metrics exporter unavailable on %s\n", g_config.metrics_listen);
         }
-        exit(0);
     }
-    // ========================================================================
+
+    // 5. Fork Worker Pool (後面 read_workers 個只接讀取 lane 的 port)
+    for (int i = 0; i < nworkers; i++) {
+        int reader = i >= WORKER_COUNT;
+        pid_t pid = fork();
+        if (pid == 0) {
+            g_read_only = reader;
+            if (read_fd != -1) close(reader ? server_fd : read_fd);
+            // 先 pin 再碰自己的 ring / trace ring：first-touch 才會配在這顆 CPU 的 node
+            if (g_worker_ncpu > 0 && affinity_pin(&g_worker_cpus[i % g_worker_ncpu], 1) != 0)
+                perror("[Worker] sched_setaffinity");
+            logger_bind_worker(i);
+            g_metrics = metrics_bind_worker(i);
+            trace_bind_worker(i);
+            worker_process_loop(reader ? read_fd : server_fd, mq_id);
+            exit(0);
+        }
+        printf("[Server] ✓ %s %d started (PID: %d)\n", reader ? "Read worker" : "Worker", i + 1, pid);
+    }
 
     printf("\n[Server] System Ready. Press Ctrl+C to shutdown.\n");
     printf("========================================\n\n");
 
+    // SIGUSR1 = 把 trace ring 的快照寫成檔案；不設 SA_RESTART，waitpid 才會被叫醒
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_trace_dump;
+    sigaction(SIGUSR1, &sa, NULL);
+
     // 7. Master Wait Loop
     int status;
     while (keep_running) {
         waitpid(-1, &status, 0);
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            trace_dump();
+        }
     }
 
     printf("[Server] Master process exiting.\n");
@@ -0,0 +1,323 @@
+// 檔案位置: src/tools/hsts-top.c
+// Live server status from the SHM metrics page (per-op rates, errors, waits, log backlog)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "affinity.h"
+#include "logger.h"
+#include "metrics.h"
+
+/*
+ * 取代 Server 裡每 1 ms 跑一次 msgctl 的 Monitor 行程：
+ *   唯讀 mmap metrics page，每個 interval 取一次快照，兩次快照相減就是速率
+ *   延遲百分位數也是這段時間的 (直方圖相減)，不是從開機到現在的累積
+ *   Server 端不做任何事 (沒有 system call、沒有鎖)，所以取樣多頻繁都不影響它
+ *   Server 重啟時 (magic 變 0 / start_ns 改變) 自動重新 attach
+ */
+
+#define ANSI_COLOR_CYAN    "\x1b[36m"
+#define ANSI_COLOR_YELLOW  "\x1b[33m"
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+#define ANSI_CLEAR         "\x1b[H\x1b[2J"
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_signal(int sig) { (void)sig; g_stop = 1; }
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --interval <ms>   Sampling interval (default 1000)\n");
+    printf("  --count <N>       Print N samples and exit (default: until Ctrl+C)\n");
+    printf("  --workers         Also show one line per worker\n");
+    printf("  --plain           No colors / screen clearing (for logs and pipes)\n");
+    printf("  --prometheus      Print one snapshot in Prometheus text format and exit\n");
+    printf("                    (for the node_exporter textfile collector)\n");
+    printf("  --cpu <list>      Run on these CPUs only (keep the monitor off the workers' cores)\n");
+    printf("  --help            Show this message\n");
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static double rate(uint64_t now, uint64_t prev, double secs) {
+    return now >= prev && secs > 0 ? (double)(now - prev) / secs : 0.0;
+}
+
+// 平均等待 (us)：這段時間內新增的等待時間 / 新增的等待次數
+static double avg_us(uint64_t ns, uint64_t prev_ns, uint64_t n, uint64_t prev_n) {
+    return n > prev_n ? (double)(ns - prev_ns) / (double)(n - prev_n) / 1000.0 : 0.0;
+}
+
+// 這次取樣期間的直方圖 = 兩次快照 (都先合併所有 Worker) 相減
+static void hist_delta(const MetricsShm *cur, const MetricsShm *prev, int op, int stage, LatencyHist *out) {
+    static LatencyHist p;
+    metrics_merge_latency(cur, op, stage, out);
+    metrics_merge_latency(prev, op, stage, &p);
+    out->count -= p.count;
+    out->sum_ns -= p.sum_ns;
+    for (int b = 0; b < METRICS_LAT_BUCKETS; b++) out->buckets[b] -= p.buckets[b];
+}
+
+static void print_ops(const MetricsShm *snap, const MetricsShm *psnap,
+                      const WorkerMetrics *cur, const WorkerMetrics *prev, double secs) {
+    static LatencyHist h;
+    printf("%-10s %12s %10s %14s %12s %9s %9s %9s\n", "OP", "req/s", "fail/s", "total", "failed",
+           "p50 us", "p99 us", "p99.9 us");
+    for (int i = 0; i < METRICS_OPS; i++) {
+        if (!cur->requests[i]) continue;
+        hist_delta(snap, psnap, i, METRICS_STAGE_TOTAL, &h);
+        printf("%-10s %12.0f %10.0f %14lu %12lu %9.1f %9.1f %9.1f\n", metrics_op_name(i),
+               rate(cur->requests[i], prev->requests[i], secs), rate(cur->failures[i], prev->failures[i], secs),
+               (unsigned long)cur->requests[i], (unsigned long)cur->failures[i],
+               metrics_lat_percentile(&h, 50.0) / 1e3, metrics_lat_percentile(&h, 99.0) / 1e3,
+               metrics_lat_percentile(&h, 99.9) / 1e3);
+    }
+
+    int any = 0;
+    for (int e = 1; e < METRICS_ERRORS; e++) {
+        if (!cur->errors[e]) continue;
+        printf("%s %s %.0f/s (%lu)", any ? "," : "Errors:", metrics_error_name(e),
+               rate(cur->errors[e], prev->errors[e], secs), (unsigned long)cur->errors[e]);
+        any = 1;
+    }
+    if (any) printf("\n");
+}
+
+static void print_waits(const char *name, const WorkerMetrics *cur, const WorkerMetrics *prev, double secs) {
+    printf("%-10s %10.0f %8lu %8lu %7lu %10.0f %9.1f %10.0f %9.1f",
+           name, rate(cur->connections, prev->connections, secs), (unsigned long)cur->bad_packets,
+           (unsigned long)(cur->header_timeouts + cur->body_timeouts + cur->write_timeouts + cur->parked_full),
+           (unsigned long)cur->parked,
+           rate(cur->admission_waits, prev->admission_waits, secs),
+           avg_us(cur->admission_wait_ns, prev->admission_wait_ns, cur->admission_waits, prev->admission_waits),
+           rate(cur->lock_waits, prev->lock_waits, secs),
+           avg_us(cur->lock_wait_ns, prev->lock_wait_ns, cur->lock_waits, prev->lock_waits));
+    if (cur->settle_batches)
+        printf(" %8.1f %7lu", (double)(cur->settle_items - prev->settle_items) /
+                              (cur->settle_batches > prev->settle_batches ? cur->settle_batches - prev->settle_batches : 1),
+               (unsigned long)cur->settle_pending);
+    printf("\n");
+}
+
+// 每個 op 的各 stage p50 / p99 (us)：時間花在哪裡
+static void print_stages(const MetricsShm *cur, const MetricsShm *prev) {
+    static LatencyHist h;
+    printf("%-10s", "p50/p99 us");
+    for (int s = 1; s < METRICS_STAGES; s++) printf(" %15s", metrics_stage_name(s));
+    printf("\n");
+    for (int op = 0; op < METRICS_OPS; op++) {
+        hist_delta(cur, prev, op, METRICS_STAGE_TOTAL, &h);
+        if (!h.count) continue;
+        printf("%-10s", metrics_op_name(op));
+        for (int s = 1; s < METRICS_STAGES; s++) {
+            hist_delta(cur, prev, op, s, &h);
+            if (!h.count) {
+                printf(" %15s", "-");
+                continue;
+            }
+            char cell[32];
+            snprintf(cell, sizeof(cell), "%.1f/%.1f", metrics_lat_percentile(&h, 50.0) / 1e3,
+                     metrics_lat_percentile(&h, 99.0) / 1e3);
+            printf(" %15s", cell);
+        }
+        printf("\n");
+    }
+}
+
+// --lock-profile：從開機累積的熱鎖 (SpaceSaving 合併後依等待時間排序)
+static void print_hot_locks(const MetricsShm *cur, int top) {
+    static LockHotEntry hot[METRICS_MAX_WORKERS * METRICS_LOCK_TOPK];
+    int n = metrics_lock_top(cur, hot, top);
+    printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n", "HOT LOCK", "acquired", "waits", "wait ms",
+           "avg wait", "avg hold", "max hold", "+/- ms");
+    for (int i = 0; i < n; i++) {
+        const LockHotEntry *e = &hot[i];
+        char name[16];
+        if (e->account == METRICS_LOCK_ALLOC) snprintf(name, sizeof(name), "alloc");
+        else snprintf(name, sizeof(name), "#%d", e->account);
+        printf("%-10s %10lu %10lu %10.2f %7.1f us %7.1f us %7.1f us %10.2f\n", name,
+               (unsigned long)e->acquisitions, (unsigned long)e->waits, e->wait_ns / 1e6,
+               e->waits ? e->wait_ns / 1e3 / e->waits : 0.0,
+               e->acquisitions ? e->hold_ns / 1e3 / e->acquisitions : 0.0, e->hold_max_ns / 1e3, e->error_ns / 1e6);
+    }
+    if (!n) printf("(no contended locks yet)\n");
+}
+
+static void print_loggers(const MetricsShm *cur, const MetricsShm *prev, double secs, int color) {
+    printf("%-10s %8s %12s %8s %8s %8s %8s %8s %8s %8s %9s %9s %7s %7s\n", "LOGGER", "pid", "rec/s", "MB/s",
+           "fsync/s", "ring", "spill", "spill/s", "merge/s", "queue", "lag p99", "lag max", "gaps", "dropped");
+    uint64_t now = mono_ns();
+    for (int k = 0; k < METRICS_MAX_LOGGERS; k++) {
+        const LoggerMetrics *c = &cur->loggers[k], *p = &prev->loggers[k];
+        if (!c->pid) continue;
+        // 堆積程度：跟舊的 Monitor 一樣，空閒 / 忙碌 / 擁塞 三種顏色
+        uint64_t backlog = c->ring_depth + c->spill_depth + c->mq_depth;
+        double load = (double)backlog / LOG_RING_SLOTS * 100.0;
+        const char *col = !color ? "" : load < 20.0 ? ANSI_COLOR_CYAN : load < 70.0 ? ANSI_COLOR_YELLOW : ANSI_COLOR_RED;
+        // 超過 2 秒沒有 tick 的 Logger 大概已經卡住 / 掛了
+        int stale = c->tick_ns && now > c->tick_ns && now - c->tick_ns > 2000000000ULL;
+        printf("%sshard %-4d %8u %12.0f %8.1f %8.0f %8lu %8lu %8.0f %8.0f %8lu %6lu us %6lu us %7lu %7lu%s%s\n", col, k,
+               c->pid, rate(c->records, p->records, secs), rate(c->bytes, p->bytes, secs) / 1e6,
+               rate(c->fsyncs, p->fsyncs, secs), (unsigned long)c->ring_depth, (unsigned long)c->spill_depth,
+               rate(c->spilled, p->spilled, secs), rate(c->merged, p->merged, secs), (unsigned long)c->mq_depth, (unsigned long)c->lag_p99_us, (unsigned long)c->lag_max_us,
+               (unsigned long)c->seq_gaps, (unsigned long)c->dropped,
+               stale ? "  (no heartbeat)" : "", color ? ANSI_COLOR_RESET : "");
+    }
+}
+
+static void print_screen(const MetricsShm *cur, const MetricsShm *prev, double secs, int workers, int color) {
+    WorkerMetrics sum, psum;
+    metrics_sum_workers(cur, &sum);
+    metrics_sum_workers(prev, &psum);
+
+    time_t now = time(NULL);
+    char time_str[20];
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", localtime(&now));
+    uint64_t up = (mono_ns() - cur->start_mono_ns) / 1000000000ULL;
+    uint64_t total = 0, ptotal = 0;
+    for (int i = 0; i < METRICS_OPS; i++) {
+        total += sum.requests[i];
+        ptotal += psum.requests[i];
+    }
+
+    if (color) printf(ANSI_CLEAR);
+    printf("[%s] hsts-top | up %02lu:%02lu:%02lu | %u workers, %u loggers | %.0f req/s | "
+           "accounts %lu (%lu extents) | sample %.2f s\n\n",
+           time_str, (unsigned long)(up / 3600), (unsigned long)(up / 60 % 60), (unsigned long)(up % 60),
+           sum.pid, cur->nloggers, rate(total, ptotal, secs),
+           (unsigned long)cur->bank.open_accounts, (unsigned long)cur->bank.extents, secs);
+    print_ops(cur, prev, &sum, &psum, secs);
+    printf("\n");
+    print_stages(cur, prev);
+
+    // timeout = 讀 / 寫超過期限被關掉 (+ 停車位滿了)，waiting = 還在等封包剩下部分的連線
+    printf("\n%-10s %10s %8s %8s %7s %10s %9s %10s %9s", "WORKER", "conn/s", "bad", "timeout", "waiting",
+           "adm wait/s", "avg us", "lock wait/s", "avg us");
+    if (sum.settle_batches) printf(" %8s %7s", "settle/b", "pending");
+    printf("\n");
+    print_waits("all", &sum, &psum, secs);
+    for (int w = 0; workers && w < METRICS_MAX_WORKERS; w++) {
+        const WorkerMetrics *c = &cur->workers[w];
+        if (!c->pid) continue;
+        char name[24];
+        snprintf(name, sizeof(name), "%u", c->pid);
+        print_waits(name, c, &prev->workers[w], secs);
+    }
+
+    if (cur->lockprof[0].enabled) {
+        printf("\n");
+        print_hot_locks(cur, 10);
+    }
+
+    printf("\n");
+    print_loggers(cur, prev, secs, color);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "interval", required_argument, NULL, 'i' },
+        { "count",    required_argument, NULL, 'n' },
+        { "workers",  no_argument,       NULL, 'w' },
+        { "plain",    no_argument,       NULL, 'p' },
+        { "prometheus", no_argument,     NULL, 'P' },
+        { "cpu",      required_argument, NULL, 'c' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int interval_ms = 1000, count = 0, workers = 0, color = isatty(STDOUT_FILENO), prometheus = 0, opt;
+    static int cpus[AFFINITY_MAX_CPUS];
+    int ncpu;
+    while ((opt = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 'w': workers = 1; break;
+            case 'p': color = 0; break;
+            case 'P': prometheus = 1; break;
+            case 'c':
+                ncpu = affinity_parse(optarg, cpus, AFFINITY_MAX_CPUS);
+                if (ncpu < 1 || affinity_pin(cpus, ncpu) != 0) {
+                    fprintf(stderr, "[hsts-top] cannot run on CPUs %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h': print_usage(argv[0]); return 0;
+            default:  print_usage(argv[0]); return 1;
+        }
+    }
+    if (interval_ms < 1 || count < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    static MetricsShm cur, prev;
+    char err[160];
+    if (prometheus) {
+        const MetricsShm *live = metrics_attach(err, sizeof(err));
+        if (!live) {
+            fprintf(stderr, "[hsts-top] %s\n", err);
+            return 1;
+        }
+        metrics_snapshot(live, &cur);
+        metrics_detach(live);
+        size_t len;
+        char *text = metrics_render_prometheus(&cur, &len);
+        if (!text) return 1;
+        fwrite(text, 1, len, stdout);
+        free(text);
+        return 0;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    const MetricsShm *m = NULL;
+    uint64_t prev_ns = 0;
+    int shown = 0;
+
+    while (!g_stop && (count == 0 || shown < count)) {
+        if (!m) {
+            m = metrics_attach(err, sizeof(err));
+            if (!m) {
+                fprintf(stderr, "\r[hsts-top] %s, retrying...", err);
+                sleep(1);
+                continue;
+            }
+            metrics_snapshot(m, &prev);
+            prev_ns = mono_ns();
+        }
+
+        struct timespec ts = { interval_ms / 1000, (long)(interval_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        if (g_stop) break;
+
+        metrics_snapshot(m, &cur);
+        uint64_t now_ns = mono_ns();
+        // Server 已經結束 / 重啟：丟掉舊的 mapping 重新 attach
+        if (cur.magic != METRICS_MAGIC || cur.start_ns != prev.start_ns) {
+            metrics_detach(m);
+            m = NULL;
+            fprintf(stderr, "[hsts-top] server went away, waiting for it to come back\n");
+            continue;
+        }
+        print_screen(&cur, &prev, (double)(now_ns - prev_ns) / 1e9, workers, color);
+        if (!color) printf("\n");
+        prev = cur;
+        prev_ns = now_ns;
+        shown++;
+    }
+    metrics_detach(m);
+    return 0;
+}
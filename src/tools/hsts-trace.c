@@ -0,0 +1,129 @@
+// 檔案位置: src/tools/hsts-trace.c
+// Snapshot the server's request trace rings as Chrome / Perfetto trace-event JSON
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "metrics.h"
+#include "trace.h"
+
+/*
+ * Server 以 --trace-sample N / --trace-slow-us U 啟動時，每個 Worker 把取樣到的請求
+ * (各 stage 的起訖時間) 寫進 /hsts_trace 的 ring。這個工具唯讀 mmap，複製一次快照：
+ *   預設：Chrome trace-event JSON (chrome://tracing 或 https://ui.perfetto.dev 直接開)
+ *   --slowest N：在終端機列出最慢的 N 個請求和每個 stage 的時間
+ */
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --output <file>   Write the JSON here instead of stdout\n");
+    printf("  --min-us <N>      Only requests that took at least N us\n");
+    printf("  --slowest <N>     Print the N slowest traced requests with their stages (no JSON)\n");
+    printf("  --help            Show this message\n");
+}
+
+typedef struct {
+    int worker;
+    TraceSpan req;
+    uint64_t stage_ns[METRICS_STAGES];
+} SlowRequest;
+
+static int cmp_slow(const void *a, const void *b) {
+    uint32_t x = ((const SlowRequest *)a)->req.dur_ns, y = ((const SlowRequest *)b)->req.dur_ns;
+    return (x < y) - (x > y);
+}
+
+static int print_slowest(const TraceShm *t, int max, uint64_t min_ns) {
+    TraceSpan *spans = malloc(sizeof(TraceSpan) * TRACE_RING_SPANS);
+    SlowRequest *list = malloc(sizeof(SlowRequest) * TRACE_RING_SPANS * TRACE_MAX_WORKERS);
+    if (!spans || !list) {
+        free(spans);
+        free(list);
+        return 1;
+    }
+    int n = 0;
+    for (int w = 0; w < (int)t->nworkers && w < TRACE_MAX_WORKERS; w++) {
+        int got = trace_snapshot_ring(t, w, spans);
+        for (int i = 0; i < got; i++) {
+            if (spans[i].stage != TRACE_SPAN_REQUEST || spans[i].dur_ns < min_ns) continue;
+            SlowRequest *r = &list[n++];
+            memset(r, 0, sizeof(*r));
+            r->worker = w;
+            r->req = spans[i];
+            for (int j = i - 1; j >= 0 && spans[j].req == spans[i].req && spans[j].stage != TRACE_SPAN_REQUEST; j--)
+                if (spans[j].stage < METRICS_STAGES) r->stage_ns[spans[j].stage] += spans[j].dur_ns;
+        }
+    }
+    qsort(list, (size_t)n, sizeof(SlowRequest), cmp_slow);
+
+    printf("%d traced requests (sample 1/%u, slow >= %lu us)\n", n, t->sample_every,
+           (unsigned long)(t->slow_ns / 1000));
+    printf("%-6s %-10s %6s %10s", "worker", "op", "ret", "total us");
+    for (int s = 1; s < METRICS_STAGES; s++) printf(" %10s", metrics_stage_name(s));
+    printf("  %s\n", "why");
+    for (int i = 0; i < n && i < max; i++) {
+        const SlowRequest *r = &list[i];
+        printf("%-6d %-10s %6d %10.1f", r->worker, metrics_op_name(r->req.op), r->req.ret, r->req.dur_ns / 1e3);
+        for (int s = 1; s < METRICS_STAGES; s++) printf(" %10.1f", r->stage_ns[s] / 1e3);
+        printf("  %s%s\n", (r->req.flags & TRACE_FLAG_SLOW) ? "slow " : "",
+               (r->req.flags & TRACE_FLAG_SAMPLED) ? "sampled" : "");
+    }
+    free(spans);
+    free(list);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "output",  required_argument, NULL, 'o' },
+        { "min-us",  required_argument, NULL, 'm' },
+        { "slowest", required_argument, NULL, 's' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *output = NULL;
+    long min_us = 0;
+    int slowest = 0, opt;
+    while ((opt = getopt_long(argc, argv, "ho:", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'o': output = optarg; break;
+            case 'm': min_us = atol(optarg); break;
+            case 's': slowest = atoi(optarg); break;
+            case 'h': print_usage(argv[0]); return 0;
+            default:  print_usage(argv[0]); return 1;
+        }
+    }
+    if (min_us < 0 || slowest < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    char err[160];
+    const TraceShm *t = trace_attach(err, sizeof(err));
+    if (!t) {
+        fprintf(stderr, "[hsts-trace] %s\n", err);
+        return 1;
+    }
+    if (slowest) {
+        int r = print_slowest(t, slowest, (uint64_t)min_us * 1000);
+        trace_detach(t);
+        return r;
+    }
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror("[hsts-trace] fopen");
+        trace_detach(t);
+        return 1;
+    }
+    int n = trace_write_chrome(t, out, (uint64_t)min_us * 1000);
+    if (output && fclose(out) != 0) n = -1;
+    trace_detach(t);
+    if (n < 0) {
+        fprintf(stderr, "[hsts-trace] write failed\n");
+        return 1;
+    }
+    if (output) printf("[hsts-trace] %d requests -> %s (open in chrome://tracing or ui.perfetto.dev)\n", n, output);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// 檔案位置: src/tools/logdecode.c
+// Offline decoder: binary audit log (logs/transaction.bin) -> text log / CSV
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "logger.h"
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] <file.bin> [more.bin ...]\n", prog);
+    printf("  --csv       Comma-separated output (with header row)\n");
+    printf("  --text      Same format as logs/transaction.log (default)\n");
+    printf("  --key <file> Key of an encrypted log (server --log-key)\n");
+    printf("  --help      Show this message\n");
+}
+
+static void decode_csv(const AuditRecord *r, uint64_t n, AuditTimeCache *tc) {
+    char op_tmp[20];
+    for (uint64_t i = 0; i < n; i++) {
+        const AuditRecord *x = &r[i];
+        printf("%llu,%s.%09llu,%u,%u,%s,%d,%d,%d,%d,%u\n",
+               (unsigned long long)x->ts_ns, audit_time_str(tc, x->ts_ns),
+               (unsigned long long)(x->ts_ns % 1000000000ULL),
+               x->worker_id, x->seq,
+               (x->flags & AUDIT_FLAG_DROPPED) ? "DROPPED" : audit_op_name(x->op_code, op_tmp, sizeof(op_tmp)),
+               x->status, x->src_id, x->dst_id, x->amount, x->flags);
+    }
+}
+
+static void decode_text(const AuditRecord *r, uint64_t n, AuditTimeCache *tc) {
+    char line[256];
+    for (uint64_t i = 0; i < n; i++) {
+        int len = audit_format_text(line, sizeof(line), &r[i], tc);
+        if (len > 0) fwrite(line, 1, (size_t)len, stdout);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "csv",  no_argument, NULL, 'c' },
+        { "text", no_argument, NULL, 't' },
+        { "key",  required_argument, NULL, 'k' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int csv = 0, opt;
+    while ((opt = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'c': csv = 1; break;
+            case 't': csv = 0; break;
+            case 'k':
+                if (audit_load_read_key(optarg) != 0) return 1;
+                break;
+            case 'h': print_usage(argv[0]); return 0;
+            default:  print_usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    static char outbuf[1 << 20];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    if (csv) printf("ts_ns,time,worker,seq,op,status,src,dst,amount,flags\n");
+
+    int rc = 0;
+    AuditTimeCache tc;
+    memset(&tc, 0, sizeof(tc));
+    for (int f = optind; f < argc; f++) {
+        const AuditFileHeader *hdr;
+        uint64_t count;
+        size_t map_size;
+        const AuditRecord *recs = audit_map_readonly(argv[f], &hdr, &count, &map_size);
+        if (!recs) {
+            fprintf(stderr, "[logdecode] %s: not a readable audit file\n", argv[f]);
+            rc = 1;
+            continue;
+        }
+        if (csv) decode_csv(recs, count, &tc);
+        else decode_text(recs, count, &tc);
+        audit_unmap(hdr, map_size);
+    }
+    fflush(stdout);
+    return rc;
+}
@@ -0,0 +1,232 @@
+// 檔案位置: src/tools/logmerge.c
+// Merge sharded audit logs (server --loggers N) into one globally ordered view
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "logger.h"
+
+/*
+ * 每個 Worker 只會被一個 shard 收，而且在那個 shard 裡是照 seq 寫入的，
+ * 所以把每個檔案再拆成「每個 worker 一條」的有序串流，做 k-way merge：
+ *   拆串流只掃一次檔案：next[i] = 同一個 worker 在這個檔案裡的下一筆 (== count 表示沒有)
+ *   排序鍵 = (送出端時間 ts_ns, worker_id, seq)
+ * 同一個 Worker 的紀錄永遠照 seq 輸出 (就算牆上時鐘往回跳)。
+ * Text shard 沒有 worker / seq，只能照秒級時間戳合併 (同一秒內保留各檔案的順序)。
+ */
+
+#define MAX_FILES 1024
+#define WORKER_SLOTS 65536       // uint16_t worker_id (含 LOG_WORKER_NONE)
+
+typedef struct {
+    const AuditRecord *recs;
+    uint64_t count;
+    const AuditFileHeader *hdr;
+    size_t map_size;
+    uint64_t *next;              // 同一個 worker 的下一筆紀錄
+} MappedFile;
+
+typedef struct {
+    const MappedFile *f;
+    uint16_t worker;
+    uint64_t pos;                // 目前指到的紀錄 (== count 表示結束)
+} Stream;
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] <shard> [more shards / segments ...]\n", prog);
+    printf("  --csv       Comma-separated output (same columns as logdecode --csv)\n");
+    printf("  --text      transaction.log lines (default)\n");
+    printf("  --key <file> Key of an encrypted log (server --log-key)\n");
+    printf("  --help      Show this message\n");
+    printf("Example: %s logs/transaction.s*.bin\n", prog);
+}
+
+// ============================================================================
+// Binary shards: k-way merge over per-worker streams (binary heap)
+// ============================================================================
+static int stream_less(const Stream *a, const Stream *b) {
+    const AuditRecord *x = &a->f->recs[a->pos], *y = &b->f->recs[b->pos];
+    if (x->ts_ns != y->ts_ns) return x->ts_ns < y->ts_ns;
+    if (x->worker_id != y->worker_id) return x->worker_id < y->worker_id;
+    return (int32_t)(x->seq - y->seq) < 0;
+}
+
+static void heap_down(Stream **h, int n, int i) {
+    while (1) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && stream_less(h[l], h[m])) m = l;
+        if (r < n && stream_less(h[r], h[m])) m = r;
+        if (m == i) return;
+        Stream *t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
+    }
+}
+
+static void emit(const AuditRecord *r, int csv, AuditTimeCache *tc) {
+    if (csv) {
+        char op_tmp[20];
+        printf("%llu,%s.%09llu,%u,%u,%s,%d,%d,%d,%d,%u\n",
+               (unsigned long long)r->ts_ns, audit_time_str(tc, r->ts_ns),
+               (unsigned long long)(r->ts_ns % 1000000000ULL), r->worker_id, r->seq,
+               (r->flags & AUDIT_FLAG_DROPPED) ? "DROPPED" : audit_op_name(r->op_code, op_tmp, sizeof(op_tmp)),
+               r->status, r->src_id, r->dst_id, r->amount, r->flags);
+    } else {
+        char line[256];
+        int len = audit_format_text(line, sizeof(line), r, tc);
+        if (len > 0) fwrite(line, 1, (size_t)len, stdout);
+    }
+}
+
+static int merge_binary(MappedFile *files, int nfiles, int csv) {
+    // 1. 每個檔案掃一次：第一次看到的 worker 開一條串流，之後的紀錄串到它上一筆的 next
+    static uint64_t last[WORKER_SLOTS];     // 上一筆的 index + 1 (0 = 還沒看過)
+    int nstreams = 0, cap = 64;
+    Stream *streams = malloc(sizeof(Stream) * cap);
+    if (!streams) return 1;
+    for (int f = 0; f < nfiles; f++) {
+        MappedFile *m = &files[f];
+        m->next = malloc(sizeof(uint64_t) * (m->count ? m->count : 1));
+        if (!m->next) { free(streams); return 1; }
+        memset(last, 0, sizeof(last));
+        for (uint64_t i = 0; i < m->count; i++) {
+            uint16_t w = m->recs[i].worker_id;
+            m->next[i] = m->count;
+            if (last[w]) {
+                m->next[last[w] - 1] = i;
+                last[w] = i + 1;
+                continue;
+            }
+            last[w] = i + 1;
+            if (nstreams == cap) {
+                cap *= 2;
+                Stream *ns = realloc(streams, sizeof(Stream) * cap);
+                if (!ns) { free(streams); return 1; }
+                streams = ns;
+            }
+            streams[nstreams++] = (Stream){ m, w, i };
+        }
+    }
+
+    // 2. Heap merge
+    Stream **heap = malloc(sizeof(Stream *) * (nstreams ? nstreams : 1));
+    if (!heap) { free(streams); return 1; }
+    int n = 0;
+    for (int i = 0; i < nstreams; i++) heap[n++] = &streams[i];
+    for (int i = n / 2 - 1; i >= 0; i--) heap_down(heap, n, i);
+
+    AuditTimeCache tc;
+    memset(&tc, 0, sizeof(tc));
+    uint64_t total = 0;
+    while (n > 0) {
+        Stream *s = heap[0];
+        emit(&s->f->recs[s->pos], csv, &tc);
+        total++;
+        s->pos = s->f->next[s->pos];
+        if (s->pos >= s->f->count) heap[0] = heap[--n];
+        heap_down(heap, n, 0);
+    }
+    fprintf(stderr, "[logmerge] %llu records from %d files (%d worker streams)\n",
+            (unsigned long long)total, nfiles, nstreams);
+    free(heap);
+    free(streams);
+    return 0;
+}
+
+// ============================================================================
+// Text shards: merge lines by their "[YYYY-mm-dd HH:MM:SS]" prefix
+// ============================================================================
+static int merge_text(char **paths, int nfiles) {
+    FILE **fp = calloc((size_t)nfiles, sizeof(FILE *));
+    char (*line)[256] = calloc((size_t)nfiles, 256);
+    int *live = calloc((size_t)nfiles, sizeof(int));
+    if (!fp || !line || !live) return 1;
+
+    int rc = 0;
+    for (int f = 0; f < nfiles; f++) {
+        fp[f] = fopen(paths[f], "r");
+        if (!fp[f]) {
+            fprintf(stderr, "[logmerge] %s: cannot open\n", paths[f]);
+            rc = 1;
+            continue;
+        }
+        live[f] = fgets(line[f], sizeof(line[f]), fp[f]) != NULL;
+    }
+
+    uint64_t total = 0;
+    while (1) {
+        int best = -1;
+        for (int f = 0; f < nfiles; f++) {
+            // 時間戳是固定寬度，字串比較就是時間比較；同一秒取檔案順序較前的
+            if (live[f] && (best < 0 || strncmp(line[f], line[best], 21) < 0)) best = f;
+        }
+        if (best < 0) break;
+        fputs(line[best], stdout);
+        total++;
+        live[best] = fgets(line[best], sizeof(line[best]), fp[best]) != NULL;
+    }
+    for (int f = 0; f < nfiles; f++) if (fp[f]) fclose(fp[f]);
+    fprintf(stderr, "[logmerge] %llu lines from %d text files (second resolution, no seq)\n",
+            (unsigned long long)total, nfiles);
+    free(fp);
+    free(line);
+    free(live);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "csv",  no_argument, NULL, 'c' },
+        { "text", no_argument, NULL, 't' },
+        { "key",  required_argument, NULL, 'k' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int csv = 0, opt;
+    while ((opt = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'c': csv = 1; break;
+            case 't': csv = 0; break;
+            case 'k':
+                if (audit_load_read_key(optarg) != 0) return 1;
+                break;
+            case 'h': print_usage(argv[0]); return 0;
+            default:  print_usage(argv[0]); return 1;
+        }
+    }
+    int nfiles = argc - optind;
+    if (nfiles <= 0 || nfiles > MAX_FILES) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    static char outbuf[1 << 20];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+    // 全部是 binary 才做精確合併；否則當成 text
+    static MappedFile files[MAX_FILES];
+    int binary = 0;
+    for (int f = 0; f < nfiles; f++) {
+        MappedFile *m = &files[f];
+        m->recs = audit_map_readonly(argv[optind + f], &m->hdr, &m->count, &m->map_size);
+        binary += (m->recs != NULL);
+    }
+
+    int rc;
+    if (binary == nfiles) {
+        if (csv) printf("ts_ns,time,worker,seq,op,status,src,dst,amount,flags\n");
+        rc = merge_binary(files, nfiles, csv);
+    } else if (binary == 0 && !csv) {
+        rc = merge_text(argv + optind, nfiles);
+    } else {
+        fprintf(stderr, "[logmerge] %s\n", binary ? "Cannot mix binary and text shards"
+                                                 : "--csv needs binary shards (--log-format binary)");
+        rc = 1;
+    }
+    for (int f = 0; f < nfiles; f++) {
+        if (files[f].recs) audit_unmap(files[f].hdr, files[f].map_size);
+        free(files[f].next);
+    }
+    fflush(stdout);
+    return rc;
+}
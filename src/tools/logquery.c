@@ -0,0 +1,291 @@
+// 檔案位置: src/tools/logquery.c
+// Account history query over a segmented audit log ("<base>.NNNNNN" + ".idx")
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "logger.h"
+
+/*
+ * 查詢流程 (每個 segment):
+ *   1. 有 .idx：先用 header 的時間範圍整段跳過，再 binary search 帳戶，只讀 index 指到的 offset
+ *   2. 沒有 .idx (正在寫的 segment / 當機留下的)：退回整段掃描
+ * 文字格式的 segment 讀回來後解析成 AuditRecord，跟 binary 共用同一套過濾與輸出
+ */
+
+#define LINE_MAX_LEN 256
+
+typedef struct {
+    int32_t account;
+    uint64_t from_ns;
+    uint64_t to_ns;
+    int all_ops;
+    int csv;
+    // 統計 (stderr)
+    int seg_indexed;
+    int seg_skipped;
+    int seg_scanned;
+    uint64_t records_read;
+    uint64_t matched;
+} Query;
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s --account <id> [options] <log base path>\n", prog);
+    printf("  --account <id>  Account to look up (source or destination)\n");
+    printf("  --from <time>   Earliest record (epoch seconds or \"YYYY-mm-dd HH:MM:SS\")\n");
+    printf("  --to <time>     Latest record (inclusive, same formats)\n");
+    printf("  --all-ops       Every operation on the account, not just transfers\n");
+    printf("  --csv           Comma-separated output (same columns as logdecode --csv)\n");
+    printf("  --scan          Ignore the indexes and read every segment (for comparison)\n");
+    printf("  --key <file>    Key of an encrypted log (server --log-key)\n");
+    printf("  --help          Show this message\n");
+    printf("Example: %s --account 42 --from \"2026-01-01 09:00:00\" logs/transaction.bin\n", prog);
+}
+
+static int parse_time(const char *s, uint64_t *ns) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*s && *end == '\0') {
+        *ns = v * 1000000000ULL;
+        return 0;
+    }
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!end) {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(s, "%Y-%m-%d", &tm);
+    }
+    if (!end || *end != '\0') return -1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1) return -1;
+    *ns = (uint64_t)t * 1000000000ULL;
+    return 0;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// ============================================================================
+// Text segments: parse a line of audit_format_text() back into a record
+// ============================================================================
+static int op_from_name(const char *name) {
+    static const int codes[] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x51, 0x52 };
+    char tmp[20];
+    for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+        if (strcmp(name, audit_op_name(codes[i], tmp, sizeof(tmp))) == 0) return codes[i];
+    }
+    if (strncmp(name, "OP_", 3) == 0) return atoi(name + 3);
+    return -1;
+}
+
+static int parse_text_line(const char *line, AuditRecord *r) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    memset(r, 0, sizeof(*r));
+    const char *p = strptime(line, "[%Y-%m-%d %H:%M:%S] ", &tm);
+    if (!p) return -1;
+    tm.tm_isdst = -1;
+    r->ts_ns = (uint64_t)mktime(&tm) * 1000000000ULL;
+    r->worker_id = LOG_WORKER_NONE;
+
+    if (sscanf(p, "LOGGER: %d records dropped", &r->amount) == 1) {
+        r->flags = AUDIT_FLAG_DROPPED;
+        return 0;
+    }
+    char op[20], status[16];
+    if (sscanf(p, "CMD:%19s | Status:%15s | Src:%d -> Dst:%d | Amt:$%d",
+               op, status, &r->src_id, &r->dst_id, &r->amount) != 5) return -1;
+    int code = op_from_name(op);
+    if (code < 0) return -1;
+    r->op_code = (uint8_t)code;
+    r->status = strcmp(status, "SUCCESS") == 0 ? 0 : -1;
+    return 0;
+}
+
+// ============================================================================
+// Filter + output
+// ============================================================================
+static void emit(Query *q, const AuditRecord *r, AuditTimeCache *tc) {
+    q->records_read++;
+    if (r->ts_ns < q->from_ns || r->ts_ns > q->to_ns) return;
+    if (!q->all_ops && r->op_code != 0x30) return;
+    int32_t ids[2];
+    int n = audit_record_accounts(r, ids);
+    int hit = 0;
+    for (int i = 0; i < n; i++) hit |= (ids[i] == q->account);
+    if (!hit) return;
+
+    q->matched++;
+    if (q->csv) {
+        char op_tmp[20];
+        printf("%llu,%s.%09llu,%u,%u,%s,%d,%d,%d,%d,%u\n",
+               (unsigned long long)r->ts_ns, audit_time_str(tc, r->ts_ns),
+               (unsigned long long)(r->ts_ns % 1000000000ULL), r->worker_id, r->seq,
+               audit_op_name(r->op_code, op_tmp, sizeof(op_tmp)),
+               r->status, r->src_id, r->dst_id, r->amount, r->flags);
+    } else {
+        char line[LINE_MAX_LEN];
+        int len = audit_format_text(line, sizeof(line), r, tc);
+        if (len > 0) fwrite(line, 1, (size_t)len, stdout);
+    }
+}
+
+static void scan_text(Query *q, const char *path, AuditTimeCache *tc) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+    char line[LINE_MAX_LEN];
+    AuditRecord r;
+    while (fgets(line, sizeof(line), fp)) {
+        if (parse_text_line(line, &r) == 0) emit(q, &r, tc);
+    }
+    fclose(fp);
+}
+
+// 只讀 index 指到的那幾行
+static void read_text_offsets(Query *q, const char *path, const uint32_t *offs, uint32_t n, AuditTimeCache *tc) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    char line[LINE_MAX_LEN];
+    AuditRecord r;
+    for (uint32_t i = 0; i < n; i++) {
+        ssize_t got = pread(fd, line, sizeof(line) - 1, (off_t)offs[i]);
+        if (got <= 0) continue;
+        line[got] = '\0';
+        char *nl = strchr(line, '\n');
+        if (nl) nl[1] = '\0';
+        if (parse_text_line(line, &r) == 0) emit(q, &r, tc);
+    }
+    close(fd);
+}
+
+static void query_segment(Query *q, const char *path, int use_index, AuditTimeCache *tc) {
+    AuditIndex idx;
+    char idx_path[600];
+    snprintf(idx_path, sizeof(idx_path), "%s%s", path, AUDIT_INDEX_SUFFIX);
+    int indexed = use_index && audit_index_open(&idx, idx_path) == 0;
+
+    if (indexed && (idx.hdr->last_ts_ns < q->from_ns || idx.hdr->first_ts_ns > q->to_ns)) {
+        q->seg_skipped++;
+        audit_index_close(&idx);
+        return;
+    }
+
+    const AuditFileHeader *hdr;
+    uint64_t count;
+    size_t map_size;
+    const AuditRecord *recs = audit_map_readonly(path, &hdr, &count, &map_size);
+
+    if (indexed) {
+        q->seg_indexed++;
+        uint32_t n;
+        const uint32_t *offs = audit_index_lookup(&idx, q->account, &n);
+        if (recs) {
+            for (uint32_t i = 0; i < n; i++) {
+                uint64_t k = (offs[i] - sizeof(AuditFileHeader)) / sizeof(AuditRecord);
+                if (offs[i] >= sizeof(AuditFileHeader) && k < count) emit(q, &recs[k], tc);
+            }
+        } else if (n > 0) {
+            read_text_offsets(q, path, offs, n, tc);
+        }
+        audit_index_close(&idx);
+    } else {
+        q->seg_scanned++;
+        if (recs) {
+            for (uint64_t i = 0; i < count; i++) emit(q, &recs[i], tc);
+        } else {
+            scan_text(q, path, tc);
+        }
+    }
+    if (recs) audit_unmap(hdr, map_size);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "account", required_argument, NULL, 'a' },
+        { "from",    required_argument, NULL, 'f' },
+        { "to",      required_argument, NULL, 't' },
+        { "all-ops", no_argument,       NULL, 'A' },
+        { "csv",     no_argument,       NULL, 'c' },
+        { "scan",    no_argument,       NULL, 's' },
+        { "key",     required_argument, NULL, 'k' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    Query q;
+    memset(&q, 0, sizeof(q));
+    q.to_ns = UINT64_MAX;
+    int have_account = 0, use_index = 1, opt;
+
+    while ((opt = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'a': q.account = atoi(optarg); have_account = 1; break;
+            case 'f':
+            case 't':
+                if (parse_time(optarg, opt == 'f' ? &q.from_ns : &q.to_ns) != 0) {
+                    fprintf(stderr, "[logquery] Bad time: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'A': q.all_ops = 1; break;
+            case 'c': q.csv = 1; break;
+            case 's': use_index = 0; break;
+            case 'k':
+                if (audit_load_read_key(optarg) != 0) return 1;
+                break;
+            case 'h': print_usage(argv[0]); return 0;
+            default:  print_usage(argv[0]); return 1;
+        }
+    }
+    if (!have_account || optind != argc - 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    // --to 是「那一秒」為止
+    if (q.to_ns != UINT64_MAX) q.to_ns += 999999999ULL;
+    const char *base = argv[optind];
+
+    static char outbuf[1 << 20];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    if (q.csv) printf("ts_ns,time,worker,seq,op,status,src,dst,amount,flags\n");
+
+    // 先數有幾個 segment 再配置 (不設上限：漏掉最新的 segment 等於查詢結果少一截)
+    int total = 0;
+    audit_segment_list(base, NULL, 0, NULL, &total);
+    uint32_t *segs = malloc(sizeof(uint32_t) * (size_t)(total > 0 ? total : 1));
+    if (!segs) return 1;
+    int nseg = audit_segment_list(base, segs, total, NULL, NULL);
+    AuditTimeCache tc;
+    memset(&tc, 0, sizeof(tc));
+    double t0 = now_ms();
+
+    if (nseg == 0) {
+        // 沒有 rotation 的單一檔案
+        if (access(base, R_OK) != 0) {
+            fprintf(stderr, "[logquery] No segments or file found for %s\n", base);
+            return 1;
+        }
+        query_segment(&q, base, 0, &tc);
+    }
+    for (int i = 0; i < nseg; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), AUDIT_SEGMENT_FMT, base, segs[i]);
+        query_segment(&q, path, use_index, &tc);
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "[logquery] segments: %d via index, %d skipped by time, %d scanned | "
+                    "records read: %llu | matched: %llu | %.2f ms\n",
+            q.seg_indexed, q.seg_skipped, q.seg_scanned,
+            (unsigned long long)q.records_read, (unsigned long long)q.matched, now_ms() - t0);
+    free(segs);
+    return 0;
+}
@@ -0,0 +1,219 @@
+// 檔案: tests/test_affinity.c
+// CPU pinning: OP_TRANSFER throughput / latency and worker migrations, unpinned vs --cpu-workers
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "affinity.h"
+#include "bank.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "test_server_util.h"
+
+#define SERVER_PORT 8080
+#define MAX_CLIENTS 256
+#define MAX_SAMPLES (1 << 22)
+
+/*
+ * 同一組 closed-loop 轉帳負載跑三種 Server：
+ *   unpinned: ./bin/server                       Worker 由 scheduler 決定放哪
+ *   pinned:   ./bin/server --cpu-workers auto    Worker i 固定在第 i 顆 CPU (同一個 node 的排在一起)
+ *   packed:   ./bin/server --cpu-workers <一顆>   全部擠在一顆 CPU (錯誤的 pin 會有多糟；只有 1 顆 CPU 時略過)
+ * 量 client 端的 req/s、p50 / p99，以及這段時間內 Worker 被搬到別顆 CPU 的次數 (/proc/<pid>/sched)
+ */
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static double *g_lat_ms;
+static long g_n, g_failed;
+static volatile int g_stop = 0;
+
+// 轉帳 client：closed loop，每個請求一條新連線 (來回轉 1 元，餘額不會用完)
+static void *client_thread(void *arg) {
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    uint8_t pkt[64];
+    while (!g_stop) {
+        int a = (int)(rand_r(&seed) % 100), b = (a + 1 + (int)(rand_r(&seed) % 99)) % 100;
+        TransferBody tf = { htonl(a), htonl(b), htonl(1) };
+        size_t n = build_packet(pkt, OP_TRANSFER, &tf, sizeof(tf));
+        double t0 = now_sec();
+        int fd = connect_server(SERVER_PORT), ok = 0;
+        if (fd >= 0) {
+            PacketHeader h;
+            void *body = NULL;
+            if (write(fd, pkt, n) == (ssize_t)n && protocol_read_packet(fd, &h, &body) == 0) ok = 1;
+            free(body);
+            close(fd);
+        }
+        double ms = (now_sec() - t0) * 1e3;
+        pthread_mutex_lock(&g_lock);
+        if (ok && g_n < MAX_SAMPLES) g_lat_ms[g_n++] = ms;
+        if (!ok) g_failed++;
+        pthread_mutex_unlock(&g_lock);
+        if (!ok) usleep(10000);
+    }
+    return NULL;
+}
+
+// 所有 Worker 的 se.nr_migrations 加總 (pid 從 metrics page 拿)
+static long worker_migrations(void) {
+    char err[160];
+    const MetricsShm *m = metrics_attach(err, sizeof(err));
+    if (!m) return -1;
+    long total = 0;
+    for (uint32_t w = 0; w < m->nworkers && w < METRICS_MAX_WORKERS; w++) {
+        uint32_t pid = m->workers[w].pid;
+        if (!pid) continue;
+        char path[64], line[256];
+        snprintf(path, sizeof(path), "/proc/%u/sched", pid);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        while (fgets(line, sizeof(line), f)) {
+            char *colon = strchr(line, ':');
+            if (colon && strncmp(line, "se.nr_migrations", 16) == 0) total += atol(colon + 1);
+        }
+        fclose(f);
+    }
+    metrics_detach(m);
+    return total;
+}
+
+typedef struct {
+    double rps, p50, p99;
+    long failed, migrations;
+} Result;
+
+static Result run_load(int clients, int seconds) {
+    pthread_t th[MAX_CLIENTS];
+    g_n = g_failed = 0;
+    g_stop = 0;
+    for (int i = 0; i < clients; i++) pthread_create(&th[i], NULL, client_thread, (void *)(uintptr_t)(i * 7919 + 3));
+    usleep(300000);   // 先暖機再開始量
+    pthread_mutex_lock(&g_lock);
+    g_n = g_failed = 0;
+    pthread_mutex_unlock(&g_lock);
+    long mig0 = worker_migrations();
+    double t0 = now_sec();
+    sleep((unsigned)seconds);
+    long mig1 = worker_migrations();
+    pthread_mutex_lock(&g_lock);
+    long n = g_n;
+    double secs = now_sec() - t0;
+    pthread_mutex_unlock(&g_lock);
+    g_stop = 1;
+    for (int i = 0; i < clients; i++) pthread_join(th[i], NULL);
+
+    qsort(g_lat_ms, (size_t)n, sizeof(double), cmp_double);
+    Result r;
+    r.rps = n / secs;
+    r.p50 = n ? g_lat_ms[(long)((n - 1) * 0.50)] : 0;
+    r.p99 = n ? g_lat_ms[(long)((n - 1) * 0.99)] : 0;
+    r.failed = g_failed;
+    r.migrations = mig0 >= 0 && mig1 >= 0 ? mig1 - mig0 : -1;
+    return r;
+}
+
+static int run_config(const char *bin, const char *name, const char *cpus, int clients, int seconds, Result *out) {
+    char *argv_plain[] = { (char *)bin, NULL };
+    char *argv_pinned[] = { (char *)bin, "--cpu-workers", (char *)cpus, NULL };
+    pid_t pid = start_server(cpus ? argv_pinned : argv_plain, SERVER_PORT, 0);
+    if (pid < 0) {
+        fprintf(stderr, "[Error] Could not start %s\n", bin);
+        return -1;
+    }
+    *out = run_load(clients, seconds);
+    stop_server(pid);
+    char opt[64];
+    snprintf(opt, sizeof(opt), cpus ? "--cpu-workers %s" : "(no option)", cpus);
+    printf("%-9s %-22s | %8.0f | %7.2f | %7.2f | %10ld | %ld\n", name, opt, out->rps, out->p50, out->p99,
+           out->migrations, out->failed);
+    return 0;
+}
+
+// 1. cpulist 解析 / 格式化來回一致
+static int check_parse(void) {
+    int cpus[16], bad = 0;
+    char buf[64];
+    int n = affinity_parse("0-3,8,10-11", cpus, 16);
+    affinity_format(cpus, n, buf, sizeof(buf));
+    bad += n != 7 || cpus[4] != 8 || strcmp(buf, "0-3,8,10-11") != 0;
+    bad += affinity_parse("3-1", cpus, 16) != -1;
+    bad += affinity_parse("1,x", cpus, 16) != -1;
+    bad += affinity_parse("0-100", cpus, 16) != 16;      // 超過 max 的截掉
+    bad += affinity_parse("auto", cpus, 16) < 1;
+    printf("%-26s: ranges, bad lists, truncation, auto | %s\n", "cpulist parsing", bad ? "FAILED" : "PASS");
+    return bad == 0;
+}
+
+// 2. 開戶長出來的 extent 用 Worker CPU 的 interleave policy 建立 (單一 node 時 policy 是 no-op)，
+//    帳戶要照常可以用
+static int check_extent_interleave(const int *cpus, int n) {
+    if (bank_init() != 0) return 0;
+    bank_set_interleave(cpus, n);
+    int bad = 0, last = -1;
+    for (int i = 0; i < EXTENT_ACCOUNTS + 1; i++) last = bank_open_account(0xAFF00000ULL + (uint64_t)i, 0);
+    int bal = -1;
+    bad += last != MAX_ACCOUNTS + EXTENT_ACCOUNTS;                 // 第二個 extent 的第一個帳戶
+    bad += bank_transfer(0, last, 7) != BANK_OK;
+    bad += bank_get_balance(last, &bal) != BANK_OK || bal != 7;
+    bank_destroy();
+    printf("%-26s: 2 extents created with the workers' memory policy (%d node%s), transfers work | %s\n",
+           "extent interleave", affinity_node_count(), affinity_node_count() > 1 ? "s" : "", bad ? "FAILED" : "PASS");
+    return bad == 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *bin = argc > 1 ? argv[1] : "./bin/server";
+    int clients = argc > 2 ? atoi(argv[2]) : 16;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+    if (clients < 1 || clients > MAX_CLIENTS || seconds < 1) {
+        fprintf(stderr, "Usage: %s [server binary] [client connections (max %d)] [seconds per run]\n", argv[0],
+                MAX_CLIENTS);
+        return 1;
+    }
+    int probe = connect_server(SERVER_PORT);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] Something already listens on %s:%d (stop the server first)\n", SERVER_IP,
+                SERVER_PORT);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    g_lat_ms = malloc(sizeof(double) * MAX_SAMPLES);
+    if (!g_lat_ms) return 1;
+
+    int allowed[AFFINITY_MAX_CPUS];
+    int ncpu = affinity_parse("auto", allowed, AFFINITY_MAX_CPUS);
+    char list[256], one[16];
+    affinity_format(allowed, ncpu, list, sizeof(list));
+    printf("=== [Benchmark] CPU Pinning (%d clients, %d s per run; CPUs %s, %d NUMA node%s) ===\n", clients, seconds,
+           list, affinity_node_count(), affinity_node_count() > 1 ? "s" : "");
+    int ok = check_parse();
+    ok &= check_extent_interleave(allowed, ncpu);
+
+    printf("%-32s | %8s | %7s | %7s | %10s | %s\n", "server", "req/s", "p50 ms", "p99 ms", "migrations", "failed");
+    Result unpinned, pinned, packed;
+    if (run_config(bin, "unpinned", NULL, clients, seconds, &unpinned) != 0) return 1;
+    if (run_config(bin, "pinned", "auto", clients, seconds, &pinned) != 0) return 1;
+    if (ncpu > 1) {
+        snprintf(one, sizeof(one), "%d", allowed[0]);
+        if (run_config(bin, "packed", one, clients, seconds, &packed) != 0) return 1;
+    } else {
+        printf("%-32s | (same as pinned: only one CPU available)\n", "packed");
+    }
+
+    printf("pinned vs unpinned: %+.1f%% req/s, p99 %.2f -> %.2f ms, worker migrations %ld -> %ld\n",
+           unpinned.rps > 0 ? 100.0 * (pinned.rps - unpinned.rps) / unpinned.rps : 0.0, unpinned.p99, pinned.p99,
+           unpinned.migrations, pinned.migrations);
+    if (ncpu == 1) printf("(one CPU: the scheduler has nowhere to move workers, so both runs should match)\n");
+
+    // 有 pin 的 Worker 不會被搬走；兩種都要能正常服務
+    ok &= pinned.migrations == 0 && pinned.rps > 0 && unpinned.rps > 0 && pinned.failed == 0;
+    free(g_lat_ms);
+    printf("Result: %s (pinned workers never migrate)\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+// 檔案: tests/test_auditsub.c
+// Audit stream subscribers under load: ordering, completeness, resume, slow consumer; accept with no flush interval
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "logger.h"
+
+#define PRODUCERS 4
+#define RECORDS_PER_PRODUCER 250000
+#define PACED_RATE 100000            // records/s per producer
+#define SLOW_FRAME_US 2000           // 慢的訂閱者每個 frame 停 2 ms (最多 ~128k records/s)
+#define RESUME_PAUSE_MS 20           // resume 訂閱者斷線這麼久再接回來
+#define LAT_BUCKETS 32
+#define BENCH_LOG "logs/bench_auditsub.bin"
+#define BENCH_SOCK "logs/bench_auditsub.sock"
+
+#define SUB_LIVE   0
+#define SUB_RESUME 1
+#define SUB_SLOW   2
+
+typedef struct {
+    const char *name;
+    int mode;
+    pthread_t th;
+    // 結果
+    uint64_t records;
+    uint64_t frames;
+    uint64_t skipped;                // GAP frame 跳過的 stream seq
+    uint64_t order_errors;           // 同一個 producer 的紀錄沒有照順序 / 少了
+    uint64_t stream_errors;          // first_seq 不連續又沒有 GAP 標記
+    uint64_t resumed_at;
+    long last[PRODUCERS];
+    uint64_t lat_hist[LAT_BUCKETS];  // log2(us)，送出端 ts_ns -> 訂閱者收到
+} Sub;
+
+static volatile int g_ready = 0;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t percentile_us(const uint64_t *hist, double pct) {
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) total += hist[b];
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        seen += hist[b];
+        if (total && seen * 100.0 >= total * pct) return 1ULL << (b + 1);
+    }
+    return 0;
+}
+
+static void check_records(Sub *s, const AuditRecord *recs, int n) {
+    uint64_t now = realtime_ns();
+    for (int i = 0; i < n; i++) {
+        const AuditRecord *r = &recs[i];
+        if (r->flags & AUDIT_FLAG_DROPPED) continue;
+        int p = r->src_id;
+        // Src = producer，Amt = producer 內的序號：沒跳號的訂閱者必須剛好 +1
+        if (p < 0 || p >= PRODUCERS || r->amount <= s->last[p] ||
+            (s->mode != SUB_SLOW && r->amount != s->last[p] + 1)) s->order_errors++;
+        if (p >= 0 && p < PRODUCERS) s->last[p] = r->amount;
+        s->records++;
+
+        uint64_t us = now > r->ts_ns ? (now - r->ts_ns) / 1000 : 0;
+        int b = 0;
+        while (b < LAT_BUCKETS - 1 && (1ULL << (b + 1)) <= us) b++;
+        s->lat_hist[b]++;
+    }
+}
+
+static void *subscriber(void *arg) {
+    Sub *s = arg;
+    for (int p = 0; p < PRODUCERS; p++) s->last[p] = -1;
+    static __thread AuditRecord recs[AUDIT_SUB_BATCH_MAX];
+
+    AuditSubFrame hello, f;
+    int fd = -1;
+    for (int tries = 0; fd == -1 && tries < 500; tries++) {
+        fd = audit_sub_connect(BENCH_SOCK, 0, 0, &hello);
+        if (fd == -1) usleep(10000);
+    }
+    if (fd == -1) return NULL;
+    __sync_fetch_and_add(&g_ready, 1);
+
+    uint64_t expected = hello.head_seq;
+    uint64_t total = (uint64_t)PRODUCERS * RECORDS_PER_PRODUCER;
+    int n;
+    while ((n = audit_sub_read(fd, &f, recs)) >= 0) {
+        if (f.first_seq != expected) {
+            if ((f.flags & AUDIT_SUB_FLAG_GAP) && f.first_seq > expected) s->skipped += f.first_seq - expected;
+            else s->stream_errors++;
+        }
+        expected = f.first_seq + (uint64_t)n;
+        s->frames++;
+        check_records(s, recs, n);
+
+        if (s->mode == SUB_SLOW) usleep(SLOW_FRAME_US);
+        if (s->mode == SUB_RESUME && !s->resumed_at && s->records >= total / 2) {
+            // 模擬下游重啟：斷線一陣子，再從下一個 seq 接回來 (Logger 這段時間照常發布)
+            close(fd);
+            usleep(RESUME_PAUSE_MS * 1000);
+            AuditSubFrame again;
+            fd = audit_sub_connect(BENCH_SOCK, expected, hello.epoch, &again);
+            if (fd == -1 || (again.flags & AUDIT_SUB_FLAG_EPOCH) || again.first_seq > expected) {
+                s->stream_errors++;
+                if (fd == -1) break;
+            }
+            s->resumed_at = expected;
+        }
+    }
+    if (fd != -1) close(fd);
+    return NULL;
+}
+
+// --log-flush-ms 0 (只在 buffer 滿的時候 flush)：tick 照樣要跑，不然新的訂閱者永遠等不到 HELLO
+static int check_zero_flush_interval(int mqid) {
+    unlink(BENCH_SOCK);
+    pid_t logger = fork();
+    if (logger == 0) {
+        if (!freopen("/dev/null", "w", stdout)) exit(1);
+        LoggerConfig cfg;
+        logger_config_default(&cfg);
+        snprintf(cfg.path, sizeof(cfg.path), "%s", BENCH_LOG);
+        snprintf(cfg.sub_path, sizeof(cfg.sub_path), "%s", BENCH_SOCK);
+        cfg.format = LOG_FORMAT_BINARY;
+        cfg.flush_interval_ms = 0;
+        logger_configure(&cfg);
+        logger_main_loop(mqid);
+        exit(0);
+    }
+    // audit_sub_connect 在收到 HELLO 之前不會回來：放在子行程裡，逾時就砍掉
+    pid_t sub = fork();
+    if (sub == 0) {
+        AuditSubFrame hello;
+        for (int i = 0; i < 100; i++) {
+            int fd = audit_sub_connect(BENCH_SOCK, 0, 0, &hello);
+            if (fd >= 0) exit(0);
+            usleep(10000);
+        }
+        exit(1);
+    }
+    double t0 = now_sec();
+    int st = 0, done = 0;
+    while (!done && now_sec() - t0 < 3.0) {
+        done = waitpid(sub, &st, WNOHANG) == sub;
+        if (!done) usleep(10000);
+    }
+    if (!done) {
+        kill(sub, SIGKILL);
+        waitpid(sub, NULL, 0);
+    }
+    double secs = now_sec() - t0;
+    kill(logger, SIGTERM);
+    waitpid(logger, NULL, 0);
+    unlink(BENCH_LOG);
+
+    int ok = done && WIFEXITED(st) && WEXITSTATUS(st) == 0;
+    printf("%-7s: flush interval 0 -> subscriber %s after %.0f ms | %s\n", "tick", ok ? "accepted" : "NOT accepted",
+           secs * 1e3, ok ? "PASS" : "FAILED");
+    return ok;
+}
+
+int main() {
+    printf("=== [Benchmark] Audit Stream Subscribers (%d producers x %d records, %d records/s each) ===\n",
+           PRODUCERS, RECORDS_PER_PRODUCER, PACED_RATE);
+
+    int probe = shm_open(LOG_RING_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", LOG_RING_SHM_NAME);
+        return 1;
+    }
+    mkdir("logs", 0777);
+    unlink(BENCH_LOG);
+
+    int mqid = logger_mq_init();
+    if (logger_ring_init(PRODUCERS) != 0 || logger_spill_init(BENCH_LOG, PRODUCERS) != 0) return 1;
+    fflush(stdout);
+
+    pid_t logger = fork();
+    if (logger == 0) {
+        if (!freopen("/dev/null", "w", stdout)) exit(1);
+        LoggerConfig cfg;
+        logger_config_default(&cfg);
+        snprintf(cfg.path, sizeof(cfg.path), "%s", BENCH_LOG);
+        snprintf(cfg.sub_path, sizeof(cfg.sub_path), "%s", BENCH_SOCK);
+        cfg.format = LOG_FORMAT_BINARY;
+        cfg.flush_interval_ms = 5;   // tick = 新訂閱者被 accept 的間隔
+        logger_configure(&cfg);
+        logger_main_loop(mqid);
+        exit(0);
+    }
+
+    // 1. 訂閱者先連上 (只收之後的新紀錄)
+    static Sub subs[] = {
+        { .name = "live",   .mode = SUB_LIVE },
+        { .name = "resume", .mode = SUB_RESUME },
+        { .name = "slow",   .mode = SUB_SLOW },
+    };
+    const int nsubs = (int)(sizeof(subs) / sizeof(subs[0]));
+    for (int i = 0; i < nsubs; i++) pthread_create(&subs[i].th, NULL, subscriber, &subs[i]);
+    double wait_start = now_sec();
+    while (g_ready < nsubs && now_sec() - wait_start < 5.0) usleep(1000);
+    if (g_ready < nsubs) {
+        fprintf(stderr, "[Error] subscribers could not connect\n");
+        kill(logger, SIGTERM);
+        return 1;
+    }
+
+    // 2. Producer 以固定速率送出
+    double t0 = now_sec();
+    pid_t producers[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers[p] = fork();
+        if (producers[p] == 0) {
+            logger_bind_worker(p);
+            double s = now_sec();
+            for (int i = 0; i < RECORDS_PER_PRODUCER; i++) {
+                while (now_sec() - s < (double)i / PACED_RATE) {}
+                logger_send_async(mqid, 0x30, 0, p, 0, i);
+            }
+            exit(0);
+        }
+    }
+    for (int p = 0; p < PRODUCERS; p++) waitpid(producers[p], NULL, 0);
+    double send_secs = now_sec() - t0;
+
+    // 3. Logger 收完、寫完、把尾巴推給訂閱者後關閉 socket -> 訂閱者讀到 EOF
+    kill(logger, SIGTERM);
+    waitpid(logger, NULL, 0);
+    for (int i = 0; i < nsubs; i++) pthread_join(subs[i].th, NULL);
+
+    const AuditFileHeader *hdr;
+    uint64_t in_file = 0;
+    size_t map_size;
+    if (audit_map_readonly(BENCH_LOG, &hdr, &in_file, &map_size)) audit_unmap(hdr, map_size);
+
+    uint64_t total = (uint64_t)PRODUCERS * RECORDS_PER_PRODUCER;
+    int ok = in_file >= total;
+    for (int i = 0; i < nsubs; i++) {
+        Sub *s = &subs[i];
+        int lossless = s->mode != SUB_SLOW;
+        int pass = s->order_errors == 0 && s->stream_errors == 0 &&
+                   (lossless ? s->records == total && s->skipped == 0 : s->records + s->skipped <= in_file);
+        ok &= pass;
+        printf("%-7s: %7lu/%lu records | %5lu frames (%5.1f rec/frame) | skipped %6lu | order errors %lu | "
+               "stream errors %lu | latency p50 <= %lu us, p99 <= %lu us | %s\n",
+               s->name, (unsigned long)s->records, (unsigned long)total, (unsigned long)s->frames,
+               s->frames ? (double)s->records / s->frames : 0.0, (unsigned long)s->skipped,
+               (unsigned long)s->order_errors, (unsigned long)s->stream_errors,
+               (unsigned long)percentile_us(s->lat_hist, 50.0), (unsigned long)percentile_us(s->lat_hist, 99.0),
+               pass ? "PASS" : "FAILED");
+        if (s->mode == SUB_RESUME)
+            printf("%-7s  disconnected for %d ms, resumed at stream seq %lu without loss\n", "",
+                   RESUME_PAUSE_MS, (unsigned long)s->resumed_at);
+    }
+    printf("Logger : %lu records written in %.2f s (%.0f records/s) while the slow subscriber fell behind | %s\n",
+           (unsigned long)in_file, send_secs, in_file / send_secs, in_file >= total ? "PASS" : "FAILED (logger stalled)");
+    ok &= check_zero_flush_interval(mqid);
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+
+    logger_spill_cleanup();
+    logger_ring_cleanup();
+    logger_mq_cleanup(mqid);
+    unlink(BENCH_LOG);
+    return ok ? 0 : 1;
+}
@@ -1,8 +1,101 @@
+// 檔案: tests/test_bank.c
+// Bank core: account open / close / extents, transfers to closed accounts, aggregate over open accounts only
 #include <stdio.h>
+#include <string.h>
 #include "bank.h"
 
+#define OPENED (EXTENT_ACCOUNTS + 10)    // 超過一個 extent：第二個 extent 也會長出來
+
+static int g_failures = 0;
+
+static void expect(int cond, const char *what) {
+    if (!cond) {
+        printf("  [FAIL] %s\n", what);
+        g_failures++;
+    }
+}
+
+static BankAggregate aggregate(void) {
+    BankScanParams p;
+    BankAggregate a;
+    memset(&p, 0, sizeof(p));
+    p.threshold = 1;           // below = 餘額 0 的帳戶
+    p.hist_base = 0;
+    p.hist_width = 1000;
+    if (bank_aggregate(&p, &a) != BANK_OK) memset(&a, 0, sizeof(a));
+    return a;
+}
+
 int main() {
-    printf("Testing Bank Core...\n");
-    // TODO: Call init_bank_shm()
-    return 0;
+    printf("=== [Test] Bank Core (account lifecycle, aggregate) ===\n");
+    if (bank_init() != 0) {
+        fprintf(stderr, "[Error] bank_init failed (server running?)\n");
+        return 1;
+    }
+
+    // 1. 初始狀態：MAX_ACCOUNTS 個帳戶，每個 10000
+    BankAggregate a = aggregate();
+    expect(a.count == MAX_ACCOUNTS && a.total == (int64_t)MAX_ACCOUNTS * 10000, "initial aggregate");
+    expect(a.min == 10000 && a.max == 10000 && a.below == 0, "initial min / max / below");
+
+    // 2. 開戶 (跨 extent)，新帳戶從 0 開始
+    static int ids[OPENED];
+    for (int i = 0; i < OPENED; i++) {
+        ids[i] = bank_open_account(0xC0DE0000ULL + (uint64_t)i, 0);
+        if (ids[i] < 0) {
+            expect(0, "open account");
+            bank_destroy();
+            return 1;
+        }
+    }
+    expect(ids[0] == MAX_ACCOUNTS && ids[OPENED - 1] == MAX_ACCOUNTS + OPENED - 1, "ids allocated in order");
+    expect(bank_open_account(0xC0DE0000ULL, 0) == BANK_ERR_DUPLICATE_ID, "duplicate external id refused");
+    expect(bank_open_account(0, -1) == BANK_ERR_INVALID_AMOUNT, "negative opening balance refused");
+    expect(bank_resolve_ext_id(0xC0DE0000ULL + OPENED - 1) == ids[OPENED - 1], "ext id resolves in 2nd extent");
+
+    // 入金：每個新帳戶從帳戶 0..99 轉 5 元
+    for (int i = 0; i < OPENED; i++)
+        expect(bank_transfer(i % MAX_ACCOUNTS, ids[i], 5) == BANK_OK, "fund new account");
+    a = aggregate();
+    expect(a.count == MAX_ACCOUNTS + OPENED, "count after open");
+    expect(a.total == (int64_t)MAX_ACCOUNTS * 10000, "total unchanged by transfers");
+    expect(a.min == 5 && a.below == 0, "min after funding");
+
+    // 3. 關戶：餘額不是 0 不能關；轉回去之後才能關
+    int victim = ids[OPENED - 1];
+    expect(bank_close_account(victim) == BANK_ERR_NONZERO_BALANCE, "close with balance refused");
+    expect(bank_transfer(victim, 0, 5) == BANK_OK, "drain account");
+    expect(bank_close_account(victim) == BANK_OK, "close account");
+    expect(bank_close_account(victim) == BANK_ERR_INVALID_ID, "close twice refused");
+    expect(bank_resolve_ext_id(0xC0DE0000ULL + OPENED - 1) == BANK_ERR_INVALID_ID, "ext id gone after close");
+    for (int i = 0; i < 10; i++) {                          // 中間再關幾個 (extent 裡出現空洞)
+        expect(bank_transfer(ids[100 + i], 1, 5) == BANK_OK, "drain account");
+        expect(bank_close_account(ids[100 + i]) == BANK_OK, "close account");
+    }
+
+    // 4. 已關閉 / 從沒開過的帳戶：轉入 / 轉出都是錯誤
+    int bal = 0;
+    expect(bank_transfer(0, victim, 1) == BANK_ERR_INVALID_ID, "transfer to closed account");
+    expect(bank_transfer(victim, 0, 1) == BANK_ERR_INVALID_ID, "transfer from closed account");
+    expect(bank_transfer(0, MAX_ACCOUNTS + OPENED + 5, 1) == BANK_ERR_INVALID_ID, "transfer to never-opened slot");
+    int paid0 = 5 * ((OPENED - 1) / MAX_ACCOUNTS + 1);     // 帳戶 0 資助了 i = 0, 100, 200, ...
+    expect(bank_get_balance(0, &bal) == BANK_OK && bal == 10000 - paid0 + 5, "balance of account 0");
+
+    // 5. Aggregate 只算 OPEN 的帳戶：關閉的 (餘額 0) 不能把 min / below / histogram 拉到 0
+    a = aggregate();
+    expect(a.count == MAX_ACCOUNTS + OPENED - 11, "count excludes closed accounts");
+    expect(a.total == (int64_t)MAX_ACCOUNTS * 10000, "total after close");
+    expect(a.min == 5, "min ignores closed / free slots");
+    expect(a.below == 0 && a.histogram[0] == (uint64_t)(OPENED - 11), "below / histogram ignore closed slots");
+
+    // 6. 關掉的 slot 會被重複使用，新帳戶從 0 開始；0 元的帳戶要算進 min / below
+    int reused = bank_open_account(0, 0);
+    expect(reused >= MAX_ACCOUNTS && reused < MAX_ACCOUNTS + OPENED, "closed slot reused");
+    expect(bank_get_balance(reused, &bal) == BANK_OK && bal == 0, "reused slot starts at 0");
+    a = aggregate();
+    expect(a.count == MAX_ACCOUNTS + OPENED - 10 && a.min == 0 && a.below == 1, "zero-balance open account counted");
+
+    bank_destroy();
+    printf("Result: %s (%d failures)\n", g_failures ? "FAILED" : "PASS", g_failures);
+    return g_failures ? 1 : 0;
 }
@@ -0,0 +1,221 @@
+// 檔案: tests/test_crypt.c
+// Audit log encryption: per-record XOR (old) vs block-level AES-128-CTR (portable / AES-NI)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "logger.h"
+
+#define BULK_BYTES (64u << 20)        // 64 MiB 的連續資料
+#define BATCH_RECORDS 256             // Logger 預設一批的大小
+#define E2E_RECORDS 1000000
+#define E2E_PATH "logs/bench_crypt.bin"
+#define KEY_PATH "logs/bench_crypt.key"
+#define XOR_KEY 0xAB                  // 舊版 apply_xor_cipher 的 key
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 舊版：每筆 LogMessage 在 Worker 加密一次、Logger 解密一次，逐 byte XOR
+static void xor_per_record(void *data, size_t len) {
+    char *ptr = (char *)data;
+    for (size_t i = 0; i < len; i++) ptr[i] ^= XOR_KEY;
+}
+
+// ============================================================================
+// 1. Correctness
+// ============================================================================
+static int check_known_answer(const LogCipher *c, const char *name) {
+    // FIPS-197 Appendix C.1
+    static const uint8_t pt[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+    static const uint8_t ct[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+    uint8_t out[16];
+    log_cipher_block(c, pt, out);
+    int ok = memcmp(out, ct, 16) == 0;
+
+    // CTR 第一個 block = AES(nonce || 0)：同一個 keystream 必須跟單 block 結果一致
+    uint8_t nonce[8] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77 }, zero[16] = { 0 }, ks[16];
+    uint8_t blk[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77 };
+    log_cipher_block(c, blk, out);
+    log_cipher_ctr(c, nonce, 0, zero, ks, 16);
+    ok &= memcmp(out, ks, 16) == 0;
+
+    printf("%-28s: %s\n", name, ok ? "PASS (FIPS-197 C.1)" : "FAILED");
+    return ok;
+}
+
+// AES-NI 整段加密 == portable 分成不對齊的小段解密
+static int check_cross(const LogCipher *fast, const LogCipher *slow) {
+    size_t len = (1u << 20) + 13;
+    uint8_t *plain = malloc(len), *buf = malloc(len);
+    if (!plain || !buf) return 0;
+    for (size_t i = 0; i < len; i++) plain[i] = (uint8_t)(i * 131 + 7);
+    uint8_t nonce[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    log_cipher_ctr(fast, nonce, 64, plain, buf, len);
+    int differs = memcmp(plain, buf, 64) != 0;
+    size_t pos = 0, step = 1;
+    while (pos < len) {
+        size_t n = step < len - pos ? step : len - pos;
+        log_cipher_ctr(slow, nonce, 64 + pos, buf + pos, buf + pos, n);
+        pos += n;
+        step = step * 3 + 5;   // 1, 8, 29, ...：跨越各種 block 邊界
+    }
+    int ok = differs && memcmp(plain, buf, len) == 0;
+    printf("%-28s: %s\n", "AES-NI vs portable (CTR)", ok ? "PASS (unaligned offsets round-trip)" : "FAILED");
+    free(plain);
+    free(buf);
+    return ok;
+}
+
+// ============================================================================
+// 2. Throughput
+// ============================================================================
+static void bench_line(const char *name, double bytes, double secs, double base) {
+    printf("%-28s: %8.1f MB/s", name, bytes / secs / 1e6);
+    if (base > 0) printf(" | %5.2fx vs XOR", (bytes / secs) / base);
+    printf("\n");
+}
+
+static double bench_xor(uint8_t *buf) {
+    // 舊版的單位是一筆 LogMessage (送出端加密 + Logger 解密 = 兩趟)
+    size_t rec = sizeof(LogMessage) - sizeof(long);
+    size_t n = BULK_BYTES / rec;
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; i++) {
+        xor_per_record(buf + i * rec, rec);
+        xor_per_record(buf + i * rec, rec);
+    }
+    double secs = now_sec() - t0;
+    double rate = (double)(n * rec) / secs;
+    bench_line("per-record XOR (old)", (double)(n * rec), secs, 0);
+    return rate;
+}
+
+static void bench_ctr(const LogCipher *c, const char *name, uint8_t *buf, size_t chunk, double base) {
+    uint8_t nonce[8] = { 9, 9, 9, 9, 9, 9, 9, 9 };
+    double t0 = now_sec();
+    for (size_t off = 0; off + chunk <= BULK_BYTES; off += chunk)
+        log_cipher_ctr(c, nonce, 64 + off, buf + off, buf + off, chunk);
+    double secs = now_sec() - t0;
+    bench_line(name, (double)(BULK_BYTES / chunk * chunk), secs, base);
+}
+
+// ============================================================================
+// 3. End to end: audit_append (plain / encrypted) + audit_map_readonly
+// ============================================================================
+static int bench_append(const LogCipher *c, AuditRecord *recs) {
+    double ns[2] = { 0, 0 };
+    int ok = 1;
+    for (int enc = 0; enc <= 1; enc++) {
+        unlink(E2E_PATH);
+        AuditFile af;
+        if (audit_open_encrypted(&af, E2E_PATH, enc ? c : NULL) != 0) return 0;
+        double t0 = now_sec();
+        for (int i = 0; i < E2E_RECORDS; i += BATCH_RECORDS)
+            audit_append(&af, &recs[i], E2E_RECORDS - i < BATCH_RECORDS ? E2E_RECORDS - i : BATCH_RECORDS);
+        ns[enc] = (now_sec() - t0) * 1e9 / E2E_RECORDS;
+        // 檔案裡不應該出現明文
+        if (enc && memcmp((char *)af.hdr + sizeof(AuditFileHeader), recs, sizeof(AuditRecord)) == 0) ok = 0;
+        audit_close(&af);
+    }
+
+    // 讀回來 (private mapping 上解密) 必須一模一樣
+    const AuditFileHeader *hdr;
+    uint64_t count = 0;
+    size_t map_size;
+    double t0 = now_sec();
+    const AuditRecord *back = audit_map_readonly(E2E_PATH, &hdr, &count, &map_size);
+    double read_ms = (now_sec() - t0) * 1e3;
+    if (!back || count != E2E_RECORDS || memcmp(back, recs, sizeof(AuditRecord) * E2E_RECORDS) != 0) ok = 0;
+    if (back) audit_unmap(hdr, map_size);
+    unlink(E2E_PATH);
+
+    printf("%-28s: plain %6.1f ns/rec | encrypted %6.1f ns/rec (+%.1f) | map+decrypt %.1f ms | %s\n",
+           "audit_append (batch 256)", ns[0], ns[1], ns[1] - ns[0], read_ms,
+           ok ? "PASS (round-trip, no plaintext)" : "FAILED");
+    return ok;
+}
+
+int main() {
+    printf("=== [Benchmark] Audit Log Encryption (AES-128-CTR, block level) ===\n");
+    mkdir("logs", 0777);
+
+    uint8_t key[LOG_KEY_BYTES];
+    for (int i = 0; i < LOG_KEY_BYTES; i++) key[i] = (uint8_t)i;   // FIPS-197 的測試 key
+    LogCipher fast, slow;
+    log_cipher_init(&fast, key);
+    slow = fast;
+    slow.aesni = 0;
+
+    int ok = check_known_answer(&slow, "portable AES-128");
+    if (fast.aesni) {
+        ok &= check_known_answer(&fast, "AES-NI AES-128");
+        ok &= check_cross(&fast, &slow);
+    } else {
+        printf("%-28s: not available on this CPU\n", "AES-NI");
+    }
+
+    uint8_t *buf = malloc(BULK_BYTES);
+    AuditRecord *recs = calloc(E2E_RECORDS, sizeof(AuditRecord));
+    if (!buf || !recs) return 1;
+    memset(buf, 0x5A, BULK_BYTES);
+
+    printf("--- Throughput (%u MiB) ---\n", BULK_BYTES >> 20);
+    double base = bench_xor(buf);
+    bench_ctr(&slow, "AES-CTR portable, 8 KB batch", buf, BATCH_RECORDS * sizeof(AuditRecord), base);
+    if (fast.aesni) {
+        bench_ctr(&fast, "AES-CTR AES-NI, 32 B record", buf, sizeof(AuditRecord), base);
+        bench_ctr(&fast, "AES-CTR AES-NI, 8 KB batch", buf, BATCH_RECORDS * sizeof(AuditRecord), base);
+        bench_ctr(&fast, "AES-CTR AES-NI, 1 MB block", buf, 1u << 20, base);
+    }
+
+    for (int i = 0; i < E2E_RECORDS; i++) {
+        recs[i].ts_ns = 1700000000000000000ULL + (uint64_t)i * 1000;
+        recs[i].seq = (uint32_t)i + 1;
+        recs[i].op_code = 0x30;
+        recs[i].src_id = i % 1000;
+        recs[i].dst_id = (i * 7) % 1000;
+        recs[i].amount = 100 + i % 5000;
+    }
+    // 讀的一方沒有 key / key 錯了就不能讀
+    AuditFile af;
+    unlink(E2E_PATH);
+    if (audit_open_encrypted(&af, E2E_PATH, &fast) == 0) {
+        audit_append(&af, recs, 16);
+        audit_close(&af);
+        const AuditFileHeader *hdr;
+        uint64_t count;
+        size_t map_size;
+        int leaked = audit_map_readonly(E2E_PATH, &hdr, &count, &map_size) != NULL;
+        printf("%-28s: %s\n", "read without key", leaked ? "FAILED (decoded)" : "PASS (refused)");
+        ok &= !leaked;
+        unlink(E2E_PATH);
+    }
+
+    // 工具端的用法：從 key 檔載入 (32 hex digits)
+    FILE *kf = fopen(KEY_PATH, "w");
+    if (!kf) return 1;
+    for (int i = 0; i < LOG_KEY_BYTES; i++) fprintf(kf, "%02x", key[i]);
+    fprintf(kf, "\n");
+    fclose(kf);
+    chmod(KEY_PATH, 0600);
+    ok &= audit_load_read_key(KEY_PATH) == 0;
+    unlink(KEY_PATH);
+
+    printf("--- End to end (%d records) ---\n", E2E_RECORDS);
+    ok &= bench_append(fast.aesni ? &fast : &slow, recs);
+
+    free(buf);
+    free(recs);
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
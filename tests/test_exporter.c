@@ -0,0 +1,242 @@
+// 檔案: tests/test_exporter.c
+// Prometheus exporter: exposition format, histogram consistency, counters under load, scrape cost vs writer cost
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "metrics.h"
+#include "protocol.h"
+
+#define WRITERS 4
+#define REQUESTS_PER_WRITER 2000000
+#define BENCH_SOCK "logs/bench_exporter.sock"
+#define MAX_BODY (4 << 20)
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 一次 HTTP/1.0 請求，回傳收到的 bytes (header + body)，-1 = 連不上
+static long http_get(const char *method, const char *path, char *out, size_t cap) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", BENCH_SOCK);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    char req[256];
+    int n = snprintf(req, sizeof(req), "%s %s HTTP/1.0\r\nHost: localhost\r\n\r\n", method, path);
+    if (write(fd, req, (size_t)n) != n) {
+        close(fd);
+        return -1;
+    }
+    size_t got = 0;
+    ssize_t r;
+    while (got < cap - 1 && (r = read(fd, out + got, cap - 1 - got)) > 0) got += (size_t)r;
+    out[got] = '\0';
+    close(fd);
+    return (long)got;
+}
+
+// 找出 "name{labels} value" 的 value；沒有這行回傳 -1
+static double sample_value(const char *body, const char *series) {
+    size_t sl = strlen(series);
+    for (const char *p = body; p && *p; p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL) {
+        if (strncmp(p, series, sl) == 0 && p[sl] == ' ') return atof(p + sl + 1);
+    }
+    return -1;
+}
+
+// 檢查 exposition format：每一行是 # HELP / # TYPE 或 "metric{labels} number"；
+// 直方圖的 bucket 要遞增，+Inf == _count
+static int check_format(char *body, int *samples, int *histograms) {
+    char prev_series[256] = "";
+    double prev_bucket = -1;
+    *samples = *histograms = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(body, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        if (line[0] == '#') {
+            if (strncmp(line, "# HELP ", 7) != 0 && strncmp(line, "# TYPE ", 7) != 0) return 0;
+            continue;
+        }
+        char *p = line;
+        if (!(isalpha((unsigned char)*p) || *p == '_')) return 0;
+        while (isalnum((unsigned char)*p) || *p == '_' || *p == ':') p++;
+        if (*p == '{') {
+            char *end = strchr(p, '}');
+            if (!end) return 0;
+            p = end + 1;
+        }
+        if (*p != ' ') return 0;
+        char *num_end;
+        double v = strtod(p + 1, &num_end);
+        if (num_end == p + 1 || *num_end != '\0' || v < 0) return 0;
+        (*samples)++;
+
+        // 同一個 (op, stage) 的 bucket 連續出現：比對 le 之前的前綴
+        char *le = strstr(line, ",le=\"");
+        if (strncmp(line, "hsts_request_duration_seconds_bucket{", 37) == 0 && le) {
+            size_t pl = (size_t)(le - line);
+            if (pl >= sizeof(prev_series)) return 0;
+            if (strncmp(prev_series, line, pl) != 0 || prev_series[pl] != '\0') {
+                memcpy(prev_series, line, pl);
+                prev_series[pl] = '\0';
+                prev_bucket = -1;
+                (*histograms)++;
+            }
+            if (v < prev_bucket) return 0;
+            prev_bucket = v;
+        } else if (strncmp(line, "hsts_request_duration_seconds_count{", 36) == 0) {
+            if (v != prev_bucket) return 0;   // 上一行是 _sum，再上一行是 +Inf：值要一樣
+        }
+    }
+    return *samples > 0;
+}
+
+static void writer_loop(int w) {
+    metrics_bind_worker(w);
+    for (int i = 0; i < REQUESTS_PER_WRITER; i++) {
+        metrics_req_begin();
+        metrics_stage_set(METRICS_STAGE_PARSE, 1500 + (i & 511));
+        metrics_stage_add(METRICS_STAGE_LOG, 200);
+        metrics_stage_set(METRICS_STAGE_TOTAL, 8000 + (i & 8191) * 16);
+        metrics_req_end((i & 1) ? OP_BALANCE : OP_TRANSFER, (i % 20 == 0) ? -5 : 0);
+    }
+}
+
+// 所有 Writer 跑完的時間；scrape = 1 時主行程同時不停地 scrape
+static double run_writers(int scrape, int *scrapes, double *scrape_max_ms, double *scrape_avg_ms, int *regressions,
+                          char *body) {
+    pid_t pids[WRITERS];
+    double t0 = now_sec();
+    for (int w = 0; w < WRITERS; w++) {
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            writer_loop(w);
+            exit(0);
+        }
+    }
+    int running = WRITERS;
+    double last = 0, total_ms = 0;
+    *scrapes = *regressions = 0;
+    *scrape_max_ms = 0;
+    while (running > 0) {
+        if (scrape) {
+            double s0 = now_sec();
+            if (http_get("GET", "/metrics", body, MAX_BODY) > 0) {
+                double ms = (now_sec() - s0) * 1e3;
+                total_ms += ms;
+                if (ms > *scrape_max_ms) *scrape_max_ms = ms;
+                (*scrapes)++;
+                double v = sample_value(body, "hsts_requests_total{op=\"TRANSFER\"}");
+                if (v < last) (*regressions)++;
+                last = v;
+            }
+            usleep(10000);   // ~100 scrapes/s：比一般 Prometheus 的 15 s 密得多
+        } else {
+            usleep(1000);
+        }
+        while (running > 0 && waitpid(-1, NULL, WNOHANG) > 0) running--;
+    }
+    *scrape_avg_ms = *scrapes ? total_ms / *scrapes : 0;
+    return now_sec() - t0;
+}
+
+int main() {
+    printf("=== [Benchmark] Prometheus Exporter (%d writers x %d requests) ===\n", WRITERS, REQUESTS_PER_WRITER);
+
+    int probe = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", METRICS_SHM_NAME);
+        return 1;
+    }
+    mkdir("logs", 0777);
+    if (metrics_init(WRITERS, 1) != 0) return 1;
+    int lfd = metrics_export_listen("unix:" BENCH_SOCK);
+    if (lfd < 0) return 1;
+    fflush(stdout);
+    pid_t exporter = fork();
+    if (exporter == 0) {
+        if (!freopen("/dev/null", "w", stdout)) exit(1);
+        metrics_export_loop(lfd);
+        exit(0);
+    }
+    close(lfd);
+    char *body = malloc(MAX_BODY);
+    if (!body) return 1;
+
+    // 1. Writer 的成本：沒人 scrape vs 每 10 ms scrape 一次 (Worker 完全不知道有人在讀)
+    int scrapes, regressions, dummy;
+    double smax, savg, d0, d1;
+    double quiet = run_writers(0, &dummy, &d0, &d1, &dummy, body);
+    double busy = run_writers(1, &scrapes, &smax, &savg, &regressions, body);
+    uint64_t total = (uint64_t)WRITERS * REQUESTS_PER_WRITER;
+    printf("%-26s: %6.1f ns/request without scrapes, %6.1f ns/request while scraping (%d CPUs shared)\n",
+           "writer cost", quiet * 1e9 / total, busy * 1e9 / total, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-26s: %d scrapes, avg %.2f ms, max %.2f ms, counter went backwards %d times | %s\n",
+           "scrapes under load", scrapes, savg, smax, regressions, regressions == 0 ? "PASS" : "FAILED");
+    int ok = regressions == 0 && scrapes > 0;
+
+    // 2. 最後一次 scrape：格式、直方圖一致、數字剛好 (logger 的 spill / 收回計數也要匯出)
+    LoggerMetrics *lm = metrics_bind_logger(0);
+    if (lm) {
+        lm->spilled = 1234;
+        lm->merged = 1200;
+    }
+    long n = http_get("GET", "/metrics", body, MAX_BODY);
+    char *text = n > 0 ? strstr(body, "\r\n\r\n") : NULL;
+    int status_ok = n > 0 && strncmp(body, "HTTP/1.0 200 OK", 15) == 0 &&
+                    strstr(body, "Content-Type: text/plain; version=0.0.4") != NULL && text;
+    double tf = text ? sample_value(text, "hsts_requests_total{op=\"TRANSFER\"}") : -1;
+    double bal = text ? sample_value(text, "hsts_requests_total{op=\"BALANCE\"}") : -1;
+    double insuf = text ? sample_value(text, "hsts_errors_total{code=\"INSUFFICIENT\"}") : -1;
+    double cnt = text ? sample_value(text, "hsts_request_duration_seconds_count{op=\"TRANSFER\",stage=\"total\"}") : -1;
+    double spilled = text ? sample_value(text, "hsts_log_spilled_total{shard=\"0\"}") : -1;
+    double merged = text ? sample_value(text, "hsts_log_merged_total{shard=\"0\"}") : -1;
+    // 兩輪 (安靜 + scrape) 各 total 個請求：一半 TRANSFER、一半 BALANCE，每 20 個一個 INSUFFICIENT
+    int counts_ok = tf == (double)total && bal == (double)total && insuf == 2.0 * total / 20 && cnt == tf &&
+                    strstr(text, "hsts_worker_up{worker=\"3\"") != NULL && spilled == 1234 && merged == 1200;
+    int samples = 0, histograms = 0;
+    int format_ok = text && check_format(text + 4, &samples, &histograms);
+    printf("%-26s: %ld bytes, %d samples, %d histograms, format %s, counters %s | %s\n", "final scrape", n, samples,
+           histograms, format_ok ? "valid" : "INVALID", counts_ok ? "exact" : "WRONG",
+           status_ok && format_ok && counts_ok ? "PASS" : "FAILED");
+    ok &= status_ok && format_ok && counts_ok;
+
+    // 3. 其他路徑 / method
+    char small[512];
+    int notfound = http_get("GET", "/nope", small, sizeof(small)) > 0 && strstr(small, " 404 ");
+    int badmethod = http_get("POST", "/metrics", small, sizeof(small)) > 0 && strstr(small, " 405 ");
+    int headonly = http_get("HEAD", "/metrics", small, sizeof(small)) > 0 && strstr(small, " 200 ") &&
+                   !strstr(small, "# HELP");
+    printf("%-26s: 404 %s, 405 %s, HEAD without body %s | %s\n", "other requests", notfound ? "ok" : "no",
+           badmethod ? "ok" : "no", headonly ? "ok" : "no", notfound && badmethod && headonly ? "PASS" : "FAILED");
+    ok &= notfound && badmethod && headonly;
+
+    kill(exporter, SIGTERM);
+    waitpid(exporter, NULL, 0);
+    int unlinked = access(BENCH_SOCK, F_OK) != 0;
+    printf("%-26s: %s\n", "socket removed on exit", unlinked ? "PASS" : "FAILED");
+    ok &= unlinked;
+
+    free(body);
+    metrics_cleanup();
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
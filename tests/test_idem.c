@@ -0,0 +1,264 @@
+// 檔案: tests/test_idem.c
+// Idempotency table: retry storms must apply each key exactly once; capacity at the target rate over a full window;
+// first-time racers on one key never both run when a slot in front of them frees up mid-scan
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "bank.h"
+
+#define THREADS 8
+#define KEYS 2000
+#define RETRIES_PER_KEY 5      // 每個 thread 對每把 key 都送 5 次
+#define RACE_ROUNDS 1000       // 同一把 key 的第一次請求同時到，前面的格子在掃描中途被釋放
+#define RACE_THREADS 4
+
+static IdemTable *g_table;
+static volatile int g_applied[KEYS];
+static volatile long g_replays;
+static volatile long g_busy;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_key(int k, uint8_t key[16]) {
+    memset(key, 0, 16);
+    uint64_t v = 0xA5A5000000000000ULL + (uint64_t)k * 0x9E3779B97F4A7C15ULL;
+    memcpy(key, &v, 8);
+    memcpy(key + 8, &k, sizeof(k));
+}
+
+// 容量：IDEM_TARGET_RATE 把新 key / 秒，連續一整個視窗 (每一把都還活著)，一個 BUSY 都不能有；
+// 之後同一秒內繼續塞到第一次 BUSY 為止 (超出設計容量)，最後視窗過了又能重新塞滿
+static int check_capacity(void) {
+    IdemTable *t = malloc(sizeof(IdemTable));
+    if (!t) return 1;
+    idem_init(t);
+    uint32_t base = 1000000000u, seconds = (IDEM_WINDOW_BUCKETS + 1) * IDEM_BUCKET_SECONDS;
+    uint8_t key[16];
+    IdemEntry *e;
+    int result, failures = 0;
+    long busy = 0, k = 0;
+
+    for (uint32_t s = 0; s < seconds; s++) {
+        for (int i = 0; i < IDEM_TARGET_RATE; i++, k++) {
+            make_key((int)(KEYS + k), key);
+            if (idem_begin(t, key, base + s, &e, &result) == IDEM_NEW) idem_complete(e, BANK_OK);
+            else busy++;
+        }
+    }
+    long live = k, lost = 0;
+    for (long i = 0; i < live; i++) {                        // 每一把都還查得到
+        make_key((int)(KEYS + i), key);
+        if (idem_begin(t, key, base + seconds - 1, &e, &result) != IDEM_DUPLICATE || result != BANK_OK) lost++;
+    }
+    long first_busy = -1;
+    for (; k < (long)IDEM_TABLE_SIZE && first_busy < 0; k++) {  // 超過設計容量
+        make_key((int)(KEYS + k), key);
+        if (idem_begin(t, key, base + seconds - 1, &e, &result) == IDEM_NEW) idem_complete(e, BANK_OK);
+        else first_busy = k;
+    }
+    uint32_t later = base + seconds + (IDEM_WINDOW_BUCKETS + 1) * IDEM_BUCKET_SECONDS;
+    long busy_after = 0;
+    for (long i = 0; i < live; i++) {                        // 視窗過了：舊的全部可覆蓋
+        make_key((int)(KEYS + k + i), key);
+        if (idem_begin(t, key, later, &e, &result) == IDEM_NEW) idem_complete(e, BANK_OK);
+        else busy_after++;
+    }
+    free(t);
+
+    failures = busy != 0 || lost != 0 || busy_after != 0 || first_busy < live;
+    printf("Capacity: %ld keys at %d/s over %u s -> %ld busy, %ld lost | first busy at key %ld (table %u) | "
+           "after the window: %ld busy | %s\n", live, IDEM_TARGET_RATE, seconds, busy, lost, first_busy,
+           IDEM_TABLE_SIZE, busy_after, failures ? "FAILED" : "PASS");
+    return failures;
+}
+
+// 同 home 的兩把 key (target / noise)：noise 不停地佔住 home 又放掉，
+// 同時 RACE_THREADS 個 thread 第一次送 target -> 有的掃到 home 空著、有的掃到 home+1，每輪最多只能執行一次
+// (掃描到佔位之間只有幾百 ns：要多核心才撞得到，單核心上大多只走到一般的重播)
+typedef struct {
+    IdemTable *t;
+    uint8_t target[16], noise[16];
+    volatile uint32_t now;
+    volatile int stop;
+    pthread_mutex_t clock;         // noise 的一次佔用不能跨過換 now (否則它的 entry 在新的一輪已經過期)
+    volatile long applied, replays, busy, wrong;
+    pthread_barrier_t start, done;
+} Race;
+
+static void* race_worker(void *arg) {
+    Race *r = arg;
+    for (int round = 0; round < RACE_ROUNDS; round++) {
+        pthread_barrier_wait(&r->start);
+        IdemEntry *e;
+        int result, st = idem_begin(r->t, r->target, r->now, &e, &result);
+        if (st == IDEM_NEW) {
+            __sync_fetch_and_add(&r->applied, 1);
+            sched_yield();                                   // 模擬轉帳的時間
+            idem_complete(e, BANK_OK);
+        } else if (st == IDEM_DUPLICATE) {
+            __sync_fetch_and_add(&r->replays, 1);
+            if (result != BANK_OK) __sync_fetch_and_add(&r->wrong, 1);
+        } else {
+            __sync_fetch_and_add(&r->busy, 1);
+        }
+        pthread_barrier_wait(&r->done);
+    }
+    return NULL;
+}
+
+static void* race_noise(void *arg) {
+    Race *r = arg;
+    while (!r->stop) {
+        IdemEntry *e;
+        int result;
+        pthread_mutex_lock(&r->clock);
+        if (idem_begin(r->t, r->noise, r->now, &e, &result) == IDEM_NEW)
+            idem_complete(e, BANK_ERR_OVERLOADED);           // 釋放：target 前面的格子空出來
+        pthread_mutex_unlock(&r->clock);
+    }
+    return NULL;
+}
+
+static int check_race(void) {
+    Race *r = calloc(1, sizeof(Race));
+    int32_t *owner = malloc(sizeof(int32_t) * IDEM_TABLE_SIZE);
+    if (!r || !owner || !(r->t = malloc(sizeof(IdemTable)))) return 1;
+    idem_init(r->t);
+    memset(owner, 0xff, sizeof(int32_t) * IDEM_TABLE_SIZE);
+
+    // 找兩把 home 相同的 key：每次都跳過一整個視窗，所以 key 一定佔在自己的 home
+    uint32_t now = 0, step = (IDEM_WINDOW_BUCKETS + 2) * IDEM_BUCKET_SECONDS;
+    uint8_t key[16];
+    IdemEntry *e;
+    int result, target = -1, noise = -1;
+    for (int c = 0; c < 100000 && noise < 0; c++, now += step) {
+        make_key(-1 - c, key);
+        if (idem_begin(r->t, key, now, &e, &result) != IDEM_NEW) break;
+        uint32_t home = (uint32_t)(e - r->t->entries);
+        if (owner[home] >= 0) { target = owner[home]; noise = c; }
+        else owner[home] = c;
+    }
+    free(owner);
+    if (noise < 0) return 1;
+    make_key(-1 - target, r->target);
+    make_key(-1 - noise, r->noise);
+
+    pthread_t th[RACE_THREADS + 1];
+    pthread_mutex_init(&r->clock, NULL);
+    pthread_barrier_init(&r->start, NULL, RACE_THREADS + 1);
+    pthread_barrier_init(&r->done, NULL, RACE_THREADS + 1);
+    for (int i = 0; i < RACE_THREADS; i++) pthread_create(&th[i], NULL, race_worker, r);
+    pthread_create(&th[RACE_THREADS], NULL, race_noise, r);
+
+    long twice = 0;
+    for (int round = 0; round < RACE_ROUNDS; round++) {
+        now += step;                                         // 上一輪的 entry 全部過期
+        pthread_mutex_lock(&r->clock);
+        r->now = now;
+        pthread_mutex_unlock(&r->clock);
+        long before = r->applied;
+        pthread_barrier_wait(&r->start);
+        pthread_barrier_wait(&r->done);
+        twice += r->applied - before > 1;
+    }
+    r->stop = 1;
+    for (int i = 0; i <= RACE_THREADS; i++) pthread_join(th[i], NULL);
+    pthread_barrier_destroy(&r->start);
+    pthread_barrier_destroy(&r->done);
+    pthread_mutex_destroy(&r->clock);
+
+    int failures = twice != 0 || r->wrong != 0;
+    printf("Same-key race: %d rounds x %d threads, slot in front freed mid-scan | applied %ld, replayed %ld, "
+           "busy %ld | %ld rounds ran twice | %s\n", RACE_ROUNDS, RACE_THREADS, r->applied, r->replays, r->busy,
+           twice, failures ? "FAILED" : "PASS");
+    free(r->t);
+    free(r);
+    return failures;
+}
+
+static void* storm_worker(void *arg) {
+    (void)arg;
+    uint8_t key[16];
+    uint32_t now = (uint32_t)time(NULL);
+
+    for (int r = 0; r < RETRIES_PER_KEY; r++) {
+        for (int k = 0; k < KEYS; k++) {
+            IdemEntry *e;
+            int result;
+            make_key(k, key);
+            int st = idem_begin(g_table, key, now, &e, &result);
+            if (st == IDEM_NEW) {
+                __sync_fetch_and_add(&g_applied[k], 1);   // 模擬「真的轉帳」
+                idem_complete(e, k % 7 == 0 ? BANK_ERR_INSUFFICIENT : BANK_OK);
+            } else if (st == IDEM_DUPLICATE) {
+                int expect = (k % 7 == 0) ? BANK_ERR_INSUFFICIENT : BANK_OK;
+                if (result != expect) fprintf(stderr, "[Idem] wrong replay result for key %d\n", k);
+                __sync_fetch_and_add(&g_replays, 1);
+            } else {
+                __sync_fetch_and_add(&g_busy, 1);
+            }
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    printf("=== [Test] Idempotency Dedup Table ===\n");
+
+    g_table = malloc(sizeof(IdemTable));
+    if (!g_table) return 1;
+    idem_init(g_table);
+
+    pthread_t th[THREADS];
+    double t0 = now_sec();
+    for (int i = 0; i < THREADS; i++) pthread_create(&th[i], NULL, storm_worker, NULL);
+    for (int i = 0; i < THREADS; i++) pthread_join(th[i], NULL);
+    double dt = now_sec() - t0;
+
+    int failures = 0;
+    for (int k = 0; k < KEYS; k++) {
+        if (g_applied[k] != 1) failures++;
+    }
+
+    long total = (long)THREADS * KEYS * RETRIES_PER_KEY;
+    printf("Requests: %ld | Applied once: %d/%d | Replays: %ld | Busy: %ld\n",
+           total, KEYS - failures, KEYS, g_replays, g_busy);
+    printf("Avg cost per request: %.1f ns (%d threads)\n", dt * 1e9 / total, THREADS);
+
+    /* ---------- Window expiry: same key after the window is new again ---------- */
+    uint8_t key[16];
+    IdemEntry *e;
+    int result;
+    uint32_t now = (uint32_t)time(NULL);
+    make_key(0, key);
+    uint32_t later = now + (IDEM_WINDOW_BUCKETS + 2) * IDEM_BUCKET_SECONDS;
+    if (idem_begin(g_table, key, later, &e, &result) != IDEM_NEW) {
+        printf("✗ Expired key was not treated as new\n");
+        failures++;
+    } else {
+        idem_complete(e, BANK_OK);
+    }
+
+    /* ---------- Clock skew: an entry from the next bucket is live, not expired ---------- */
+    make_key(1, key);
+    if (idem_begin(g_table, key, later + IDEM_BUCKET_SECONDS, &e, &result) == IDEM_NEW) idem_complete(e, BANK_OK);
+    if (idem_begin(g_table, key, later, &e, &result) != IDEM_DUPLICATE) {
+        printf("✗ Entry from a later bucket was overwritten by an earlier clock\n");
+        failures++;
+    }
+
+    failures += check_capacity();
+    failures += check_race();
+
+    printf("%s\n", failures ? "FAILED" : "PASS");
+    free(g_table);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+// 檔案: tests/test_index.c
+// Benchmark: external 64-bit ID hash index vs direct-index account lookup
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "bank.h"
+
+#define INSERT_THREADS 4
+#define KEYS_PER_THREAD 6000      // 24k keys -> load factor ~0.37
+#define CONTESTED_KEYS 1000       // 每個 thread 都搶著插入同一批 key
+#define LOOKUPS 5000000
+
+static AccountIndex *g_index;
+static uint64_t g_keys[INSERT_THREADS][KEYS_PER_THREAD];
+static uint64_t g_contested[CONTESTED_KEYS];
+static int g_contested_wins[INSERT_THREADS];
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift64: 產生稀疏的 64-bit 帳號
+static uint64_t next_rand(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static void* insert_worker(void *arg) {
+    int t = *(int*)arg;
+    for (int i = 0; i < KEYS_PER_THREAD; i++) {
+        int r = account_index_insert(g_index, g_keys[t][i], t * KEYS_PER_THREAD + i);
+        if (r != BANK_OK) fprintf(stderr, "[Index] insert failed: %d\n", r);
+        if (i < CONTESTED_KEYS) {
+            if (account_index_insert(g_index, g_contested[i], 900000 + i) == BANK_OK) {
+                g_contested_wins[t]++;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    printf("=== [Benchmark] External ID Index ===\n");
+
+    g_index = malloc(sizeof(AccountIndex));
+    if (!g_index) return 1;
+    account_index_init(g_index);
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (int t = 0; t < INSERT_THREADS; t++)
+        for (int i = 0; i < KEYS_PER_THREAD; i++) g_keys[t][i] = next_rand(&seed);
+    for (int i = 0; i < CONTESTED_KEYS; i++) g_contested[i] = next_rand(&seed);
+
+    /* ---------- 1. Concurrent inserts ---------- */
+    pthread_t th[INSERT_THREADS];
+    int ids[INSERT_THREADS];
+    double t0 = now_sec();
+    for (int t = 0; t < INSERT_THREADS; t++) {
+        ids[t] = t;
+        pthread_create(&th[t], NULL, insert_worker, &ids[t]);
+    }
+    for (int t = 0; t < INSERT_THREADS; t++) pthread_join(th[t], NULL);
+    double insert_time = now_sec() - t0;
+
+    int wins = 0;
+    for (int t = 0; t < INSERT_THREADS; t++) wins += g_contested_wins[t];
+    int failures = 0;
+    if (wins != CONTESTED_KEYS) {
+        printf("✗ Contested inserts: %d winners for %d keys\n", wins, CONTESTED_KEYS);
+        failures++;
+    }
+
+    /* ---------- 2. Verify every key ---------- */
+    for (int t = 0; t < INSERT_THREADS; t++)
+        for (int i = 0; i < KEYS_PER_THREAD; i++)
+            if (account_index_lookup(g_index, g_keys[t][i]) != t * KEYS_PER_THREAD + i) failures++;
+    for (int i = 0; i < CONTESTED_KEYS; i++)
+        if (account_index_lookup(g_index, g_contested[i]) != 900000 + i) failures++;
+
+    printf("Inserted %u keys with %d threads in %.2f ms (load factor %.2f) %s\n",
+           g_index->count, INSERT_THREADS, insert_time * 1e3,
+           (double)g_index->count / ACCOUNT_INDEX_CAPACITY, failures ? "FAILED" : "OK");
+
+    /* ---------- 3. Lookup cost vs direct index ---------- */
+    int32_t *balances = calloc(MAX_ACCOUNTS, sizeof(int32_t));
+    uint32_t *order = malloc(sizeof(uint32_t) * LOOKUPS);
+    for (int i = 0; i < LOOKUPS; i++) order[i] = (uint32_t)(next_rand(&seed) % (INSERT_THREADS * KEYS_PER_THREAD));
+
+    volatile int64_t sink = 0;
+
+    t0 = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        int id = (int)(order[i] % MAX_ACCOUNTS);
+        if (id >= 0 && id < MAX_ACCOUNTS) sink += balances[id];
+    }
+    double direct = now_sec() - t0;
+
+    t0 = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        uint32_t k = order[i];
+        sink += account_index_lookup(g_index, g_keys[k / KEYS_PER_THREAD][k % KEYS_PER_THREAD]);
+    }
+    double hit = now_sec() - t0;
+
+    t0 = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        sink += account_index_lookup(g_index, next_rand(&seed)); // 幾乎必定 miss
+    }
+    double miss = now_sec() - t0;
+
+    printf("%-24s: %6.2f ns/op\n", "direct index", direct * 1e9 / LOOKUPS);
+    printf("%-24s: %6.2f ns/op (+%.2f ns)\n", "hash index (hit)", hit * 1e9 / LOOKUPS,
+           (hit - direct) * 1e9 / LOOKUPS);
+    printf("%-24s: %6.2f ns/op\n", "hash index (miss)", miss * 1e9 / LOOKUPS);
+
+    free(order);
+    free(balances);
+    free(g_index);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// 檔案: tests/test_lanes.c
+// Read / write lanes: OP_BALANCE latency under growing OP_TRANSFER load, shared workers vs --read-workers
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "test_server_util.h"
+
+#define SERVER_PORT 8080
+#define READ_PORT 8081
+#define READERS 4
+#define READ_THINK_US 1000           // 讀取的 client 不是壓力來源：每次之間停 1 ms
+#define MAX_WRITERS 256
+#define MAX_SAMPLES (1 << 21)
+
+/*
+ * 同一組負載跑兩種 Server：
+ *   shared: ./bin/server              讀寫同一個 port、同一批 Worker、同一個 accept queue
+ *   lanes:  ./bin/server --read-workers 2   讀取走 8081 (自己的 Worker + accept queue + read lane)
+ * 每種都從 0 個轉帳 client 開始加壓 (W = 0, W1, W2, ...)，READERS 個讀取 client 一直在跑，
+ * 各 lane 分開統計 client 端的 p50 / p99 / p99.9
+ */
+
+typedef struct {
+    pthread_mutex_t lock;
+    double *lat_ms;
+    long n, failed;
+} Lane;
+
+static Lane g_read = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static Lane g_write = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static volatile int g_stop = 0;
+static int g_read_port = SERVER_PORT;
+
+// 一個請求 (新連線)，成功時記下延遲
+static void one_request(Lane *lane, int port, const uint8_t *pkt, size_t n) {
+    double t0 = now_sec();
+    int fd = connect_server(port);
+    int ok = 0;
+    if (fd >= 0) {
+        PacketHeader h;
+        void *body = NULL;
+        if (write(fd, pkt, n) == (ssize_t)n && protocol_read_packet(fd, &h, &body) == 0) ok = 1;
+        free(body);
+        close(fd);
+    }
+    double ms = (now_sec() - t0) * 1e3;
+    pthread_mutex_lock(&lane->lock);
+    if (ok && lane->n < MAX_SAMPLES) lane->lat_ms[lane->n++] = ms;
+    if (!ok) lane->failed++;
+    pthread_mutex_unlock(&lane->lock);
+    if (!ok) usleep(10000);
+}
+
+static void *reader_thread(void *arg) {
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    uint8_t pkt[64];
+    while (!g_stop) {
+        int account = htonl((int)(rand_r(&seed) % 100));
+        size_t n = build_packet(pkt, OP_BALANCE, &account, sizeof(account));
+        one_request(&g_read, g_read_port, pkt, n);
+        usleep(READ_THINK_US);
+    }
+    return NULL;
+}
+
+// 轉帳 client：closed loop，沒有停頓 (來回轉 1 元，餘額不會用完)
+static void *writer_thread(void *arg) {
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    uint8_t pkt[64];
+    while (!g_stop) {
+        int a = (int)(rand_r(&seed) % 100), b = (a + 1 + (int)(rand_r(&seed) % 99)) % 100;
+        TransferBody tf = { htonl(a), htonl(b), htonl(1) };
+        size_t n = build_packet(pkt, OP_TRANSFER, &tf, sizeof(tf));
+        one_request(&g_write, SERVER_PORT, pkt, n);
+    }
+    return NULL;
+}
+
+static double pct(const Lane *l, double p) {
+    return l->n ? l->lat_ms[(long)((l->n - 1) * p)] : 0;
+}
+
+typedef struct {
+    double read_rps, read_p50, read_p99, read_p999;
+    double write_rps, write_p50, write_p99, write_p999;
+    long failed;
+} Phase;
+
+static Phase run_phase(int writers, int seconds) {
+    pthread_t rd[READERS], wr[MAX_WRITERS];
+    g_read.n = g_write.n = g_read.failed = g_write.failed = 0;
+    g_stop = 0;
+    for (int i = 0; i < writers; i++) pthread_create(&wr[i], NULL, writer_thread, (void *)(uintptr_t)(i * 7919 + 3));
+    usleep(200000);   // 轉帳先跑起來再開始量
+    g_read.n = g_write.n = 0;
+    double t0 = now_sec();
+    for (int i = 0; i < READERS; i++) pthread_create(&rd[i], NULL, reader_thread, (void *)(uintptr_t)(i * 104729 + 1));
+    sleep((unsigned)seconds);
+    g_stop = 1;
+    for (int i = 0; i < READERS; i++) pthread_join(rd[i], NULL);
+    double secs = now_sec() - t0;
+    for (int i = 0; i < writers; i++) pthread_join(wr[i], NULL);
+
+    qsort(g_read.lat_ms, (size_t)g_read.n, sizeof(double), cmp_double);
+    qsort(g_write.lat_ms, (size_t)g_write.n, sizeof(double), cmp_double);
+    Phase p;
+    p.read_rps = g_read.n / secs;
+    p.read_p50 = pct(&g_read, 0.50);
+    p.read_p99 = pct(&g_read, 0.99);
+    p.read_p999 = pct(&g_read, 0.999);
+    p.write_rps = g_write.n / secs;
+    p.write_p50 = pct(&g_write, 0.50);
+    p.write_p99 = pct(&g_write, 0.99);
+    p.write_p999 = pct(&g_write, 0.999);
+    p.failed = g_read.failed + g_write.failed;
+    return p;
+}
+
+static int run_config(const char *bin, int lanes, const int *levels, int nlevels, int seconds, Phase *out) {
+    char *argv_shared[] = { (char *)bin, NULL };
+    char *argv_lanes[] = { (char *)bin, "--read-workers", "2", NULL };
+    pid_t pid = start_server(lanes ? argv_lanes : argv_shared, lanes ? READ_PORT : SERVER_PORT, 0);
+    if (pid < 0) {
+        fprintf(stderr, "[Error] Could not start %s\n", bin);
+        return -1;
+    }
+    g_read_port = lanes ? READ_PORT : SERVER_PORT;
+    printf("--- %s ---\n", lanes ? "lanes: --read-workers 2, reads on :8081" : "shared: one port, one worker pool");
+    printf("%-10s | %-38s | %-38s\n", "transfers", "OP_BALANCE req/s  p50 / p99 / p99.9 ms",
+           "OP_TRANSFER req/s  p50 / p99 / p99.9 ms");
+    for (int i = 0; i < nlevels; i++) {
+        out[i] = run_phase(levels[i], seconds);
+        printf("%4d conns | %7.0f  %6.2f / %6.2f / %7.2f     | %7.0f  %6.2f / %6.2f / %7.2f    %s\n", levels[i],
+               out[i].read_rps, out[i].read_p50, out[i].read_p99, out[i].read_p999, out[i].write_rps,
+               out[i].write_p50, out[i].write_p99, out[i].write_p999, out[i].failed ? "(failures)" : "");
+    }
+    stop_server(pid);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *bin = argc > 1 ? argv[1] : "./bin/server";
+    int max_writers = argc > 2 ? atoi(argv[2]) : 64;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+    if (max_writers < 1 || max_writers > MAX_WRITERS || seconds < 1) {
+        fprintf(stderr, "Usage: %s [server binary] [max transfer connections (max %d)] [seconds per step]\n",
+                argv[0], MAX_WRITERS);
+        return 1;
+    }
+    int probe = connect_server(SERVER_PORT);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] Something already listens on %s:%d (stop the server first)\n", SERVER_IP,
+                SERVER_PORT);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    g_read.lat_ms = malloc(sizeof(double) * MAX_SAMPLES);
+    g_write.lat_ms = malloc(sizeof(double) * MAX_SAMPLES);
+    if (!g_read.lat_ms || !g_write.lat_ms) return 1;
+
+    int levels[4] = { 0, max_writers / 4, max_writers / 2, max_writers };
+    printf("=== [Benchmark] Read / Write Lanes (%d readers, up to %d transfer connections, %d s per step) ===\n",
+           READERS, max_writers, seconds);
+    Phase shared[4], lanes[4];
+    if (run_config(bin, 0, levels, 4, seconds, shared) != 0) return 1;
+    if (run_config(bin, 1, levels, 4, seconds, lanes) != 0) return 1;
+
+    // 讀取的 p99：滿載 / 沒有轉帳
+    double grow_shared = shared[0].read_p99 > 0 ? shared[3].read_p99 / shared[0].read_p99 : 0;
+    double grow_lanes = lanes[0].read_p99 > 0 ? lanes[3].read_p99 / lanes[0].read_p99 : 0;
+    printf("OP_BALANCE p99 at %d transfer conns vs none: shared %.1fx, lanes %.1fx\n", max_writers, grow_shared,
+           grow_lanes);
+    // 共用 accept queue 滿了的時候 SYN 被丟，要等 ~1 s 重送：這些讀取落在 p99 之上，p99 看不出來，
+    // 所以看讀取吞吐 (讀取 client 是 closed loop，被卡住的 1 s 直接少做事) 或 p99.9
+    int ok = (lanes[3].read_rps > shared[3].read_rps || lanes[3].read_p999 < shared[3].read_p999) &&
+             lanes[3].write_rps > 0 && lanes[3].read_rps > 0;
+    printf("OP_BALANCE at %d transfer conns: shared %.0f req/s p99.9 %.2f ms, lanes %.0f req/s p99.9 %.2f ms\n",
+           max_writers, shared[3].read_rps, shared[3].read_p999, lanes[3].read_rps, lanes[3].read_p999);
+    free(g_read.lat_ms);
+    free(g_write.lat_ms);
+    printf("Result: %s (reads under full transfer load: more req/s or lower p99.9 with lanes)\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// 檔案: tests/test_lockprof.c
+// Lock contention profiler: SpaceSaving top-N accuracy, per-transfer overhead off / on, hot accounts under load
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "bank.h"
+#include "metrics.h"
+
+#define SKETCH_KEYS 5000             // 1. 不同的鎖 (Zipf 分布)
+#define SKETCH_EVENTS 500000
+#define SKETCH_CHECK_TOP 10          //    真正前 10 名有幾個在報表裡 (只報告)
+#define BENCH_TRANSFERS 2000000      // 2. 單一行程的 bank_transfer 成本
+#define WORKERS 4                    // 3. 多個 Worker 搶少數熱帳戶
+#define LOAD_TRANSFERS 500000
+#define HOT_ACCOUNTS 3
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+// 1. 合成的等待事件直接餵給 sketch，和精確的每把鎖總和比對
+static int check_sketch(void) {
+    static double cdf[SKETCH_KEYS];
+    static uint64_t truth[SKETCH_KEYS];
+    double z = 0;
+    for (int k = 0; k < SKETCH_KEYS; k++) z += 1.0 / pow(k + 1, 1.1);
+    double acc = 0;
+    for (int k = 0; k < SKETCH_KEYS; k++) cdf[k] = (acc += 1.0 / pow(k + 1, 1.1) / z);
+
+    metrics_bind_worker(0);
+    uint64_t seed = 88172645463325252ULL, total = 0;
+    for (int i = 0; i < SKETCH_EVENTS; i++) {
+        double u = (double)(xorshift(&seed) % 1000000) / 1e6;
+        int lo = 0, hi = SKETCH_KEYS - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (cdf[mid] < u) lo = mid + 1;
+            else hi = mid;
+        }
+        // 鍵打散 (熱的不一定是小 id)，等待 200 ns ~ 5 us
+        int32_t account = (int32_t)((lo * 2654435761u) % 1000003u);
+        uint64_t wait = 200 + xorshift(&seed) % 4800;
+        truth[lo] += wait;
+        total += wait;
+        int hint = metrics_lock_acquired(account, wait);
+        metrics_lock_released(account, hint, 1000);
+    }
+
+    static LockHotEntry top[METRICS_LOCK_TOPK];
+    int n = metrics_lock_top(metrics_region(), top, METRICS_LOCK_TOPK);
+    const LockProfile *p = &metrics_region()->lockprof[0];
+
+    // 真正的前 N 名 (truth 已經依 Zipf 排名大致遞減，仍然排序一次)
+    int order[SKETCH_KEYS];
+    for (int k = 0; k < SKETCH_KEYS; k++) order[k] = k;
+    for (int i = 0; i < SKETCH_CHECK_TOP; i++)
+        for (int j = i + 1; j < SKETCH_KEYS; j++)
+            if (truth[order[j]] > truth[order[i]]) {
+                int t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+            }
+
+    // SpaceSaving 保證：總等待 > total / K 的鎖一定在表裡，且 weight - error <= 真值 <= weight
+    int guaranteed = 0, missing = 0, bound_errors = 0, found_top = 0;
+    for (int k = 0; k < SKETCH_KEYS; k++) {
+        int32_t account = (int32_t)((k * 2654435761u) % 1000003u);
+        int j = 0;
+        while (j < n && top[j].account != account) j++;
+        if (j < n) {
+            if (top[j].weight_ns < truth[k] || top[j].weight_ns - top[j].error_ns > truth[k]) bound_errors++;
+        }
+        if (truth[k] > total / METRICS_LOCK_TOPK) {
+            guaranteed++;
+            if (j == n) missing++;
+        }
+    }
+    for (int i = 0; i < SKETCH_CHECK_TOP; i++) {
+        int32_t account = (int32_t)((order[i] * 2654435761u) % 1000003u);
+        for (int j = 0; j < SKETCH_CHECK_TOP; j++) found_top += top[j].account == account;
+    }
+    int ok = guaranteed > 0 && missing == 0 && bound_errors == 0;
+    printf("%-28s: %d keys, %d events, K=%d -> %d/%d locks above total/K kept, error bounds %s, "
+           "reported top %d = true top %d for %d/%d, %lu evictions | %s\n", "SpaceSaving top-N", SKETCH_KEYS,
+           SKETCH_EVENTS, METRICS_LOCK_TOPK, guaranteed - missing, guaranteed, bound_errors ? "VIOLATED" : "hold",
+           SKETCH_CHECK_TOP, SKETCH_CHECK_TOP, found_top, SKETCH_CHECK_TOP, (unsigned long)p->evictions,
+           ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+// 1b. 重啟的 Worker 接手同一個 slot：SHM 裡已經有的帳戶要接著累加，不能再佔一格
+static int rebind_run(int worker, int accounts) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        metrics_bind_worker(worker);
+        for (int32_t a = 0; a < accounts; a++) metrics_lock_released(a, metrics_lock_acquired(a, 1000), 100);
+        exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int check_rebind(void) {
+    const int worker = 1, accounts = 5;
+    const LockProfile *p = &metrics_region()->lockprof[worker];
+    int bad = !rebind_run(worker, accounts) || !rebind_run(worker, accounts);
+    bad += p->used != (uint32_t)accounts;
+    for (int i = 0; i < accounts && i < METRICS_LOCK_TOPK; i++)
+        bad += p->top[i].account != i || p->top[i].waits != 2 || p->top[i].wait_ns != 2000;
+    printf("%-28s: 2 processes on worker slot %d, %d accounts each -> %u entries | %s\n", "worker restart", worker,
+           accounts, p->used, bad ? "FAILED" : "PASS");
+    memset((void *)p, 0, sizeof(LockProfile));
+    return bad == 0;
+}
+
+// 2. 同一個工作量，profiler 關 / 開 (每次都在新的行程裡，slot 0 都先清空)
+static double transfer_cost(int profile) {
+    int pfd[2];
+    double ns = -1;
+    if (pipe(pfd) != 0) return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        metrics_bind_worker(0);
+        if (profile && bank_lock_profile_enable() != 0) exit(1);
+        uint64_t seed = 12345;
+        double t0 = now_sec();
+        for (int i = 0; i < BENCH_TRANSFERS; i++) {
+            int src = (int)(xorshift(&seed) % MAX_ACCOUNTS), dst = (int)(xorshift(&seed) % MAX_ACCOUNTS);
+            metrics_req_begin();
+            bank_transfer(src, dst == src ? (dst + 1) % MAX_ACCOUNTS : dst, 1);
+        }
+        double r = (now_sec() - t0) * 1e9 / BENCH_TRANSFERS;
+        exit(write(pfd[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+    }
+    if (read(pfd[0], &ns, sizeof(ns)) != sizeof(ns)) ns = -1;
+    waitpid(pid, NULL, 0);
+    close(pfd[0]);
+    close(pfd[1]);
+    return ns;
+}
+
+int main() {
+    printf("=== [Benchmark] Lock Contention Profiler ===\n");
+
+    int probe = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (probe < 0) probe = shm_open(SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s / %s already exist (server running?)\n", SHM_NAME, METRICS_SHM_NAME);
+        return 1;
+    }
+    if (bank_init() != 0) return 1;
+    if (metrics_init(WORKERS, 0) != 0) {
+        bank_destroy();
+        return 1;
+    }
+    BankMap *bank = get_bank_map();
+    for (int i = 0; i < MAX_ACCOUNTS; i++) bank->balances[i] = 1000000;
+
+    // 1. 準確度
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) exit(check_sketch());
+    int status;
+    waitpid(pid, &status, 0);
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    memset((void *)&((MetricsShm *)metrics_region())->lockprof[0], 0, sizeof(LockProfile));
+    ok &= check_rebind();
+
+    // 2. 成本：關閉時只多一個分支；開啟時每把鎖多兩次 clock_gettime + 最多 K 格的掃描
+    double off = transfer_cost(0), on = transfer_cost(1);
+    printf("%-28s: off %.1f ns, on %.1f ns (+%.1f ns, 2 locks per transfer)\n", "bank_transfer cost", off, on,
+           on - off);
+    ok &= off > 0 && on > 0;
+
+    // 3. 多個 Worker、一半的轉帳從 3 個熱帳戶轉出：熱帳戶應該排在最前面
+    const MetricsShm *m = metrics_region();
+    memset((void *)&((MetricsShm *)m)->lockprof, 0, sizeof(m->lockprof));
+    bank_lock_profile_enable();
+    int64_t before = 0;
+    for (int i = 0; i < MAX_ACCOUNTS; i++) before += bank->balances[i];
+    fflush(stdout);
+    double t0 = now_sec();
+    for (int w = 0; w < WORKERS; w++) {
+        if (fork() == 0) {
+            metrics_bind_worker(w);
+            uint64_t seed = 777 + (uint64_t)w;
+            for (int i = 0; i < LOAD_TRANSFERS; i++) {
+                int src = (i & 1) ? (int)(xorshift(&seed) % HOT_ACCOUNTS) : (int)(xorshift(&seed) % MAX_ACCOUNTS);
+                int dst = (int)(xorshift(&seed) % MAX_ACCOUNTS);
+                if (dst == src) dst = (dst + 1) % MAX_ACCOUNTS;
+                metrics_req_begin();
+                bank_transfer(src, dst, 1);
+            }
+            exit(0);
+        }
+    }
+    for (int w = 0; w < WORKERS; w++) wait(NULL);
+    double secs = now_sec() - t0;
+
+    int64_t after = 0;
+    for (int i = 0; i < MAX_ACCOUNTS; i++) after += bank->balances[i];
+    static LockHotEntry top[5];
+    int n = metrics_lock_top(m, top, 5);
+    uint64_t events = 0;
+    for (int w = 0; w < WORKERS; w++) events += m->lockprof[w].events;
+    int hot_first = n > 0 && top[0].account >= 0 && top[0].account < HOT_ACCOUNTS;
+    printf("%-28s: %d workers x %d transfers in %.2f s, %lu contended acquisitions (%ld CPUs)\n", "skewed load",
+           WORKERS, LOAD_TRANSFERS, secs, (unsigned long)events, sysconf(_SC_NPROCESSORS_ONLN));
+    for (int i = 0; i < n; i++)
+        printf("%-28s  #%-4d waits %7lu  wait %8.2f ms  avg hold %6.2f us  max hold %8.1f us\n", i ? "" : "hot locks",
+               top[i].account, (unsigned long)top[i].waits, top[i].wait_ns / 1e6,
+               top[i].acquisitions ? top[i].hold_ns / 1e3 / top[i].acquisitions : 0.0, top[i].hold_max_ns / 1e3);
+    // 單核心時只有被搶占的持鎖者會造成等待：數量可能很少，只在有等待時要求熱帳戶排第一
+    int load_ok = before == after && (events == 0 || hot_first);
+    printf("%-28s: money conserved %s, hottest lock is a hot account %s | %s\n", "skewed load",
+           before == after ? "yes" : "NO", events == 0 ? "(no contention seen)" : hot_first ? "yes" : "NO",
+           load_ok ? "PASS" : "FAILED");
+    ok &= load_ok;
+
+    metrics_cleanup();
+    bank_destroy();
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+// 檔案: tests/test_logmerge.c
+// Sharded audit log merge: out-of-order shard files and real sharded loggers -> one globally ordered view
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "logger.h"
+
+#define SHARDS 2
+#define SYN_BASE "logs/bench_merge_syn.bin"
+#define SYN_WORKERS 64               // 1. 合成的 shard 檔：worker w 在 shard w % SHARDS
+#define SYN_RECORDS 4000             //    每個 worker 幾筆
+#define SYN_BATCH 100                //    Logger 一次收一個 worker 的一批 -> 檔案裡不是時間順序
+#define SYN_JUMP_WORKER 5            //    這個 worker 的牆上時鐘中途往回跳
+#define SYN_JUMP_AT 2000
+#define SYN_JUMP_NS 5000000ULL
+
+#define LIVE_BASE "logs/bench_merge.bin"
+#define LIVE_WORKERS 4               // 2. 真的 Logger：SHARDS 個行程，Worker 走 SysV (mtype 1 + shard)
+#define LIVE_RECORDS 20000
+
+typedef struct {
+    uint64_t ts_ns;
+    uint32_t worker, seq;
+} Key;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int key_less(const Key *a, const Key *b) {
+    if (a->ts_ns != b->ts_ns) return a->ts_ns < b->ts_ns;
+    if (a->worker != b->worker) return a->worker < b->worker;
+    return a->seq < b->seq;
+}
+
+// ./bin/logmerge --csv 的輸出 (ts_ns, worker, seq)，回傳筆數，失敗 -1
+static long run_logmerge(const char *files, Key *out, long max, double *secs) {
+    char cmd[512], line[512];
+    snprintf(cmd, sizeof(cmd), "./bin/logmerge --csv %s 2>/dev/null", files);
+    double t0 = now_sec();
+    FILE *p = popen(cmd, "r");
+    if (!p) return -1;
+    long n = 0;
+    if (!fgets(line, sizeof(line), p)) n = -1;           // CSV 標頭
+    while (n >= 0 && fgets(line, sizeof(line), p)) {
+        unsigned long long ts;
+        unsigned w, seq;
+        if (sscanf(line, "%llu,%*[^,],%u,%u,", &ts, &w, &seq) != 3) continue;
+        if (n < max) out[n] = (Key){ ts, w, seq };
+        n++;
+    }
+    if (pclose(p) != 0) return -1;
+    *secs = now_sec() - t0;
+    return n;
+}
+
+// 1. 合成的 shard 檔 (批次交錯、一個 worker 時鐘往回跳)：輸出必須跟「每個 worker 一條、
+//    依 (ts, worker, seq) 合併」完全一樣
+static uint64_t syn_ts(int w, int i) {
+    uint64_t ts = 1700000000000000000ULL + (uint64_t)i * 1000 + (uint64_t)w * 7;
+    if (w == SYN_JUMP_WORKER && i >= SYN_JUMP_AT) ts -= SYN_JUMP_NS;
+    return ts;
+}
+
+static int check_synthetic(void) {
+    char paths[SHARDS][256], files[600] = "";
+    AuditRecord batch[SYN_BATCH];
+    for (int k = 0; k < SHARDS; k++) {
+        AuditFile af;
+        logger_shard_path(SYN_BASE, k, paths[k], sizeof(paths[k]));
+        unlink(paths[k]);
+        if (audit_open(&af, paths[k]) != 0) return 0;
+        for (int r = 0; r < SYN_RECORDS / SYN_BATCH; r++) {
+            for (int w = SYN_WORKERS - 1 - k; w >= 0; w -= SHARDS) {   // 倒著收：後面的 worker 先寫
+                memset(batch, 0, sizeof(batch));
+                for (int j = 0; j < SYN_BATCH; j++) {
+                    int i = r * SYN_BATCH + j;
+                    batch[j].ts_ns = syn_ts(w, i);
+                    batch[j].seq = (uint32_t)i + 1;
+                    batch[j].worker_id = (uint16_t)w;
+                    batch[j].op_code = 0x30;
+                    batch[j].src_id = w;
+                    batch[j].amount = i;
+                }
+                if (audit_append(&af, batch, SYN_BATCH) != 0) return 0;
+            }
+        }
+        audit_close(&af);
+        strcat(files, paths[k]);
+        strcat(files, " ");
+    }
+
+    // 預期的順序：每個 worker 的串流頭裡最小的先出 (簡單的 O(N * W) 版本)
+    long total = (long)SYN_WORKERS * SYN_RECORDS;
+    Key *expect = malloc(sizeof(Key) * total), *got = malloc(sizeof(Key) * total);
+    if (!expect || !got) return 0;
+    int pos[SYN_WORKERS] = { 0 };
+    for (long n = 0; n < total; n++) {
+        int best = -1;
+        Key bk = { 0, 0, 0 };
+        for (int w = 0; w < SYN_WORKERS; w++) {
+            if (pos[w] == SYN_RECORDS) continue;
+            Key k = { syn_ts(w, pos[w]), (uint32_t)w, (uint32_t)pos[w] + 1 };
+            if (best < 0 || key_less(&k, &bk)) {
+                best = w;
+                bk = k;
+            }
+        }
+        expect[n] = bk;
+        pos[best]++;
+    }
+
+    double secs = 0;
+    long n = run_logmerge(files, got, total, &secs);
+    long mismatches = 0;
+    for (long i = 0; i < n && i < total; i++)
+        mismatches += got[i].ts_ns != expect[i].ts_ns || got[i].worker != expect[i].worker || got[i].seq != expect[i].seq;
+    int ok = n == total && mismatches == 0;
+    printf("%-10s: %d shards, %d workers x %d records in interleaved batches, 1 clock step back | "
+           "%ld/%ld merged, %ld out of place, %.0f ms | %s\n", "synthetic", SHARDS, SYN_WORKERS, SYN_RECORDS, n, total,
+           mismatches, secs * 1e3, ok ? "PASS" : "FAILED");
+    free(expect);
+    free(got);
+    for (int k = 0; k < SHARDS; k++) unlink(paths[k]);
+    return ok;
+}
+
+// 2. 真的 Logger：SHARDS 個 logger 行程各收自己的 worker (SysV mtype 1 + shard，滿了走 spill)，
+//    每個 shard 檔只有自己的 worker；合併後每個 worker 的 seq 連續、全域照 (ts, worker, seq)
+static int check_live(void) {
+    char paths[SHARDS][256], files[600] = "";
+    for (int k = 0; k < SHARDS; k++) {
+        logger_shard_path(LIVE_BASE, k, paths[k], sizeof(paths[k]));
+        unlink(paths[k]);
+    }
+    int mqid = logger_mq_init();
+    // 0 條 ring：Worker 一律走 SysV queue，只有 queue 滿了才寫 spill 檔
+    if (mqid < 0 || logger_ring_init(0) != 0 || logger_ring_set_shards(SHARDS) != 0 ||
+        logger_spill_init(LIVE_BASE, LIVE_WORKERS) != 0)
+        return 0;
+    fflush(stdout);
+
+    pid_t loggers[SHARDS], workers[LIVE_WORKERS];
+    for (int k = 0; k < SHARDS; k++) {
+        loggers[k] = fork();
+        if (loggers[k] == 0) {
+            if (!freopen("/dev/null", "w", stdout)) exit(1);
+            LoggerConfig cfg;
+            logger_config_default(&cfg);
+            snprintf(cfg.path, sizeof(cfg.path), "%s", LIVE_BASE);
+            cfg.format = LOG_FORMAT_BINARY;
+            cfg.shards = SHARDS;
+            logger_configure(&cfg);
+            logger_select_shard(k);
+            logger_main_loop(mqid);
+            exit(0);
+        }
+    }
+    for (int w = 0; w < LIVE_WORKERS; w++) {
+        workers[w] = fork();
+        if (workers[w] == 0) {
+            if (logger_bind_worker(w) != 0) exit(1);
+            for (int i = 0; i < LIVE_RECORDS; i++) logger_send_async(mqid, 0x30, 0, w, (w + 1) % LIVE_WORKERS, i);
+            exit(0);
+        }
+    }
+    int bad = 0;
+    for (int w = 0; w < LIVE_WORKERS; w++) {
+        int st;
+        waitpid(workers[w], &st, 0);
+        bad += !WIFEXITED(st) || WEXITSTATUS(st) != 0;
+    }
+    for (int k = 0; k < SHARDS; k++) kill(loggers[k], SIGTERM);   // 收完 queue / spill 才結束
+    for (int k = 0; k < SHARDS; k++) waitpid(loggers[k], NULL, 0);
+    logger_spill_cleanup();
+    logger_ring_cleanup();
+    logger_mq_cleanup(mqid);
+
+    // 每個 shard 檔只有 w % SHARDS == k 的 worker
+    long misrouted = 0, in_shards = 0;
+    for (int k = 0; k < SHARDS; k++) {
+        const AuditFileHeader *hdr;
+        uint64_t count;
+        size_t map_size;
+        const AuditRecord *recs = audit_map_readonly(paths[k], &hdr, &count, &map_size);
+        if (!recs) {
+            bad++;
+            continue;
+        }
+        for (uint64_t i = 0; i < count; i++) misrouted += recs[i].worker_id % SHARDS != (unsigned)k;
+        in_shards += (long)count;
+        audit_unmap(hdr, map_size);
+        strcat(files, paths[k]);
+        strcat(files, " ");
+    }
+
+    long total = (long)LIVE_WORKERS * LIVE_RECORDS;
+    Key *got = malloc(sizeof(Key) * total);
+    if (!got) return 0;
+    double secs = 0;
+    long n = run_logmerge(files, got, total, &secs);
+    uint32_t next_seq[LIVE_WORKERS] = { 0 };
+    long seq_errors = 0, order_errors = 0;
+    for (long i = 0; i < n && i < total; i++) {
+        uint32_t w = got[i].worker;
+        if (w >= LIVE_WORKERS || (next_seq[w] && got[i].seq != next_seq[w])) seq_errors++;
+        else next_seq[w] = got[i].seq + 1;
+        if (i > 0 && key_less(&got[i], &got[i - 1])) order_errors++;
+    }
+    int ok = !bad && misrouted == 0 && in_shards == total && n == total && seq_errors == 0 && order_errors == 0;
+    printf("%-10s: %d loggers, %d workers x %d records | %ld in shard files (%ld misrouted) | %ld merged, "
+           "%ld seq errors, %ld order errors | %s\n", "loggers", SHARDS, LIVE_WORKERS, LIVE_RECORDS, in_shards,
+           misrouted, n, seq_errors, order_errors, ok ? "PASS" : "FAILED");
+    free(got);
+    for (int k = 0; k < SHARDS; k++) unlink(paths[k]);
+    return ok;
+}
+
+int main() {
+    printf("=== [Test] Sharded Log Merge (logmerge over %d shards) ===\n", SHARDS);
+    mkdir("logs", 0777);
+
+    int probe = shm_open(LOG_RING_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", LOG_RING_SHM_NAME);
+        return 1;
+    }
+    int ok = check_synthetic();
+    ok &= check_live();
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
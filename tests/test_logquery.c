@@ -0,0 +1,278 @@
+// 檔案: tests/test_logquery.c
+// Segmented audit log: per-segment account index vs full scan
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "logger.h"
+
+#define SEGMENTS 8
+#define RECORDS_PER_SEGMENT 200000
+#define ACCOUNTS 10000
+#define QUERIES 200
+#define BENCH_BASE "logs/bench_query.bin"
+
+#define ROTATE_BASE "logs/bench_rotate.bin"
+#define ROTATE_PRESEED 1100      // 已經有超過 1024 個 segment (readdir 的順序是任意的)
+#define ROTATE_KEEP 8
+#define ROTATE_RECORDS 200000    // 32 bytes 一筆 = 6.1 MB，--log-rotate-mb 1 會換 6 次
+#define ROTATE_ACCOUNTS 1000
+#define ROTATE_CHECKS 20
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void segment_path(char *out, size_t len, int seg, const char *suffix) {
+    snprintf(out, len, AUDIT_SEGMENT_FMT "%s", BENCH_BASE, (unsigned)seg, suffix);
+}
+
+// 跟 Logger 一樣：append 一段、同時建 index、封存時寫出 .idx
+static int write_segments(void) {
+    AuditIndexBuilder *b = audit_index_new();
+    AuditRecord *recs = malloc(sizeof(AuditRecord) * RECORDS_PER_SEGMENT);
+    if (!b || !recs) return -1;
+    srand(11);
+    uint64_t ts = 1700000000ULL * 1000000000ULL;
+
+    for (int s = 1; s <= SEGMENTS; s++) {
+        char path[256], idx[256];
+        segment_path(path, sizeof(path), s, "");
+        segment_path(idx, sizeof(idx), s, AUDIT_INDEX_SUFFIX);
+        unlink(path);
+
+        AuditFile af;
+        if (audit_open(&af, path) != 0) return -1;
+        memset(recs, 0, sizeof(AuditRecord) * RECORDS_PER_SEGMENT);
+        for (int i = 0; i < RECORDS_PER_SEGMENT; i++) {
+            AuditRecord *r = &recs[i];
+            r->ts_ns = ts += 1000;
+            r->seq = (uint32_t)i;
+            r->op_code = (i % 10 == 0) ? 0x20 : 0x30;
+            r->src_id = rand() % ACCOUNTS;
+            r->dst_id = rand() % ACCOUNTS;
+            r->amount = 1;
+            audit_index_add(b, r, (uint32_t)(sizeof(AuditFileHeader) + (uint64_t)i * sizeof(AuditRecord)));
+        }
+        audit_append(&af, recs, RECORDS_PER_SEGMENT);
+        audit_close(&af);
+        if (audit_index_write(b, idx, LOG_FORMAT_BINARY) != 0) return -1;
+        audit_index_reset(b);
+    }
+    free(recs);
+    audit_index_free(b);
+    return 0;
+}
+
+static void rotate_cleanup(void) {
+    for (int s = 1; s <= ROTATE_PRESEED + 64; s++) {
+        char path[256];
+        snprintf(path, sizeof(path), AUDIT_SEGMENT_FMT, ROTATE_BASE, (unsigned)s);
+        unlink(path);
+        strcat(path, AUDIT_INDEX_SUFFIX);
+        unlink(path);
+    }
+}
+
+// ./bin/logquery 查一個帳戶：筆數與 amount 總和 (每筆 amount 都不一樣)
+static long run_logquery(int32_t account, int scan, long *amount_sum) {
+    char cmd[256], line[512];
+    snprintf(cmd, sizeof(cmd), "./bin/logquery --csv %s --account %d %s 2>/dev/null", scan ? "--scan" : "",
+             account, ROTATE_BASE);
+    FILE *p = popen(cmd, "r");
+    if (!p) return -1;
+    long n = 0;
+    *amount_sum = 0;
+    if (!fgets(line, sizeof(line), p)) n = -1;           // CSV 標頭
+    while (n >= 0 && fgets(line, sizeof(line), p)) {
+        char *col = line;
+        for (int c = 0; c < 8 && col; c++) {             // 第 9 欄 = amount
+            col = strchr(col, ',');
+            if (col) col++;
+        }
+        if (!col) continue;
+        *amount_sum += atol(col);
+        n++;
+    }
+    if (pclose(p) != 0) return -1;
+    return n;
+}
+
+// 真正的 Logger (rotation / 封存 / index / 保留) 在已經有 >1024 個 segment 的目錄裡寫，
+// 再用 logquery 跨所有 segment 查：新的 segment 必須接在最大編號後面、舊的照順序刪
+static int check_logger_rotation(void) {
+    rotate_cleanup();
+    for (int s = 1; s <= ROTATE_PRESEED; s++) {           // 前一次執行留下的 (空的) segment
+        char path[256];
+        AuditFile af;
+        snprintf(path, sizeof(path), AUDIT_SEGMENT_FMT, ROTATE_BASE, (unsigned)s);
+        if (audit_open(&af, path) != 0) return 0;
+        audit_close(&af);
+    }
+
+    int mqid = logger_mq_init();
+    if (mqid < 0 || logger_ring_init(1) != 0 || logger_spill_init(ROTATE_BASE, 1) != 0) return 0;
+    fflush(stdout);
+    pid_t logger = fork();
+    if (logger == 0) {
+        if (!freopen("/dev/null", "w", stdout)) exit(1);
+        LoggerConfig cfg;
+        logger_config_default(&cfg);
+        snprintf(cfg.path, sizeof(cfg.path), "%s", ROTATE_BASE);
+        cfg.format = LOG_FORMAT_BINARY;
+        cfg.rotate_mb = 1;
+        cfg.keep_segments = ROTATE_KEEP;
+        logger_configure(&cfg);
+        logger_main_loop(mqid);
+        exit(0);
+    }
+    logger_bind_worker(0);
+    LoggerStats *ls = logger_stats();
+    for (int i = 0; i < ROTATE_RECORDS; i++) {
+        // 不測背壓：ring + spill 裝不下時等 Logger 追上，一筆都不能丟
+        while (ls && i - (long)ls->records > LOG_SPILL_SLOTS / 2) usleep(1000);
+        logger_send_async(mqid, 0x30, 0, i % ROTATE_ACCOUNTS, (i * 7 + 1) % ROTATE_ACCOUNTS, i);
+    }
+    kill(logger, SIGTERM);                                // 收完、封存最後一個 segment 才結束
+    waitpid(logger, NULL, 0);
+    logger_spill_cleanup();
+    logger_ring_cleanup();
+    logger_mq_cleanup(mqid);
+
+    // 1. 留下來的剛好是最新的 ROTATE_KEEP 個：新寫的全部在 (有 .idx)，舊的從最小的開始刪
+    uint32_t segs[64], last = 0;
+    int total = 0, bad = 0;
+    int n = audit_segment_list(ROTATE_BASE, segs, 64, &last, &total);
+    int written = (int)last - ROTATE_PRESEED;
+    bad += total != ROTATE_KEEP || n != total || written < 6;
+    for (int i = 0; i < n; i++) {
+        char idx[256];
+        snprintf(idx, sizeof(idx), AUDIT_SEGMENT_FMT "%s", ROTATE_BASE, segs[i], AUDIT_INDEX_SUFFIX);
+        bad += segs[i] != last - (uint32_t)(n - 1 - i);                   // 連續、最新的幾個
+        bad += segs[i] > ROTATE_PRESEED && access(idx, R_OK) != 0;         // 新 segment 都有 index
+    }
+
+    // 2. logquery (index / 全掃) 跨 segment 查到的，跟送出去的一模一樣
+    int mismatches = 0;
+    for (int q = 0; q < ROTATE_CHECKS; q++) {
+        int32_t account = (q * 97) % ROTATE_ACCOUNTS;
+        long expect_n = 0, expect_sum = 0, sum_idx, sum_scan;
+        for (int i = 0; i < ROTATE_RECORDS; i++) {
+            if (i % ROTATE_ACCOUNTS == account || (i * 7 + 1) % ROTATE_ACCOUNTS == account) {
+                expect_n++;
+                expect_sum += i;
+            }
+        }
+        long got_idx = run_logquery(account, 0, &sum_idx);
+        long got_scan = run_logquery(account, 1, &sum_scan);
+        mismatches += got_idx != expect_n || sum_idx != expect_sum || got_scan != expect_n || sum_scan != expect_sum;
+    }
+    printf("%-12s: %d records via the logger, %d rotations after %d old segments, kept %d | "
+           "logquery %d/%d accounts exact | %s\n", "rotation", ROTATE_RECORDS, written - 1, ROTATE_PRESEED, total,
+           ROTATE_CHECKS - mismatches, ROTATE_CHECKS, bad || mismatches ? "FAILED" : "PASS");
+    rotate_cleanup();
+    return bad == 0 && mismatches == 0;
+}
+
+static int touches(const AuditRecord *r, int32_t account) {
+    int32_t ids[2];
+    int n = audit_record_accounts(r, ids);
+    for (int i = 0; i < n; i++) if (ids[i] == account) return 1;
+    return 0;
+}
+
+// 回傳命中筆數與所有命中 seq 的 checksum (兩種方法必須一致)
+static uint64_t query(int32_t account, int use_index, uint64_t *sum, uint64_t *read) {
+    uint64_t hits = 0;
+    for (int s = 1; s <= SEGMENTS; s++) {
+        char path[256], idx_path[256];
+        segment_path(path, sizeof(path), s, "");
+        segment_path(idx_path, sizeof(idx_path), s, AUDIT_INDEX_SUFFIX);
+
+        const AuditFileHeader *hdr;
+        uint64_t count;
+        size_t map_size;
+        const AuditRecord *recs = audit_map_readonly(path, &hdr, &count, &map_size);
+        if (!recs) continue;
+
+        AuditIndex idx;
+        if (use_index && audit_index_open(&idx, idx_path) == 0) {
+            uint32_t n;
+            const uint32_t *offs = audit_index_lookup(&idx, account, &n);
+            for (uint32_t i = 0; i < n; i++) {
+                const AuditRecord *r = &recs[(offs[i] - sizeof(AuditFileHeader)) / sizeof(AuditRecord)];
+                (*read)++;
+                if (touches(r, account)) { hits++; *sum += r->seq + (uint64_t)s * RECORDS_PER_SEGMENT; }
+            }
+            audit_index_close(&idx);
+        } else {
+            for (uint64_t i = 0; i < count; i++) {
+                (*read)++;
+                if (touches(&recs[i], account)) { hits++; *sum += recs[i].seq + (uint64_t)s * RECORDS_PER_SEGMENT; }
+            }
+        }
+        audit_unmap(hdr, map_size);
+    }
+    return hits;
+}
+
+int main() {
+    printf("=== [Benchmark] Segmented Audit Log Query (%d segments x %d records) ===\n",
+           SEGMENTS, RECORDS_PER_SEGMENT);
+    mkdir("logs", 0777);
+
+    int probe = shm_open(LOG_RING_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", LOG_RING_SHM_NAME);
+        return 1;
+    }
+    int rotation_ok = check_logger_rotation();
+    if (write_segments() != 0) {
+        fprintf(stderr, "[Error] failed to write segments\n");
+        return 1;
+    }
+
+    int failures = 0;
+    uint64_t idx_hits = 0, scan_hits = 0, idx_read = 0, scan_read = 0;
+    double idx_time = 0, scan_time = 0;
+    for (int q = 0; q < QUERIES; q++) {
+        int32_t account = (q * 7919) % ACCOUNTS;
+        uint64_t s1 = 0, s2 = 0;
+        double t0 = now_sec();
+        uint64_t h1 = query(account, 1, &s1, &idx_read);
+        double t1 = now_sec();
+        uint64_t h2 = query(account, 0, &s2, &scan_read);
+        double t2 = now_sec();
+        idx_time += t1 - t0;
+        scan_time += t2 - t1;
+        idx_hits += h1;
+        scan_hits += h2;
+        if (h1 != h2 || s1 != s2) failures++;
+    }
+
+    printf("%-12s: %8.3f ms/query | records read: %10llu | matches: %llu\n", "index",
+           idx_time * 1e3 / QUERIES, (unsigned long long)idx_read, (unsigned long long)idx_hits);
+    printf("%-12s: %8.3f ms/query | records read: %10llu | matches: %llu\n", "full scan",
+           scan_time * 1e3 / QUERIES, (unsigned long long)scan_read, (unsigned long long)scan_hits);
+    printf("Speedup: %.0fx | %s\n", scan_time / idx_time,
+           failures ? "FAILED (index and scan disagree)" : "PASS (identical results)");
+
+    for (int s = 1; s <= SEGMENTS; s++) {
+        char path[256];
+        segment_path(path, sizeof(path), s, "");
+        unlink(path);
+        segment_path(path, sizeof(path), s, AUDIT_INDEX_SUFFIX);
+        unlink(path);
+    }
+    return failures || !rotation_ok ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+// 檔案: tests/test_logring.c
+// Benchmark: SHM log rings vs SysV msgsnd as the audit log transport (with / without spill)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "logger.h"
+
+#define PRODUCERS 4
+#define RECORDS_PER_PRODUCER 100000
+#define PACED_RATE 100000        // records/s per producer (paced scenario)
+#define BENCH_LOG "logs/bench_logring.log"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 讀回 log：每個 producer 的紀錄必須照順序、不重複
+// Src = producer id, Amt = 該 producer 的序號；讀不到檔案回傳 -1
+static long verify_log(const char *path, int *order_errors) {
+    *order_errors = 0;
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    long last[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++) last[p] = -1;
+
+    char line[256];
+    long records = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char *src = strstr(line, "Src:");
+        char *amt = strstr(line, "Amt:$");
+        if (!src || !amt) continue; // LOGGER 說明行
+        int p = atoi(src + 4);
+        long seq = atol(amt + 5);
+        if (p < 0 || p >= PRODUCERS || seq <= last[p]) (*order_errors)++;
+        else last[p] = seq;
+        records++;
+    }
+    fclose(fp);
+    return records;
+}
+
+// rate = 0: 全速 burst；否則每個 producer 以 rate records/s 平均送出
+// use_spill: Ring / Queue 滿了改寫 spill 檔，應該 100% 送達且順序不變
+// 回傳 1 = log 讀得到且沒有順序錯誤
+static int run_transport(const char *name, int use_ring, int use_spill, int rate, double *producer_ns) {
+    unlink(BENCH_LOG);
+    int mqid = logger_mq_init();
+    // SysV 模式也建立 segment (0 條 ring)，才拿得到 Logger 的延遲 / 缺號統計
+    if (logger_ring_init(use_ring ? PRODUCERS : 0) != 0) return 0;
+    if (use_spill && logger_spill_init(BENCH_LOG, PRODUCERS) != 0) return 0;
+    fflush(stdout);
+
+    double t0 = now_sec();
+    pid_t logger = fork();
+    if (logger == 0) {
+        if (!freopen("/dev/null", "w", stdout)) exit(1);
+        LoggerConfig cfg;
+        logger_config_default(&cfg);
+        snprintf(cfg.path, sizeof(cfg.path), "%s", BENCH_LOG);
+        logger_configure(&cfg);
+        logger_main_loop(mqid);
+        exit(0);
+    }
+
+    pid_t producers[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers[p] = fork();
+        if (producers[p] == 0) {
+            if (!freopen("/dev/null", "w", stderr)) exit(1); // SysV 的 "log dropped" 訊息
+            logger_bind_worker(p); // SysV 模式也蓋上 worker id，Logger 才能算缺號
+            double s = now_sec();
+            for (int i = 0; i < RECORDS_PER_PRODUCER; i++) {
+                if (rate) while (now_sec() - s < (double)i / rate) {}
+                logger_send_async(mqid, 0x30, 0, p, 0, i);
+            }
+            producer_ns[p] = rate ? 0 : (now_sec() - s) * 1e9 / RECORDS_PER_PRODUCER;
+            exit(0);
+        }
+    }
+    for (int p = 0; p < PRODUCERS; p++) waitpid(producers[p], NULL, 0);
+
+    // Logger 收到 SIGTERM 會把剩下的全部收完、flush 後才結束
+    kill(logger, SIGTERM);
+    waitpid(logger, NULL, 0);
+    double secs = now_sec() - t0;
+
+    int order_errors = 0;
+    long sent = (long)PRODUCERS * RECORDS_PER_PRODUCER;
+    long delivered = verify_log(BENCH_LOG, &order_errors);
+    if (delivered < 0) {
+        fprintf(stderr, "[Error] %s: cannot read %s\n", name, BENCH_LOG);
+        if (use_spill) logger_spill_cleanup();
+        logger_ring_cleanup();
+        logger_mq_cleanup(mqid);
+        return 0;
+    }
+    double avg_ns = 0;
+    for (int p = 0; p < PRODUCERS; p++) avg_ns += producer_ns[p] / PRODUCERS;
+
+    char send_cost[32] = "      -      ";
+    if (!rate) snprintf(send_cost, sizeof(send_cost), "%7.1f ns/op", avg_ns);
+    uint64_t spilled = 0, merged = 0;
+    log_spill_stats(&spilled, &merged);
+    printf("%-11s: send %s | %7ld/%ld delivered (%5.1f%%) | %9.0f records/s | order errors: %d",
+           name, send_cost, delivered, sent, 100.0 * delivered / sent, delivered / secs, order_errors);
+    if (use_spill) printf(" | spilled %lu, merged %lu", (unsigned long)spilled, (unsigned long)merged);
+    LoggerStats *ls = logger_stats();
+    printf("\n%-11s  lag p50 <= %lu us, p99 <= %lu us, max %lu us | seq gaps: %lu (lost %ld)\n", "",
+           (unsigned long)logger_lag_percentile_us(ls, 50.0), (unsigned long)logger_lag_percentile_us(ls, 99.0),
+           (unsigned long)(ls->lag_max_ns / 1000), (unsigned long)ls->seq_gaps, sent - delivered);
+
+    if (use_spill) logger_spill_cleanup();
+    logger_ring_cleanup();
+    logger_mq_cleanup(mqid);
+    unlink(BENCH_LOG);
+    return order_errors == 0;
+}
+
+int main() {
+    printf("=== [Benchmark] Audit Log Transport (%d producers x %d records) ===\n",
+           PRODUCERS, RECORDS_PER_PRODUCER);
+
+    int probe = shm_open(LOG_RING_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", LOG_RING_SHM_NAME);
+        return 1;
+    }
+    mkdir("logs", 0777);
+
+    // Producer 是子行程：結果放在共享的匿名記憶體
+    double *producer_ns = mmap(NULL, sizeof(double) * PRODUCERS, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (producer_ns == MAP_FAILED) return 1;
+
+    int ok = 1;
+    printf("--- Burst (producers as fast as possible) ---\n");
+    ok &= run_transport("sysv", 0, 0, 0, producer_ns);
+    ok &= run_transport("ring", 1, 0, 0, producer_ns);
+    ok &= run_transport("sysv+spill", 0, 1, 0, producer_ns);
+    ok &= run_transport("ring+spill", 1, 1, 0, producer_ns);
+    printf("--- Paced (%d records/s per producer) ---\n", PACED_RATE);
+    ok &= run_transport("sysv", 0, 0, PACED_RATE, producer_ns);
+    ok &= run_transport("ring", 1, 0, PACED_RATE, producer_ns);
+    ok &= run_transport("sysv+spill", 0, 1, PACED_RATE, producer_ns);
+    ok &= run_transport("ring+spill", 1, 1, PACED_RATE, producer_ns);
+
+    munmap(producer_ns, sizeof(double) * PRODUCERS);
+    printf("Result: %s (every log readable, no order errors)\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
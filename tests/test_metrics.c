@@ -0,0 +1,184 @@
+// 檔案: tests/test_metrics.c
+// SHM metrics page: publish cost per request, latency histogram accuracy, reader consistency, old msgctl monitor cost
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "metrics.h"
+#include "protocol.h"
+
+#define WRITERS 4
+#define REQUESTS_PER_WRITER 5000000
+#define MSGCTL_CALLS 200000
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t total_requests(const WorkerMetrics *w) {
+    uint64_t t = 0;
+    for (int i = 0; i < METRICS_OPS; i++) t += w->requests[i];
+    return t;
+}
+
+int main() {
+    printf("=== [Benchmark] SHM Metrics Page (%d writers x %d requests) ===\n", WRITERS, REQUESTS_PER_WRITER);
+
+    int probe = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", METRICS_SHM_NAME);
+        return 1;
+    }
+    if (metrics_init(WRITERS, 1) != 0) return 1;
+
+    // 1. 發布的成本：每個請求 = 一次 metrics_count_request (失敗的再多兩個 counter)
+    WorkerMetrics scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    double t0 = now_sec();
+    for (int i = 0; i < REQUESTS_PER_WRITER; i++)
+        metrics_count_request(&scratch, OP_TRANSFER, (i & 15) ? 0 : -5);
+    double ns_single = (now_sec() - t0) * 1e9 / REQUESTS_PER_WRITER;
+
+    volatile uint64_t shared = 0;
+    t0 = now_sec();
+    for (int i = 0; i < REQUESTS_PER_WRITER; i++) __atomic_fetch_add(&shared, 1, __ATOMIC_RELAXED);
+    double ns_xadd = (now_sec() - t0) * 1e9 / REQUESTS_PER_WRITER;
+    printf("%-30s: %6.1f ns/request (one counter with lock xadd: %.1f ns)\n",
+           "metrics_count_request", ns_single, ns_xadd);
+
+    // 2. 舊的 Monitor：每 1 ms 一次 msgctl(IPC_STAT) = 一次 system call
+    int mqid = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+    double ns_msgctl = 0;
+    if (mqid != -1) {
+        struct msqid_ds ds;
+        t0 = now_sec();
+        for (int i = 0; i < MSGCTL_CALLS; i++) msgctl(mqid, IPC_STAT, &ds);
+        ns_msgctl = (now_sec() - t0) * 1e9 / MSGCTL_CALLS;
+        msgctl(mqid, IPC_RMID, NULL);
+    }
+    printf("%-30s: %6.1f ns/call (old monitor: 1000 calls/s + a printf, forever)\n", "msgctl(IPC_STAT)", ns_msgctl);
+
+    // 3. 直方圖：每個值都落在 upper >= v 且誤差 <= 1/8 的 bucket，百分位數對得上
+    int hist_ok = 1;
+    for (uint64_t v = 0; v < (1ULL << 36); v = v < 4096 ? v + 1 : v + v / 997) {
+        int b = metrics_lat_bucket(v);
+        uint64_t up = metrics_lat_bucket_upper(b);
+        if (b < 0 || b >= METRICS_LAT_BUCKETS || (b + 1 < METRICS_LAT_BUCKETS && (up < v || up - v > v / 8)) ||
+            (b > 0 && metrics_lat_bucket_upper(b - 1) >= v)) {
+            hist_ok = 0;
+            break;
+        }
+    }
+    static LatencyHist h;
+    for (uint64_t v = 1; v <= 100000; v++) metrics_hist_record(&h, v * 1000);   // 1 us .. 100 ms 均勻分布
+    double p50 = metrics_lat_percentile(&h, 50.0) / 1e6, p99 = metrics_lat_percentile(&h, 99.0) / 1e6;
+    hist_ok &= p50 >= 50.0 && p50 <= 50.0 * 1.125 && p99 >= 99.0 && p99 <= 100.0 &&
+               metrics_lat_percentile(&h, 100.0) == h.max_ns && h.count == 100000;
+    printf("%-30s: p50 %.2f ms (exact 50), p99 %.2f ms (exact 99), %d buckets | %s\n", "histogram accuracy", p50, p99,
+           METRICS_LAT_BUCKETS, hist_ok ? "PASS" : "FAILED");
+
+    // 每個請求完整的記錄成本：begin + 4 個 stage + end (counter + 5 個直方圖)
+    double ns_req = 0;
+    int pfd[2];
+    if (pipe(pfd) != 0) return 1;
+    fflush(stdout);
+    pid_t cost = fork();
+    if (cost == 0) {
+        metrics_bind_worker(0);
+        t0 = now_sec();
+        for (int i = 0; i < REQUESTS_PER_WRITER; i++) {
+            metrics_req_begin();
+            metrics_stage_set(METRICS_STAGE_PARSE, 2000 + (i & 1023));
+            metrics_stage_add(METRICS_STAGE_LOCK, 0);
+            metrics_stage_add(METRICS_STAGE_LOG, 150);
+            metrics_stage_set(METRICS_STAGE_TOTAL, 9000 + (i & 4095));
+            metrics_req_end(OP_TRANSFER, 0);
+        }
+        double ns = (now_sec() - t0) * 1e9 / REQUESTS_PER_WRITER;
+        exit(write(pfd[1], &ns, sizeof(ns)) == sizeof(ns) ? 0 : 1);
+    }
+    if (read(pfd[0], &ns_req, sizeof(ns_req)) != sizeof(ns_req)) ns_req = -1;
+    waitpid(cost, NULL, 0);
+    close(pfd[0]);
+    close(pfd[1]);
+    const MetricsShm *live = metrics_region();
+    LatencyHist merged;
+    metrics_merge_latency(live, METRICS_OP_TRANSFER, METRICS_STAGE_LOG, &merged);
+    int rec_ok = merged.count == REQUESTS_PER_WRITER && live->workers[0].requests[METRICS_OP_TRANSFER] ==
+                 REQUESTS_PER_WRITER;
+    printf("%-30s: %6.1f ns/request (4 stages + total) | %s\n", "metrics_req_begin..end", ns_req,
+           rec_ok ? "PASS" : "FAILED");
+    hist_ok &= rec_ok;
+    // 清掉這一段的資料，下面的總數檢查從 0 開始
+    memset((void *)&((MetricsShm *)live)->workers[0], 0, sizeof(WorkerMetrics));
+    memset((void *)((MetricsShm *)live)->latency[0], 0, sizeof(live->latency[0]));
+
+    // 4. 多個 Worker 同時寫、讀者一邊取樣：每個 counter 只會變大，最後總數要剛好
+    fflush(stdout);
+    pid_t pids[WRITERS];
+    for (int w = 0; w < WRITERS; w++) {
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            WorkerMetrics *m = metrics_bind_worker(w);
+            for (int i = 0; i < REQUESTS_PER_WRITER; i++) {
+                metrics_count_request(m, (i & 1) ? OP_BALANCE : OP_TRANSFER, (i % 10 == 0) ? -5 : 0);
+                if (i % 1000 == 0) metrics_lock_wait(100);
+            }
+            exit(0);
+        }
+    }
+
+    char err[160];
+    const MetricsShm *view = metrics_attach(err, sizeof(err));
+    if (!view) {
+        fprintf(stderr, "[Error] %s\n", err);
+        return 1;
+    }
+    static MetricsShm snap;
+    WorkerMetrics sum;
+    uint64_t last = 0, samples = 0, regressions = 0;
+    int running = WRITERS;
+    t0 = now_sec();
+    while (running > 0) {
+        metrics_snapshot(view, &snap);
+        metrics_sum_workers(&snap, &sum);
+        uint64_t t = total_requests(&sum);
+        if (t < last) regressions++;
+        last = t;
+        samples++;
+        while (running > 0 && waitpid(-1, NULL, WNOHANG) > 0) running--;
+    }
+    double secs = now_sec() - t0;
+
+    metrics_snapshot(view, &snap);
+    metrics_sum_workers(&snap, &sum);
+    uint64_t expect = (uint64_t)WRITERS * REQUESTS_PER_WRITER;
+    int ok = total_requests(&sum) == expect && sum.failures[METRICS_OP_TRANSFER] + sum.failures[METRICS_OP_BALANCE] ==
+             sum.errors[5] && sum.errors[5] == (uint64_t)WRITERS * (REQUESTS_PER_WRITER / 10) &&
+             sum.lock_waits == (uint64_t)WRITERS * (REQUESTS_PER_WRITER / 1000) && sum.pid == WRITERS &&
+             regressions == 0;
+    printf("%-30s: %lu/%lu requests, %lu %s errors, %lu samples while writing (%.0f/s), %lu went backwards | %s\n",
+           "concurrent writers + reader", (unsigned long)total_requests(&sum), (unsigned long)expect,
+           (unsigned long)sum.errors[5], metrics_error_name(5), (unsigned long)samples, samples / secs,
+           (unsigned long)regressions, ok ? "PASS" : "FAILED");
+
+    // 5. Server 結束後讀者必須看得出來 (magic = 0)
+    metrics_cleanup();
+    int gone = __atomic_load_n(&view->magic, __ATOMIC_ACQUIRE) == 0 && !metrics_attach(NULL, 0);
+    printf("%-30s: %s\n", "reader sees shutdown", gone ? "PASS" : "FAILED");
+    ok &= gone && hist_ok;
+    metrics_detach(view);
+
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -13,12 +13,14 @@
 #include <sys/time.h>   // 用於計算 TPS 微秒級時間
 #include <time.h>
 #include <math.h>       // 用於模擬正弦波流量
+#include <fcntl.h>
+#include <sys/mman.h>   // shm_open
+#include <sys/resource.h> // wait4 / rusage
 #include "logger.h"     
 
 // === 壓力測試設定 ===
 #define TEST_COUNT 30000        
 #define BATCH_UPDATE 500        
-#define ENCRYPTION_KEY 0xAB  
 
 // === 顏色定義 ===
 #define ANSI_COLOR_CYAN    "\x1b[36m"
@@ -42,20 +44,229 @@ long long current_timestamp() {
     return te.tv_sec * 1000000LL + te.tv_usec;
 }
 
-// [接收端] 解密並驗證 (僅抽樣檢查)
-void decrypt_and_verify(LogMessage *msg, int current_idx) {
-    if (current_idx % 1000 != 0 && msg->amount < 1000000) return;
+// ============================================================================
+// [Logger Throughput] ./test_monitor --logger
+// 同一批訊息分別交給「舊版逐筆 fopen/fclose」與「常駐 buffer writer」寫檔
+// ============================================================================
+#define BENCH_LEGACY_COUNT   2000     // 舊版太慢，只送少量
+#define BENCH_BUFFERED_COUNT 300000
+#define BENCH_LEGACY_PATH    "logs/bench_legacy.log"
 
-    size_t payload_size = sizeof(LogMessage) - sizeof(long);
-    // 指向 mtype 之後的資料開始 XOR
-    char *ptr = (char *)msg + sizeof(long);
-    
-    for (size_t i = 0; i < payload_size; i++) {
-        ptr[i] ^= ENCRYPTION_KEY;
+static volatile sig_atomic_t legacy_stop = 0;
+static void legacy_on_term(int sig) { (void)sig; legacy_stop = 1; }
+
+// 原本 logger_main_loop 的寫法：每筆都 mkdir + fopen + strftime + fclose
+static void legacy_logger_loop(int msqid) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = legacy_on_term;
+    sigaction(SIGTERM, &sa, NULL);
+
+    LogMessage msg;
+    size_t msg_size = sizeof(LogMessage) - sizeof(long);
+    while (!legacy_stop) {
+        if (msgrcv(msqid, &msg, msg_size, 1, 0) == -1) continue;
+
+        system("mkdir -p logs");
+        FILE *fp = fopen(BENCH_LEGACY_PATH, "a");
+        if (!fp) continue;
+        time_t now = time(NULL);
+        struct tm *t = localtime(&now);
+        char time_str[30];
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", t);
+        fprintf(fp, "[%s] CMD:%-10s | Status:%-8s | Src:%d -> Dst:%d | Amt:$%d\n",
+                time_str, "TRANSFER", msg.status == 0 ? "SUCCESS" : "FAILED",
+                msg.src_id, msg.dst_id, msg.amount);
+        fclose(fp);
     }
 }
 
-int main() {
+// 阻塞式送出 (Queue 滿就等)，讓瓶頸落在 Logger 而不是丟訊息
+static void bench_send(int msqid, int i) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    LogMessage msg = {
+        .mtype = 1, .cmd_type = 0x30, .status = 0, .src_id = 1001, .dst_id = 2001,
+        .amount = 100 + i % 5000, .worker_id = LOG_WORKER_NONE, .seq = (uint32_t)i + 1,
+        .ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec
+    };
+    while (msgsnd(msqid, &msg, sizeof(LogMessage) - sizeof(long), 0) == -1 && errno == EINTR) {}
+}
+
+static long count_lines(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    long lines = 0;
+    int c;
+    while ((c = getc_unlocked(fp)) != EOF) if (c == '\n') lines++;
+    fclose(fp);
+    return lines;
+}
+
+// 回傳 records/s；檔案內容必須剛好 count 行
+static double bench_one(const char *name, const char *path, int count, const LoggerConfig *cfg) {
+    unlink(path);
+    int msqid = logger_mq_init();
+    fflush(stdout);
+    if (msqid == -1) return 0;
+
+    LoggerStats *stats = logger_stats();
+    if (stats) memset(stats, 0, sizeof(*stats));
+
+    long long t0 = current_timestamp();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) exit(1); // Logger 的啟動訊息不要混進報表
+        if (cfg) {
+            logger_configure(cfg);
+            logger_main_loop(msqid);
+        } else {
+            legacy_logger_loop(msqid);
+        }
+        exit(0);
+    }
+
+    for (int i = 0; i < count; i++) bench_send(msqid, i);
+
+    // 等 Logger 收完，再請它 flush 並結束
+    struct msqid_ds buf;
+    while (msgctl(msqid, IPC_STAT, &buf) == 0 && buf.msg_qnum > 0) usleep(100);
+    kill(pid, SIGTERM);
+    struct rusage ru;
+    wait4(pid, NULL, 0, &ru);
+    double secs = (current_timestamp() - t0) / 1000000.0;
+
+    // 紀錄數 / 檔案大小 / Logger 的 CPU 時間 (user + sys)
+    long lines;
+    if (cfg && cfg->format == LOG_FORMAT_BINARY) {
+        const AuditFileHeader *hdr;
+        uint64_t n = 0;
+        size_t map_size;
+        if (audit_map_readonly(path, &hdr, &n, &map_size)) audit_unmap(hdr, map_size);
+        lines = (long)n;
+    } else {
+        lines = count_lines(path);
+    }
+    struct stat st;
+    double bytes = (stat(path, &st) == 0) ? (double)st.st_size : 0;
+    double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+    double rate = lines / secs;
+    printf("%-28s: %8ld records in %7.3f s | %10.0f records/s | %5.1f B/rec | logger CPU %6.0f ns/rec %s\n",
+           name, lines, secs, rate, lines ? bytes / lines : 0, lines ? cpu * 1e9 / lines : 0,
+           lines == count ? "" : ANSI_COLOR_RED "(records lost!)" ANSI_COLOR_RESET);
+    if (cfg && stats && stats->batches) {
+        printf("%-28s  avg batch %6.1f | %6.1f records/writev | fill wait %5.1f us/batch\n", "",
+               (double)stats->records / stats->batches,
+               stats->writes ? (double)stats->records / stats->writes : 0.0,
+               (double)stats->batch_fill_us / stats->batches);
+    }
+
+    logger_mq_cleanup(msqid);
+    unlink(path);
+    return lines == count ? rate : 0;
+}
+
+// 只量「編碼」成本 (不含 IPC)：文字格式化 vs 固定長度二進位 append
+static void bench_encode(void) {
+    const int n = BENCH_BUFFERED_COUNT;
+    AuditRecord *recs = malloc(sizeof(AuditRecord) * n);
+    char *text = malloc((size_t)n * 160);
+    if (!recs || !text) return;
+    for (int i = 0; i < n; i++) {
+        LogMessage m = { .mtype = 1, .cmd_type = 0x30, .src_id = 1001, .dst_id = 2001,
+                         .amount = 100 + i % 5000, .seq = (uint32_t)i + 1,
+                         .ts_ns = 1700000000000000000ULL + (uint64_t)i * 1000 };
+        audit_record_from_msg(&recs[i], &m);
+    }
+
+    AuditTimeCache tc;
+    memset(&tc, 0, sizeof(tc));
+    long long t0 = current_timestamp();
+    size_t text_len = 0;
+    for (int i = 0; i < n; i++) text_len += (size_t)audit_format_text(text + text_len, 160, &recs[i], &tc);
+    double text_ns = (current_timestamp() - t0) * 1000.0 / n;
+
+    AuditFile af;
+    unlink("logs/bench_encode.bin");
+    double bin_ns = 0;
+    if (audit_open(&af, "logs/bench_encode.bin") == 0) {
+        t0 = current_timestamp();
+        for (int i = 0; i < n; i += 256) audit_append(&af, &recs[i], (n - i < 256) ? n - i : 256);
+        bin_ns = (current_timestamp() - t0) * 1000.0 / n;
+        audit_close(&af);
+    }
+    unlink("logs/bench_encode.bin");
+
+    printf("%-28s: text %6.1f ns/rec, %5.1f B/rec | binary %6.1f ns/rec, %5.1f B/rec\n", "encode only (no IPC)",
+           text_ns, (double)text_len / n, bin_ns, (double)sizeof(AuditRecord));
+    free(recs);
+    free(text);
+}
+
+static int run_logger_bench(void) {
+    printf("=== [Benchmark] Logger Throughput (SysV MQ -> log file) ===\n");
+    mkdir("logs", 0777);
+
+    // 只借用 segment 裡的 LoggerStats (0 條 ring)；別動到正在跑的 Server
+    int probe = shm_open(LOG_RING_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", LOG_RING_SHM_NAME);
+        return 1;
+    }
+    logger_ring_init(0);
+
+    LoggerConfig cfg;
+    logger_config_default(&cfg);
+    snprintf(cfg.path, sizeof(cfg.path), "logs/bench_buffered.log");
+
+    struct { const char *name; int format; int sync_policy; } modes[] = {
+        { "buffered (sync none)",     LOG_FORMAT_TEXT,   LOG_SYNC_NONE },
+        { "buffered (sync interval)", LOG_FORMAT_TEXT,   LOG_SYNC_INTERVAL },
+        { "buffered (sync flush)",    LOG_FORMAT_TEXT,   LOG_SYNC_FLUSH },
+        { "binary mmap (sync none)",  LOG_FORMAT_BINARY, LOG_SYNC_NONE },
+    };
+
+    double legacy = bench_one("legacy (fopen per record)", BENCH_LEGACY_PATH, BENCH_LEGACY_COUNT, NULL);
+    double best = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        cfg.format = modes[m].format;
+        cfg.sync_policy = modes[m].sync_policy;
+        snprintf(cfg.path, sizeof(cfg.path), "%s",
+                 cfg.format == LOG_FORMAT_BINARY ? "logs/bench_buffered.bin" : "logs/bench_buffered.log");
+        double r = bench_one(modes[m].name, cfg.path, BENCH_BUFFERED_COUNT, &cfg);
+        if (r > best) best = r;
+    }
+
+    bench_encode();
+
+    // 批次大小 / 等待時間的取捨：每批都直接 writev (flush_bytes = 1)
+    printf("--- Batch size vs latency (write-through: one writev per batch) ---\n");
+    struct { const char *name; unsigned batch; int wait_us; } batches[] = {
+        { "batch 1",                1,   0 },
+        { "batch 16",               16,  0 },
+        { "batch 256",              256, 0 },
+        { "batch 256 + wait 500us", 256, 500 },
+    };
+    cfg.format = LOG_FORMAT_TEXT;
+    cfg.sync_policy = LOG_SYNC_NONE;
+    cfg.flush_bytes = 1;
+    snprintf(cfg.path, sizeof(cfg.path), "logs/bench_buffered.log");
+    for (size_t m = 0; m < sizeof(batches) / sizeof(batches[0]); m++) {
+        cfg.batch_size = batches[m].batch;
+        cfg.batch_latency_us = batches[m].wait_us;
+        bench_one(batches[m].name, cfg.path, BENCH_BUFFERED_COUNT, &cfg);
+    }
+
+    logger_ring_cleanup();
+    if (legacy > 0 && best > 0) printf("Speedup vs legacy: %.0fx\n", best / legacy);
+    return (legacy > 0 && best > 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--logger") == 0) return run_logger_bench();
+
     signal(SIGINT, handle_signal);
     srand(time(NULL)); 
 
@@ -129,8 +340,6 @@ int main() {
             // 接收 (非阻塞)
             if (msgrcv(msqid, &msg, msg_size, 0, IPC_NOWAIT) != -1) {
                 total_received++;
-                
-                decrypt_and_verify(&msg, total_received);
 
                 if (fp) fprintf(fp, "Recv Log: Type=%d Amt=%d\n", msg.cmd_type, msg.amount);
 
@@ -0,0 +1,295 @@
+// 檔案: tests/test_overload.c
+// Overload goodput: impatient clients against ./bin/server, with and without --queue-budget-ms
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "bank.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "test_server_util.h"
+
+#define SERVER_PORT 8080
+#define MAX_CLIENTS 4096
+#define LISTEN_BACKLOG "4096"
+#define SERVER_NICE 10
+
+/*
+ * 一個 epoll 迴圈模擬 C 個沒耐心的 client (open connection -> TRANSFER -> 等回覆)：
+ *   T ms 內拿到回覆 (不是 OVERLOADED) = goodput
+ *   T ms 沒回覆 = 放棄、關掉連線、馬上重送 (舊的請求還在 Server 的 accept queue 裡 —— 之後白做)
+ *   OVERLOADED = 指數退避 (T, 2T, ... 16T，加 jitter) 之後再送
+ * 同一個 Server (listen backlog 一樣長) 跑兩次：沒有排隊預算 / --queue-budget-ms T/4
+ * Client 數 > Server 每秒處理量 * T 時，FIFO 的 accept queue 裡每個請求都等超過 T：
+ * 沒有預算的 Server 一直在做 client 已經放棄的請求 (goodput 掉到接近 0)
+ */
+
+enum { C_IDLE, C_CONNECTING, C_WAITING };
+
+typedef struct {
+    int fd;
+    int state;
+    int backoff;             // 連續被 shed 的次數
+    uint64_t start_ns;       // 這次請求開始 (connect) 的時間
+    uint64_t wake_ns;        // C_IDLE: 什麼時候再送
+    uint8_t resp[sizeof(PacketHeader) + sizeof(int)];   // 回覆 = 標頭 + ret_code
+    uint32_t got;
+} Client;
+
+typedef struct {
+    long good, shed, timeouts, errors;
+    double good_ms_sum;
+    uint64_t served;         // Server 端真的做完的 TRANSFER (不含 OVERLOADED)
+} RunResult;
+
+static Client g_clients[MAX_CLIENTS];
+static uint8_t g_pkt[64];
+static size_t g_pkt_len;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void build_transfer(void) {
+    TransferBody tf = { htonl(1), htonl(2), htonl(1) };
+    g_pkt_len = build_packet(g_pkt, OP_TRANSFER, &tf, sizeof(tf));
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 帶 idempotency key 的轉帳被 shed (OVERLOADED) 之後，同一把 key 重送要真的執行，
+// 不能在整個去重視窗內一直重播 OVERLOADED。write lane 先被佔滿，請求必然等到期限
+static int check_idem_retry(void) {
+    if (bank_init() != 0) return 0;
+    BankMap *bank = get_bank_map();
+    uint8_t key[16] = { 0x4F, 0x56, 0x4C, 0x44 };
+    int bad = 0, replayed = 0, before = 0, after = 0;
+    bad += bank_set_lane_limits(1, MAX_READ_CONCURRENCY) != BANK_OK;
+    bad += bank_get_balance(1, &before) != BANK_OK;
+
+    sem_wait(&bank->limit_sem);                       // lane 滿了
+    bank_set_deadline(realtime_ns() + 5000000ULL);    // 5 ms 後放棄
+    bad += bank_transfer_idem(key, 1, 2, 10, &replayed) != BANK_ERR_OVERLOADED;
+    sem_post(&bank->limit_sem);
+    bank_set_deadline(0);
+
+    int r = bank_transfer_idem(key, 1, 2, 10, &replayed);   // 重送：這次要真的轉
+    bad += r != BANK_OK || replayed;
+    r = bank_transfer_idem(key, 1, 2, 10, &replayed);       // 再重送：重播成功的結果
+    bad += r != BANK_OK || !replayed;
+    bad += bank_get_balance(1, &after) != BANK_OK || after != before - 10;
+    bank_destroy();
+
+    printf("%-20s: keyed transfer shed, retry with the same key executes once | %s\n", "idempotent retry",
+           bad ? "FAILED" : "PASS");
+    return bad == 0;
+}
+
+static void client_close(int ep, Client *c) {
+    if (c->fd >= 0) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    }
+    c->fd = -1;
+    c->state = C_IDLE;
+}
+
+static void client_start(int ep, Client *c, uint64_t now) {
+    static struct sockaddr_in addr;
+    if (!addr.sin_family) {
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(SERVER_PORT);
+        inet_pton(AF_INET, SERVER_IP, &addr.sin_addr);
+    }
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    c->start_ns = now;
+    c->got = 0;
+    if (c->fd < 0 || (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)) {
+        client_close(ep, c);
+        c->wake_ns = now + 10000000ULL;
+        return;
+    }
+    // loopback 的握手通常馬上完成：直接送請求 (資料和連線一起進 accept queue)，還沒好才等 EPOLLOUT
+    int sent = write(c->fd, g_pkt, g_pkt_len) == (ssize_t)g_pkt_len;
+    struct epoll_event ev = { .events = sent ? EPOLLIN : EPOLLOUT, .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev);
+    c->state = sent ? C_WAITING : C_CONNECTING;
+}
+
+// 退避：T * 2^k (最多 16T) 再加上 0..T 的 jitter
+static void client_backoff(Client *c, uint64_t now, uint64_t timeout_ns, unsigned *seed) {
+    uint64_t base = timeout_ns << (c->backoff < 4 ? c->backoff : 4);
+    c->backoff++;
+    c->wake_ns = now + base + (uint64_t)(rand_r(seed) % 1000) * (timeout_ns / 1000);
+}
+
+static void client_event(int ep, Client *c, uint32_t events, RunResult *r, uint64_t timeout_ns, unsigned *seed) {
+    uint64_t now = now_ns();
+    if (c->state == C_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err || (events & (EPOLLERR | EPOLLHUP)) || write(c->fd, g_pkt, g_pkt_len) != (ssize_t)g_pkt_len) {
+            r->errors++;
+            client_close(ep, c);
+            c->wake_ns = now + 10000000ULL;
+            return;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->state = C_WAITING;
+        return;
+    }
+    ssize_t n = read(c->fd, c->resp + c->got, sizeof(c->resp) - c->got);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n <= 0) {
+        r->errors++;
+        client_close(ep, c);
+        c->wake_ns = now + 10000000ULL;
+        return;
+    }
+    c->got += (uint32_t)n;
+    if (c->got < sizeof(c->resp)) return;
+    int ret;
+    memcpy(&ret, c->resp + sizeof(PacketHeader), sizeof(ret));
+    ret = (int)ntohl((uint32_t)ret);
+    client_close(ep, c);
+    if (ret == BANK_ERR_OVERLOADED) {
+        r->shed++;
+        client_backoff(c, now, timeout_ns, seed);
+    } else if (now - c->start_ns <= timeout_ns) {
+        r->good++;
+        r->good_ms_sum += (now - c->start_ns) / 1e6;
+        c->backoff = 0;
+        c->wake_ns = now;
+    } else {
+        r->timeouts++;   // 讀到的時候已經超過 T (epoll 迴圈本身慢)
+        c->wake_ns = now;
+    }
+}
+
+static RunResult run_clients(int nclients, int seconds, uint64_t timeout_ns) {
+    RunResult r;
+    memset(&r, 0, sizeof(r));
+    int ep = epoll_create1(0);
+    unsigned seed = 12345;
+    uint64_t t0 = now_ns(), end = t0 + (uint64_t)seconds * 1000000000ULL;
+    for (int i = 0; i < nclients; i++) {
+        g_clients[i].fd = -1;
+        g_clients[i].state = C_IDLE;
+        g_clients[i].backoff = 0;
+        g_clients[i].wake_ns = t0 + (uint64_t)(rand_r(&seed) % 1000) * 1000000ULL;   // 第一秒內陸續加入
+    }
+    static struct epoll_event evs[256];
+    uint64_t now = t0;
+    while (now < end) {
+        int n = epoll_wait(ep, evs, 256, 1);
+        for (int i = 0; i < n; i++) client_event(ep, evs[i].data.ptr, evs[i].events, &r, timeout_ns, &seed);
+        now = now_ns();
+        for (int i = 0; i < nclients; i++) {
+            Client *c = &g_clients[i];
+            if (c->state == C_IDLE) {
+                if (now >= c->wake_ns) client_start(ep, c, now);
+            } else if (now - c->start_ns > timeout_ns) {
+                r.timeouts++;        // 放棄：關掉連線、馬上重送
+                client_close(ep, c);
+                client_start(ep, c, now);
+            }
+        }
+    }
+    for (int i = 0; i < nclients; i++) client_close(ep, &g_clients[i]);
+    close(ep);
+    return r;
+}
+
+static int run(const char *bin, int budget_ms, int nclients, int seconds, uint64_t timeout_ns, RunResult *out) {
+    char budget[16];
+    snprintf(budget, sizeof(budget), "%d", budget_ms);
+    char *argv[] = { (char *)bin, "--listen-backlog", LISTEN_BACKLOG, "--queue-budget-ms", budget, NULL };
+    // CPU 不多的機器上 client 和 Server 搶同一顆 CPU：Server 降一點優先權，過載才會是 Server 的 queue 在排
+    pid_t pid = start_server(argv, SERVER_PORT, SERVER_NICE);
+    if (pid < 0) {
+        fprintf(stderr, "[Error] Could not start %s\n", bin);
+        return -1;
+    }
+    *out = run_clients(nclients, seconds, timeout_ns);
+    usleep(200000);   // 讓 Server 處理完 accept queue 裡剩下的 (被放棄的) 請求
+
+    char err[160];
+    const MetricsShm *m = metrics_attach(err, sizeof(err));
+    if (m) {
+        static MetricsShm snap;
+        WorkerMetrics sum;
+        metrics_snapshot(m, &snap);
+        metrics_sum_workers(&snap, &sum);
+        int op = metrics_op_index(OP_TRANSFER);
+        out->served = sum.requests[op] - sum.errors[-BANK_ERR_OVERLOADED];
+        metrics_detach(m);
+    }
+    stop_server(pid);
+    return 0;
+}
+
+static void print_result(const char *name, const RunResult *r, int seconds) {
+    long total = r->good + r->shed + r->timeouts + r->errors;
+    printf("%-22s: goodput %7.0f req/s (mean %5.1f ms), %6.1f%% timed out, %6.1f%% shed, %ld errors",
+           name, r->good / (double)seconds, r->good ? r->good_ms_sum / r->good : 0,
+           total ? 100.0 * r->timeouts / total : 0, total ? 100.0 * r->shed / total : 0, r->errors);
+    if (r->served) printf(", server did %.0f%% wasted work", 100.0 * (double)(r->served - (uint64_t)r->good) / r->served);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *bin = argc > 1 ? argv[1] : "./bin/server";
+    int nclients = argc > 2 ? atoi(argv[2]) : 2048;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    int timeout_ms = argc > 4 ? atoi(argv[4]) : 100;
+    if (nclients < 1 || nclients > MAX_CLIENTS || seconds < 1 || timeout_ms < 2) {
+        fprintf(stderr, "Usage: %s [server binary] [clients (max %d)] [seconds per run] [client timeout ms]\n",
+                argv[0], MAX_CLIENTS);
+        return 1;
+    }
+    int probe = connect_server(SERVER_PORT);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] Something already listens on %s:%d (stop the server first)\n", SERVER_IP,
+                SERVER_PORT);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    build_transfer();
+    uint64_t timeout_ns = (uint64_t)timeout_ms * 1000000ULL;
+    printf("=== [Benchmark] Overload Goodput (%d clients, timeout %d ms, backlog %s, %d s per run) ===\n",
+           nclients, timeout_ms, LISTEN_BACKLOG, seconds);
+    if (!check_idem_retry()) {
+        printf("Result: FAILED (shed transfer was remembered by its idempotency key)\n");
+        return 1;
+    }
+
+    RunResult plain, shed;
+    if (run(bin, 0, nclients, seconds, timeout_ns, &plain) != 0) return 1;
+    print_result("no queue budget", &plain, seconds);
+    char name[32];
+    snprintf(name, sizeof(name), "queue budget %d ms", timeout_ms / 4);
+    if (run(bin, timeout_ms / 4, nclients, seconds, timeout_ns, &shed) != 0) return 1;
+    print_result(name, &shed, seconds);
+
+    int ok = shed.good > plain.good && shed.shed > 0;
+    printf("Result: %s (goodput with a queue budget %.1fx of without)\n", ok ? "PASS" : "FAILED",
+           plain.good ? (double)shed.good / plain.good : 0.0);
+    return ok ? 0 : 1;
+}
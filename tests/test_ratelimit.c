@@ -0,0 +1,194 @@
+// 檔案: tests/test_ratelimit.c
+// Token-bucket rate limiter: exact refill on a fake clock, table exhaustion / idle reclaim, CAS accuracy across processes, cost per check
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "ratelimit.h"
+
+#define FLOOD_KEYS 200000            // 2. 一秒內出現的 client 位址數 (遠多於 RATELIMIT_CLIENT_SLOTS)
+#define PROCS 4                      // 3. 同一個 key 被幾個行程同時搶
+#define RACE_RATE 200000             //    每秒 token 數
+#define RACE_BURST 1000
+#define RACE_SECONDS 1
+#define BENCH_CHECKS 5000000         // 4. 每種情況量幾次
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 1. 假時鐘：桶子滿的時候一次給 burst 個，之後每 interval 補一個，閒置不會超過 burst
+static int check_refill(void) {
+    if (ratelimit_init(1000, 50, 10, 0) != 0) return 0;   // account: 1000/s burst 50；client: 10/s burst 10
+    uint64_t t = 1000000000ULL;
+    int bad = 0, n;
+
+    for (n = 0; ratelimit_take_at(RATELIMIT_ACCOUNT, 7, t) == RATELIMIT_OK && n < 1000; n++) {
+    }
+    bad += n != 50;                                         // 一開始滿的
+    t += 10000000ULL;                                       // 10 ms = 10 個 token
+    for (n = 0; ratelimit_take_at(RATELIMIT_ACCOUNT, 7, t) == RATELIMIT_OK && n < 1000; n++) {
+    }
+    bad += n != 10;
+    t += 999999ULL;                                         // 差 1 ns 才滿 1 ms
+    bad += ratelimit_take_at(RATELIMIT_ACCOUNT, 7, t) != RATELIMIT_LIMITED;
+    t += 1;
+    bad += ratelimit_take_at(RATELIMIT_ACCOUNT, 7, t) != RATELIMIT_OK;
+    t += 3600000000000ULL;                                  // 閒置一小時：還是只有 burst 個
+    for (n = 0; ratelimit_take_at(RATELIMIT_ACCOUNT, 7, t) == RATELIMIT_OK && n < 1000; n++) {
+    }
+    bad += n != 50;
+    bad += ratelimit_take_at(RATELIMIT_ACCOUNT, 8, t) != RATELIMIT_OK;    // 別的 key 有自己的桶子
+
+    // client 沒給 burst = 一秒份；兩種 key 互不影響
+    for (n = 0; ratelimit_take_at(RATELIMIT_CLIENT, 7, t) == RATELIMIT_OK && n < 1000; n++) {
+    }
+    bad += n != 10;
+
+    // 關掉的 kind 永遠放行
+    ratelimit_cleanup();
+    if (ratelimit_init(0, 0, 5, 1) != 0) return 0;
+    for (n = 0; n < 1000; n++) bad += ratelimit_take(RATELIMIT_ACCOUNT, 1) != RATELIMIT_OK;
+    bad += ratelimit_enabled(RATELIMIT_ACCOUNT) || !ratelimit_enabled(RATELIMIT_CLIENT);
+    ratelimit_cleanup();
+
+    printf("%-26s: burst, refill to the ns, idle cap, per-key / per-kind buckets, kind off | %s\n", "refill on a fake clock",
+           bad ? "FAILED" : "PASS");
+    return bad == 0;
+}
+
+// 2. 表滿了：同一瞬間湧進大量 client 位址，超出的放行不追蹤；桶子閒置之後要能換給新位址，
+//    而不是永遠 UNTRACKED。帳戶表涵蓋整個帳戶空間，最後一個帳戶也有桶子
+static int check_exhaustion(void) {
+    if (ratelimit_init(1, 1, 1000, 1) != 0) return 0;     // account: 1/s；client: 1000/s burst 1 (1 ms 就閒置)
+    const RateLimitShm *rl = ratelimit_region();
+    uint64_t t = 1000000000ULL;
+    int bad = 0;
+    long untracked = 0, limited = 0;
+
+    for (uint64_t k = 0; k < FLOOD_KEYS; k++) untracked += ratelimit_take_at(RATELIMIT_CLIENT, k, t) == RATELIMIT_UNTRACKED;
+    bad += untracked == 0;                                  // probe 範圍都被佔滿了
+    bad += rl->kinds[RATELIMIT_CLIENT].reclaimed != 0;      // 還沒有閒置的桶子
+    uint64_t used = rl->kinds[RATELIMIT_CLIENT].used;
+
+    // 一秒後：前一批都閒置了。另一批新位址每 us 來一個 (同時在用的桶子 ~1000 個)，
+    // 全部都要拿得到桶子，而且真的被限制
+    t += 1000000000ULL;
+    untracked = 0;
+    for (uint64_t k = FLOOD_KEYS; k < 2 * FLOOD_KEYS; k++, t += 1000) {
+        untracked += ratelimit_take_at(RATELIMIT_CLIENT, k, t) == RATELIMIT_UNTRACKED;
+        limited += ratelimit_take_at(RATELIMIT_CLIENT, k, t) == RATELIMIT_LIMITED;
+    }
+    uint64_t reclaimed = rl->kinds[RATELIMIT_CLIENT].reclaimed;
+    bad += untracked != 0 || limited != FLOOD_KEYS;
+    bad += reclaimed == 0 || rl->kinds[RATELIMIT_CLIENT].used != RATELIMIT_CLIENT_SLOTS;
+
+    // 帳戶：id 直接當 index，最後一個可能的帳戶也被限制；範圍外的才放行不追蹤
+    bad += ratelimit_take_at(RATELIMIT_ACCOUNT, BANK_CAPACITY - 1, t) != RATELIMIT_OK;
+    bad += ratelimit_take_at(RATELIMIT_ACCOUNT, BANK_CAPACITY - 1, t) != RATELIMIT_LIMITED;
+    bad += ratelimit_take_at(RATELIMIT_ACCOUNT, BANK_CAPACITY, t) != RATELIMIT_UNTRACKED;
+    ratelimit_cleanup();
+
+    printf("%-26s: %d new clients at once: %lu buckets, rest untracked; then %d more, 1 per us: %lu reclaimed, 0 untracked;"
+           " account %d limited | %s\n", "table exhaustion", FLOOD_KEYS, (unsigned long)used, FLOOD_KEYS,
+           (unsigned long)reclaimed, BANK_CAPACITY - 1, bad ? "FAILED" : "PASS");
+    return bad == 0;
+}
+
+// 3. PROCS 個行程搶同一個 key RACE_SECONDS 秒：放行的總數不能超過 burst + rate * 時間
+static int check_race(void) {
+    if (ratelimit_init(RACE_RATE, RACE_BURST, 0, 0) != 0) return 0;
+    long *allowed = mmap(NULL, sizeof(long) * PROCS, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (allowed == MAP_FAILED) return 0;
+    uint64_t t0 = now_ns(), end = t0 + RACE_SECONDS * 1000000000ULL;
+    fflush(stdout);
+    for (int p = 0; p < PROCS; p++) {
+        if (fork() == 0) {
+            long ok = 0;
+            uint64_t t;
+            while ((t = now_ns()) < end) ok += ratelimit_take_at(RATELIMIT_ACCOUNT, 42, t) == RATELIMIT_OK;
+            allowed[p] = ok;
+            exit(0);
+        }
+    }
+    for (int p = 0; p < PROCS; p++) wait(NULL);
+    long total = 0;
+    for (int p = 0; p < PROCS; p++) total += allowed[p];
+    double expect = RACE_BURST + (double)RACE_RATE * (end - t0) / 1e9;
+    // 上限是硬條件 (CAS 搶輸不能多放行)；少放行只代表行程在結束前沒被排到 (單核心 / 機器很忙)，
+    // 所以下限只要求 burst 有發出去，差多少照印出來
+    int ok = total <= (long)expect + 1 && total >= RACE_BURST;
+    printf("%-26s: %d processes, 1 key, %d/s burst %d for %d s: %ld allowed, expected %.0f (%+.3f%%) | %s\n",
+           "CAS under contention", PROCS, RACE_RATE, RACE_BURST, RACE_SECONDS, total, expect,
+           100.0 * (total - expect) / expect, ok ? "PASS" : "FAILED");
+    munmap(allowed, sizeof(long) * PROCS);
+    ratelimit_cleanup();
+    return ok;
+}
+
+// 4. 每次檢查的成本 (ratelimit_take，含讀時鐘)
+static double bench(int kind, uint64_t nkeys, long *limited, long *untracked) {
+    *limited = *untracked = 0;
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < BENCH_CHECKS; i++) {
+        uint64_t key = nkeys == 1 ? 1 : ((uint64_t)i * 2654435761u) % nkeys;
+        int r = ratelimit_take(kind, key);
+        *limited += r == RATELIMIT_LIMITED;
+        *untracked += r == RATELIMIT_UNTRACKED;
+    }
+    return (double)(now_ns() - t0) / BENCH_CHECKS;
+}
+
+static int check_cost(void) {
+    long lim, unt;
+    if (ratelimit_init(0, 0, 0, 0) != 0) return 0;
+    double off = bench(RATELIMIT_ACCOUNT, 1, &lim, &unt);
+    ratelimit_cleanup();
+    printf("%-26s: %6.1f ns per check\n", "limiter off", off);
+
+    // 帳戶是直接 index；超過 client 表大小的位址數要靠換手閒置的桶子
+    static const struct { const char *name; int kind; uint64_t keys; } cases[] = {
+        { "1 key (hot account)", RATELIMIT_ACCOUNT, 1 },
+        { "1000 accounts", RATELIMIT_ACCOUNT, 1000 },
+        { "50000 accounts", RATELIMIT_ACCOUNT, 50000 },
+        { "1M clients (reclaim)", RATELIMIT_CLIENT, 1000000 },
+    };
+    int ok = off > 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        if (ratelimit_init(1000000, 1000, 1000000, 1000) != 0) return 0;
+        int kind = cases[c].kind;
+        double ns = bench(kind, cases[c].keys, &lim, &unt);
+        const RateLimitShm *rl = ratelimit_region();
+        printf("%-26s: %6.1f ns per check (+%.1f), %lu buckets (%lu reclaimed), %.1f%% limited, %.1f%% untracked\n",
+               cases[c].name, ns, ns - off, (unsigned long)rl->kinds[kind].used,
+               (unsigned long)rl->kinds[kind].reclaimed, 100.0 * lim / BENCH_CHECKS, 100.0 * unt / BENCH_CHECKS);
+        ok &= ns > 0;
+        ratelimit_cleanup();
+    }
+    return ok;
+}
+
+int main() {
+    printf("=== [Benchmark] Rate Limiter (token buckets in SHM) ===\n");
+
+    int probe = shm_open(RATELIMIT_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", RATELIMIT_SHM_NAME);
+        return 1;
+    }
+
+    int ok = check_refill();
+    ok &= check_exhaustion();
+    ok &= check_race();
+    ok &= check_cost();
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -46,8 +46,8 @@ int main(int argc, char *argv[]) {
             printf("[Survivor] Mutex recovered. I now hold the lock.\n");
             
             // 檢查是否真的能運作
-            acc->balance += 100; 
-            printf("[Survivor] Modified balance to %d. Unlocking...\n", acc->balance);
+            bank->balances[0] += 100; 
+            printf("[Survivor] Modified balance to %d. Unlocking...\n", bank->balances[0]);
             pthread_mutex_unlock(&acc->lock);
         } else if (r == 0) {
             printf("[Survivor] Got lock normally (Victim didn't crash?).\n");
@@ -0,0 +1,117 @@
+// 檔案: tests/test_scan.c
+// Benchmark: bank-wide aggregate scan (SoA + SIMD) vs naive loop over Account[]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bank.h"
+
+#define DEFAULT_ACCOUNTS 10000000
+#define ROUNDS 5
+
+// 舊版 Account 佈局 (balance 夾在 mutex 旁邊，一個帳戶佔一條 64-byte cache line)
+typedef struct {
+    uint32_t id;
+    int32_t  balance;
+    pthread_mutex_t lock;
+    uint64_t last_updated;
+    char padding[8];
+} LegacyAccount;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Naive loop：跟以前一樣直接走 bank->accounts[i].balance
+static void naive_scan(const LegacyAccount *acc, size_t n, const BankScanParams *p, BankAggregate *out) {
+    memset(out, 0, sizeof(*out));
+    out->count = n;
+    out->min = INT32_MAX;
+    out->max = INT32_MIN;
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = acc[i].balance;
+        out->total += v;
+        if (v < out->min) out->min = v;
+        if (v > out->max) out->max = v;
+        if (v < p->threshold) out->below++;
+        int64_t k = ((int64_t)v - p->hist_base) / p->hist_width;
+        if ((int64_t)v < p->hist_base) k = 0;
+        if (k >= BANK_HIST_BUCKETS) k = BANK_HIST_BUCKETS - 1;
+        out->histogram[k]++;
+    }
+}
+
+static int same_result(const BankAggregate *a, const BankAggregate *b) {
+    return a->count == b->count && a->total == b->total && a->min == b->min &&
+           a->max == b->max && a->below == b->below &&
+           memcmp(a->histogram, b->histogram, sizeof(a->histogram)) == 0;
+}
+
+static double bench_kernel(const int32_t *bal, size_t n, const BankScanParams *p, BankAggregate *out) {
+    double best = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        double t0 = now_sec();
+        bank_scan_balances(bal, n, p, out);
+        double dt = now_sec() - t0;
+        if (dt < best) best = dt;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_ACCOUNTS;
+    BankScanParams p = { 1000, 0, 2000 };
+
+    printf("=== [Benchmark] Aggregate Scan (%zu accounts) ===\n", n);
+
+    LegacyAccount *legacy = calloc(n, sizeof(LegacyAccount));
+    int32_t *balances = aligned_alloc(64, ((n * sizeof(int32_t)) + 63) / 64 * 64);
+    if (!legacy || !balances) {
+        fprintf(stderr, "[Error] Out of memory\n");
+        return 1;
+    }
+
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = rand() % 40000 - 2000; // 包含負值與超出直方圖範圍的值
+        legacy[i].id = (uint32_t)i;
+        legacy[i].balance = v;
+        balances[i] = v;
+    }
+
+    BankAggregate ref, out;
+    double best = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        double t0 = now_sec();
+        naive_scan(legacy, n, &p, &ref);
+        double dt = now_sec() - t0;
+        if (dt < best) best = dt;
+    }
+    double naive_time = best;
+    printf("%-22s: %8.2f ms  (%7.2f GB/s touched)\n", "naive Account[] loop",
+           naive_time * 1e3, n * sizeof(LegacyAccount) / naive_time / 1e9);
+
+    int failures = 0;
+    const int isas[] = { BANK_SCAN_SCALAR, BANK_SCAN_SSE41, BANK_SCAN_AVX2 };
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+        if (bank_scan_force_isa(isas[k]) != 0) {
+            printf("%-22s: (not supported on this CPU)\n", "");
+            continue;
+        }
+        double t = bench_kernel(balances, n, &p, &out);
+        int ok = same_result(&ref, &out);
+        if (!ok) failures++;
+        printf("SoA %-18s: %8.2f ms  (%5.1fx vs naive) %s\n", bank_scan_isa_name(),
+               t * 1e3, naive_time / t, ok ? "OK" : "MISMATCH");
+    }
+
+    printf("\nTotal=%lld Min=%d Max=%d Below(%d)=%llu\n", (long long)ref.total,
+           ref.min, ref.max, p.threshold, (unsigned long long)ref.below);
+
+    free(legacy);
+    free(balances);
+    return failures ? 1 : 0;
+}
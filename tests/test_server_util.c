@@ -0,0 +1,87 @@
+// 檔案: tests/test_server_util.c
+// Shared fixture for the tests that drive a real ./bin/server over TCP
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "protocol.h"
+#include "test_server_util.h"
+
+double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int connect_server(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, SERVER_IP, &addr.sin_addr);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+size_t build_packet(uint8_t *buf, uint8_t op, const void *body, uint32_t len) {
+    PacketHeader h;
+    uint16_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum ^= ((const uint8_t *)body)[i];
+    h.magic = PROTOCOL_MAGIC;
+    h.op_code = op;
+    h.checksum = htons(sum);
+    h.body_len = htonl(len);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), body, len);
+    return sizeof(h) + len;
+}
+
+pid_t start_server(char *const argv[], int ready_port, int nice_inc) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (nice_inc && nice(nice_inc) < 0) perror("[Test] nice");
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            close(null);
+        }
+        setpgid(0, 0);   // Server 關閉時 kill(0, SIGTERM) 只打到它自己的行程群組
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (pid < 0) return -1;
+    for (int i = 0; i < 100; i++) {
+        usleep(50000);
+        int fd = connect_server(ready_port);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid) return -1;
+    }
+    stop_server(pid);
+    return -1;
+}
+
+void stop_server(pid_t pid) {
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+}
@@ -0,0 +1,32 @@
+// 檔案: tests/test_server_util.h
+// Shared fixture for the tests that drive a real ./bin/server over TCP
+#ifndef TEST_SERVER_UTIL_H
+#define TEST_SERVER_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SERVER_IP "127.0.0.1"
+
+double now_sec(void);                                   // CLOCK_MONOTONIC, seconds
+int cmp_double(const void *a, const void *b);           // qsort() comparator for latency samples
+
+// 連到 SERVER_IP:port，失敗回傳 -1
+int connect_server(int port);
+
+// 一個完整的請求封包 (header + XOR checksum + body) 寫進 buf，回傳長度
+size_t build_packet(uint8_t *buf, uint8_t op, const void *body, uint32_t len);
+
+/**
+ * fork + exec 一個 Server (輸出丟掉)，等到 ready_port 可以連線
+ * @param argv      NULL 結尾，argv[0] = Server 執行檔
+ * @param nice_inc  子行程先 nice() 多少 (0 = 不變)
+ * @return Server pid，啟動失敗 / 5 秒內沒開 port 回傳 -1
+ */
+pid_t start_server(char *const argv[], int ready_port, int nice_inc);
+
+// SIGINT (正常關閉) 並等它結束
+void stop_server(pid_t pid);
+
+#endif
@@ -0,0 +1,101 @@
+// 檔案: tests/test_settle.c
+// Netting settlement vs one-by-one bank_transfer on a clearing workload
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "bank.h"
+
+#define TRANSFERS 100000
+#define PAIRS 10                 // 清算：少數幾對帳戶之間大量來回
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void reset_balances(BankMap *bank) {
+    for (int i = 0; i < MAX_ACCOUNTS; i++) bank->balances[i] = 10000;
+}
+
+int main() {
+    printf("=== [Benchmark] Netting Settlement ===\n");
+
+    // 不要動到正在跑的 Server
+    int probe = shm_open(SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s already exists (server running?)\n", SHM_NAME);
+        return 1;
+    }
+    if (bank_init() != 0) return 1;
+    BankMap *bank = get_bank_map();
+
+    SettleItem *items = malloc(sizeof(SettleItem) * TRANSFERS);
+    int *seq_results = malloc(sizeof(int) * TRANSFERS);
+    int *net_results = malloc(sizeof(int) * TRANSFERS);
+    srand(7);
+    for (int i = 0; i < TRANSFERS; i++) {
+        int pair = rand() % PAIRS;
+        int a = pair * 2, b = pair * 2 + 1;
+        int fwd = rand() % 2;
+        items[i].src_id = fwd ? a : b;
+        items[i].dst_id = fwd ? b : a;
+        items[i].amount = (rand() % 5000) + 1;
+        if (i % 997 == 0) items[i].amount = 50000; // 偶爾餘額不足
+    }
+
+    /* ---------- 1. Sequential bank_transfer ---------- */
+    reset_balances(bank);
+    double t0 = now_sec();
+    for (int i = 0; i < TRANSFERS; i++) {
+        seq_results[i] = bank_transfer(items[i].src_id, items[i].dst_id, items[i].amount);
+    }
+    double seq_time = now_sec() - t0;
+    int32_t seq_final[MAX_ACCOUNTS];
+    memcpy(seq_final, bank->balances, sizeof(seq_final));
+    long seq_locks = 2L * TRANSFERS;
+
+    /* ---------- 2. Netting settlement ---------- */
+    reset_balances(bank);
+    long net_locks = 0;
+    t0 = now_sec();
+    for (int i = 0; i < TRANSFERS; i += SETTLE_MAX_BATCH) {
+        int n = (TRANSFERS - i < SETTLE_MAX_BATCH) ? TRANSFERS - i : SETTLE_MAX_BATCH;
+        bank_settle(&items[i], n, &net_results[i]);
+
+        // 這批碰到幾個不同帳戶 = 這批拿了幾次鎖
+        char seen[MAX_ACCOUNTS] = {0};
+        for (int j = i; j < i + n; j++) {
+            if (!seen[items[j].src_id]++) net_locks++;
+            if (!seen[items[j].dst_id]++) net_locks++;
+        }
+    }
+    double net_time = now_sec() - t0;
+
+    int failures = 0;
+    if (memcmp(seq_final, bank->balances, sizeof(seq_final)) != 0) {
+        printf("✗ Final balances differ\n");
+        failures++;
+    }
+    if (memcmp(seq_results, net_results, sizeof(int) * TRANSFERS) != 0) {
+        printf("✗ Per-transfer results differ\n");
+        failures++;
+    }
+
+    printf("%-20s: %8.2f ms | lock acquisitions: %8ld\n", "bank_transfer x N", seq_time * 1e3, seq_locks);
+    printf("%-20s: %8.2f ms | lock acquisitions: %8ld (%.0fx fewer)\n", "bank_settle batches",
+           net_time * 1e3, net_locks, (double)seq_locks / net_locks);
+    printf("%s\n", failures ? "FAILED" : "PASS (identical results and balances)");
+
+    free(items);
+    free(seq_results);
+    free(net_results);
+    bank_destroy();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+// 檔案: tests/test_slowclient.c
+// Slow-client harness: stalled connections alongside normal traffic against a running server (./bin/server)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "metrics.h"
+#include "protocol.h"
+#include "test_server_util.h"
+
+#define SERVER_PORT 8080
+#define LOAD_THREADS 8
+#define MAX_SAMPLES (1 << 20)
+
+/*
+ * 三個階段各跑 N 秒，normal traffic (BALANCE，每次一條新連線) 一直在跑：
+ *   1. 只有正常流量 (基準)
+ *   2. 加上 S 條卡住的連線：只連線不送、送半個標頭、送完標頭只送半個 body；
+ *      被 Server 關掉就馬上重連 —— 以前每一條都會卡住 4 個 Worker 之一直到 client 自己斷線
+ *   3. 加上送完請求就 RST 的 client (回應寫到已經斷掉的連線：以前的 SIGPIPE 會殺掉 Worker)
+ * 最後從 metrics page 讀 timeout 計數，並確認 Worker 都還活著
+ */
+
+static volatile int g_stop = 0;
+static volatile int g_phase = 0;
+
+typedef struct {
+    pthread_mutex_t lock;
+    long done, failed;
+    long closes[3];                  // 卡住的連線被 Server 關掉的次數 (依種類)
+    double hold_sum[3];              // 被關之前撐了多久 (s)
+    long hangups;
+    double *lat_ms;
+    long nlat;
+} Stats;
+
+static Stats g_stats = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void *load_thread(void *arg) {
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    uint8_t pkt[64];
+    while (!g_stop) {
+        int account = htonl((int)(rand_r(&seed) % 100));
+        size_t n = build_packet(pkt, OP_BALANCE, &account, sizeof(account));
+        double t0 = now_sec();
+        int fd = connect_server(SERVER_PORT);
+        int ok = 0;
+        if (fd >= 0) {
+            PacketHeader h;
+            void *body = NULL;
+            if (write(fd, pkt, n) == (ssize_t)n && protocol_read_packet(fd, &h, &body) == 0) ok = 1;
+            free(body);
+            close(fd);
+        }
+        double ms = (now_sec() - t0) * 1e3;
+        pthread_mutex_lock(&g_stats.lock);
+        if (ok) {
+            g_stats.done++;
+            if (g_stats.nlat < MAX_SAMPLES) g_stats.lat_ms[g_stats.nlat++] = ms;
+        } else {
+            g_stats.failed++;
+        }
+        pthread_mutex_unlock(&g_stats.lock);
+        if (!ok) usleep(10000);
+    }
+    return NULL;
+}
+
+// kind 0: 只連線；1: 半個標頭；2: 標頭 + 半個 body。然後等 Server 關掉 (read 回 0 / 錯誤)
+static void *staller_thread(void *arg) {
+    int kind = (int)(uintptr_t)arg % 3;
+    uint8_t pkt[64];
+    TransferBody tf = { htonl(1), htonl(2), htonl(1) };
+    size_t n = build_packet(pkt, OP_TRANSFER, &tf, sizeof(tf));
+    size_t partial = kind == 0 ? 0 : kind == 1 ? sizeof(PacketHeader) / 2 : n - sizeof(tf) / 2;
+    struct timeval tv = { 0, 200000 };   // 每 200 ms 醒來看一下要不要結束
+    while (!g_stop) {
+        int fd = connect_server(SERVER_PORT);
+        if (fd < 0) {
+            usleep(10000);
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        double t0 = now_sec();
+        if (partial && write(fd, pkt, partial) != (ssize_t)partial) {
+            close(fd);
+            continue;
+        }
+        char c;
+        ssize_t r;
+        while (!g_stop && (r = read(fd, &c, 1)) < 0 && (errno == EAGAIN || errno == EINTR)) {
+        }
+        if (!g_stop) {
+            pthread_mutex_lock(&g_stats.lock);
+            g_stats.closes[kind]++;
+            g_stats.hold_sum[kind] += now_sec() - t0;
+            pthread_mutex_unlock(&g_stats.lock);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+// 送出完整請求後立刻 RST：Server 寫回應時會遇到 EPIPE / ECONNRESET
+static void *hangup_thread(void *arg) {
+    (void)arg;
+    uint8_t pkt[64];
+    int account = htonl(7);
+    size_t n = build_packet(pkt, OP_BALANCE, &account, sizeof(account));
+    struct linger lg = { 1, 0 };
+    while (!g_stop) {
+        int fd = connect_server(SERVER_PORT);
+        if (fd < 0) {
+            usleep(10000);
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        if (write(fd, pkt, n) == (ssize_t)n) {
+            pthread_mutex_lock(&g_stats.lock);
+            g_stats.hangups++;
+            pthread_mutex_unlock(&g_stats.lock);
+        }
+        close(fd);
+        usleep(2000);
+    }
+    return NULL;
+}
+
+typedef struct {
+    double rps, p50, p99;
+    long failed;
+} PhaseResult;
+
+static PhaseResult run_phase(int stallers, int hangups, int seconds) {
+    pthread_t load[LOAD_THREADS], st[256], hu[16];
+    pthread_mutex_lock(&g_stats.lock);
+    g_stats.done = g_stats.failed = g_stats.nlat = 0;
+    pthread_mutex_unlock(&g_stats.lock);
+    g_stop = 0;
+    for (int i = 0; i < stallers; i++) pthread_create(&st[i], NULL, staller_thread, (void *)(uintptr_t)i);
+    for (int i = 0; i < hangups; i++) pthread_create(&hu[i], NULL, hangup_thread, NULL);
+    usleep(100000); // 卡住的連線先就位
+    double t0 = now_sec();
+    for (int i = 0; i < LOAD_THREADS; i++)
+        pthread_create(&load[i], NULL, load_thread, (void *)(uintptr_t)(i * 7919 + 1));
+    sleep((unsigned)seconds);
+    g_stop = 1;
+    for (int i = 0; i < LOAD_THREADS; i++) pthread_join(load[i], NULL);
+    double secs = now_sec() - t0;
+    for (int i = 0; i < stallers; i++) pthread_join(st[i], NULL);
+    for (int i = 0; i < hangups; i++) pthread_join(hu[i], NULL);
+
+    PhaseResult r;
+    qsort(g_stats.lat_ms, (size_t)g_stats.nlat, sizeof(double), cmp_double);
+    r.rps = g_stats.done / secs;
+    r.p50 = g_stats.nlat ? g_stats.lat_ms[g_stats.nlat / 2] : 0;
+    r.p99 = g_stats.nlat ? g_stats.lat_ms[(long)(g_stats.nlat * 0.99)] : 0;
+    r.failed = g_stats.failed;
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    int stallers = argc > 1 ? atoi(argv[1]) : 32;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    if (stallers < 0 || stallers > 256 || seconds < 1) {
+        fprintf(stderr, "Usage: %s [stalled connections (max 256)] [seconds per phase]\n", argv[0]);
+        return 1;
+    }
+    printf("=== [Benchmark] Slow Clients (%d load threads, %d stalled connections, %d s per phase) ===\n",
+           LOAD_THREADS, stallers, seconds);
+    signal(SIGPIPE, SIG_IGN);
+
+    int probe = connect_server(SERVER_PORT);
+    if (probe < 0) {
+        fprintf(stderr, "[Error] No server on %s:%d (start ./bin/server first)\n", SERVER_IP, SERVER_PORT);
+        return 1;
+    }
+    close(probe);
+    g_stats.lat_ms = malloc(sizeof(double) * MAX_SAMPLES);
+    if (!g_stats.lat_ms) return 1;
+
+    PhaseResult base = run_phase(0, 0, seconds);
+    printf("%-28s: %8.0f req/s, p50 %6.2f ms, p99 %7.2f ms, %ld failed\n", "normal traffic only", base.rps, base.p50,
+           base.p99, base.failed);
+    PhaseResult slow = run_phase(stallers, 0, seconds);
+    printf("%-28s: %8.0f req/s, p50 %6.2f ms, p99 %7.2f ms, %ld failed (%.0f%% of baseline)\n",
+           "+ stalled connections", slow.rps, slow.p50, slow.p99, slow.failed, base.rps ? 100 * slow.rps / base.rps : 0);
+    static const char *kinds[3] = { "connect only", "half header", "header + half body" };
+    for (int k = 0; k < 3; k++) {
+        if (!g_stats.closes[k]) continue;
+        printf("%-28s  %-18s closed by server %4ld times, after %.2f s on average\n", "", kinds[k],
+               g_stats.closes[k], g_stats.hold_sum[k] / g_stats.closes[k]);
+    }
+    PhaseResult hang = run_phase(stallers, 4, seconds);
+    printf("%-28s: %8.0f req/s, p50 %6.2f ms, p99 %7.2f ms, %ld failed, %ld requests hung up on\n",
+           "+ stalled + RST clients", hang.rps, hang.p50, hang.p99, hang.failed, g_stats.hangups);
+
+    // Server 端的計數 (有 metrics page 時)：timeout 依階段、Worker 都還活著
+    int ok = slow.rps >= 0.5 * base.rps && hang.rps >= 0.5 * base.rps && slow.failed == 0 && hang.failed == 0;
+    char err[160];
+    const MetricsShm *m = metrics_attach(err, sizeof(err));
+    if (m) {
+        static MetricsShm snap;
+        WorkerMetrics sum;
+        metrics_snapshot(m, &snap);
+        metrics_sum_workers(&snap, &sum);
+        int alive = 0;
+        for (int w = 0; w < (int)snap.nworkers; w++) alive += snap.workers[w].pid && kill((pid_t)snap.workers[w].pid, 0) == 0;
+        printf("%-28s: header %lu, body %lu, write %lu timeouts, %lu dropped (table full), %d/%u workers alive\n",
+               "server counters", (unsigned long)sum.header_timeouts, (unsigned long)sum.body_timeouts,
+               (unsigned long)sum.write_timeouts, (unsigned long)sum.parked_full, alive, snap.nworkers);
+        ok &= alive == (int)snap.nworkers;
+        metrics_detach(m);
+    } else {
+        printf("%-28s: %s\n", "server counters", err);
+    }
+    free(g_stats.lat_ms);
+    printf("Result: %s (throughput with stalled clients >= 50%% of baseline, no failed requests)\n",
+           ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}
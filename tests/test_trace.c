@@ -0,0 +1,178 @@
+// 檔案: tests/test_trace.c
+// Request tracing: ring consistency under a concurrent reader, slow-request capture, Chrome JSON, per-request cost
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "metrics.h"
+#include "protocol.h"
+#include "trace.h"
+
+#define RING_REQUESTS 2000000        // 1. Writer 一直寫，讀者不停地快照
+#define SLOW_REQUESTS 100000         // 2. 只留慢請求
+#define SLOW_NS 50000
+#define BENCH_REQUESTS 2000000       // 3. 每個請求的成本：tracing 關 / 1 in 100 / 每個都留
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 模擬一個 Worker 請求：parse、lock 等待、log (真的計時)、response；ret 帶請求編號讓讀者檢查
+static void fake_request(int i, uint64_t total_ns) {
+    metrics_req_begin();
+    metrics_stage_set(METRICS_STAGE_PARSE, 1000);
+    metrics_lock_wait(300);
+    uint64_t t0 = metrics_stage_clock();
+    metrics_stage_since(METRICS_STAGE_LOG, t0);
+    metrics_stage_set(METRICS_STAGE_RESPONSE, 2000);
+    metrics_stage_set(METRICS_STAGE_TOTAL, total_ns);
+    metrics_req_end(OP_TRANSFER, i & 0x3FFF);
+}
+
+// 一組 = parse, lock, log, response, request；同一組 req / ret 一樣，組與組的 req 連續
+static int check_groups(const TraceSpan *s, int n, long *groups) {
+    static const int expect[5] = { METRICS_STAGE_PARSE, METRICS_STAGE_LOCK, METRICS_STAGE_LOG,
+                                   METRICS_STAGE_RESPONSE, TRACE_SPAN_REQUEST };
+    int bad = 0, first = 0;
+    while (first < n && s[first].stage != TRACE_SPAN_REQUEST) first++;   // 最舊的一組可能不完整
+    uint32_t prev = 0;
+    for (int i = first + 1; i + 5 <= n; i += 5) {
+        uint32_t req = s[i].req;
+        for (int k = 0; k < 5; k++) {
+            if (s[i + k].stage != expect[k] || s[i + k].req != req || s[i + k].ret != s[i].ret) bad++;
+        }
+        if (prev && req != prev + 1) bad++;
+        prev = req;
+        (*groups)++;
+    }
+    return bad;
+}
+
+static int check_ring(void) {
+    if (trace_init(1, 1, 0) != 0) return 0;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        metrics_bind_worker(0);
+        trace_bind_worker(0);
+        for (int i = 0; i < RING_REQUESTS; i++) fake_request(i, 10000);
+        exit(0);
+    }
+    const TraceShm *t = trace_region();
+    TraceSpan *spans = malloc(sizeof(TraceSpan) * TRACE_RING_SPANS);
+    long snapshots = 0, groups = 0, torn = 0;
+    int status;
+    while (waitpid(pid, &status, WNOHANG) == 0) {
+        int n = trace_snapshot_ring(t, 0, spans);
+        torn += check_groups(spans, n, &groups);
+        snapshots++;
+    }
+    int n = trace_snapshot_ring(t, 0, spans);
+    torn += check_groups(spans, n, &groups);
+    uint64_t traced = t->rings[0].traced;
+    int ok = torn == 0 && traced == RING_REQUESTS && snapshots > 0;
+    printf("%-26s: %d requests, %ld snapshots while writing, %ld groups checked, %ld torn / out of order | %s\n",
+           "ring consistency", RING_REQUESTS, snapshots, groups, torn, ok ? "PASS" : "FAILED");
+    free(spans);
+    trace_cleanup();
+    return ok;
+}
+
+// 2. sample 0：只有總時間 >= 門檻的請求留下來；JSON 也只有它們
+static int check_slow(void) {
+    if (trace_init(1, 0, SLOW_NS) != 0) return 0;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        metrics_bind_worker(0);
+        trace_bind_worker(0);
+        for (int i = 0; i < SLOW_REQUESTS; i++) fake_request(i, (i % 97 == 0) ? SLOW_NS + (uint64_t)i : SLOW_NS - 1);
+        exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    const TraceShm *t = trace_region();
+    int expect = (SLOW_REQUESTS + 96) / 97;
+    uint64_t traced = t->rings[0].traced;
+
+    char *json = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&json, &len);
+    int written = trace_write_chrome(t, out, 0);
+    fclose(out);
+    // 結構：括號平衡、事件數 = 請求 * 5 + metadata
+    long events = 0, depth = 0, min_depth = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (json[i] == '{' || json[i] == '[') depth++;
+        if (json[i] == '}' || json[i] == ']') depth--;
+        if (depth < min_depth) min_depth = depth;
+        if (strncmp(json + i, "\"ph\":\"X\"", 8) == 0) events++;
+    }
+    int kept = TRACE_RING_SPANS / 5 < expect ? TRACE_RING_SPANS / 5 : expect;   // ring 只留最新的
+    int json_ok = written >= kept - 1 && written <= kept && events == written * 5L && depth == 0 && min_depth == 0 &&
+                  strncmp(json, "{\"displayTimeUnit\"", 17) == 0 && strstr(json, "\"slow\":1") &&
+                  !strstr(json, "\"slow\":0");
+    int ok = traced == (uint64_t)expect && json_ok;
+    printf("%-26s: %d requests, %d over %d us, %lu traced, JSON %zu bytes, %d requests / %ld X events %s | %s\n",
+           "slow-request capture", SLOW_REQUESTS, expect, SLOW_NS / 1000, (unsigned long)traced, len, written, events,
+           json_ok ? "valid" : "INVALID", ok ? "PASS" : "FAILED");
+    free(json);
+    trace_cleanup();
+    return ok;
+}
+
+// 3. 同一個假請求的成本 (每次都在新的行程裡)
+static double request_cost(uint32_t sample_every) {
+    int pfd[2];
+    double ns = -1;
+    if (pipe(pfd) != 0) return -1;
+    if (sample_every && trace_init(1, sample_every, 0) != 0) return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        metrics_bind_worker(0);
+        trace_bind_worker(0);
+        double t0 = now_sec();
+        for (int i = 0; i < BENCH_REQUESTS; i++) fake_request(i, 10000);
+        double r = (now_sec() - t0) * 1e9 / BENCH_REQUESTS;
+        exit(write(pfd[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+    }
+    if (read(pfd[0], &ns, sizeof(ns)) != sizeof(ns)) ns = -1;
+    waitpid(pid, NULL, 0);
+    close(pfd[0]);
+    close(pfd[1]);
+    if (sample_every) trace_cleanup();
+    return ns;
+}
+
+int main() {
+    printf("=== [Benchmark] Request Tracing ===\n");
+
+    int probe = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (probe < 0) probe = shm_open(TRACE_SHM_NAME, O_RDONLY, 0);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "[Error] %s / %s already exist (server running?)\n", METRICS_SHM_NAME, TRACE_SHM_NAME);
+        return 1;
+    }
+    if (metrics_init(1, 0) != 0) return 1;
+
+    int ok = check_ring();
+    ok &= check_slow();
+
+    double off = request_cost(0), sampled = request_cost(100), all = request_cost(1);
+    printf("%-26s: off %.1f ns, 1 in 100 %.1f ns (+%.1f), every request %.1f ns (+%.1f)\n", "per-request cost", off,
+           sampled, sampled - off, all, all - off);
+    ok &= off > 0 && sampled > 0 && all > 0;
+
+    metrics_cleanup();
+    printf("Result: %s\n", ok ? "PASS" : "FAILED");
+    return ok ? 0 : 1;
+}